@@ -6,23 +6,117 @@
 #include <vector>
 #include <memory>
 #include <cstddef>
+#include <cstdint>
 
 namespace Delve::Script::Ast {
 
 struct Node
 {
-	Node(const Token* t) : token(t) {}
+	enum class Kind
+	{
+		// Expressions
+		Identifier,
+		IntegerLiteral,
+		BooleanLiteral,
+		PrefixExpression,
+		InfixExpression,
+		CallExpression,
+		FunctionLiteral,
+
+		// Statements
+		LetStatement,
+		ReturnStatement,
+		ExpressionStatement,
+		BlockStatement,
+		IfStatement
+	};
+
+	static constexpr size_t kindCount = static_cast<size_t>(Kind::IfStatement) + 1;
+
+	Node(Kind k, const Token* t) : kind(k), token(t) {}
 	virtual ~Node() {}
 	virtual std::string toString() const = 0;
 
+	const Kind kind;
 	const Token* token;
 };
 
 typedef Node Expression;
 
+/*
+* The storage location an identifier refers to.  Filled in by the Resolver.
+*/
+struct Binding
+{
+	enum class Kind
+	{
+		Unresolved,
+
+		// index is into the program's globals
+		Global,
+
+		// index is a slot in the frame of the function which uses the identifier
+		Local,
+
+		// index is into the values captured by the closure of the function which uses the identifier
+		Capture
+	};
+
+	Kind kind = Kind::Unresolved;
+	uint32_t index = 0;
+
+	// set for variables which are captured and then declared again, these are shared between frames and closures
+	// through a heap allocated box rather than copied.
+	bool boxed = false;
+};
+
+/*
+* Sets of the kinds of value an expression may produce, as found by TypeInference.
+*/
+namespace TypeSet {
+	constexpr uint8_t Null = 1 << 0;
+	constexpr uint8_t Integer = 1 << 1;
+	constexpr uint8_t Boolean = 1 << 2;
+	constexpr uint8_t Function = 1 << 3;
+	constexpr uint8_t HostFunction = 1 << 4;
+	constexpr uint8_t Any = Null | Integer | Boolean | Function | HostFunction;
+}
+
+// The type both operands of an operator are proven to have, filled in by TypeInference.
+enum class OperandType : uint8_t
+{
+	// checked when the operator runs
+	Unknown,
+	Integer,
+	Boolean
+};
+
+/*
+* Describes where a closure gets one of its captured values from when it is created.  Filled in by the Resolver.
+*/
+struct Capture
+{
+	enum class Source
+	{
+		// index is a slot in the frame of the enclosing function
+		Local,
+
+		// index is into the values captured by the enclosing function's closure
+		Capture,
+
+		// the closure itself, for functions which refer to the name they are being bound to
+		Self
+	};
+
+	Source source;
+	uint32_t index;
+};
+
 struct Identifier : public Expression
 {
-	Identifier(const Token* t) : Expression(t) {}
+	Identifier(const Token* t) : Expression(Kind::Identifier, t) {}
+
+	Binding binding;
 
 	virtual std::string toString() const override
 	{
@@ -32,7 +126,7 @@ struct Identifier : public Expression
 
 struct IntegerLiteral : public Expression
 {
-	IntegerLiteral(const Token* t) : Expression(t) {}
+	IntegerLiteral(const Token* t) : Expression(Kind::IntegerLiteral, t) {}
 	
 	int64_t value;
 
@@ -44,7 +138,7 @@ struct IntegerLiteral : public Expression
 
 struct BooleanLiteral : public Expression
 {
-	BooleanLiteral(const Token* t) : Expression(t) {}
+	BooleanLiteral(const Token* t) : Expression(Kind::BooleanLiteral, t) {}
 
 	virtual std::string toString() const override
 	{
@@ -54,7 +148,7 @@ struct BooleanLiteral : public Expression
 
 struct PrefixExpression : public Expression
 {
-	PrefixExpression(const Token* t) : Expression(t) {}
+	PrefixExpression(const Token* t) : Expression(Kind::PrefixExpression, t) {}
 
 	std::unique_ptr<Expression> rightExpression;
 
@@ -66,11 +160,13 @@ struct PrefixExpression : public Expression
 
 struct InfixExpression : public Expression
 {
-	InfixExpression(const Token* t) : Expression(t) {}
+	InfixExpression(const Token* t) : Expression(Kind::InfixExpression, t) {}
 
 	std::unique_ptr<Expression> left;
 	std::unique_ptr<Expression> right;
 
+	OperandType operandType = OperandType::Unknown;
+
 	virtual std::string toString() const override
 	{
 		return '(' + left->toString() + ' ' + token->literal + ' ' + right->toString() + ')';
@@ -81,7 +177,7 @@ typedef Node Statement;
 
 struct LetStatement : public Statement
 {
-	LetStatement(const Token* t) : Statement(t) {}
+	LetStatement(const Token* t) : Statement(Kind::LetStatement, t) {}
 
 	std::unique_ptr<Identifier> identifier;
 	std::unique_ptr<Expression> expression;
@@ -94,7 +190,7 @@ struct LetStatement : public Statement
 
 struct ReturnStatement : public Statement
 {
-	ReturnStatement(const Token* t) : Statement(t) {}
+	ReturnStatement(const Token* t) : Statement(Kind::ReturnStatement, t) {}
 
 	std::unique_ptr<Expression> expression;
 
@@ -106,7 +202,7 @@ struct ReturnStatement : public Statement
 
 struct ExpressionStatement : public Statement
 {
-	ExpressionStatement(const Token* t) : Statement(t) {}
+	ExpressionStatement(const Token* t) : Statement(Kind::ExpressionStatement, t) {}
 
 	std::unique_ptr<Expression> expression;
 
@@ -118,7 +214,7 @@ struct ExpressionStatement : public Statement
 
 struct CallExpression : public Expression
 {
-	CallExpression(const Token* t) : Statement(t) {}
+	CallExpression(const Token* t) : Expression(Kind::CallExpression, t) {}
 	
 	std::unique_ptr<Expression> function;
 	std::vector<std::unique_ptr<Expression>> arguments;
@@ -158,7 +254,7 @@ inline std::string statementVectorToString(const std::vector<std::unique_ptr<Sta
 
 struct BlockStatement : public Statement
 {
-	BlockStatement(const Token* t) : Statement(t) {}
+	BlockStatement(const Token* t) : Statement(Kind::BlockStatement, t) {}
 	std::vector<std::unique_ptr<Statement>> statements;
 
 	virtual std::string toString() const override
@@ -170,10 +266,22 @@ struct BlockStatement : public Statement
 
 struct FunctionLiteral : public Expression
 {
-	FunctionLiteral(const Token* t) : Expression(t) {}
+	FunctionLiteral(const Token* t) : Expression(Kind::FunctionLiteral, t) {}
 	std::vector<std::unique_ptr<Identifier>> parameters;
 	std::unique_ptr<BlockStatement> body;
 
+	// frame layout and captured values of this function, filled in by the Resolver
+	uint32_t slotCount = 0;
+	std::vector<uint32_t> boxedSlots;
+	std::vector<Capture> captures;
+
+	// the TypeSet each parameter is proven to hold when called from the script, filled in by TypeInference.  Calls
+	// from the host are checked against these, since operators may rely on them.  Empty if types were not inferred.
+	std::vector<uint8_t> parameterTypes;
+
+	// set by PurityAnalysis for functions whose result depends only on their arguments, so calls may be memoized
+	bool pure = false;
+
 	virtual std::string toString() const override
 	{
 		std::string str = "function(";
@@ -194,7 +302,7 @@ struct FunctionLiteral : public Expression
 
 struct IfStatement : public Statement
 {
-	IfStatement(const Token* t) : Expression(t) {}
+	IfStatement(const Token* t) : Statement(Kind::IfStatement, t) {}
 	std::unique_ptr<Expression> condition;
 	std::unique_ptr<BlockStatement> consequence;
 	std::unique_ptr<BlockStatement> alternative;
@@ -217,6 +325,14 @@ struct Program
 {
 	std::vector<std::unique_ptr<Statement>> statements;
 
+	// Tokens for nodes created by passes which transform the program rather than by the parser.
+	Token::Vector tokens;
+
+	// number of globals and frame layout of the top level code, filled in by the Resolver
+	uint32_t globalCount = 0;
+	uint32_t slotCount = 0;
+	std::vector<uint32_t> boxedSlots;
+
 	std::string toString() const
 	{
 		return Internal::statementVectorToString(statements);
@@ -0,0 +1,552 @@
+#include "batch.h"
+#include "lexer.h"
+#include "parser.h"
+
+#include <algorithm>
+
+namespace Delve::Script {
+	namespace {
+		// The operators on integers, with booleans as 0 and 1.  Each matches the function in Operators used by the engines.
+		struct Add
+		{
+			static int64_t apply(int64_t left, int64_t right) { return static_cast<int64_t>(static_cast<uint64_t>(left) + static_cast<uint64_t>(right)); }
+		};
+
+		struct Subtract
+		{
+			static int64_t apply(int64_t left, int64_t right) { return static_cast<int64_t>(static_cast<uint64_t>(left) - static_cast<uint64_t>(right)); }
+		};
+
+		struct Multiply
+		{
+			static int64_t apply(int64_t left, int64_t right) { return static_cast<int64_t>(static_cast<uint64_t>(left) * static_cast<uint64_t>(right)); }
+		};
+
+		// the divisor has already been checked for zero
+		struct Divide
+		{
+			static int64_t apply(int64_t left, int64_t right) { return right == -1 ? static_cast<int64_t>(0 - static_cast<uint64_t>(left)) : left / right; }
+		};
+
+		struct LessThan
+		{
+			static int64_t apply(int64_t left, int64_t right) { return left < right; }
+		};
+
+		struct GreaterThan
+		{
+			static int64_t apply(int64_t left, int64_t right) { return left > right; }
+		};
+
+		struct Equal
+		{
+			static int64_t apply(int64_t left, int64_t right) { return left == right; }
+		};
+
+		struct NotEqual
+		{
+			static int64_t apply(int64_t left, int64_t right) { return left != right; }
+		};
+
+		/*
+		* The kernels.  Each is a single loop over arrays which the compiler can assume do not overlap, so that it can
+		* process several rows per instruction.
+		*/
+		template <typename Operation>
+		void applyColumns(const int64_t* __restrict left, const int64_t* __restrict right, int64_t* __restrict result, size_t count)
+		{
+			for (size_t i = 0; i < count; i++) {
+				result[i] = Operation::apply(left[i], right[i]);
+			}
+		}
+
+		template <typename Operation>
+		void applyConstantRight(const int64_t* __restrict left, int64_t right, int64_t* __restrict result, size_t count)
+		{
+			for (size_t i = 0; i < count; i++) {
+				result[i] = Operation::apply(left[i], right);
+			}
+		}
+
+		template <typename Operation>
+		void applyConstantLeft(int64_t left, const int64_t* __restrict right, int64_t* __restrict result, size_t count)
+		{
+			for (size_t i = 0; i < count; i++) {
+				result[i] = Operation::apply(left, right[i]);
+			}
+		}
+
+		// A null input is a constant, which is only the case for both inputs when folding would have raised an error.
+		template <typename Operation>
+		void applyBinary(const int64_t* left, int64_t leftConstant, const int64_t* right, int64_t rightConstant, int64_t* result, size_t count)
+		{
+			if (left && right) {
+				applyColumns<Operation>(left, right, result, count);
+			}
+			else if (left) {
+				applyConstantRight<Operation>(left, rightConstant, result, count);
+			}
+			else if (right) {
+				applyConstantLeft<Operation>(leftConstant, right, result, count);
+			}
+			else {
+				std::fill(result, result + count, Operation::apply(leftConstant, rightConstant));
+			}
+		}
+
+		// read as bytes, which the compiler can widen several at a time where it would test each bool
+		void loadBooleans(const unsigned char* __restrict values, int64_t* __restrict result, size_t count)
+		{
+			for (size_t i = 0; i < count; i++) {
+				result[i] = values[i];
+			}
+		}
+
+		void minus(const int64_t* __restrict values, int64_t* __restrict result, size_t count)
+		{
+			for (size_t i = 0; i < count; i++) {
+				result[i] = static_cast<int64_t>(0 - static_cast<uint64_t>(values[i]));
+			}
+		}
+
+		void negateBooleans(const int64_t* __restrict values, int64_t* __restrict result, size_t count)
+		{
+			for (size_t i = 0; i < count; i++) {
+				result[i] = values[i] ^ 1;
+			}
+		}
+
+		bool containsZero(const int64_t* __restrict values, size_t count)
+		{
+			int64_t zeros = 0;
+
+			for (size_t i = 0; i < count; i++) {
+				zeros += values[i] == 0;
+			}
+
+			return zeros != 0;
+		}
+
+		Value applyOperator(Token::Type op, const Value& left, const Value& right)
+		{
+			switch (op) {
+			case Token::Type::Plus:
+				return Operators::add(left, right);
+			case Token::Type::Minus:
+				return Operators::subtract(left, right);
+			case Token::Type::Multiply:
+				return Operators::multiply(left, right);
+			case Token::Type::Divide:
+				return Operators::divide(left, right);
+			case Token::Type::LessThan:
+				return Operators::lessThan(left, right);
+			case Token::Type::GreaterThan:
+				return Operators::greaterThan(left, right);
+			case Token::Type::Equal:
+				return Operators::equal(left, right);
+			default:
+				return Operators::notEqual(left, right);
+			}
+		}
+
+		// A value of the given type which no operator can fail on, for finding the type of an operator's result.
+		Value sampleValue(Value::Type type)
+		{
+			return type == Value::Type::Boolean ? Value::fromBoolean(true) : Value::fromInteger(1);
+		}
+
+		Value constantValue(Value::Type type, int64_t constant)
+		{
+			return type == Value::Type::Boolean ? Value::fromBoolean(constant != 0) : Value::fromInteger(constant);
+		}
+	}
+
+	BatchEvaluator::BatchEvaluator() : BatchEvaluator(Settings())
+	{
+	}
+
+	BatchEvaluator::BatchEvaluator(const Settings& batchSettings) : settings(batchSettings), resultType(Value::Type::Null), rows(0), compiled(false)
+	{
+		settings.chunkSize = std::max<size_t>(64, (settings.chunkSize + 63) / 64 * 64);
+	}
+
+	/**
+	* Binds a name to a column of integers.  The column is read in place each time the expression is evaluated, so it
+	* must outlive the evaluator or be bound again before the next compile.
+	* @param name the name the expression uses for the column
+	* @param values the first value of the column
+	* @param count the number of rows
+	*/
+	void BatchEvaluator::bindIntegers(const std::string& name, const int64_t* values, size_t count)
+	{
+		columns[name] = { Value::Type::Integer, values, nullptr, count };
+		compiled = false;
+	}
+
+	void BatchEvaluator::bindBooleans(const std::string& name, const bool* values, size_t count)
+	{
+		columns[name] = { Value::Type::Boolean, nullptr, values, count };
+		compiled = false;
+	}
+
+	/**
+	* Compiles source holding a single expression, without the semicolon which would end it as a statement.
+	* @returns true if the expression can be evaluated, otherwise the reasons are reported through getErrors()
+	*/
+	bool BatchEvaluator::compile(const std::string& source)
+	{
+		Lexer lexer(source + ';');
+		Parser parser(lexer.tokens());
+		const auto& statements = parser.getProgram()->statements;
+
+		if (!parser.getErrors().empty()) {
+			errors = parser.getErrors();
+			compiled = false;
+			return false;
+		}
+
+		if (statements.size() != 1 || !statements[0] || statements[0]->kind != Ast::Node::Kind::ExpressionStatement) {
+			errors = { "Expected a single expression." };
+			compiled = false;
+			return false;
+		}
+
+		return compile(static_cast<const Ast::ExpressionStatement*>(statements[0].get())->expression.get());
+	}
+
+	/**
+	* Compiles an expression to kernels over the columns bound so far.  Operators on constants are applied here, and
+	* every column the expression reads must have the same number of rows.
+	* @param expression the expression, which is not kept after this call
+	* @returns true if the expression can be evaluated, otherwise the reasons are reported through getErrors()
+	*/
+	bool BatchEvaluator::compile(const Ast::Expression* expression)
+	{
+		errors.clear();
+		steps.clear();
+		columnsRead.clear();
+		statistics = Statistics();
+		resultType = Value::Type::Null;
+		compiled = false;
+
+		if (!expression || !compileExpression(expression, output)) {
+			steps.clear();
+			return false;
+		}
+
+		rows = countRows();
+
+		if (!errors.empty()) {
+			steps.clear();
+			return false;
+		}
+
+		resultType = output.type;
+		registers.assign(steps.size() * settings.chunkSize, 0);
+		scratch.assign(settings.chunkSize, 0);
+		statistics.kernels = static_cast<uint32_t>(steps.size());
+
+		compiled = true;
+		return true;
+	}
+
+	bool BatchEvaluator::compileExpression(const Ast::Expression* expression, Operand& operand)
+	{
+		switch (expression->kind) {
+		case Ast::Node::Kind::IntegerLiteral:
+			operand.source = Operand::Source::Constant;
+			operand.type = Value::Type::Integer;
+			operand.constant = static_cast<const Ast::IntegerLiteral*>(expression)->value;
+			return true;
+
+		case Ast::Node::Kind::BooleanLiteral:
+			operand.source = Operand::Source::Constant;
+			operand.type = Value::Type::Boolean;
+			operand.constant = expression->token->type == Token::Type::True;
+			return true;
+
+		case Ast::Node::Kind::Identifier: {
+			auto column = columns.find(expression->token->literal);
+
+			if (column == columns.end()) {
+				errors.push_back("No column is bound to " + expression->token->literal + '.');
+				return false;
+			}
+
+			columnsRead.insert(column->first);
+
+			if (column->second.type == Value::Type::Boolean) {
+				operand = addStep(Kernel::LoadBooleans, Value::Type::Boolean, Operand(), Operand(), column->second.booleans);
+				return true;
+			}
+
+			operand.source = Operand::Source::Column;
+			operand.type = Value::Type::Integer;
+			operand.column = column->second.integers;
+			return true;
+		}
+
+		case Ast::Node::Kind::PrefixExpression: {
+			Operand right;
+
+			if (!compileExpression(static_cast<const Ast::PrefixExpression*>(expression)->rightExpression.get(), right)) {
+				return false;
+			}
+
+			bool negate = expression->token->type == Token::Type::Negate;
+
+			// integers are always truthy, so negating one is always false
+			if (negate && right.type == Value::Type::Integer) {
+				operand = Operand();
+				operand.type = Value::Type::Boolean;
+				return true;
+			}
+
+			if (!negate && right.type != Value::Type::Integer) {
+				try {
+					Operators::typeMismatch(Token::Type::Minus, sampleValue(right.type));
+				}
+				catch (const RuntimeError& error) {
+					errors.push_back(error.what());
+					return false;
+				}
+			}
+
+			if (right.source == Operand::Source::Constant) {
+				operand = right;
+				operand.constant = negate ? right.constant ^ 1 : Operators::minus(Value::fromInteger(right.constant)).integer;
+				return true;
+			}
+
+			operand = addStep(negate ? Kernel::Not : Kernel::Minus, right.type, right, Operand());
+			return true;
+		}
+
+		case Ast::Node::Kind::InfixExpression: {
+			auto* infixExpression = static_cast<const Ast::InfixExpression*>(expression);
+			Operand left, right;
+
+			if (!compileExpression(infixExpression->left.get(), left) || !compileExpression(infixExpression->right.get(), right)) {
+				return false;
+			}
+
+			Token::Type op = expression->token->type;
+			Value::Type type;
+
+			try {
+				type = applyOperator(op, sampleValue(left.type), sampleValue(right.type)).type;
+			}
+			catch (const RuntimeError& error) {
+				errors.push_back(error.what());
+				return false;
+			}
+
+			if (left.source == Operand::Source::Constant && right.source == Operand::Source::Constant) {
+				try {
+					operand = Operand();
+					operand.type = type;
+					Value value = applyOperator(op, constantValue(left.type, left.constant), constantValue(right.type, right.constant));
+					operand.constant = type == Value::Type::Boolean ? value.boolean : value.integer;
+					return true;
+				}
+				catch (const RuntimeError&) {
+					// division by zero is only an error if there are rows to divide
+				}
+			}
+
+			static const std::unordered_map<Token::Type, Kernel> kernels = {
+				{ Token::Type::Plus, Kernel::Add },
+				{ Token::Type::Minus, Kernel::Subtract },
+				{ Token::Type::Multiply, Kernel::Multiply },
+				{ Token::Type::Divide, Kernel::Divide },
+				{ Token::Type::LessThan, Kernel::LessThan },
+				{ Token::Type::GreaterThan, Kernel::GreaterThan },
+				{ Token::Type::Equal, Kernel::Equal },
+				{ Token::Type::NotEqual, Kernel::NotEqual }
+			};
+
+			operand = addStep(kernels.at(op), type, left, right);
+			return true;
+		}
+
+		default:
+			errors.push_back("Expression " + expression->toString() + " cannot be evaluated in batches.");
+			return false;
+		}
+	}
+
+	BatchEvaluator::Operand BatchEvaluator::addStep(Kernel kernel, Value::Type type, const Operand& left, const Operand& right, const bool* booleans)
+	{
+		Step step = { kernel, left, right, booleans, static_cast<uint32_t>(steps.size()) };
+		steps.push_back(step);
+
+		Operand result;
+		result.source = Operand::Source::Register;
+		result.type = type;
+		result.reg = step.result;
+		return result;
+	}
+
+	/*
+	* Finds the number of rows from the columns the expression reads, or every bound column if it reads none.
+	* @returns the number of rows, with an error reported if the columns differ
+	*/
+	size_t BatchEvaluator::countRows()
+	{
+		std::vector<std::pair<std::string, size_t>> counts;
+
+		for (const auto& column : columns) {
+			if (columnsRead.empty() || columnsRead.count(column.first)) {
+				counts.emplace_back(column.first, column.second.count);
+			}
+		}
+
+		std::sort(counts.begin(), counts.end());
+
+		for (const auto& count : counts) {
+			if (count.second != counts[0].second) {
+				errors.push_back("Columns " + counts[0].first + " and " + count.first + " have different numbers of rows.");
+				return 0;
+			}
+		}
+
+		return counts.empty() ? 0 : counts[0].second;
+	}
+
+	/**
+	* Evaluates the expression for every row.
+	* @param result receives one value per row, with booleans as 0 or 1
+	* @returns true if every row was evaluated, otherwise the error is reported through getErrors()
+	*/
+	bool BatchEvaluator::evaluate(std::vector<int64_t>& result)
+	{
+		result.resize(compiled ? rows : 0);
+
+		return run([&](const int64_t* values, size_t first, size_t count) {
+			std::copy(values, values + count, result.begin() + first);
+		});
+	}
+
+	/**
+	* Evaluates the expression for every row and records which rows it is true for, with the same rules for truth as
+	* if statements.
+	* @param bitmap receives one bit per row, with row i at bit i % 64 of word i / 64
+	* @returns true if every row was evaluated, otherwise the error is reported through getErrors()
+	*/
+	bool BatchEvaluator::select(std::vector<uint64_t>& bitmap)
+	{
+		bitmap.assign(compiled ? (rows + 63) / 64 : 0, 0);
+		bool integers = resultType == Value::Type::Integer;
+
+		return run([&](const int64_t* values, size_t first, size_t count) {
+			for (size_t i = 0; i < count; i += 64) {
+				size_t bits = std::min<size_t>(64, count - i);
+				uint64_t word = 0;
+
+				if (integers) {
+					word = bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+				}
+				else {
+					// booleans are already 0 or 1
+					for (size_t j = 0; j < bits; j++) {
+						word |= static_cast<uint64_t>(values[i + j]) << j;
+					}
+				}
+
+				bitmap[(first + i) / 64] = word;
+			}
+		});
+	}
+
+	// Runs every kernel over each chunk of rows in turn, passing the values of the expression for the chunk on.
+	bool BatchEvaluator::run(const std::function<void(const int64_t* values, size_t first, size_t count)>& consume)
+	{
+		errors.clear();
+
+		if (!compiled) {
+			errors.push_back("No expression has been compiled.");
+			return false;
+		}
+
+		try {
+			for (size_t first = 0; first < rows; first += settings.chunkSize) {
+				size_t count = std::min(settings.chunkSize, rows - first);
+
+				for (const auto& step : steps) {
+					runStep(step, first, count);
+				}
+
+				consume(read(output, first, scratch.data(), count), first, count);
+				statistics.chunks += 1;
+			}
+		}
+		catch (const RuntimeError& error) {
+			errors.push_back(error.what());
+			return false;
+		}
+
+		statistics.rows += rows;
+		return true;
+	}
+
+	void BatchEvaluator::runStep(const Step& step, size_t first, size_t count)
+	{
+		int64_t* result = &registers[step.result * settings.chunkSize];
+		const int64_t* left = step.left.source == Operand::Source::Constant ? nullptr : read(step.left, first, nullptr, count);
+		const int64_t* right = step.right.source == Operand::Source::Constant ? nullptr : read(step.right, first, nullptr, count);
+
+		switch (step.kernel) {
+		case Kernel::LoadBooleans:
+			loadBooleans(reinterpret_cast<const unsigned char*>(step.booleans + first), result, count);
+			break;
+		case Kernel::Minus:
+			minus(left, result, count);
+			break;
+		case Kernel::Not:
+			negateBooleans(left, result, count);
+			break;
+		case Kernel::Add:
+			applyBinary<Add>(left, step.left.constant, right, step.right.constant, result, count);
+			break;
+		case Kernel::Subtract:
+			applyBinary<Subtract>(left, step.left.constant, right, step.right.constant, result, count);
+			break;
+		case Kernel::Multiply:
+			applyBinary<Multiply>(left, step.left.constant, right, step.right.constant, result, count);
+			break;
+		case Kernel::Divide:
+			if (right ? containsZero(right, count) : step.right.constant == 0) {
+				Operators::divisionByZero();
+			}
+
+			applyBinary<Divide>(left, step.left.constant, right, step.right.constant, result, count);
+			break;
+		case Kernel::LessThan:
+			applyBinary<LessThan>(left, step.left.constant, right, step.right.constant, result, count);
+			break;
+		case Kernel::GreaterThan:
+			applyBinary<GreaterThan>(left, step.left.constant, right, step.right.constant, result, count);
+			break;
+		case Kernel::Equal:
+			applyBinary<Equal>(left, step.left.constant, right, step.right.constant, result, count);
+			break;
+		case Kernel::NotEqual:
+			applyBinary<NotEqual>(left, step.left.constant, right, step.right.constant, result, count);
+			break;
+		}
+	}
+
+	// Finds the values of an operand for a chunk of rows, spreading a constant across the scratch space if given one.
+	const int64_t* BatchEvaluator::read(const Operand& operand, size_t first, int64_t* space, size_t count)
+	{
+		switch (operand.source) {
+		case Operand::Source::Column:
+			return operand.column + first;
+		case Operand::Source::Register:
+			return &registers[operand.reg * settings.chunkSize];
+		default:
+			std::fill(space, space + count, operand.constant);
+			return space;
+		}
+	}
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "ast.h"
+#include "value.h"
+
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* Evaluates one expression over many rows at once, for rules which are run against every row of a table.  Each name in
+* the expression is bound to a column of integers or booleans, and the expression is compiled to a list of kernels, one
+* per operator, which each run over a chunk of rows at a time.  The kernels are simple loops over arrays without
+* branches, which the compiler turns into SIMD instructions.
+*
+*     BatchEvaluator evaluator;
+*     evaluator.bindIntegers("score", scores.data(), scores.size());
+*     evaluator.bindIntegers("limit", limits.data(), limits.size());
+*     evaluator.compile("score * 3 > limit == true");
+*     evaluator.select(selected);
+*
+* Only operators, integer and boolean literals and names are supported.  The types of the columns are known when the
+* expression is compiled, so type mismatches are reported then, with the same errors as running the expression a row
+* at a time.  Division by zero in any row is reported when the expression is evaluated.
+*/
+class BatchEvaluator
+{
+public:
+	using ErrorList = std::vector<std::string>;
+
+	struct Settings
+	{
+		// rows processed by each kernel at a time, rounded up to a multiple of 64
+		size_t chunkSize = 1024;
+	};
+
+	struct Statistics
+	{
+		uint32_t kernels = 0;
+		uint64_t rows = 0;
+		uint64_t chunks = 0;
+	};
+
+public:
+	BatchEvaluator();
+	BatchEvaluator(const Settings& settings);
+
+public:
+	void bindIntegers(const std::string& name, const int64_t* values, size_t count);
+	void bindBooleans(const std::string& name, const bool* values, size_t count);
+
+	bool compile(const std::string& source);
+	bool compile(const Ast::Expression* expression);
+
+	bool evaluate(std::vector<int64_t>& result);
+	bool select(std::vector<uint64_t>& bitmap);
+
+	// the type of the value the expression produces for each row, integer or boolean once compiled
+	inline Value::Type getResultType() const { return resultType; }
+
+	inline const Statistics& getStatistics() const { return statistics; }
+	inline const ErrorList& getErrors() const { return errors; }
+
+private:
+	enum class Kernel : uint8_t
+	{
+		LoadBooleans,
+		Minus,
+		Not,
+		Add,
+		Subtract,
+		Multiply,
+		Divide,
+		LessThan,
+		GreaterThan,
+		Equal,
+		NotEqual
+	};
+
+	// where a kernel reads one of its inputs from, booleans are held as integers which are 0 or 1
+	struct Operand
+	{
+		enum class Source : uint8_t
+		{
+			Constant,
+			Column,
+			Register
+		};
+
+		Source source = Source::Constant;
+		Value::Type type = Value::Type::Integer;
+		int64_t constant = 0;
+		const int64_t* column = nullptr;
+		uint32_t reg = 0;
+	};
+
+	struct Step
+	{
+		Kernel kernel;
+		Operand left;
+		Operand right;
+		const bool* booleans = nullptr;
+		uint32_t result = 0;
+	};
+
+	struct Column
+	{
+		Value::Type type;
+		const int64_t* integers;
+		const bool* booleans;
+		size_t count;
+	};
+
+private:
+	bool compileExpression(const Ast::Expression* expression, Operand& operand);
+	Operand addStep(Kernel kernel, Value::Type type, const Operand& left, const Operand& right, const bool* booleans = nullptr);
+
+	size_t countRows();
+	bool run(const std::function<void(const int64_t* values, size_t first, size_t count)>& consume);
+	void runStep(const Step& step, size_t first, size_t count);
+	const int64_t* read(const Operand& operand, size_t first, int64_t* space, size_t count);
+
+private:
+	Settings settings;
+	std::unordered_map<std::string, Column> columns;
+
+	std::vector<Step> steps;
+	Operand output;
+	Value::Type resultType;
+	std::set<std::string> columnsRead;
+	size_t rows;
+	bool compiled;
+
+	// one chunk of values per step, and one for constants which have to be spread across a chunk
+	std::vector<int64_t> registers;
+	std::vector<int64_t> scratch;
+
+	Statistics statistics;
+	ErrorList errors;
+};
+
+}
@@ -0,0 +1,175 @@
+#include "batch.h"
+#include "script.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace Delve::Script;
+
+namespace {
+	const std::vector<int64_t> scores = { 0, 1, -1, 7, 12, 40, -300, 9223372036854775807, -9223372036854775807 - 1, 5, 33, 2 };
+	const std::vector<int64_t> limits = { 1, 3, -3, 20, 36, 119, -1, -1, -1, 15, 100, 7 };
+	const bool flags[] = { true, false, true, true, false, false, true, false, true, true, false, true };
+}
+
+// helper function that evaluates an expression one row at a time with let statements binding each column
+std::vector<std::string> evaluateRows(const std::string& expression);
+
+/*
+* Tests that evaluating in batches gives the same value for every row as running the expression as a script, including
+* where integers overflow and wrap.
+*/
+TEST(BatchEvaluator, MatchesScripts)
+{
+	std::vector<std::string> inputs = {
+		"score * 3 > limit == true",
+		"score + limit * 2 - 7",
+		"-score / limit",
+		"score / -1",
+		"!flag == (score < limit)",
+		"flag != !flag",
+		"(1 + 2) * score - -limit",
+		"!score",
+		"5 < 3",
+		"score",
+		"flag"
+	};
+
+	for (const auto& input : inputs) {
+		BatchEvaluator evaluator;
+		evaluator.bindIntegers("score", scores.data(), scores.size());
+		evaluator.bindIntegers("limit", limits.data(), limits.size());
+		evaluator.bindBooleans("flag", flags, scores.size());
+
+		ASSERT_TRUE(evaluator.compile(input)) << input;
+
+		std::vector<int64_t> result;
+		ASSERT_TRUE(evaluator.evaluate(result)) << input;
+
+		std::vector<std::string> values;
+
+		for (int64_t value : result) {
+			values.push_back(evaluator.getResultType() == Value::Type::Boolean ? (value ? "true" : "false") : std::to_string(value));
+		}
+
+		EXPECT_EQ(values, evaluateRows(input)) << input;
+	}
+}
+
+/*
+* Tests selection bitmaps over more rows than fit in a chunk, and a number of rows which is not a multiple of the
+* bitmap's words.
+*/
+TEST(BatchEvaluator, Select)
+{
+	BatchEvaluator::Settings settings;
+	settings.chunkSize = 100;
+
+	std::vector<int64_t> values(1000);
+
+	for (size_t i = 0; i < values.size(); i++) {
+		values[i] = static_cast<int64_t>(i);
+	}
+
+	BatchEvaluator evaluator(settings);
+	evaluator.bindIntegers("n", values.data(), values.size());
+	ASSERT_TRUE(evaluator.compile("n / 3 * 3 == n"));
+
+	std::vector<uint64_t> bitmap;
+	ASSERT_TRUE(evaluator.select(bitmap));
+	ASSERT_EQ(bitmap.size(), 16);
+
+	for (size_t i = 0; i < values.size(); i++) {
+		EXPECT_EQ((bitmap[i / 64] >> (i % 64)) & 1, i % 3 == 0 ? 1 : 0) << i;
+	}
+
+	EXPECT_EQ(bitmap.back() >> (values.size() % 64), 0);
+
+	// chunks are whole words of the bitmap
+	const auto& statistics = evaluator.getStatistics();
+	EXPECT_EQ(statistics.chunks, 8);
+	EXPECT_EQ(statistics.rows, 1000);
+	EXPECT_EQ(statistics.kernels, 3);
+
+	// every integer is true, as in an if statement
+	ASSERT_TRUE(evaluator.compile("n - n"));
+	ASSERT_TRUE(evaluator.select(bitmap));
+	EXPECT_EQ(bitmap[0], ~uint64_t(0));
+	EXPECT_EQ(bitmap.back(), (uint64_t(1) << (values.size() % 64)) - 1);
+}
+
+TEST(BatchEvaluator, Errors)
+{
+	const bool moreFlags[] = { true, false };
+	const std::vector<int64_t> divisors = { 3, 2, 1, 0, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+	BatchEvaluator evaluator;
+	evaluator.bindIntegers("score", scores.data(), scores.size());
+	evaluator.bindIntegers("divisor", divisors.data(), divisors.size());
+	evaluator.bindBooleans("flag", flags, scores.size());
+	evaluator.bindBooleans("short", moreFlags, 2);
+
+	std::vector<std::pair<std::string, std::string>> inputs = {
+		{ "score + flag", "Type mismatch: int + bool." },
+		{ "-flag", "Type mismatch: -bool." },
+		{ "score == (flag == true)", "Type mismatch: int == bool." },
+		{ "score * unknown", "No column is bound to unknown." },
+		{ "f(score)", "Expression f(score) cannot be evaluated in batches." },
+		{ "let x = 1", "Expected a single expression." },
+		{ "!short == (score > 0)", "Columns score and short have different numbers of rows." }
+	};
+
+	for (const auto& input : inputs) {
+		EXPECT_FALSE(evaluator.compile(input.first)) << input.first;
+		EXPECT_EQ(evaluator.getErrors(), std::vector<std::string>({ input.second })) << input.first;
+	}
+
+	std::vector<int64_t> result;
+	EXPECT_FALSE(evaluator.evaluate(result));
+	EXPECT_EQ(evaluator.getErrors(), std::vector<std::string>({ "No expression has been compiled." }));
+
+	// the type mismatch matches running the expression as a script
+	Script script("let score = 1; let flag = true; score + flag;");
+	script.run();
+	EXPECT_EQ(script.getErrors(), std::vector<std::string>({ "Type mismatch: int + bool." }));
+
+	// division by zero is only known once the rows are seen, and a constant divisor of zero only fails when there are rows
+	ASSERT_TRUE(evaluator.compile("score / divisor"));
+	EXPECT_FALSE(evaluator.evaluate(result));
+	EXPECT_EQ(evaluator.getErrors(), std::vector<std::string>({ "Division by zero." }));
+
+	ASSERT_TRUE(evaluator.compile("score / (divisor + 1)"));
+	EXPECT_TRUE(evaluator.evaluate(result));
+	EXPECT_EQ(evaluator.getErrors(), std::vector<std::string>());
+
+	ASSERT_TRUE(evaluator.compile("1 / 0 + score"));
+	EXPECT_FALSE(evaluator.evaluate(result));
+
+	BatchEvaluator empty;
+	empty.bindIntegers("score", scores.data(), 0);
+	ASSERT_TRUE(empty.compile("1 / 0 + score"));
+	EXPECT_TRUE(empty.evaluate(result));
+	EXPECT_TRUE(result.empty());
+}
+
+std::vector<std::string> evaluateRows(const std::string& expression)
+{
+	// the lexer has no negative literals, and the most negative integer has no positive counterpart
+	auto integer = [](int64_t value) {
+		return value < 0 ? "(0 - " + std::to_string(-(value + 1)) + " - 1)" : std::to_string(value);
+	};
+
+	std::vector<std::string> values;
+
+	for (size_t i = 0; i < scores.size(); i++) {
+		std::string source = "let score = " + integer(scores[i]) + "; let limit = " + integer(limits[i]) + "; let flag = " + (flags[i] ? "true" : "false") + "; " + expression + ";";
+
+		Script script(source);
+		values.push_back(script.run().toString());
+		EXPECT_EQ(script.getErrors(), std::vector<std::string>()) << source;
+	}
+
+	return values;
+}
@@ -0,0 +1,86 @@
+#include "budget.h"
+#include "value.h"
+
+#include <algorithm>
+
+namespace Delve::Script {
+
+/**
+* Starts metering a new run.
+* @param limits the fuel and time the run may use
+*/
+void Budget::start(const ExecutionLimits& limits)
+{
+	ticksUsed = 0;
+	batch = 0;
+	ticks = 0;
+
+	// one extra tick so that the run is stopped when it tries to exceed its fuel rather than when it reaches it
+	meterFuel = limits.fuel != 0;
+	fuel = meterFuel ? limits.fuel + 1 : 0;
+
+	meterSlice = false;
+	slice = 0;
+
+	hasDeadline = limits.timeout.count() != 0;
+	deadline = hasDeadline ? std::chrono::steady_clock::now() + limits.timeout : std::chrono::steady_clock::time_point();
+
+	check();
+}
+
+/**
+* Limits the number of ticks before tick next reports that the run should yield.
+* @param sliceTicks ticks in the slice, or zero to never yield
+*/
+void Budget::startSlice(uint64_t sliceTicks)
+{
+	// return the unused part of the current batch before starting over
+	fuel += meterFuel ? ticks : 0;
+	ticksUsed += batch - ticks;
+	batch = 0;
+	ticks = 0;
+
+	meterSlice = sliceTicks != 0;
+	slice = sliceTicks;
+
+	check();
+}
+
+/*
+* Called when a batch of ticks has been used up.  Throws a RuntimeError if the run is out of fuel or past its deadline.
+* @returns true if the slice is used up, otherwise starts the next batch and returns false
+*/
+bool Budget::check()
+{
+	ticksUsed += batch;
+	batch = 0;
+
+	if (meterFuel && fuel == 0) {
+		throw RuntimeError("Fuel exhausted.");
+	}
+
+	if (hasDeadline && std::chrono::steady_clock::now() >= deadline) {
+		throw RuntimeError("Deadline exceeded.");
+	}
+
+	if (meterSlice && slice == 0) {
+		return true;
+	}
+
+	refill();
+	return false;
+}
+
+void Budget::refill()
+{
+	uint64_t size = ticksPerCheck;
+	size = meterFuel ? std::min(size, fuel) : size;
+	size = meterSlice ? std::min(size, slice) : size;
+
+	batch = static_cast<uint32_t>(size);
+	ticks = batch;
+	fuel -= meterFuel ? size : 0;
+	slice -= meterSlice ? size : 0;
+}
+
+}
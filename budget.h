@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace Delve::Script {
+
+/*
+* Bounds on the work a single run of a program may do.  Zero means no limit.
+*/
+struct ExecutionLimits
+{
+	// number of function entries and branches the run may make
+	uint64_t fuel = 0;
+
+	// wall clock time the run may take
+	std::chrono::nanoseconds timeout{ 0 };
+};
+
+/*
+* Meters a run against its ExecutionLimits.  Engines call tick at every function entry and branch.  Ticks count down
+* from a batch and the limits are only examined when a batch runs out, so the common case costs a decrement and a branch.
+*
+* A run may also be given a slice of ticks, after which tick reports that the run should yield so that other work can
+* use the thread.  Engines which cannot suspend simply run without a slice.
+*/
+class Budget
+{
+public:
+	void start(const ExecutionLimits& limits);
+	void startSlice(uint64_t sliceTicks);
+
+	// returns true when the current slice is used up
+	inline bool tick()
+	{
+		if (--ticks == 0) {
+			return check();
+		}
+
+		return false;
+	}
+
+	inline uint64_t used() const { return ticksUsed + batch - ticks; }
+
+	static constexpr uint32_t ticksPerCheck = 4096;
+
+private:
+	bool check();
+	void refill();
+
+private:
+	uint32_t ticks = 0;
+	uint32_t batch = 0;
+	uint64_t ticksUsed = 0;
+
+	uint64_t fuel = 0;
+	bool meterFuel = false;
+
+	uint64_t slice = 0;
+	bool meterSlice = false;
+
+	std::chrono::steady_clock::time_point deadline;
+	bool hasDeadline = false;
+};
+
+}
@@ -0,0 +1,589 @@
+#include "bytecode.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace Delve::Script {
+
+	using Bytecode::OpCode;
+
+	namespace {
+		const char* opCodeName(OpCode op)
+		{
+			static const char* names[] = {
+				"Constant", "Null", "GetGlobal", "SetGlobal", "GetLocal", "SetLocal", "GetLocalBoxed", "SetLocalBoxed",
+				"GetCapture", "GetCaptureBoxed", "Negate", "Minus", "Add", "Subtract", "Multiply", "Divide", "LessThan",
+				"GreaterThan", "Equal", "NotEqual", "AddIntegers", "SubtractIntegers", "MultiplyIntegers", "DivideIntegers",
+				"LessThanIntegers", "GreaterThanIntegers", "EqualIntegers", "NotEqualIntegers", "EqualBooleans", "NotEqualBooleans", "Jump", "JumpIfFalse", "Pop", "Closure", "Call", "TailCall", "Return"
+			};
+
+			return names[static_cast<size_t>(op)];
+		}
+	}
+
+	int Bytecode::getStackEffect(OpCode op, uint32_t operand)
+	{
+		switch (op) {
+		case OpCode::Constant:
+		case OpCode::Null:
+		case OpCode::GetGlobal:
+		case OpCode::GetLocal:
+		case OpCode::GetLocalBoxed:
+		case OpCode::GetCapture:
+		case OpCode::GetCaptureBoxed:
+		case OpCode::Closure:
+			return 1;
+		case OpCode::Negate:
+		case OpCode::Minus:
+		case OpCode::Jump:
+			return 0;
+		case OpCode::Call:
+		case OpCode::TailCall:
+			return -static_cast<int>(operand);
+		default:
+			return -1;
+		}
+	}
+
+	void Bytecode::Closure::trace(Heap& heap)
+	{
+		for (const auto& value : captures) {
+			heap.mark(value);
+		}
+	}
+
+	/**
+	* Finds the source line an instruction was compiled from.
+	* @returns the line, or zero if the function has no line table
+	*/
+	uint32_t Bytecode::Function::getLine(size_t pc) const
+	{
+		auto entry = std::upper_bound(lines.begin(), lines.end(), pc, [](size_t target, const LineEntry& e) { return target < e.pc; });
+		return entry == lines.begin() ? 0 : (entry - 1)->line;
+	}
+
+	// Points the function's views at its storage once it has been compiled.
+	void Bytecode::Function::seal()
+	{
+		boxedSlots = storage.boxedSlots;
+		captures = storage.captures;
+		code = storage.code;
+		constants = storage.constants;
+		lines = storage.lines;
+	}
+
+	/**
+	* Returns the number of bytes held by the program's functions, their code and constants.  Functions loaded from a
+	* bytecode file only count their headers, since their code belongs to the mapped file.
+	*/
+	size_t BytecodeProgram::getMemoryUsage() const
+	{
+		size_t bytes = sizeof(BytecodeProgram);
+
+		for (const auto& function : functions) {
+			const auto& storage = function->storage;
+			bytes += sizeof(Bytecode::Function);
+			bytes += storage.boxedSlots.capacity() * sizeof(uint32_t);
+			bytes += storage.captures.capacity() * sizeof(Ast::Capture);
+			bytes += storage.code.capacity() * sizeof(Bytecode::Instruction);
+			bytes += storage.constants.capacity() * sizeof(Value);
+			bytes += storage.lines.capacity() * sizeof(Bytecode::LineEntry);
+		}
+
+		return bytes;
+	}
+
+	/**
+	* Lists the instructions of every function in the program, for debugging.
+	* @returns one line per instruction, with each function headed by its index and frame layout
+	*/
+	std::string BytecodeProgram::disassemble() const
+	{
+		std::ostringstream out;
+
+		for (size_t i = 0; i < functions.size(); ++i) {
+			const auto& function = *functions[i];
+			out << "function " << i << " (parameters " << function.parameterCount << ", slots " << function.slotCount << ", stack " << function.maxStack << ")\n";
+
+			size_t lineEntry = 0;
+
+			for (size_t pc = 0; pc < function.code.size(); ++pc) {
+				if (lineEntry < function.lines.size() && function.lines[lineEntry].pc == pc) {
+					out << " line " << function.lines[lineEntry++].line << '\n';
+				}
+
+				const auto& instruction = function.code[pc];
+				out << "  " << pc << ' ' << opCodeName(instruction.op);
+
+				switch (instruction.op) {
+				case OpCode::Null:
+				case OpCode::Negate:
+				case OpCode::Minus:
+				case OpCode::Add:
+				case OpCode::Subtract:
+				case OpCode::Multiply:
+				case OpCode::Divide:
+				case OpCode::LessThan:
+				case OpCode::GreaterThan:
+				case OpCode::Equal:
+				case OpCode::NotEqual:
+				case OpCode::AddIntegers:
+				case OpCode::SubtractIntegers:
+				case OpCode::MultiplyIntegers:
+				case OpCode::DivideIntegers:
+				case OpCode::LessThanIntegers:
+				case OpCode::GreaterThanIntegers:
+				case OpCode::EqualIntegers:
+				case OpCode::NotEqualIntegers:
+				case OpCode::EqualBooleans:
+				case OpCode::NotEqualBooleans:
+				case OpCode::Pop:
+				case OpCode::Return:
+					break;
+				case OpCode::Constant:
+					out << ' ' << function.constants[instruction.operand].toString();
+					break;
+				default:
+					out << ' ' << instruction.operand;
+					break;
+				}
+
+				out << '\n';
+			}
+		}
+
+		return out.str();
+	}
+
+	BytecodeCompiler::BytecodeCompiler()
+	{
+	}
+
+	BytecodeCompiler::BytecodeCompiler(Ast::Program* program, const Host* host)
+	{
+		compile(program, host);
+	}
+
+	void BytecodeCompiler::clear()
+	{
+		program.reset();
+		errors.clear();
+	}
+
+	/**
+	* Compiles a program to bytecode.  The program is first run through the Resolver, which annotates it in place.
+	* On success the result is available through getProgram().  If the program could not be compiled the program will
+	* be null and the reasons are available through getErrors().
+	* @param ast the program to compile
+	* @param host functions the program may call, which must outlive the compiled program
+	*/
+	void BytecodeCompiler::compile(Ast::Program* ast, const Host* host)
+	{
+		DELVE_SCRIPT_TRACE("compile bytecode", "compile");
+
+		clear();
+
+		if (!ast) {
+			return;
+		}
+
+		resolver.resolve(*ast, host ? host->getNames() : std::vector<std::string>());
+
+		if (!resolver.getErrors().empty()) {
+			errors = resolver.getErrors();
+			return;
+		}
+
+		auto compiled = std::make_shared<BytecodeProgram>();
+		program = compiled;
+		compiled->globalCount = ast->globalCount;
+		compiled->host = host;
+		compiled->functions.push_back(std::make_unique<Bytecode::Function>());
+
+		auto* main = compiled->functions.back().get();
+		main->slotCount = ast->slotCount;
+		main->storage.boxedSlots = ast->boxedSlots;
+
+		try {
+			inFunction = false;
+			compileFunction(main, ast->statements, false);
+		}
+		catch (const CompileError& error) {
+			errors.push_back(error.what());
+			program.reset();
+		}
+	}
+
+	/*
+	* Compiles the statements of a function body, followed by a return of the value of the last statement.
+	*/
+	void BytecodeCompiler::compileFunction(Bytecode::Function* target, const std::vector<std::unique_ptr<Ast::Statement>>& statements, bool tail)
+	{
+		auto* outerFunction = function;
+		uint32_t outerDepth = stackDepth;
+		uint32_t outerLine = line;
+
+		function = target;
+		stackDepth = 0;
+
+		compileStatements(statements, true, tail);
+		emit(OpCode::Return);
+		target->seal();
+
+		function = outerFunction;
+		stackDepth = outerDepth;
+		line = outerLine;
+	}
+
+	/*
+	* Compiles a list of statements.  Only the value of the last statement can be the result of the list, so the values
+	* of the others are discarded.
+	* @param wantResult true if the value of the list should be left on the stack
+	* @param tail true if the value of the list is the result of the enclosing function
+	*/
+	void BytecodeCompiler::compileStatements(const std::vector<std::unique_ptr<Ast::Statement>>& statements, bool wantResult, bool tail)
+	{
+		const Ast::Statement* last = nullptr;
+
+		for (auto& statement : statements) {
+			if (statement) {
+				last = statement.get();
+			}
+		}
+
+		for (auto& statement : statements) {
+			if (statement) {
+				bool isLast = statement.get() == last;
+				compileStatement(statement.get(), wantResult && isLast, tail && isLast);
+			}
+		}
+
+		if (!last && wantResult) {
+			emit(OpCode::Null);
+		}
+	}
+
+	/*
+	* Compiles a single statement, leaving its value on the stack if it is wanted.  A call whose value becomes the result
+	* of the enclosing function, either because it is returned or because it is the last statement of the body, is
+	* compiled as a tail call.
+	*/
+	void BytecodeCompiler::compileStatement(const Ast::Statement* statement, bool wantResult, bool tail)
+	{
+		setLine(statement);
+
+		switch (statement->kind) {
+		case Ast::Node::Kind::LetStatement:
+			compileLetStatement(static_cast<const Ast::LetStatement*>(statement), wantResult);
+			return;
+
+		case Ast::Node::Kind::ReturnStatement: {
+			auto* returnExpression = static_cast<const Ast::ReturnStatement*>(statement)->expression.get();
+
+			if (inFunction && returnExpression && returnExpression->kind == Ast::Node::Kind::CallExpression) {
+				compileCall(static_cast<const Ast::CallExpression*>(returnExpression), true);
+			}
+			else {
+				compileExpression(returnExpression, statement);
+			}
+
+			emit(OpCode::Return);
+
+			// nothing after a return is reached, but the code which follows expects the statement to have left a value
+			stackDepth += wantResult ? 1 : 0;
+			return;
+		}
+
+		case Ast::Node::Kind::ExpressionStatement: {
+			auto* statementExpression = static_cast<const Ast::ExpressionStatement*>(statement)->expression.get();
+
+			if (tail && statementExpression && statementExpression->kind == Ast::Node::Kind::CallExpression) {
+				compileCall(static_cast<const Ast::CallExpression*>(statementExpression), true);
+				emit(OpCode::Return);
+				stackDepth += wantResult ? 1 : 0;
+				return;
+			}
+
+			compileExpression(statementExpression, statement);
+			break;
+		}
+
+		case Ast::Node::Kind::BlockStatement:
+			compileStatements(static_cast<const Ast::BlockStatement*>(statement)->statements, wantResult, tail);
+			return;
+
+		case Ast::Node::Kind::IfStatement:
+			compileIfStatement(static_cast<const Ast::IfStatement*>(statement), wantResult, tail);
+			return;
+
+		default:
+			compileExpression(statement, statement);
+			break;
+		}
+
+		if (!wantResult) {
+			emit(OpCode::Pop);
+		}
+	}
+
+	void BytecodeCompiler::compileLetStatement(const Ast::LetStatement* statement, bool wantResult)
+	{
+		if (!statement->identifier) {
+			compileExpression(nullptr, statement);
+		}
+
+		compileExpression(statement->expression.get(), statement);
+		const Ast::Binding& binding = statement->identifier->binding;
+
+		if (binding.kind == Ast::Binding::Kind::Global) {
+			emit(OpCode::SetGlobal, binding.index);
+		}
+		else {
+			emit(binding.boxed ? OpCode::SetLocalBoxed : OpCode::SetLocal, binding.index);
+		}
+
+		if (wantResult) {
+			emit(OpCode::Null);
+		}
+	}
+
+	void BytecodeCompiler::compileIfStatement(const Ast::IfStatement* statement, bool wantResult, bool tail)
+	{
+		compileExpression(statement->condition.get(), statement);
+
+		if (!statement->consequence) {
+			compileExpression(nullptr, statement);
+		}
+
+		size_t skipConsequence = emit(OpCode::JumpIfFalse);
+		uint32_t branchDepth = stackDepth;
+
+		compileStatement(statement->consequence.get(), wantResult, tail);
+		size_t skipAlternative = emit(OpCode::Jump);
+
+		patchJump(skipConsequence);
+		stackDepth = branchDepth;
+
+		if (statement->alternative) {
+			compileStatement(statement->alternative.get(), wantResult, tail);
+		}
+		else if (wantResult) {
+			emit(OpCode::Null);
+		}
+
+		patchJump(skipAlternative);
+	}
+
+	/*
+	* Compiles a call.  The callee is pushed first, followed by the arguments in order.  A tail call must be followed by
+	* a return, which is only reached when the callee is a host function.
+	*/
+	void BytecodeCompiler::compileCall(const Ast::CallExpression* expression, bool tail)
+	{
+		compileExpression(expression->function.get(), expression);
+
+		for (auto& argument : expression->arguments) {
+			compileExpression(argument.get(), expression);
+		}
+
+		emit(tail ? OpCode::TailCall : OpCode::Call, static_cast<uint32_t>(expression->arguments.size()));
+	}
+
+	/*
+	* Compiles an expression which pushes a single value.
+	* @param parent the node which owns the expression, used for error reporting if the parser left the expression empty.
+	*/
+	void BytecodeCompiler::compileExpression(const Ast::Expression* expression, const Ast::Node* parent)
+	{
+		if (!expression) {
+			std::ostringstream error;
+			error << "Incomplete expression at " << parent->token->lineNum << ", " << parent->token->colNum << '.';
+
+			throw CompileError(error.str());
+		}
+
+		setLine(expression);
+
+		switch (expression->kind) {
+		case Ast::Node::Kind::Identifier:
+			compileIdentifier(static_cast<const Ast::Identifier*>(expression));
+			break;
+
+		case Ast::Node::Kind::IntegerLiteral:
+			emitConstant(Value::fromInteger(static_cast<const Ast::IntegerLiteral*>(expression)->value));
+			break;
+
+		case Ast::Node::Kind::BooleanLiteral:
+			emitConstant(Value::fromBoolean(expression->token->type == Token::Type::True));
+			break;
+
+		case Ast::Node::Kind::PrefixExpression: {
+			auto* prefix = static_cast<const Ast::PrefixExpression*>(expression);
+			compileExpression(prefix->rightExpression.get(), prefix);
+			emit(prefix->token->type == Token::Type::Negate ? OpCode::Negate : OpCode::Minus);
+			break;
+		}
+
+		case Ast::Node::Kind::InfixExpression:
+			compileInfixExpression(static_cast<const Ast::InfixExpression*>(expression));
+			break;
+
+		case Ast::Node::Kind::CallExpression:
+			compileCall(static_cast<const Ast::CallExpression*>(expression), false);
+			break;
+
+		case Ast::Node::Kind::FunctionLiteral:
+			compileFunctionLiteral(static_cast<const Ast::FunctionLiteral*>(expression));
+			break;
+
+		default: {
+			std::ostringstream error;
+			error << "Statement used as an expression at " << expression->token->lineNum << ", " << expression->token->colNum << '.';
+
+			throw CompileError(error.str());
+		}
+		}
+	}
+
+	void BytecodeCompiler::compileIdentifier(const Ast::Identifier* identifier)
+	{
+		const Ast::Binding& binding = identifier->binding;
+
+		switch (binding.kind) {
+		case Ast::Binding::Kind::Global:
+			emit(OpCode::GetGlobal, binding.index);
+			break;
+
+		case Ast::Binding::Kind::Local:
+			emit(binding.boxed ? OpCode::GetLocalBoxed : OpCode::GetLocal, binding.index);
+			break;
+
+		case Ast::Binding::Kind::Capture:
+			emit(binding.boxed ? OpCode::GetCaptureBoxed : OpCode::GetCapture, binding.index);
+			break;
+
+		default: {
+			std::ostringstream error;
+			error << "Unresolved identifier " << identifier->token->literal << " at " << identifier->token->lineNum << ", " << identifier->token->colNum << '.';
+
+			throw CompileError(error.str());
+		}
+		}
+	}
+
+	void BytecodeCompiler::compileInfixExpression(const Ast::InfixExpression* expression)
+	{
+		compileExpression(expression->left.get(), expression);
+		compileExpression(expression->right.get(), expression);
+
+		OpCode op;
+
+		switch (expression->token->type) {
+		case Token::Type::Plus:
+			op = OpCode::Add;
+			break;
+		case Token::Type::Minus:
+			op = OpCode::Subtract;
+			break;
+		case Token::Type::Multiply:
+			op = OpCode::Multiply;
+			break;
+		case Token::Type::Divide:
+			op = OpCode::Divide;
+			break;
+		case Token::Type::LessThan:
+			op = OpCode::LessThan;
+			break;
+		case Token::Type::GreaterThan:
+			op = OpCode::GreaterThan;
+			break;
+		case Token::Type::Equal:
+			op = OpCode::Equal;
+			break;
+		default:
+			op = OpCode::NotEqual;
+			break;
+		}
+
+		// the integer operators are declared in the same order as the checked ones
+		if (expression->operandType == Ast::OperandType::Integer) {
+			op = static_cast<OpCode>(static_cast<uint8_t>(op) - static_cast<uint8_t>(OpCode::Add) + static_cast<uint8_t>(OpCode::AddIntegers));
+		}
+		else if (expression->operandType == Ast::OperandType::Boolean) {
+			op = op == OpCode::Equal ? OpCode::EqualBooleans : OpCode::NotEqualBooleans;
+		}
+
+		emit(op);
+	}
+
+	/*
+	* Compiles the body of a function literal into a new function of the program.  Evaluating the literal creates a
+	* closure which copies the values it captures out of the current frame and closure.
+	*/
+	void BytecodeCompiler::compileFunctionLiteral(const Ast::FunctionLiteral* literal)
+	{
+		if (!literal->body) {
+			compileExpression(nullptr, literal);
+		}
+
+		uint32_t index = static_cast<uint32_t>(program->functions.size());
+		program->functions.push_back(std::make_unique<Bytecode::Function>());
+
+		auto* compiled = program->functions.back().get();
+		compiled->parameterCount = static_cast<uint32_t>(literal->parameters.size());
+		compiled->slotCount = literal->slotCount;
+		compiled->storage.boxedSlots = literal->boxedSlots;
+		compiled->storage.captures = literal->captures;
+
+		bool wasInFunction = inFunction;
+		inFunction = true;
+		compileFunction(compiled, literal->body->statements, true);
+		inFunction = wasInFunction;
+
+		emit(OpCode::Closure, index);
+	}
+
+	size_t BytecodeCompiler::emit(OpCode op, uint32_t operand)
+	{
+		stackDepth += Bytecode::getStackEffect(op, operand);
+		function->maxStack = std::max(function->maxStack, stackDepth);
+		auto& storage = function->storage;
+
+		if (storage.lines.empty() || storage.lines.back().line != line) {
+			storage.lines.push_back({ static_cast<uint32_t>(storage.code.size()), line });
+		}
+
+		storage.code.push_back({ op, operand });
+
+		return storage.code.size() - 1;
+	}
+
+	void BytecodeCompiler::setLine(const Ast::Node* node)
+	{
+		if (node->token) {
+			line = node->token->lineNum;
+		}
+	}
+
+	void BytecodeCompiler::emitConstant(Value value)
+	{
+		auto& constants = function->storage.constants;
+
+		for (size_t i = 0; i < constants.size(); ++i) {
+			if (constants[i].type == value.type && constants[i].integer == value.integer) {
+				emit(OpCode::Constant, static_cast<uint32_t>(i));
+				return;
+			}
+		}
+
+		constants.push_back(value);
+		emit(OpCode::Constant, static_cast<uint32_t>(constants.size() - 1));
+	}
+
+	// points a jump at the next instruction to be emitted
+	void BytecodeCompiler::patchJump(size_t jump)
+	{
+		function->storage.code[jump].operand = static_cast<uint32_t>(function->storage.code.size());
+	}
+}
@@ -0,0 +1,246 @@
+#pragma once
+
+#include "ast.h"
+#include "heap.h"
+#include "host.h"
+#include "value.h"
+#include "resolver.h"
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Delve::Script {
+
+namespace Bytecode {
+	enum class OpCode : uint8_t
+	{
+		// push constants[operand]
+		Constant,
+		Null,
+
+		// variable access, operands are the indices filled in by the Resolver.  Set instructions pop the value they store.
+		GetGlobal,
+		SetGlobal,
+		GetLocal,
+		SetLocal,
+		GetLocalBoxed,
+		SetLocalBoxed,
+		GetCapture,
+		GetCaptureBoxed,
+
+		// operators pop their operands and push the result
+		Negate,
+		Minus,
+		Add,
+		Subtract,
+		Multiply,
+		Divide,
+		LessThan,
+		GreaterThan,
+		Equal,
+		NotEqual,
+
+		// operators whose operands TypeInference proved are integers or booleans, which skip the type checks
+		AddIntegers,
+		SubtractIntegers,
+		MultiplyIntegers,
+		DivideIntegers,
+		LessThanIntegers,
+		GreaterThanIntegers,
+		EqualIntegers,
+		NotEqualIntegers,
+		EqualBooleans,
+		NotEqualBooleans,
+
+		// operand is the index of the instruction to jump to
+		Jump,
+		JumpIfFalse,
+
+		Pop,
+
+		// push a new closure of functions[operand]
+		Closure,
+
+		// operand is the number of arguments, which are on top of the stack above the callee
+		Call,
+		TailCall,
+
+		// pop the result and return it to the caller
+		Return
+	};
+
+	struct Instruction
+	{
+		OpCode op;
+		uint32_t operand;
+	};
+
+	// change in the number of operands on the stack made by an instruction
+	int getStackEffect(OpCode op, uint32_t operand);
+
+	// A read only view of an array owned by something else.
+	template <typename T>
+	class Span
+	{
+	public:
+		Span() = default;
+		Span(const T* d, size_t s) : first(d), count(s) {}
+		Span(const std::vector<T>& v) : first(v.data()), count(v.size()) {}
+
+		inline const T* data() const { return first; }
+		inline size_t size() const { return count; }
+		inline bool empty() const { return count == 0; }
+		inline const T& operator[](size_t i) const { return first[i]; }
+		inline const T* begin() const { return first; }
+		inline const T* end() const { return first + count; }
+
+	private:
+		const T* first = nullptr;
+		size_t count = 0;
+	};
+
+	// An entry in a function's line table.  Instructions from pc up to the next entry were compiled from the given line.
+	struct LineEntry
+	{
+		uint32_t pc;
+		uint32_t line;
+	};
+
+	/*
+	* The code and frame layout of a function.  The arrays are views, either of the function's own storage when it was
+	* compiled in this process or of a mapped bytecode file, so loaded functions run without being copied.
+	*/
+	struct Function
+	{
+		uint32_t parameterCount = 0;
+		uint32_t slotCount = 0;
+
+		// the most operands the function's code holds on the stack at once
+		uint32_t maxStack = 0;
+
+		Span<uint32_t> boxedSlots;
+		Span<Ast::Capture> captures;
+		Span<Instruction> code;
+		Span<Value> constants;
+		Span<LineEntry> lines;
+
+		// the arrays of a function being compiled, the views are pointed at them once it is complete
+		struct Storage
+		{
+			std::vector<uint32_t> boxedSlots;
+			std::vector<Ast::Capture> captures;
+			std::vector<Instruction> code;
+			std::vector<Value> constants;
+			std::vector<LineEntry> lines;
+		};
+
+		Storage storage;
+
+		uint32_t getLine(size_t pc) const;
+		void seal();
+	};
+
+	// A function value in the bytecode engine.
+	struct Closure : public Object
+	{
+		Closure(const Function* f) : function(f) {}
+
+		const Function* function;
+		std::vector<Value> captures;
+
+		void trace(Heap& heap) override;
+	};
+}
+
+/*
+* A program compiled to bytecode for a stack machine.  Unlike the closure engine the running state of a bytecode
+* program is entirely explicit, held in a Task rather than on the native stack, so a run can be suspended at any
+* instruction and resumed later, possibly on another thread.
+*
+* A BytecodeProgram is never changed once compiled and may be shared by any number of tasks on any number of threads.
+*/
+class BytecodeProgram
+{
+public:
+	inline const Bytecode::Function* getMain() const { return functions.front().get(); }
+	inline const Bytecode::Function* getFunction(size_t index) const { return functions[index].get(); }
+	inline size_t functionCount() const { return functions.size(); }
+
+	inline size_t getGlobalCount() const { return globalCount; }
+	inline const Host* getHost() const { return host; }
+
+	std::string disassemble() const;
+	size_t getMemoryUsage() const;
+
+private:
+	friend class BytecodeCompiler;
+	friend class BytecodeFile;
+	friend class SinglePassCompiler;
+
+	// the top level code is function 0
+	std::vector<std::unique_ptr<Bytecode::Function>> functions;
+	size_t globalCount = 0;
+	const Host* host = nullptr;
+
+	// keeps the file a loaded program's functions point into mapped
+	std::shared_ptr<const void> image;
+};
+
+class BytecodeCompiler
+{
+public:
+	using ErrorList = std::vector<std::string>;
+
+public:
+	BytecodeCompiler();
+	BytecodeCompiler(Ast::Program* program, const Host* host = nullptr);
+
+public:
+	void compile(Ast::Program* program, const Host* host = nullptr);
+	void clear();
+
+	inline std::shared_ptr<const BytecodeProgram> getProgram() const { return program; }
+	inline const ErrorList& getErrors() const { return errors; }
+
+private:
+	class CompileError : public std::runtime_error {
+	public:
+		CompileError(const std::string& desc) : std::runtime_error(desc) {}
+	};
+
+	void compileFunction(Bytecode::Function* function, const std::vector<std::unique_ptr<Ast::Statement>>& statements, bool tail);
+	void compileStatements(const std::vector<std::unique_ptr<Ast::Statement>>& statements, bool wantResult, bool tail);
+	void compileStatement(const Ast::Statement* statement, bool wantResult, bool tail);
+	void compileLetStatement(const Ast::LetStatement* statement, bool wantResult);
+	void compileIfStatement(const Ast::IfStatement* statement, bool wantResult, bool tail);
+	void compileCall(const Ast::CallExpression* expression, bool tail);
+
+	void compileExpression(const Ast::Expression* expression, const Ast::Node* parent);
+	void compileIdentifier(const Ast::Identifier* identifier);
+	void compileInfixExpression(const Ast::InfixExpression* expression);
+	void compileFunctionLiteral(const Ast::FunctionLiteral* function);
+
+	size_t emit(Bytecode::OpCode op, uint32_t operand = 0);
+	void setLine(const Ast::Node* node);
+	void emitConstant(Value value);
+	void patchJump(size_t jump);
+
+private:
+	Resolver resolver;
+
+	std::shared_ptr<BytecodeProgram> program;
+	ErrorList errors;
+
+	// the function being compiled and the number of operands its code has on the stack at the current instruction
+	Bytecode::Function* function = nullptr;
+	uint32_t stackDepth = 0;
+	bool inFunction = false;
+
+	// the source line of the node being compiled, recorded in the line table of the function
+	uint32_t line = 0;
+};
+
+}
@@ -0,0 +1,622 @@
+#include "bytecode_file.h"
+#include "hash.h"
+#include "lexer.h"
+#include "parser.h"
+#include "trace.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#if defined(_WIN32)
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Delve::Script {
+
+	namespace {
+		using Bytecode::OpCode;
+
+		const char fileMagic[8] = { 'D', 'E', 'L', 'V', 'E', 'B', 'C', '\0' };
+		const uint32_t byteOrderMark = 0x01020304;
+
+		// the sizes of the types stored in their in memory layout, a file written with different sizes cannot be read
+		const uint32_t layout = static_cast<uint32_t>(sizeof(Value) | sizeof(Bytecode::Instruction) << 8 | sizeof(Ast::Capture) << 16 | sizeof(Bytecode::LineEntry) << 24);
+
+		// arrays are aligned so that they can be used in place once the file is mapped
+		const size_t arrayAlignment = 16;
+
+		struct Header
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t layout;
+			uint32_t byteOrder;
+			uint32_t scriptCount;
+			uint32_t functionCount;
+			uint32_t reserved;
+
+			// size of the whole file and checksum of everything after the header
+			uint64_t fileSize;
+			uint64_t checksum;
+
+			uint64_t scriptsOffset;
+			uint64_t functionsOffset;
+		};
+
+		struct ArrayRecord
+		{
+			uint64_t offset;
+			uint32_t count;
+			uint32_t reserved;
+		};
+
+		struct FunctionRecord
+		{
+			uint32_t parameterCount;
+			uint32_t slotCount;
+			uint32_t maxStack;
+			uint32_t reserved;
+
+			ArrayRecord boxedSlots;
+			ArrayRecord captures;
+			ArrayRecord code;
+			ArrayRecord constants;
+			ArrayRecord lines;
+		};
+
+		template <typename ProgramCompiler>
+		auto compile(const std::string& source, const Host* host, std::vector<std::string>* errors)
+		{
+			using Program = decltype(std::declval<ProgramCompiler>().getProgram());
+
+			Lexer lexer(source);
+			Parser parser(lexer.tokens());
+
+			if (!parser.getErrors().empty()) {
+				if (errors) {
+					*errors = parser.getErrors();
+				}
+
+				return Program();
+			}
+
+			ProgramCompiler compiler(parser.getProgram(), host);
+
+			if (errors) {
+				*errors = compiler.getErrors();
+			}
+
+			return compiler.getProgram();
+		}
+
+		std::string joinHostNames(const Host* host)
+		{
+			std::string names;
+
+			for (const auto& name : host ? host->getNames() : std::vector<std::string>()) {
+				names += name;
+				names += '\n';
+			}
+
+			return names;
+		}
+
+		/*
+		* Builds the contents of a file in memory.  Values and instructions have padding, so they are written field by field
+		* over zeroed space to keep the file, and so its checksum, the same for the same scripts.
+		*/
+		class Writer
+		{
+		public:
+			std::string buffer;
+
+			ArrayRecord append(const void* data, size_t size, uint32_t count)
+			{
+				ArrayRecord record{ align(), count, 0 };
+				buffer.append(static_cast<const char*>(data), size);
+
+				return record;
+			}
+
+			template <typename T>
+			ArrayRecord append(const Bytecode::Span<T>& values)
+			{
+				return append(values.data(), values.size() * sizeof(T), static_cast<uint32_t>(values.size()));
+			}
+
+			ArrayRecord append(const std::string& text)
+			{
+				return append(text.data(), text.size(), static_cast<uint32_t>(text.size()));
+			}
+
+			ArrayRecord appendCode(const Bytecode::Span<Bytecode::Instruction>& code)
+			{
+				ArrayRecord record{ align(), static_cast<uint32_t>(code.size()), 0 };
+
+				for (const auto& instruction : code) {
+					char bytes[sizeof(Bytecode::Instruction)] = {};
+					std::memcpy(bytes + offsetof(Bytecode::Instruction, op), &instruction.op, sizeof(instruction.op));
+					std::memcpy(bytes + offsetof(Bytecode::Instruction, operand), &instruction.operand, sizeof(instruction.operand));
+					buffer.append(bytes, sizeof(bytes));
+				}
+
+				return record;
+			}
+
+			ArrayRecord appendConstants(const Bytecode::Span<Value>& constants)
+			{
+				ArrayRecord record{ align(), static_cast<uint32_t>(constants.size()), 0 };
+
+				for (const auto& value : constants) {
+					char bytes[sizeof(Value)] = {};
+					std::memcpy(bytes + offsetof(Value, type), &value.type, sizeof(value.type));
+
+					if (value.type == Value::Type::Integer) {
+						std::memcpy(bytes + offsetof(Value, integer), &value.integer, sizeof(value.integer));
+					}
+					else if (value.type == Value::Type::Boolean) {
+						std::memcpy(bytes + offsetof(Value, boolean), &value.boolean, sizeof(value.boolean));
+					}
+
+					buffer.append(bytes, sizeof(bytes));
+				}
+
+				return record;
+			}
+
+			template <typename T>
+			void put(uint64_t offset, const T& record)
+			{
+				std::memcpy(&buffer[offset], &record, sizeof(T));
+			}
+
+		private:
+			uint64_t align()
+			{
+				buffer.resize((buffer.size() + arrayAlignment - 1) / arrayAlignment * arrayAlignment, '\0');
+				return buffer.size();
+			}
+		};
+	}
+
+	struct BytecodeFile::ScriptRecord
+	{
+		ArrayRecord name;
+
+		// the names of the host functions the script was compiled against, each followed by a newline
+		ArrayRecord hostNames;
+
+		// hash of the source, so that a script which has changed since the file was written is compiled again
+		uint64_t sourceHash;
+
+		uint32_t globalCount;
+		uint32_t firstFunction;
+		uint32_t functionCount;
+		uint32_t reserved;
+	};
+
+	/*
+	* The contents of a file, mapped read only where the platform allows and read into memory otherwise.
+	*/
+	struct BytecodeFile::Image
+	{
+		const char* data = nullptr;
+		size_t size = 0;
+
+#if defined(_WIN32)
+		std::vector<char> contents;
+#else
+		~Image()
+		{
+			if (data) {
+				munmap(const_cast<char*>(data), size);
+			}
+		}
+#endif
+
+		template <typename T>
+		inline const T* at(uint64_t offset) const { return reinterpret_cast<const T*>(data + offset); }
+
+		// true if an array of count items of type T at offset lies within the file and is aligned for T
+		template <typename T>
+		inline bool contains(uint64_t offset, uint64_t count) const
+		{
+			return offset % alignof(T) == 0 && offset <= size && count <= (size - offset) / sizeof(T);
+		}
+	};
+
+	/**
+	* Compiles scripts to bytecode and writes them to a file.  The file is written in full to a temporary file and then
+	* renamed, so a running application never sees a partly written file.
+	* @param path the file to write
+	* @param scripts the scripts to compile, names must be unique
+	* @param host the host functions the scripts are compiled against, the same names must be given when loading them
+	* @param errors receives the errors of any scripts which could not be compiled, prefixed with their names
+	* @returns true if every script compiled and the file was written
+	*/
+	bool BytecodeFile::write(const std::string& path, const std::vector<Script>& scripts, const Host* host, ErrorList& errors)
+	{
+		errors.clear();
+
+		std::vector<std::shared_ptr<const BytecodeProgram>> programs;
+		size_t functionCount = 0;
+
+		for (const auto& script : scripts) {
+			ErrorList scriptErrors;
+			auto program = compile<BytecodeCompiler>(script.source, host, &scriptErrors);
+
+			for (const auto& error : scriptErrors) {
+				errors.push_back(script.name + ": " + error);
+			}
+
+			if (program) {
+				functionCount += program->functionCount();
+			}
+			else if (scriptErrors.empty()) {
+				errors.push_back(script.name + ": Script is empty.");
+			}
+
+			programs.push_back(std::move(program));
+		}
+
+		if (!errors.empty()) {
+			return false;
+		}
+
+		Writer writer;
+		Header header = {};
+		std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+		header.version = version;
+		header.layout = layout;
+		header.byteOrder = byteOrderMark;
+		header.scriptCount = static_cast<uint32_t>(scripts.size());
+		header.functionCount = static_cast<uint32_t>(functionCount);
+		header.scriptsOffset = sizeof(Header);
+		header.functionsOffset = header.scriptsOffset + scripts.size() * sizeof(ScriptRecord);
+
+		writer.buffer.resize(header.functionsOffset + functionCount * sizeof(FunctionRecord), '\0');
+
+		std::string hostNames = joinHostNames(host);
+		uint32_t functionIndex = 0;
+
+		for (size_t i = 0; i < scripts.size(); ++i) {
+			const auto& program = *programs[i];
+
+			ScriptRecord script = {};
+			script.name = writer.append(scripts[i].name);
+			script.hostNames = writer.append(hostNames);
+			script.sourceHash = hashBytes(scripts[i].source.data(), scripts[i].source.size());
+			script.globalCount = static_cast<uint32_t>(program.getGlobalCount());
+			script.firstFunction = functionIndex;
+			script.functionCount = static_cast<uint32_t>(program.functionCount());
+			writer.put(header.scriptsOffset + i * sizeof(ScriptRecord), script);
+
+			for (size_t j = 0; j < program.functionCount(); ++j) {
+				const auto* function = program.getFunction(j);
+
+				FunctionRecord record = {};
+				record.parameterCount = function->parameterCount;
+				record.slotCount = function->slotCount;
+				record.maxStack = function->maxStack;
+				record.boxedSlots = writer.append(function->boxedSlots);
+				record.captures = writer.append(function->captures);
+				record.code = writer.appendCode(function->code);
+				record.constants = writer.appendConstants(function->constants);
+				record.lines = writer.append(function->lines);
+				writer.put(header.functionsOffset + functionIndex * sizeof(FunctionRecord), record);
+
+				functionIndex += 1;
+			}
+		}
+
+		header.fileSize = writer.buffer.size();
+		header.checksum = hashBytes(writer.buffer.data() + sizeof(Header), writer.buffer.size() - sizeof(Header));
+		writer.put(0, header);
+
+		std::string temporaryPath = path + ".tmp";
+
+		{
+			std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+			out.write(writer.buffer.data(), static_cast<std::streamsize>(writer.buffer.size()));
+
+			if (!out) {
+				errors.push_back("Could not write " + temporaryPath + '.');
+				return false;
+			}
+		}
+
+		std::remove(path.c_str());
+
+		if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+			errors.push_back("Could not write " + path + '.');
+			return false;
+		}
+
+		return true;
+	}
+
+	/**
+	* Maps a bytecode file and checks that this build can run it.  On failure the file is closed, the reasons are
+	* available through getErrors(), and load compiles every script from its source.
+	* @returns true if the file was opened
+	*/
+	bool BytecodeFile::open(const std::string& path)
+	{
+		close();
+
+		auto mapped = std::make_shared<Image>();
+
+#if defined(_WIN32)
+		std::ifstream in(path, std::ios::binary);
+		mapped->contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+		if (!in.good() && !in.eof()) {
+			errors.push_back("Could not open " + path + '.');
+			return false;
+		}
+
+		mapped->data = mapped->contents.data();
+		mapped->size = mapped->contents.size();
+#else
+		int descriptor = ::open(path.c_str(), O_RDONLY);
+		struct stat status;
+
+		if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+			if (descriptor >= 0) {
+				::close(descriptor);
+			}
+
+			errors.push_back("Could not open " + path + '.');
+			return false;
+		}
+
+		mapped->size = static_cast<size_t>(status.st_size);
+
+		if (mapped->size != 0) {
+			void* memory = mmap(nullptr, mapped->size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			mapped->data = memory == MAP_FAILED ? nullptr : static_cast<const char*>(memory);
+		}
+
+		::close(descriptor);
+
+		if (!mapped->data && mapped->size != 0) {
+			errors.push_back("Could not map " + path + '.');
+			return false;
+		}
+#endif
+
+		image = std::move(mapped);
+
+		if (!validate(path)) {
+			image.reset();
+			scripts.clear();
+			return false;
+		}
+
+		return true;
+	}
+
+	void BytecodeFile::close()
+	{
+		image.reset();
+		scripts.clear();
+		errors.clear();
+	}
+
+	/*
+	* Checks the header, checksum and every record of the mapped file, and indexes its scripts by name.  The checksum
+	* guards against damaged files; the records are still checked so that no field can point outside the file.
+	*/
+	bool BytecodeFile::validate(const std::string& path)
+	{
+		if (image->size < sizeof(Header) || std::memcmp(image->data, fileMagic, sizeof(fileMagic)) != 0) {
+			errors.push_back(path + " is not a bytecode file.");
+			return false;
+		}
+
+		const auto& header = *image->at<Header>(0);
+
+		if (header.version != version) {
+			std::ostringstream error;
+			error << path << " has bytecode version " << header.version << " but this build reads version " << version << '.';
+			errors.push_back(error.str());
+			return false;
+		}
+
+		if (header.layout != layout || header.byteOrder != byteOrderMark) {
+			errors.push_back(path + " was written by a build with a different value layout or byte order.");
+			return false;
+		}
+
+		if (header.fileSize != image->size) {
+			errors.push_back(path + " is truncated.");
+			return false;
+		}
+
+		if (header.checksum != hashBytes(image->data + sizeof(Header), image->size - sizeof(Header))) {
+			errors.push_back(path + " is corrupt, its checksum does not match.");
+			return false;
+		}
+
+		if (!image->contains<ScriptRecord>(header.scriptsOffset, header.scriptCount) ||
+			!image->contains<FunctionRecord>(header.functionsOffset, header.functionCount)) {
+			errors.push_back(path + " has invalid records.");
+			return false;
+		}
+
+		const auto* functions = image->at<FunctionRecord>(header.functionsOffset);
+
+		for (uint32_t i = 0; i < header.scriptCount; ++i) {
+			const auto* script = image->at<ScriptRecord>(header.scriptsOffset) + i;
+			bool valid = image->contains<char>(script->name.offset, script->name.count) &&
+				image->contains<char>(script->hostNames.offset, script->hostNames.count) &&
+				script->functionCount != 0 && script->firstFunction <= header.functionCount &&
+				script->functionCount <= header.functionCount - script->firstFunction;
+
+			for (uint32_t j = 0; valid && j < script->functionCount; ++j) {
+				const auto& function = functions[script->firstFunction + j];
+				valid = image->contains<uint32_t>(function.boxedSlots.offset, function.boxedSlots.count) &&
+					image->contains<Ast::Capture>(function.captures.offset, function.captures.count) &&
+					image->contains<Bytecode::Instruction>(function.code.offset, function.code.count) &&
+					image->contains<Value>(function.constants.offset, function.constants.count) &&
+					image->contains<Bytecode::LineEntry>(function.lines.offset, function.lines.count) &&
+					function.code.count != 0;
+
+				const auto* constants = image->at<Value>(function.constants.offset);
+
+				for (uint32_t k = 0; valid && k < function.constants.count; ++k) {
+					auto type = constants[k].type;
+					valid = type == Value::Type::Null || type == Value::Type::Integer || type == Value::Type::Boolean;
+				}
+
+				const auto* code = image->at<Bytecode::Instruction>(function.code.offset);
+
+				for (uint32_t pc = 0; valid && pc < function.code.count; ++pc) {
+					uint32_t operand = code[pc].operand;
+
+					switch (code[pc].op) {
+					case OpCode::Constant:
+						valid = operand < function.constants.count;
+						break;
+					case OpCode::GetGlobal:
+					case OpCode::SetGlobal:
+						valid = operand < script->globalCount;
+						break;
+					case OpCode::GetLocal:
+					case OpCode::SetLocal:
+					case OpCode::GetLocalBoxed:
+					case OpCode::SetLocalBoxed:
+						valid = operand < function.slotCount;
+						break;
+					case OpCode::GetCapture:
+					case OpCode::GetCaptureBoxed:
+						valid = operand < function.captures.count;
+						break;
+					case OpCode::Jump:
+					case OpCode::JumpIfFalse:
+						valid = operand < function.code.count;
+						break;
+					case OpCode::Closure:
+						valid = operand < script->functionCount;
+						break;
+					default:
+						valid = code[pc].op <= OpCode::Return;
+						break;
+					}
+				}
+
+				valid = valid && code[function.code.count - 1].op == OpCode::Return;
+			}
+
+			if (!valid) {
+				errors.push_back(path + " has invalid records.");
+				return false;
+			}
+
+			scripts[std::string(image->at<char>(script->name.offset), script->name.count)] = script;
+		}
+
+		return true;
+	}
+
+	/**
+	* Returns a script from the file, which runs directly from the mapped code.
+	* @param name the name the script was written with
+	* @param host the host to bind, which must define the same names in the same order as the host it was compiled against
+	* @returns the program, or null if the file is not open, has no such script, or the host does not match
+	*/
+	std::shared_ptr<const BytecodeProgram> BytecodeFile::find(const std::string& name, const Host* host) const
+	{
+		auto found = scripts.find(name);
+
+		if (found == scripts.end()) {
+			return nullptr;
+		}
+
+		const auto* script = found->second;
+
+		if (joinHostNames(host) != std::string(image->at<char>(script->hostNames.offset), script->hostNames.count)) {
+			return nullptr;
+		}
+
+		const auto& header = *image->at<Header>(0);
+		const auto* records = image->at<FunctionRecord>(header.functionsOffset) + script->firstFunction;
+
+		auto program = std::make_shared<BytecodeProgram>();
+		program->globalCount = script->globalCount;
+		program->host = host;
+		program->image = image;
+
+		for (uint32_t i = 0; i < script->functionCount; ++i) {
+			const auto& record = records[i];
+			auto function = std::make_unique<Bytecode::Function>();
+
+			function->parameterCount = record.parameterCount;
+			function->slotCount = record.slotCount;
+			function->maxStack = record.maxStack;
+			function->boxedSlots = { image->at<uint32_t>(record.boxedSlots.offset), record.boxedSlots.count };
+			function->captures = { image->at<Ast::Capture>(record.captures.offset), record.captures.count };
+			function->code = { image->at<Bytecode::Instruction>(record.code.offset), record.code.count };
+			function->constants = { image->at<Value>(record.constants.offset), record.constants.count };
+			function->lines = { image->at<Bytecode::LineEntry>(record.lines.offset), record.lines.count };
+
+			program->functions.push_back(std::move(function));
+		}
+
+		return program;
+	}
+
+	/**
+	* Returns a script from the file if it was compiled from the given source, and otherwise compiles the source.  Use
+	* this when the sources are available, so that scripts changed since the file was written are never run stale.
+	* @param errors if given, receives the reasons the source could not be compiled
+	* @returns the program, or null if it had to be compiled and could not be
+	*/
+	std::shared_ptr<const BytecodeProgram> BytecodeFile::load(const std::string& name, const std::string& source, const Host* host, ErrorList* errors) const
+	{
+		DELVE_SCRIPT_TRACE("load", "compile");
+
+		auto found = scripts.find(name);
+
+		if (found != scripts.end() && found->second->sourceHash == hashBytes(source.data(), source.size())) {
+			if (auto program = find(name, host)) {
+				if (errors) {
+					errors->clear();
+				}
+
+				return program;
+			}
+		}
+
+		return compile<BytecodeCompiler>(source, host, errors);
+	}
+
+	/**
+	* Returns the names of the scripts in the file, in the order they were written.
+	*/
+	std::vector<std::string> BytecodeFile::getNames() const
+	{
+		std::vector<std::string> names;
+
+		if (!image) {
+			return names;
+		}
+
+		const auto& header = *image->at<Header>(0);
+
+		for (uint32_t i = 0; i < header.scriptCount; ++i) {
+			const auto* script = image->at<ScriptRecord>(header.scriptsOffset) + i;
+			names.emplace_back(image->at<char>(script->name.offset), script->name.count);
+		}
+
+		return names;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "bytecode.h"
+#include "host.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* A file of scripts compiled to bytecode ahead of time, so that an application can start without lexing, parsing or
+* compiling them.  The file is mapped into memory and its functions run straight from the mapping.
+*
+* Code, constants and line tables are stored in the layout the engine uses in memory, so a file can only be loaded by a
+* build with the same format version, value layout and byte order as the one which wrote it.  A file which does not
+* match, or whose checksum is wrong, is not loaded at all, and load falls back to compiling scripts from their source.
+*/
+class BytecodeFile
+{
+public:
+	using ErrorList = std::vector<std::string>;
+
+	// a script to write, identified by name when it is loaded
+	struct Script
+	{
+		std::string name;
+		std::string source;
+	};
+
+	static constexpr uint32_t version = 2;
+
+public:
+	static bool write(const std::string& path, const std::vector<Script>& scripts, const Host* host, ErrorList& errors);
+
+	bool open(const std::string& path);
+	void close();
+
+	std::shared_ptr<const BytecodeProgram> find(const std::string& name, const Host* host = nullptr) const;
+	std::shared_ptr<const BytecodeProgram> load(const std::string& name, const std::string& source, const Host* host = nullptr, ErrorList* errors = nullptr) const;
+
+	std::vector<std::string> getNames() const;
+
+	inline bool isOpen() const { return image != nullptr; }
+	inline const ErrorList& getErrors() const { return errors; }
+
+private:
+	struct Image;
+	struct ScriptRecord;
+
+	bool validate(const std::string& path);
+
+private:
+	std::shared_ptr<const Image> image;
+	std::unordered_map<std::string, const ScriptRecord*> scripts;
+	ErrorList errors;
+};
+
+}
@@ -0,0 +1,172 @@
+#include "bytecode_file.h"
+#include "task.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace Delve::Script;
+
+namespace {
+	const std::vector<BytecodeFile::Script> scripts = {
+		{ "fib", "let fib = function(n) {\n if (n < 2) { return n; }\n fib(n - 1) + fib(n - 2);\n};\nfib(15);" },
+		{ "closures", "let adder = function(x) { function(y) { x + y; }; }; let add2 = adder(2); add2(40) == 42;" },
+		{ "boxed", "let f = function() { let x = 1; let g = function() { x; }; let x = 2; g(); }; f();" }
+	};
+
+	std::string temporaryPath(const std::string& name)
+	{
+		return (std::filesystem::temp_directory_path() / name).string();
+	}
+
+	// overwrites four bytes of a file
+	void patch(const std::string& path, std::streamoff offset, uint32_t value)
+	{
+		std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(offset);
+		file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+}
+
+/*
+* Tests that scripts loaded from a file run from the mapped code and give the same results as compiling them.
+*/
+TEST(BytecodeFile, RoundTrip)
+{
+	std::string path = temporaryPath("delve_round_trip.dbc");
+	BytecodeFile::ErrorList errors;
+	ASSERT_TRUE(BytecodeFile::write(path, scripts, nullptr, errors)) << errors[0];
+
+	BytecodeFile file;
+	ASSERT_TRUE(file.open(path)) << file.getErrors()[0];
+	EXPECT_EQ(file.getNames(), std::vector<std::string>({ "fib", "closures", "boxed" }));
+
+	std::vector<std::string> expected = { "610", "true", "2" };
+
+	for (size_t i = 0; i < scripts.size(); ++i) {
+		auto program = file.find(scripts[i].name);
+		ASSERT_NE(program, nullptr) << scripts[i].name;
+
+		Task task(program);
+		EXPECT_EQ(task.runToCompletion().toString(), expected[i]) << scripts[i].name;
+	}
+
+	// the line table survives the round trip
+	auto fib = file.find("fib");
+	const auto* function = fib->getFunction(1);
+	EXPECT_EQ(function->getLine(0), 2);
+	EXPECT_EQ(function->getLine(function->code.size() - 1), 3);
+	EXPECT_EQ(fib->disassemble().find("line 2") != std::string::npos, true);
+
+	// programs keep the file mapped after it is closed
+	file.close();
+	EXPECT_FALSE(file.isOpen());
+	EXPECT_EQ(file.find("fib"), nullptr);
+	EXPECT_EQ(Task(fib).runToCompletion().integer, 610);
+
+	std::remove(path.c_str());
+}
+
+/*
+* Tests that a file from a different format version is rejected and that load compiles from source instead.
+*/
+TEST(BytecodeFile, VersionMismatch)
+{
+	std::string path = temporaryPath("delve_version.dbc");
+	BytecodeFile::ErrorList errors;
+	ASSERT_TRUE(BytecodeFile::write(path, scripts, nullptr, errors));
+
+	patch(path, 8, BytecodeFile::version + 1);
+
+	BytecodeFile file;
+	EXPECT_FALSE(file.open(path));
+	ASSERT_EQ(file.getErrors().size(), 1);
+	std::string expected = "has bytecode version " + std::to_string(BytecodeFile::version + 1) + " but this build reads version " + std::to_string(BytecodeFile::version);
+	EXPECT_NE(file.getErrors()[0].find(expected), std::string::npos);
+
+	auto program = file.load("fib", scripts[0].source);
+	ASSERT_NE(program, nullptr);
+	EXPECT_EQ(Task(program).runToCompletion().integer, 610);
+
+	std::remove(path.c_str());
+}
+
+/*
+* Tests that damaged files are rejected by their checksum, and that missing and empty files are reported.
+*/
+TEST(BytecodeFile, Corruption)
+{
+	std::string path = temporaryPath("delve_corrupt.dbc");
+	BytecodeFile::ErrorList errors;
+	ASSERT_TRUE(BytecodeFile::write(path, scripts, nullptr, errors));
+
+	auto size = std::filesystem::file_size(path);
+	patch(path, static_cast<std::streamoff>(size - 16), 0xdeadbeef);
+
+	BytecodeFile file;
+	EXPECT_FALSE(file.open(path));
+	ASSERT_EQ(file.getErrors().size(), 1);
+	EXPECT_NE(file.getErrors()[0].find("checksum does not match"), std::string::npos);
+
+	std::filesystem::resize_file(path, size / 2);
+	EXPECT_FALSE(file.open(path));
+	EXPECT_NE(file.getErrors()[0].find("truncated"), std::string::npos);
+
+	std::ofstream(path, std::ios::trunc).close();
+	EXPECT_FALSE(file.open(path));
+	EXPECT_NE(file.getErrors()[0].find("is not a bytecode file"), std::string::npos);
+
+	std::remove(path.c_str());
+	EXPECT_FALSE(file.open(path));
+	EXPECT_NE(file.getErrors()[0].find("Could not open"), std::string::npos);
+}
+
+/*
+* Tests that load only uses a script from the file when its source and host match those it was compiled with.
+*/
+TEST(BytecodeFile, StaleScripts)
+{
+	Host host;
+	host.bind("twice", [](int64_t x) { return x * 2; });
+
+	std::string path = temporaryPath("delve_stale.dbc");
+	BytecodeFile::ErrorList errors;
+	ASSERT_TRUE(BytecodeFile::write(path, { { "main", "twice(21);" } }, &host, errors));
+
+	BytecodeFile file;
+	ASSERT_TRUE(file.open(path));
+
+	auto program = file.load("main", "twice(21);", &host);
+	ASSERT_NE(program, nullptr);
+	EXPECT_EQ(Task(program).runToCompletion().integer, 42);
+
+	// a changed script is compiled from its new source
+	program = file.load("main", "twice(2);", &host);
+	ASSERT_NE(program, nullptr);
+	EXPECT_EQ(Task(program).runToCompletion().integer, 4);
+
+	// the file's program expects the host functions it was compiled against
+	EXPECT_EQ(file.find("main"), nullptr);
+	EXPECT_NE(file.find("main", &host), nullptr);
+
+	program = file.load("main", "twice(x);", &host, &errors);
+	EXPECT_EQ(program, nullptr);
+	ASSERT_EQ(errors.size(), 1);
+	EXPECT_EQ(errors[0], "Undefined identifier x at 1, 7.");
+
+	std::remove(path.c_str());
+}
+
+TEST(BytecodeFile, CompileErrors)
+{
+	BytecodeFile::ErrorList errors;
+	EXPECT_FALSE(BytecodeFile::write(temporaryPath("delve_errors.dbc"), { { "good", "1;" }, { "bad", "let x = y;" } }, nullptr, errors));
+
+	ASSERT_EQ(errors.size(), 1);
+	EXPECT_EQ(errors[0], "bad: Undefined identifier y at 1, 9.");
+}
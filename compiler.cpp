@@ -0,0 +1,988 @@
+#include "compiler.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <sstream>
+#include <utility>
+
+namespace Delve::Script {
+
+	namespace {
+		using Compiled::Completion;
+
+		/*
+		* Builds the closure for a binary operator.  The operator is a template parameter so that each node calls its
+		* implementation directly.  The left operand is always evaluated before the right.
+		*/
+		template <Value (*Operator)(const Value&, const Value&)>
+		Compiled::Expression makeBinary(Compiled::Expression left, Compiled::Expression right)
+		{
+			return [left, right](Runtime& runtime, Frame& frame) -> Value {
+				Value leftValue = left(runtime, frame);
+				return Operator(leftValue, right(runtime, frame));
+			};
+		}
+
+		// Specialization of makeBinary for the common case where the right operand is a literal, i.e n - 1
+		template <Value (*Operator)(const Value&, const Value&)>
+		Compiled::Expression makeBinaryConstant(Compiled::Expression left, Value constant)
+		{
+			return [left, constant](Runtime& runtime, Frame& frame) -> Value {
+				return Operator(left(runtime, frame), constant);
+			};
+		}
+
+		template <Value (*Operator)(const Value&, const Value&)>
+		Compiled::Expression makeBinary(Compiled::Expression left, Compiled::Expression right, const Ast::Expression* rightExpression)
+		{
+			if (rightExpression->kind == Ast::Node::Kind::IntegerLiteral) {
+				return makeBinaryConstant<Operator>(std::move(left), Value::fromInteger(static_cast<const Ast::IntegerLiteral*>(rightExpression)->value));
+			}
+
+			return makeBinary<Operator>(std::move(left), std::move(right));
+		}
+
+		/*
+		* Variant of makeBinary for operators which can compare functions.  The left operand is kept on the stack while the
+		* right is evaluated so that it cannot be collected if the right operand allocates.
+		*/
+		template <Value (*Operator)(const Value&, const Value&)>
+		Compiled::Expression makeRootedBinary(Compiled::Expression left, Compiled::Expression right, const Ast::Expression* rightExpression)
+		{
+			// evaluating a literal or a name never allocates
+			switch (rightExpression->kind) {
+			case Ast::Node::Kind::IntegerLiteral:
+			case Ast::Node::Kind::BooleanLiteral:
+			case Ast::Node::Kind::Identifier:
+				return makeBinary<Operator>(std::move(left), std::move(right), rightExpression);
+			default:
+				break;
+			}
+
+			return [left, right](Runtime& runtime, Frame& frame) -> Value {
+				Value* leftValue = runtime.pushFrame(1);
+				*leftValue = left(runtime, frame);
+				Value rightValue = right(runtime, frame);
+				runtime.stackTop = leftValue;
+
+				return Operator(*leftValue, rightValue);
+			};
+		}
+
+		// Boxes the slots of captured variables which are declared more than once.
+		void initializeFrame(Runtime& runtime, const Compiled::FunctionPrototype* prototype, Value* slots)
+		{
+			for (uint32_t slot : prototype->boxedSlots) {
+				slots[slot] = Value::fromBox(runtime.heap.allocate<Box>(slots[slot]));
+			}
+		}
+
+		inline Value& unbox(const Value& value)
+		{
+			return static_cast<Box*>(value.object)->value;
+		}
+
+		// Checks that a value can be called with the given number of arguments.
+		Compiled::Closure* checkCallee(const Value& function, size_t argumentCount)
+		{
+			if (function.type != Value::Type::Function) {
+				throw RuntimeError("Attempted to call a value of type " + Value::getTypeName(function.type) + '.');
+			}
+
+			auto* closure = static_cast<Compiled::Closure*>(function.object);
+			const auto* prototype = closure->prototype;
+
+			if (prototype->parameterCount != argumentCount) {
+				std::ostringstream error;
+				error << "Expected " << prototype->parameterCount << " arguments but got " << argumentCount << '.';
+				throw RuntimeError(error.str());
+			}
+
+			return closure;
+		}
+
+		uint8_t typeSetOf(const Value& value)
+		{
+			switch (value.type) {
+			case Value::Type::Null:
+				return Ast::TypeSet::Null;
+			case Value::Type::Integer:
+				return Ast::TypeSet::Integer;
+			case Value::Type::Boolean:
+				return Ast::TypeSet::Boolean;
+			case Value::Type::Function:
+				return Ast::TypeSet::Function;
+			default:
+				return Ast::TypeSet::HostFunction;
+			}
+		}
+
+		/*
+		* Checks the arguments of a call from the host against the types inferred for the function's parameters, since its
+		* operators may have been specialized to rely on them.
+		*/
+		void checkArgumentTypes(const Compiled::FunctionPrototype* prototype, const Value* arguments)
+		{
+			static const std::pair<uint8_t, const char*> names[] = {
+				{ Ast::TypeSet::Null, "null" },
+				{ Ast::TypeSet::Integer, "int" },
+				{ Ast::TypeSet::Boolean, "bool" },
+				{ Ast::TypeSet::Function | Ast::TypeSet::HostFunction, "function" }
+			};
+
+			for (size_t i = 0; i < prototype->parameterTypes.size(); i++) {
+				uint8_t expected = prototype->parameterTypes[i];
+
+				if (expected & typeSetOf(arguments[i])) {
+					continue;
+				}
+
+				std::ostringstream error;
+				error << "Expected ";
+
+				for (size_t n = 0, listed = 0; n < 4; n++) {
+					if (expected & names[n].first) {
+						error << (listed++ ? " or " : "") << names[n].second;
+					}
+				}
+
+				error << " for argument " << i + 1 << " but got " << Value::getTypeName(arguments[i].type) << '.';
+				throw RuntimeError(error.str());
+			}
+		}
+
+		/*
+		* Checks a callee against the inline cache of its call site, only validating it if it is not the cached function.
+		* @returns the closure to call, or null if the callee is a valid call to a host function
+		*/
+		inline Compiled::Closure* checkCallee(const Value& function, size_t argumentCount, Compiled::CallSite* site)
+		{
+			if (function.type == Value::Type::Function) {
+				auto* closure = static_cast<Compiled::Closure*>(function.object);
+
+				if (closure->prototype == site->prototype) {
+					site->hits += 1;
+					return closure;
+				}
+			}
+
+			site->misses += 1;
+
+			if (function.type == Value::Type::HostFunction) {
+				function.host->checkArgumentCount(argumentCount);
+				return nullptr;
+			}
+
+			auto* closure = checkCallee(function, argumentCount);
+			site->prototype = closure->prototype;
+
+			return closure;
+		}
+
+		// Calls a host function with arguments evaluated onto the top of the stack, waiting for it if it is asynchronous.
+		Value callHost(Runtime& runtime, Frame& frame, const HostFunction* host, const std::vector<Compiled::Expression>& arguments)
+		{
+			Value* base = runtime.pushFrame(arguments.size());
+
+			for (size_t i = 0; i < arguments.size(); ++i) {
+				base[i] = arguments[i](runtime, frame);
+			}
+
+			Value result = host->callBlocking(base, arguments.size());
+			runtime.stackTop = base;
+
+			return result;
+		}
+
+		/*
+		* Runs the body of a closure whose frame starts just above base, where the closure itself is stored.  If the body
+		* ends in a tail call the callee and its arguments are moved down to base and the new body runs in the same place,
+		* so a chain of tail calls uses constant stack.
+		*/
+		Value runFrame(Runtime& runtime, Value* base, Compiled::Closure* closure)
+		{
+			Value result;
+
+			for (;;) {
+				const auto* prototype = closure->prototype;
+				Frame frame{ base + 1, closure };
+				initializeFrame(runtime, prototype, frame.slots);
+				runtime.budget.tick();
+
+				if (prototype->body(runtime, frame, result) != Completion::TailCall) {
+					break;
+				}
+
+				Value* pending = runtime.tailCall;
+				closure = static_cast<Compiled::Closure*>(pending[0].object);
+				size_t argumentCount = closure->prototype->parameterCount;
+
+				std::copy(pending, pending + argumentCount + 1, base);
+				runtime.stackTop = base + argumentCount + 1;
+				runtime.pushFrame(closure->prototype->slotCount - argumentCount);
+			}
+
+			return result;
+		}
+
+		/*
+		* Variant of the end of a call for pure functions, which returns the remembered result of an earlier call with the
+		* same arguments instead of running the body.  The arguments are copied aside since the body overwrites its frame.
+		*/
+		Value callMemoized(Runtime& runtime, Value* base, Compiled::Closure* closure)
+		{
+			const auto* prototype = closure->prototype;
+			Value result;
+
+			if (runtime.memos.find(prototype->memo, base + 1, result)) {
+				runtime.stackTop = base;
+				return result;
+			}
+
+			Value arguments[MemoCache::maxArguments];
+			std::copy(base + 1, base + 1 + prototype->parameterCount, arguments);
+
+			runtime.callDepth += 1;
+			result = runFrame(runtime, base, closure);
+			runtime.callDepth -= 1;
+			runtime.stackTop = base;
+
+			runtime.memos.store(prototype->memo, arguments, result);
+			return result;
+		}
+	}
+
+	void Runtime::markRoots(Heap& heap)
+	{
+		for (const auto& value : globals) {
+			heap.mark(value);
+		}
+
+		for (const Value* value = stack.data(); value != stackTop; ++value) {
+			heap.mark(*value);
+		}
+	}
+
+	void Compiled::Closure::trace(Heap& heap)
+	{
+		for (const auto& value : captures) {
+			heap.mark(value);
+		}
+	}
+
+	size_t CompiledProgram::findGlobal(const std::string& name) const
+	{
+		auto found = std::find(globalNames.begin(), globalNames.end(), name);
+		return static_cast<size_t>(found - globalNames.begin());
+	}
+
+	/**
+	* Estimates the memory held by the program.  Each compiled node is a std::function whose captures are stored on the
+	* heap, so nodes are counted at a fixed size rather than measured.
+	* @returns the estimated size in bytes
+	*/
+	size_t CompiledProgram::getMemoryUsage() const
+	{
+		const size_t bytesPerNode = sizeof(Compiled::Expression) + 64;
+		size_t bytes = sizeof(CompiledProgram) + nodeCount * bytesPerNode;
+
+		for (const auto& prototype : prototypes) {
+			bytes += sizeof(Compiled::FunctionPrototype) + prototype->boxedSlots.size() * sizeof(uint32_t);
+		}
+
+		for (const auto& name : globalNames) {
+			bytes += sizeof(std::string) + name.capacity();
+		}
+
+		for (const auto& function : memoizedFunctions) {
+			bytes += sizeof(function) + function.first.capacity();
+		}
+
+		return bytes;
+	}
+
+	Isolate::Isolate(std::shared_ptr<const CompiledProgram> p) : program(std::move(p))
+	{
+		runtime.callSites.resize(program->getCallSiteCount());
+
+		for (const auto& function : program->getMemoizedFunctions()) {
+			runtime.memos.addFunction(function.first, function.second);
+		}
+	}
+
+	/**
+	* Totals the inline cache counters of every call site in the program.  These accumulate across runs of this isolate.
+	* @returns the number of call sites and the number of calls which hit and missed their site's cache
+	*/
+	Isolate::CallStatistics Isolate::getCallStatistics() const
+	{
+		CallStatistics statistics;
+		statistics.callSites = runtime.callSites.size();
+
+		for (const auto& site : runtime.callSites) {
+			statistics.hits += site.hits;
+			statistics.misses += site.misses;
+		}
+
+		return statistics;
+	}
+
+	/**
+	* Runs the program to completion.  All objects created by a previous run are released.  If the run exceeds the
+	* limits set with setLimits it is stopped with an error and all of its state is discarded.
+	* The returned value remains valid until the next call to run.
+	* @returns the value of the first top level return statement, or the value of the last statement executed.
+	* Returns null if a runtime error occurred, in which case it is available through getErrors()
+	*/
+	Value Isolate::run()
+	{
+		DELVE_SCRIPT_TRACE("run closures", "execute");
+
+		const auto* main = program->getMain();
+		const Host* host = program->getHost();
+
+		runtime.heap.clear();
+		runtime.heap.setRootMarker([this](Heap& heap) { runtime.markRoots(heap); });
+		runtime.globals.assign(program->getGlobalCount(), Value());
+
+		for (size_t i = 0; host && i < host->functionCount(); ++i) {
+			runtime.globals[i] = Value::fromHostFunction(host->getFunction(i));
+		}
+
+		runtime.stack.resize(Runtime::stackSize);
+		runtime.stackTop = runtime.stack.data();
+		runtime.callDepth = 0;
+		errors.clear();
+
+		running = true;
+
+		try {
+			runtime.budget.start(limits);
+
+			Frame frame{ runtime.pushFrame(main->slotCount), nullptr };
+			initializeFrame(runtime, main, frame.slots);
+
+			Value result;
+			main->body(runtime, frame, result);
+			running = false;
+
+			return result;
+		}
+		catch (const RuntimeError& error) {
+			errors.push_back(error.what());
+		}
+
+		running = false;
+		return Value();
+	}
+
+	/**
+	* Calls a function created by the last run, such as one the program stored in a global.  The call shares the run's
+	* heap and globals, and is metered against the limits set with setLimits.  A host function may call back into the
+	* isolate running it, in which case errors propagate to the run which called the host function.
+	* @param function the function to call
+	* @param arguments the values to pass, which are copied into the callee's frame
+	* @returns the result of the function, which remains valid until the next call to run.  Returns null if a runtime
+	* error occurred, in which case it is available through getErrors()
+	*/
+	Value Isolate::call(const Value& function, const Value* arguments, size_t argumentCount)
+	{
+		Value* stackTop = runtime.stackTop;
+		uint32_t callDepth = runtime.callDepth;
+		bool nested = running;
+
+		try {
+			auto* closure = checkCallee(function, argumentCount);
+			checkArgumentTypes(closure->prototype, arguments);
+
+			if (!nested) {
+				errors.clear();
+				runtime.budget.start(limits);
+			}
+
+			if (callDepth >= Runtime::maxCallDepth) {
+				throw RuntimeError("Maximum call depth exceeded.");
+			}
+
+			Value* base = runtime.pushFrame(closure->prototype->slotCount + 1);
+			base[0] = function;
+			std::copy(arguments, arguments + argumentCount, base + 1);
+
+			running = true;
+			Value result;
+
+			if (closure->prototype->memo != Compiled::FunctionPrototype::notMemoized && runtime.memos.isEnabled()) {
+				result = callMemoized(runtime, base, closure);
+			}
+			else {
+				runtime.callDepth += 1;
+				result = runFrame(runtime, base, closure);
+				runtime.callDepth -= 1;
+				runtime.stackTop = base;
+			}
+
+			running = nested;
+
+			return result;
+		}
+		catch (const RuntimeError& error) {
+			if (nested) {
+				throw;
+			}
+
+			runtime.stackTop = stackTop;
+			runtime.callDepth = callDepth;
+			running = false;
+			errors.push_back(error.what());
+		}
+
+		return Value();
+	}
+
+	/**
+	* Returns the value of a global as the last run left it, or null if the program has no global of that name.
+	*/
+	Value Isolate::getGlobal(const std::string& name) const
+	{
+		size_t index = program->findGlobal(name);
+		return index < runtime.globals.size() ? runtime.globals[index] : Value();
+	}
+
+	Compiler::Compiler()
+	{
+	}
+
+	Compiler::Compiler(Ast::Program* program, const Host* host)
+	{
+		compile(program, host);
+	}
+
+	void Compiler::clear()
+	{
+		program.reset();
+		errors.clear();
+		functionName.clear();
+	}
+
+	/**
+	* Lowers a program to closures.  The program is first run through the Resolver, which annotates it in place.
+	* On success the result is available through getProgram().  If the program could not be compiled the program will
+	* be null and the reasons are available through getErrors().
+	* @param ast the program to compile
+	* @param host functions the program may call, which must outlive the compiled program
+	*/
+	void Compiler::compile(Ast::Program* ast, const Host* host)
+	{
+		DELVE_SCRIPT_TRACE("compile closures", "compile");
+
+		clear();
+
+		if (!ast) {
+			return;
+		}
+
+		resolver.resolve(*ast, host ? host->getNames() : std::vector<std::string>());
+
+		if (!resolver.getErrors().empty()) {
+			errors = resolver.getErrors();
+			return;
+		}
+
+		program = std::make_shared<CompiledProgram>();
+		auto prototype = std::make_unique<Compiled::FunctionPrototype>();
+
+		try {
+			inFunction = false;
+			prototype->body = compileStatements(ast->statements, false);
+		}
+		catch (const CompileError& error) {
+			errors.push_back(error.what());
+			program.reset();
+			return;
+		}
+
+		prototype->slotCount = ast->slotCount;
+		prototype->boxedSlots = ast->boxedSlots;
+		program->globalCount = ast->globalCount;
+		program->globalNames = resolver.getGlobalNames();
+		program->host = host;
+		program->main = prototype.get();
+		program->prototypes.push_back(std::move(prototype));
+	}
+
+	/*
+	* Compiles a list of statements into a single closure which runs them in order, stopping at the first return.
+	* @param tail true if the value of the last statement is the result of the enclosing function
+	*/
+	Compiled::Statement Compiler::compileStatements(const std::vector<std::unique_ptr<Ast::Statement>>& statements, bool tail)
+	{
+		std::vector<Compiled::Statement> sequence;
+
+		for (size_t i = 0; i < statements.size(); ++i) {
+			if (statements[i]) {
+				sequence.push_back(compileStatement(statements[i].get(), tail && i == statements.size() - 1));
+			}
+		}
+
+		if (sequence.size() == 1) {
+			return sequence[0];
+		}
+
+		return [sequence](Runtime& runtime, Frame& frame, Value& result) -> Completion {
+			result = Value();
+
+			for (auto& statement : sequence) {
+				Completion completion = statement(runtime, frame, result);
+
+				if (completion != Completion::Normal) {
+					return completion;
+				}
+			}
+
+			return Completion::Normal;
+		};
+	}
+
+	/*
+	* Compiles a single statement.  A call whose value becomes the result of the enclosing function, either because it is
+	* returned or because it is the last statement of the body, is compiled as a tail call.
+	*/
+	Compiled::Statement Compiler::compileStatement(const Ast::Statement* statement, bool tail)
+	{
+		program->nodeCount += 1;
+
+		switch (statement->kind) {
+		case Ast::Node::Kind::LetStatement:
+			return compileLetStatement(static_cast<const Ast::LetStatement*>(statement));
+
+		case Ast::Node::Kind::ReturnStatement: {
+			auto* returnExpression = static_cast<const Ast::ReturnStatement*>(statement)->expression.get();
+
+			if (inFunction && returnExpression && returnExpression->kind == Ast::Node::Kind::CallExpression) {
+				return compileTailCall(static_cast<const Ast::CallExpression*>(returnExpression));
+			}
+
+			auto expression = compileExpression(returnExpression, statement);
+
+			return [expression](Runtime& runtime, Frame& frame, Value& result) -> Completion {
+				result = expression(runtime, frame);
+				return Completion::Return;
+			};
+		}
+
+		case Ast::Node::Kind::ExpressionStatement: {
+			auto* statementExpression = static_cast<const Ast::ExpressionStatement*>(statement)->expression.get();
+
+			if (tail && statementExpression && statementExpression->kind == Ast::Node::Kind::CallExpression) {
+				return compileTailCall(static_cast<const Ast::CallExpression*>(statementExpression));
+			}
+
+			auto expression = compileExpression(statementExpression, statement);
+
+			return [expression](Runtime& runtime, Frame& frame, Value& result) -> Completion {
+				result = expression(runtime, frame);
+				return Completion::Normal;
+			};
+		}
+
+		case Ast::Node::Kind::BlockStatement:
+			return compileStatements(static_cast<const Ast::BlockStatement*>(statement)->statements, tail);
+
+		case Ast::Node::Kind::IfStatement:
+			return compileIfStatement(static_cast<const Ast::IfStatement*>(statement), tail);
+
+		default: {
+			auto expression = compileExpression(statement, statement);
+
+			return [expression](Runtime& runtime, Frame& frame, Value& result) -> Completion {
+				result = expression(runtime, frame);
+				return Completion::Normal;
+			};
+		}
+		}
+	}
+
+	Compiled::Statement Compiler::compileLetStatement(const Ast::LetStatement* statement)
+	{
+		if (!statement->identifier) {
+			compileExpression(nullptr, statement);
+		}
+
+		if (statement->expression && statement->expression->kind == Ast::Node::Kind::FunctionLiteral) {
+			functionName = statement->identifier->token->literal;
+		}
+
+		auto expression = compileExpression(statement->expression.get(), statement);
+		const Ast::Binding& binding = statement->identifier->binding;
+		uint32_t index = binding.index;
+
+		if (binding.kind == Ast::Binding::Kind::Global) {
+			return [expression, index](Runtime& runtime, Frame& frame, Value& result) -> Completion {
+				runtime.globals[index] = expression(runtime, frame);
+				result = Value();
+				return Completion::Normal;
+			};
+		}
+		else if (binding.boxed) {
+			return [expression, index](Runtime& runtime, Frame& frame, Value& result) -> Completion {
+				Value value = expression(runtime, frame);
+				unbox(frame.slots[index]) = value;
+				result = Value();
+				return Completion::Normal;
+			};
+		}
+		else {
+			return [expression, index](Runtime& runtime, Frame& frame, Value& result) -> Completion {
+				frame.slots[index] = expression(runtime, frame);
+				result = Value();
+				return Completion::Normal;
+			};
+		}
+	}
+
+	Compiled::Statement Compiler::compileIfStatement(const Ast::IfStatement* statement, bool tail)
+	{
+		auto condition = compileExpression(statement->condition.get(), statement);
+
+		if (!statement->consequence) {
+			compileExpression(nullptr, statement);
+		}
+
+		auto consequence = compileStatement(statement->consequence.get(), tail);
+
+		if (!statement->alternative) {
+			return [condition, consequence](Runtime& runtime, Frame& frame, Value& result) -> Completion {
+				runtime.budget.tick();
+
+				if (condition(runtime, frame).isTruthy()) {
+					return consequence(runtime, frame, result);
+				}
+
+				result = Value();
+				return Completion::Normal;
+			};
+		}
+
+		auto alternative = compileStatement(statement->alternative.get(), tail);
+
+		return [condition, consequence, alternative](Runtime& runtime, Frame& frame, Value& result) -> Completion {
+			runtime.budget.tick();
+
+			if (condition(runtime, frame).isTruthy()) {
+				return consequence(runtime, frame, result);
+			}
+			else {
+				return alternative(runtime, frame, result);
+			}
+		};
+	}
+
+	/*
+	* Compiles an expression.
+	* @param parent the node which owns the expression, used for error reporting if the parser left the expression empty.
+	*/
+	Compiled::Expression Compiler::compileExpression(const Ast::Expression* expression, const Ast::Node* parent)
+	{
+		if (!expression) {
+			std::ostringstream error;
+			error << "Incomplete expression at " << parent->token->lineNum << ", " << parent->token->colNum << '.';
+
+			throw CompileError(error.str());
+		}
+
+		program->nodeCount += 1;
+
+		switch (expression->kind) {
+		case Ast::Node::Kind::Identifier:
+			return compileIdentifier(static_cast<const Ast::Identifier*>(expression));
+
+		case Ast::Node::Kind::IntegerLiteral: {
+			Value value = Value::fromInteger(static_cast<const Ast::IntegerLiteral*>(expression)->value);
+			return [value](Runtime&, Frame&) -> Value { return value; };
+		}
+
+		case Ast::Node::Kind::BooleanLiteral: {
+			Value value = Value::fromBoolean(expression->token->type == Token::Type::True);
+			return [value](Runtime&, Frame&) -> Value { return value; };
+		}
+
+		case Ast::Node::Kind::PrefixExpression:
+			return compilePrefixExpression(static_cast<const Ast::PrefixExpression*>(expression));
+
+		case Ast::Node::Kind::InfixExpression:
+			return compileInfixExpression(static_cast<const Ast::InfixExpression*>(expression));
+
+		case Ast::Node::Kind::CallExpression:
+			return compileCallExpression(static_cast<const Ast::CallExpression*>(expression));
+
+		case Ast::Node::Kind::FunctionLiteral:
+			return compileFunctionLiteral(static_cast<const Ast::FunctionLiteral*>(expression));
+
+		default: {
+			std::ostringstream error;
+			error << "Statement used as an expression at " << expression->token->lineNum << ", " << expression->token->colNum << '.';
+
+			throw CompileError(error.str());
+		}
+		}
+	}
+
+	Compiled::Expression Compiler::compileIdentifier(const Ast::Identifier* identifier)
+	{
+		const Ast::Binding& binding = identifier->binding;
+		uint32_t index = binding.index;
+
+		if (binding.kind == Ast::Binding::Kind::Unresolved) {
+			std::ostringstream error;
+			error << "Unresolved identifier " << identifier->token->literal << " at " << identifier->token->lineNum << ", " << identifier->token->colNum << '.';
+
+			throw CompileError(error.str());
+		}
+
+		if (binding.kind == Ast::Binding::Kind::Global) {
+			return [index](Runtime& runtime, Frame&) -> Value { return runtime.globals[index]; };
+		}
+
+		if (binding.kind == Ast::Binding::Kind::Local) {
+			if (binding.boxed) {
+				return [index](Runtime&, Frame& frame) -> Value { return unbox(frame.slots[index]); };
+			}
+
+			return [index](Runtime&, Frame& frame) -> Value { return frame.slots[index]; };
+		}
+
+		if (binding.boxed) {
+			return [index](Runtime&, Frame& frame) -> Value { return unbox(frame.closure->captures[index]); };
+		}
+
+		return [index](Runtime&, Frame& frame) -> Value { return frame.closure->captures[index]; };
+	}
+
+	Compiled::Expression Compiler::compilePrefixExpression(const Ast::PrefixExpression* expression)
+	{
+		auto right = compileExpression(expression->rightExpression.get(), expression);
+
+		if (expression->token->type == Token::Type::Negate) {
+			return [right](Runtime& runtime, Frame& frame) -> Value { return Operators::negate(right(runtime, frame)); };
+		}
+		else {
+			return [right](Runtime& runtime, Frame& frame) -> Value { return Operators::minus(right(runtime, frame)); };
+		}
+	}
+
+	Compiled::Expression Compiler::compileInfixExpression(const Ast::InfixExpression* expression)
+	{
+		auto left = compileExpression(expression->left.get(), expression);
+		auto right = compileExpression(expression->right.get(), expression);
+		const auto* rightExpression = expression->right.get();
+
+		if (expression->operandType == Ast::OperandType::Integer) {
+			return compileIntegerExpression(expression->token->type, std::move(left), std::move(right), rightExpression);
+		}
+
+		if (expression->operandType == Ast::OperandType::Boolean) {
+			if (expression->token->type == Token::Type::Equal) {
+				return makeBinary<Operators::equalBooleans>(std::move(left), std::move(right));
+			}
+
+			return makeBinary<Operators::notEqualBooleans>(std::move(left), std::move(right));
+		}
+
+		switch (expression->token->type) {
+		case Token::Type::Plus:
+			return makeBinary<Operators::add>(std::move(left), std::move(right), rightExpression);
+		case Token::Type::Minus:
+			return makeBinary<Operators::subtract>(std::move(left), std::move(right), rightExpression);
+		case Token::Type::Multiply:
+			return makeBinary<Operators::multiply>(std::move(left), std::move(right), rightExpression);
+		case Token::Type::Divide:
+			return makeBinary<Operators::divide>(std::move(left), std::move(right), rightExpression);
+		case Token::Type::LessThan:
+			return makeBinary<Operators::lessThan>(std::move(left), std::move(right), rightExpression);
+		case Token::Type::GreaterThan:
+			return makeBinary<Operators::greaterThan>(std::move(left), std::move(right), rightExpression);
+		case Token::Type::Equal:
+			return makeRootedBinary<Operators::equal>(std::move(left), std::move(right), rightExpression);
+		default:
+			return makeRootedBinary<Operators::notEqual>(std::move(left), std::move(right), rightExpression);
+		}
+	}
+
+	/*
+	* Operators whose operands TypeInference proved are integers skip the type checks.  Integers never need rooting.
+	*/
+	Compiled::Expression Compiler::compileIntegerExpression(Token::Type op, Compiled::Expression left, Compiled::Expression right, const Ast::Expression* rightExpression)
+	{
+		switch (op) {
+		case Token::Type::Plus:
+			return makeBinary<Operators::addIntegers>(std::move(left), std::move(right), rightExpression);
+		case Token::Type::Minus:
+			return makeBinary<Operators::subtractIntegers>(std::move(left), std::move(right), rightExpression);
+		case Token::Type::Multiply:
+			return makeBinary<Operators::multiplyIntegers>(std::move(left), std::move(right), rightExpression);
+		case Token::Type::Divide:
+			return makeBinary<Operators::divideIntegers>(std::move(left), std::move(right), rightExpression);
+		case Token::Type::LessThan:
+			return makeBinary<Operators::lessThanIntegers>(std::move(left), std::move(right), rightExpression);
+		case Token::Type::GreaterThan:
+			return makeBinary<Operators::greaterThanIntegers>(std::move(left), std::move(right), rightExpression);
+		case Token::Type::Equal:
+			return makeBinary<Operators::equalIntegers>(std::move(left), std::move(right), rightExpression);
+		default:
+			return makeBinary<Operators::notEqualIntegers>(std::move(left), std::move(right), rightExpression);
+		}
+	}
+
+	/*
+	* Calls are the only place where the compiled code checks types and argument counts, since the callee is not known
+	* until runtime.  Each call site has an inline cache so that only the first call to a given function is validated.
+	*/
+	Compiled::Expression Compiler::compileCallExpression(const Ast::CallExpression* expression)
+	{
+		auto callee = compileExpression(expression->function.get(), expression);
+
+		std::vector<Compiled::Expression> arguments;
+		for (auto& argument : expression->arguments) {
+			arguments.push_back(compileExpression(argument.get(), expression));
+		}
+
+		uint32_t site = static_cast<uint32_t>(program->callSiteCount++);
+
+		return [callee, arguments, site](Runtime& runtime, Frame& frame) -> Value {
+			Value function = callee(runtime, frame);
+			auto* closure = checkCallee(function, arguments.size(), &runtime.callSites[site]);
+
+			if (!closure) {
+				return callHost(runtime, frame, function.host, arguments);
+			}
+
+			// The frame is pushed before the arguments are evaluated so that calls made by the arguments use the stack above
+			// it.  The closure being called is kept in the slot below the frame so that the collector can see it.
+			Value* base = runtime.pushFrame(closure->prototype->slotCount + 1);
+			base[0] = function;
+
+			for (size_t i = 0; i < arguments.size(); ++i) {
+				base[i + 1] = arguments[i](runtime, frame);
+			}
+
+			if (runtime.callDepth >= Runtime::maxCallDepth) {
+				throw RuntimeError("Maximum call depth exceeded.");
+			}
+
+			if (closure->prototype->memo != Compiled::FunctionPrototype::notMemoized && runtime.memos.isEnabled()) {
+				return callMemoized(runtime, base, closure);
+			}
+
+			runtime.callDepth += 1;
+			Value result = runFrame(runtime, base, closure);
+			runtime.callDepth -= 1;
+			runtime.stackTop = base;
+
+			return result;
+		};
+	}
+
+	/*
+	* A tail call evaluates the callee and arguments onto the top of the stack and hands them back to runFrame, which
+	* replaces the current frame with the callee's instead of nesting a new one.
+	*/
+	Compiled::Statement Compiler::compileTailCall(const Ast::CallExpression* expression)
+	{
+		auto callee = compileExpression(expression->function.get(), expression);
+
+		std::vector<Compiled::Expression> arguments;
+		for (auto& argument : expression->arguments) {
+			arguments.push_back(compileExpression(argument.get(), expression));
+		}
+
+		uint32_t site = static_cast<uint32_t>(program->callSiteCount++);
+
+		return [callee, arguments, site](Runtime& runtime, Frame& frame, Value& result) -> Completion {
+			Value function = callee(runtime, frame);
+
+			// host functions do not use the script's stack, so there is nothing to gain from a tail call
+			if (!checkCallee(function, arguments.size(), &runtime.callSites[site])) {
+				result = callHost(runtime, frame, function.host, arguments);
+				return Completion::Return;
+			}
+
+			Value* pending = runtime.pushFrame(arguments.size() + 1);
+			pending[0] = function;
+
+			for (size_t i = 0; i < arguments.size(); ++i) {
+				pending[i + 1] = arguments[i](runtime, frame);
+			}
+
+			runtime.tailCall = pending;
+			return Completion::TailCall;
+		};
+	}
+
+	/*
+	* Compiles the body of a function into a prototype.  Evaluating the literal creates a closure which copies the
+	* values it captures out of the current frame and closure.
+	*/
+	Compiled::Expression Compiler::compileFunctionLiteral(const Ast::FunctionLiteral* function)
+	{
+		if (!function->body) {
+			compileExpression(nullptr, function);
+		}
+
+		auto prototype = std::make_unique<Compiled::FunctionPrototype>();
+		prototype->parameterCount = function->parameters.size();
+		prototype->slotCount = function->slotCount;
+		prototype->boxedSlots = function->boxedSlots;
+		prototype->parameterTypes = function->parameterTypes;
+
+		if (function->pure && function->parameters.size() <= MemoCache::maxArguments) {
+			std::string name = functionName;
+
+			if (name.empty()) {
+				std::ostringstream location;
+				location << "function at " << function->token->lineNum << ", " << function->token->colNum;
+				name = location.str();
+			}
+
+			prototype->memo = static_cast<uint32_t>(program->memoizedFunctions.size());
+			program->memoizedFunctions.emplace_back(name, function->parameters.size());
+		}
+
+		functionName.clear();
+		bool wasInFunction = inFunction;
+		inFunction = true;
+		prototype->body = compileStatements(function->body->statements, true);
+		inFunction = wasInFunction;
+
+		const auto* result = prototype.get();
+		program->prototypes.push_back(std::move(prototype));
+
+		if (function->captures.empty()) {
+			return [result](Runtime& runtime, Frame&) -> Value {
+				return Value::fromFunction(runtime.heap.allocate<Compiled::Closure>(result));
+			};
+		}
+
+		std::vector<Ast::Capture> captures = function->captures;
+
+		return [result, captures](Runtime& runtime, Frame& frame) -> Value {
+			auto* closure = runtime.heap.allocate<Compiled::Closure>(result);
+			closure->captures.reserve(captures.size());
+
+			for (const auto& capture : captures) {
+				switch (capture.source) {
+				case Ast::Capture::Source::Local:
+					closure->captures.push_back(frame.slots[capture.index]);
+					break;
+				case Ast::Capture::Source::Capture:
+					closure->captures.push_back(frame.closure->captures[capture.index]);
+					break;
+				case Ast::Capture::Source::Self:
+					closure->captures.push_back(Value::fromFunction(closure));
+					break;
+				}
+			}
+
+			return Value::fromFunction(closure);
+		};
+	}
+}
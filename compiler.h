@@ -0,0 +1,278 @@
+#pragma once
+
+#include "ast.h"
+#include "budget.h"
+#include "heap.h"
+#include "host.h"
+#include "memo.h"
+#include "value.h"
+#include "resolver.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Delve::Script {
+
+template <typename Signature>
+class ScriptFunction;
+
+namespace Compiled {
+	struct Closure;
+	struct FunctionPrototype;
+
+	// Inline cache for a call site.  Records the function last called from the site, which is known to accept the
+	// site's argument count, so that calling it again needs no validation.
+	struct CallSite
+	{
+		const FunctionPrototype* prototype = nullptr;
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+	};
+}
+
+/*
+* The local variables of a single function call.  Slots are assigned to names at compile time and live in a window of
+* the runtime's value stack, values from enclosing functions are reached through the closure being called.
+*/
+struct Frame
+{
+	Value* slots;
+	const Compiled::Closure* closure;
+};
+
+/*
+* Mutable state used while running a compiled program.
+*/
+struct Runtime
+{
+	Heap heap;
+	std::vector<Value> globals;
+
+	// indexed by the call site numbers assigned by the compiler
+	std::vector<Compiled::CallSite> callSites;
+
+	// results of calls to pure functions, indexed by the memo numbers assigned by the compiler
+	MemoCache memos;
+
+	// frames are pushed and popped in call order so their slots are allocated from a single contiguous stack
+	std::vector<Value> stack;
+	Value* stackTop = nullptr;
+	uint32_t callDepth = 0;
+
+	// the callee followed by the arguments of a pending tail call
+	Value* tailCall = nullptr;
+
+	static constexpr uint32_t maxCallDepth = 4096;
+	static constexpr size_t stackSize = 1 << 16;
+
+	Budget budget;
+
+	// reserves null initialized slots on top of the stack
+	inline Value* pushFrame(size_t slotCount)
+	{
+		if (static_cast<size_t>(stack.data() + stack.size() - stackTop) < slotCount) {
+			throw RuntimeError("Stack overflow.");
+		}
+
+		Value* slots = stackTop;
+		stackTop += slotCount;
+		std::fill(slots, stackTop, Value());
+
+		return slots;
+	}
+
+	// the globals and everything on the stack are the roots of the heap
+	void markRoots(Heap& heap);
+};
+
+namespace Compiled {
+	enum class Completion
+	{
+		Normal,
+		Return,
+
+		// the statement was a call in tail position, the callee and arguments are waiting on top of the stack
+		TailCall
+	};
+
+	// A compiled expression computes a value in the context of the frame it is executed in.
+	using Expression = std::function<Value(Runtime&, Frame&)>;
+
+	// A compiled statement stores its value in the result parameter and reports whether it executed a return.
+	using Statement = std::function<Completion(Runtime&, Frame&, Value&)>;
+
+	struct FunctionPrototype
+	{
+		size_t parameterCount = 0;
+		size_t slotCount = 0;
+		std::vector<uint32_t> boxedSlots;
+
+		// the Ast::TypeSet of each parameter which calls from the host are checked against, empty if not inferred
+		std::vector<uint8_t> parameterTypes;
+
+		// the function's table in the runtime's MemoCache, or notMemoized if the function is not pure
+		static constexpr uint32_t notMemoized = UINT32_MAX;
+		uint32_t memo = notMemoized;
+
+		Statement body;
+	};
+
+	// A function value.  Holds a copy of every variable from enclosing functions which the function refers to.
+	struct Closure : public Object
+	{
+		Closure(const FunctionPrototype* p) : prototype(p) {}
+
+		const FunctionPrototype* prototype;
+		std::vector<Value> captures;
+
+		void trace(Heap& heap) override;
+	};
+}
+
+/*
+* A program lowered to a tree of pre-bound closures.  Each closure has its children, operator and variable locations
+* fixed at compile time so running the program performs no token switching, name lookup or virtual node dispatch.
+*
+* A compiled program is never changed once it has been compiled.  Everything which changes while it runs, including
+* the inline caches of its call sites, belongs to the Isolate running it, so one program may be shared by any number
+* of isolates on any number of threads.
+*/
+class CompiledProgram
+{
+public:
+	inline const Compiled::FunctionPrototype* getMain() const { return main; }
+	inline size_t getGlobalCount() const { return globalCount; }
+	inline size_t getCallSiteCount() const { return callSiteCount; }
+	inline const Host* getHost() const { return host; }
+
+	// the names and parameter counts of the functions whose calls may be memoized, in memo number order
+	inline const std::vector<std::pair<std::string, size_t>>& getMemoizedFunctions() const { return memoizedFunctions; }
+
+	// returns the index of a global, or getGlobalCount() if the program has no global of that name
+	size_t findGlobal(const std::string& name) const;
+
+	size_t getMemoryUsage() const;
+
+private:
+	friend class Compiler;
+
+	std::vector<std::unique_ptr<Compiled::FunctionPrototype>> prototypes;
+	const Compiled::FunctionPrototype* main = nullptr;
+	size_t globalCount = 0;
+	size_t callSiteCount = 0;
+	size_t nodeCount = 0;
+	std::vector<std::string> globalNames;
+	std::vector<std::pair<std::string, size_t>> memoizedFunctions;
+	const Host* host = nullptr;
+};
+
+/*
+* An independent instance of a compiled program, with its own globals, heap, stack and inline caches.  Isolates share
+* nothing mutable, so isolates of the same program can run concurrently on different threads without synchronizing.
+* A single isolate may only be used by one thread at a time.
+*/
+class Isolate
+{
+public:
+	using ErrorList = std::vector<std::string>;
+
+public:
+	struct CallStatistics
+	{
+		size_t callSites = 0;
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+	};
+
+public:
+	Isolate(std::shared_ptr<const CompiledProgram> program);
+
+	Isolate(const Isolate&) = delete;
+	Isolate& operator=(const Isolate&) = delete;
+
+public:
+	Value run();
+	Value call(const Value& function, const Value* arguments, size_t argumentCount);
+	Value getGlobal(const std::string& name) const;
+
+	inline void setLimits(const ExecutionLimits& executionLimits) { limits = executionLimits; }
+	inline uint64_t getFuelUsed() const { return runtime.budget.used(); }
+
+	CallStatistics getCallStatistics() const;
+
+	inline const CompiledProgram& getProgram() const { return *program; }
+	inline Heap& getHeap() { return runtime.heap; }
+	inline const Heap& getHeap() const { return runtime.heap; }
+	inline MemoCache& getMemoCache() { return runtime.memos; }
+	inline const MemoCache& getMemoCache() const { return runtime.memos; }
+	inline const ErrorList& getErrors() const { return errors; }
+
+private:
+	template <typename Signature>
+	friend class ScriptFunction;
+
+	std::shared_ptr<const CompiledProgram> program;
+
+	ExecutionLimits limits;
+	Runtime runtime;
+	ErrorList errors;
+
+	// true while a run or a call is executing, so that calls made from host functions join it
+	bool running = false;
+};
+
+class Compiler
+{
+public:
+	using ErrorList = std::vector<std::string>;
+
+public:
+	Compiler();
+	Compiler(Ast::Program* program, const Host* host = nullptr);
+
+public:
+	void compile(Ast::Program* program, const Host* host = nullptr);
+	void clear();
+
+	inline std::shared_ptr<const CompiledProgram> getProgram() const { return program; }
+	inline const ErrorList& getErrors() const { return errors; }
+
+private:
+	class CompileError : public std::runtime_error {
+	public:
+		CompileError(const std::string& desc) : std::runtime_error(desc) {}
+	};
+
+	Compiled::Statement compileStatements(const std::vector<std::unique_ptr<Ast::Statement>>& statements, bool tail);
+	Compiled::Statement compileStatement(const Ast::Statement* statement, bool tail);
+	Compiled::Statement compileLetStatement(const Ast::LetStatement* statement);
+	Compiled::Statement compileIfStatement(const Ast::IfStatement* statement, bool tail);
+	Compiled::Statement compileTailCall(const Ast::CallExpression* expression);
+
+	Compiled::Expression compileExpression(const Ast::Expression* expression, const Ast::Node* parent);
+	Compiled::Expression compileIdentifier(const Ast::Identifier* identifier);
+	Compiled::Expression compilePrefixExpression(const Ast::PrefixExpression* expression);
+	Compiled::Expression compileInfixExpression(const Ast::InfixExpression* expression);
+	Compiled::Expression compileIntegerExpression(Token::Type op, Compiled::Expression left, Compiled::Expression right, const Ast::Expression* rightExpression);
+	Compiled::Expression compileCallExpression(const Ast::CallExpression* expression);
+	Compiled::Expression compileFunctionLiteral(const Ast::FunctionLiteral* function);
+
+private:
+	Resolver resolver;
+
+	// tail calls are only possible inside a function body
+	bool inFunction = false;
+
+	// the name a let statement is binding the function literal being compiled to
+	std::string functionName;
+
+	std::shared_ptr<CompiledProgram> program;
+	ErrorList errors;
+};
+
+}
@@ -0,0 +1,451 @@
+#include "compiler.h"
+#include "script_function.h"
+#include "parser.h"
+#include "lexer.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Delve::Script;
+
+TEST(Compiler, EmptyProgram)
+{
+	Compiler compiler;
+	compiler.compile(nullptr);
+
+	ASSERT_EQ(compiler.getProgram(), nullptr);
+	ASSERT_EQ(compiler.getErrors().size(), 0);
+}
+
+TEST(Compiler, BasicProgram)
+{
+	std::string code = "let x = 5; let y = 7; x * y;";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+	Compiler compiler(parser.getProgram());
+
+	ASSERT_EQ(compiler.getErrors().size(), 0);
+
+	ASSERT_NE(compiler.getProgram(), nullptr);
+
+	Isolate isolate(compiler.getProgram());
+	Value result = isolate.run();
+	ASSERT_EQ(result.type, Value::Type::Integer);
+	ASSERT_EQ(result.integer, 35);
+}
+
+/*
+* Tests that names which are never declared are reported at compile time, in the order they are first used.
+*/
+TEST(Compiler, UndefinedIdentifiers)
+{
+	std::string code = "let x = 5;\nlet f = function(a) { a + b; };\nc;";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+	Compiler compiler(parser.getProgram());
+
+	ASSERT_EQ(compiler.getProgram(), nullptr);
+
+	const auto& errors = compiler.getErrors();
+	ASSERT_EQ(errors.size(), 2);
+	EXPECT_EQ(errors[0], "Undefined identifier b at 2, 27.");
+	EXPECT_EQ(errors[1], "Undefined identifier c at 3, 1.");
+}
+
+/*
+* Tests that a block scoped name is not visible once its block has ended.
+*/
+TEST(Compiler, BlockScope)
+{
+	std::string code = "{ let x = 5; } x;";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+	Compiler compiler(parser.getProgram());
+
+	ASSERT_EQ(compiler.getProgram(), nullptr);
+	ASSERT_EQ(compiler.getErrors().size(), 1);
+}
+
+/*
+* Tests that a node which is missing a child is reported rather than compiled.
+*/
+TEST(Compiler, IncompleteExpression)
+{
+	Token integer(Token::Type::Integer, "5");
+	Token plus(Token::Type::Plus, "+");
+
+	auto* infixExpression = new Ast::InfixExpression(&plus);
+	auto* integerLiteral = new Ast::IntegerLiteral(&integer);
+	integerLiteral->value = 5;
+	infixExpression->left.reset(integerLiteral);
+
+	auto* expressionStatement = new Ast::ExpressionStatement(&integer);
+	expressionStatement->expression.reset(infixExpression);
+
+	Ast::Program ast;
+	ast.statements.emplace_back(expressionStatement);
+
+	Compiler compiler(&ast);
+
+	ASSERT_EQ(compiler.getProgram(), nullptr);
+	ASSERT_EQ(compiler.getErrors().size(), 1);
+	EXPECT_NE(compiler.getErrors()[0].find("Incomplete expression"), std::string::npos);
+}
+
+// helper function that compiles and runs each input and compares the string representation of the result to the expected output
+void compileAndCompareResults(const std::vector<std::string>& inputs, const std::vector<std::string>& expectedOutput);
+
+/*
+* Tests that calls in tail position reuse the caller's frame, so tail recursion is not limited by the call depth.
+*/
+TEST(Compiler, TailCalls)
+{
+	std::vector<std::string> inputs = {
+		"let count = function(n) { if (n == 0) { return 0; } count(n - 1); }; count(10000000);",
+		"let sum = function(n, total) { if (n == 0) { return total; } return sum(n - 1, total + n); }; sum(10000000, 0);",
+		"let even = function(n) { if (n == 0) { true; } else { odd(n - 1); } }; let odd = function(n) { if (n == 0) { false; } else { even(n - 1); } }; even(10000001);",
+		"let f = function(n) { let step = function(i, total) { if (i > n) { return total; } { step(i + 1, total + i); } }; step(1, 0); }; f(10000000);",
+		"let g = function(n) { let x = n; let h = function() { x; }; let x = n + 1; if (n == 0) { return h(); } g(n - 1); }; g(10000000);"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"0", "50000005000000", "false", "50000005000000", "1"
+	};
+
+	compileAndCompareResults(inputs, expectedOutput);
+}
+
+/*
+* Tests that calls which are not in tail position still count towards the call depth, and that tail calls report the
+* same errors as other calls.
+*/
+TEST(Compiler, TailCallErrors)
+{
+	std::vector<std::string> inputs = {
+		"let count = function(n) { if (n == 0) { return 0; } 1 + count(n - 1); }; count(10000);",
+		"let f = function(n) { return n(1); }; f(2);",
+		"let f = function(n) { let g = function(a, b) { a; }; g(n); }; f(1);"
+	};
+
+	std::vector<std::string> expectedErrors = {
+		"Maximum call depth exceeded.",
+		"Attempted to call a value of type int.",
+		"Expected 2 arguments but got 1."
+	};
+
+	for (size_t i = 0; i < inputs.size(); i++) {
+		Lexer lexer(inputs[i]);
+		Parser parser(lexer.tokens());
+		Compiler compiler(parser.getProgram());
+
+		ASSERT_EQ(compiler.getErrors().size(), 0) << inputs[i];
+
+		Isolate isolate(compiler.getProgram());
+		Value result = isolate.run();
+
+		EXPECT_EQ(result.type, Value::Type::Null) << inputs[i];
+		ASSERT_EQ(isolate.getErrors().size(), 1) << inputs[i];
+		EXPECT_EQ(isolate.getErrors()[0], expectedErrors[i]) << inputs[i];
+	}
+}
+
+/*
+* Tests that each call site validates a function the first time it is called from there and that calls to a different
+* function miss the cache.
+*/
+TEST(Compiler, CallSiteCaches)
+{
+	std::string code =
+		"let count = function(n) { if (n == 0) { return 0; } 1 + count(n - 1); };"
+		"let apply = function(f, n) { f(n); };"
+		"count(10) + apply(count, 5) + apply(function(n) { n; }, 1) + apply(count, 1);";
+
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+	Compiler compiler(parser.getProgram());
+
+	ASSERT_NE(compiler.getProgram(), nullptr);
+
+	Isolate isolate(compiler.getProgram());
+	Value result = isolate.run();
+	ASSERT_EQ(isolate.getErrors().size(), 0);
+	EXPECT_EQ(result.integer, 17);
+
+	// count's recursive call, f(n) and the top level calls to count and apply
+	auto statistics = isolate.getCallStatistics();
+	EXPECT_EQ(statistics.callSites, 6);
+
+	// count makes 10 + 5 + 1 recursive calls, the first misses.  f(n) calls count, the literal, then count again.
+	// The four top level call sites are each used once.
+	EXPECT_EQ(statistics.misses, 1 + 3 + 4);
+	EXPECT_EQ(statistics.hits, 15);
+
+	// caches survive between runs, only f(n) switching between functions misses
+	isolate.run();
+	statistics = isolate.getCallStatistics();
+	EXPECT_EQ(statistics.misses, 8 + 2);
+	EXPECT_EQ(statistics.hits, 15 + 16 + 1 + 4);
+
+	// each isolate has its own caches
+	Isolate other(compiler.getProgram());
+	other.run();
+	EXPECT_EQ(other.getCallStatistics().misses, 8);
+}
+
+/*
+* Tests that runs are metered one tick per function entry and branch, and stopped once they try to use more fuel
+* than they were given.
+*/
+TEST(Compiler, FuelLimit)
+{
+	std::string code = "let count = function(n) { if (n == 0) { return 0; } count(n - 1); }; count(10);";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+	Compiler compiler(parser.getProgram());
+	Isolate isolate(compiler.getProgram());
+
+	isolate.run();
+	ASSERT_EQ(isolate.getErrors().size(), 0);
+	EXPECT_EQ(isolate.getFuelUsed(), 22);
+
+	ExecutionLimits limits;
+	limits.fuel = 22;
+	isolate.setLimits(limits);
+	isolate.run();
+	EXPECT_EQ(isolate.getErrors().size(), 0);
+
+	limits.fuel = 21;
+	isolate.setLimits(limits);
+	Value result = isolate.run();
+	EXPECT_EQ(result.type, Value::Type::Null);
+	ASSERT_EQ(isolate.getErrors().size(), 1);
+	EXPECT_EQ(isolate.getErrors()[0], "Fuel exhausted.");
+
+	// nothing is left over from the stopped run
+	limits.fuel = 0;
+	isolate.setLimits(limits);
+	result = isolate.run();
+	EXPECT_EQ(isolate.getErrors().size(), 0);
+	EXPECT_EQ(result.integer, 0);
+}
+
+/*
+* Tests that runaway scripts are stopped by their limits.
+*/
+TEST(Compiler, RunawayScripts)
+{
+	std::string code = "let spin = function(n) { if (n < 0) { return n; } spin(n + 1); }; spin(0);";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+	Compiler compiler(parser.getProgram());
+	Isolate isolate(compiler.getProgram());
+
+	ExecutionLimits limits;
+	limits.fuel = 1000000;
+	isolate.setLimits(limits);
+	isolate.run();
+	ASSERT_EQ(isolate.getErrors().size(), 1);
+	EXPECT_EQ(isolate.getErrors()[0], "Fuel exhausted.");
+	EXPECT_EQ(isolate.getFuelUsed(), 1000001);
+
+	limits.fuel = 0;
+	limits.timeout = std::chrono::milliseconds(20);
+	isolate.setLimits(limits);
+
+	auto start = std::chrono::steady_clock::now();
+	isolate.run();
+	auto elapsed = std::chrono::steady_clock::now() - start;
+
+	ASSERT_EQ(isolate.getErrors().size(), 1);
+	EXPECT_EQ(isolate.getErrors()[0], "Deadline exceeded.");
+	EXPECT_GE(elapsed, std::chrono::milliseconds(20));
+	EXPECT_LT(elapsed, std::chrono::milliseconds(500));
+}
+
+/*
+* Tests that isolates of one compiled program run concurrently without seeing each other's globals or heap objects.
+*/
+TEST(Compiler, Isolates)
+{
+	thread_local int64_t seed = 0;
+
+	Host host;
+	host.define("seed", 0, [](const Value*, size_t) { return Value::fromInteger(seed); });
+
+	std::string code =
+		"let base = seed();"
+		"let adder = function(x) { function(y) { x + y; }; };"
+		"let count = function(n) { if (n == 0) { return base; } 1 + adder(0)(count(n - 1)); };"
+		"count(100);";
+
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+	Compiler compiler(parser.getProgram(), &host);
+	ASSERT_NE(compiler.getProgram(), nullptr);
+
+	const int threadCount = 4;
+	std::vector<std::thread> threads;
+	std::vector<int> failures(threadCount, 0);
+
+	for (int i = 0; i < threadCount; ++i) {
+		threads.emplace_back([&, i]() {
+			seed = i * 1000;
+
+			Heap::Settings settings;
+			settings.initialThreshold = 1024;
+
+			Isolate isolate(compiler.getProgram());
+			isolate.getHeap().configure(settings);
+
+			for (int run = 0; run < 200; ++run) {
+				Value result = isolate.run();
+
+				if (!isolate.getErrors().empty() || result.integer != seed + 100) {
+					failures[i] += 1;
+				}
+			}
+		});
+	}
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	for (int i = 0; i < threadCount; ++i) {
+		EXPECT_EQ(failures[i], 0) << "isolate " << i;
+	}
+}
+
+void compileAndCompareResults(const std::vector<std::string>& inputs, const std::vector<std::string>& expectedOutput)
+{
+	ASSERT_EQ(inputs.size(), expectedOutput.size());
+
+	for (size_t i = 0; i < inputs.size(); i++) {
+		Lexer lexer(inputs[i]);
+		Parser parser(lexer.tokens());
+		Compiler compiler(parser.getProgram());
+
+		ASSERT_EQ(compiler.getErrors().size(), 0) << inputs[i];
+
+		Isolate isolate(compiler.getProgram());
+		Value result = isolate.run();
+
+		ASSERT_EQ(isolate.getErrors().size(), 0) << inputs[i] << ": " << isolate.getErrors()[0];
+		EXPECT_EQ(result.toString(), expectedOutput[i]) << inputs[i];
+	}
+}
+
+/*
+* Tests calling script functions from C++ through typed handles once the program has run.
+*/
+TEST(Compiler, ScriptFunctions)
+{
+	int64_t events = 0;
+
+	Host host;
+	host.bind("record", [&events](int64_t count) { events += count; });
+
+	std::string code =
+		"let offset = 10;"
+		"let onEvent = function(x, negate) { record(1); if (negate) { return -x; } x + offset; };"
+		"let isPositive = function(x) { x > 0; };"
+		"let fib = function(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2); };"
+		"let spin = function(n) { spin(n + 1); };"
+		"let adder = function(x) { function(y) { x + y; }; };";
+
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+	Compiler compiler(parser.getProgram(), &host);
+	ASSERT_NE(compiler.getProgram(), nullptr);
+
+	Isolate isolate(compiler.getProgram());
+	isolate.run();
+	ASSERT_EQ(isolate.getErrors().size(), 0);
+
+	ScriptFunction<int64_t(int64_t, bool)> onEvent(isolate, "onEvent");
+	ASSERT_TRUE(onEvent.isValid());
+	EXPECT_EQ(onEvent(5, false), 15);
+	EXPECT_EQ(onEvent(5, true), -5);
+	EXPECT_EQ(events, 2);
+
+	ScriptFunction<bool(int64_t)> isPositive(isolate, "isPositive");
+	EXPECT_TRUE(isPositive(3));
+	EXPECT_FALSE(isPositive(-3));
+
+	ScriptFunction<int64_t(int64_t)> fib(isolate, "fib");
+	EXPECT_EQ(fib(20), 6765);
+
+	// functions returned to C++ stay valid until the next run
+	ScriptFunction<Value(int64_t)> adder(isolate, "adder");
+	Value addOne = adder(1);
+	Value argument = Value::fromInteger(41);
+	EXPECT_EQ(isolate.call(addOne, &argument, 1).integer, 42);
+
+	// handles are only valid for globals which hold functions taking the right number of arguments
+	EXPECT_FALSE((ScriptFunction<int64_t(int64_t)>(isolate, "onEvent").isValid()));
+	EXPECT_FALSE((ScriptFunction<int64_t()>(isolate, "offset").isValid()));
+	EXPECT_FALSE((ScriptFunction<int64_t()>(isolate, "missing").isValid()));
+
+	// results of the wrong type and runtime errors are reported through the isolate
+	ScriptFunction<bool(int64_t, bool)> wrongResult(isolate, "onEvent");
+	EXPECT_FALSE(wrongResult(1, false));
+	ASSERT_EQ(isolate.getErrors().size(), 1);
+	EXPECT_EQ(isolate.getErrors()[0], "Expected bool result from onEvent but got int.");
+
+	ExecutionLimits limits;
+	limits.fuel = 1000;
+	isolate.setLimits(limits);
+
+	ScriptFunction<int64_t(int64_t)> spin(isolate, "spin");
+	EXPECT_EQ(spin(0), 0);
+	ASSERT_EQ(isolate.getErrors().size(), 1);
+	EXPECT_EQ(isolate.getErrors()[0], "Fuel exhausted.");
+
+	// the isolate is still usable after a failed call
+	EXPECT_EQ(onEvent(1, false), 11);
+	EXPECT_EQ(isolate.getErrors().size(), 0);
+}
+
+/*
+* Tests that a host function can call back into the isolate which is running it.
+*/
+TEST(Compiler, ReentrantCalls)
+{
+	Isolate* current = nullptr;
+
+	Host host;
+	host.bind("twice", [&current](Value function, int64_t x) {
+		Value argument = Value::fromInteger(x);
+		argument = current->call(function, &argument, 1);
+		return current->call(function, &argument, 1);
+	});
+
+	std::string code = "let inc = function(x) { x + 1; }; twice(inc, 1) + twice(function(x) { x * 3; }, 2);";
+
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+	Compiler compiler(parser.getProgram(), &host);
+	ASSERT_NE(compiler.getProgram(), nullptr);
+
+	Isolate isolate(compiler.getProgram());
+	current = &isolate;
+
+	EXPECT_EQ(isolate.run().integer, 3 + 18);
+
+	// an error inside a nested call fails the whole run
+	code = "twice(function(x) { x / 0; }, 1);";
+	Lexer failingLexer(code);
+	Parser failingParser(failingLexer.tokens());
+	Compiler failingCompiler(failingParser.getProgram(), &host);
+
+	Isolate failing(failingCompiler.getProgram());
+	current = &failing;
+
+	EXPECT_EQ(failing.run().type, Value::Type::Null);
+	ASSERT_EQ(failing.getErrors().size(), 1);
+	EXPECT_EQ(failing.getErrors()[0], "Division by zero.");
+}
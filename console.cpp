@@ -1,8 +1,26 @@
 #include "console.h"
+#include "bytecode_file.h"
+#include "task.h"
+#include "trace.h"
 
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 
+namespace {
+	bool readFile(const std::string& path, std::string& contents)
+	{
+		std::ifstream in(path, std::ios::binary);
+		std::ostringstream buffer;
+		buffer << in.rdbuf();
+		contents = buffer.str();
+
+		return static_cast<bool>(in);
+	}
+}
+
 namespace Delve::Script {
 
 	void Console::runInteractive() {
@@ -32,4 +50,137 @@ namespace Delve::Script {
 			}
 		}
 	}
-}
\ No newline at end of file
+
+	/**
+	* Compiles script files to a bytecode file which run can load without parsing them.  Scripts are named by the paths
+	* given here, and must be run with the same paths.
+	* @param output the bytecode file to write
+	* @param paths the script files to compile
+	* @returns the process exit code
+	*/
+	int Console::compile(const std::string& output, const std::vector<std::string>& paths)
+	{
+		std::vector<BytecodeFile::Script> scripts;
+
+		for (const auto& path : paths) {
+			BytecodeFile::Script script;
+			script.name = path;
+
+			if (!readFile(path, script.source)) {
+				std::cerr << "Could not read " << path << '.' << std::endl;
+				return 1;
+			}
+
+			scripts.push_back(std::move(script));
+		}
+
+		BytecodeFile::ErrorList errors;
+
+		if (!BytecodeFile::write(output, scripts, nullptr, errors)) {
+			for (const auto& error : errors) {
+				std::cerr << error << std::endl;
+			}
+
+			return 1;
+		}
+
+		std::cout << "Compiled " << scripts.size() << " scripts to " << output << '.' << std::endl;
+		return 0;
+	}
+
+	/**
+	* Runs script files on the bytecode engine and prints their results.  Scripts are taken from the bytecode file when
+	* it holds an up to date copy and compiled from source otherwise.
+	* @param image a bytecode file written by compile, or empty to compile every script
+	* @param paths the script files to run
+	* @param trace a file to write Chrome trace events of each phase to, or empty
+	* @returns the process exit code
+	*/
+	int Console::run(const std::string& image, const std::vector<std::string>& paths, const std::string& trace)
+	{
+		TraceRecorder recorder;
+
+		if (!trace.empty()) {
+			if (!Instrumentation::enabled) {
+				std::cerr << "Built without instrumentation, the trace will only show whole scripts." << std::endl;
+			}
+
+			TraceRecorder::setActive(&recorder);
+		}
+
+		int exitCode = runScripts(image, paths);
+
+		if (!trace.empty()) {
+			TraceRecorder::setActive(nullptr);
+
+			if (!recorder.write(trace)) {
+				std::cerr << "Could not write " << trace << '.' << std::endl;
+				return 1;
+			}
+
+			std::cerr << "Wrote " << recorder.getEventCount() << " trace events to " << trace << '.' << std::endl;
+		}
+
+		return exitCode;
+	}
+
+	int Console::runScripts(const std::string& image, const std::vector<std::string>& paths)
+	{
+		auto start = std::chrono::steady_clock::now();
+		BytecodeFile file;
+
+		if (!image.empty() && !file.open(image)) {
+			for (const auto& error : file.getErrors()) {
+				std::cerr << error << " Compiling scripts from source." << std::endl;
+			}
+		}
+
+		std::vector<std::shared_ptr<const BytecodeProgram>> programs;
+
+		for (const auto& path : paths) {
+			std::string source;
+			BytecodeFile::ErrorList errors;
+
+			if (!readFile(path, source)) {
+				std::cerr << "Could not read " << path << '.' << std::endl;
+				return 1;
+			}
+
+			TraceRecorder::Span span("load script", "console", 0, path);
+			programs.push_back(file.load(path, source, nullptr, &errors));
+
+			for (const auto& error : errors) {
+				std::cerr << path << ": " << error << std::endl;
+			}
+		}
+
+		auto loaded = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		std::cerr << "Loaded " << paths.size() << " scripts in " << loaded.count() << " us." << std::endl;
+
+		int exitCode = 0;
+
+		for (size_t i = 0; i < paths.size(); ++i) {
+			if (!programs[i]) {
+				exitCode = 1;
+				continue;
+			}
+
+			Value result;
+			Task task(programs[i]);
+
+			{
+				TraceRecorder::Span span("run script", "console", 0, paths[i]);
+				result = task.runToCompletion();
+			}
+
+			for (const auto& error : task.getErrors()) {
+				std::cerr << paths[i] << ": " << error << std::endl;
+				exitCode = 1;
+			}
+
+			std::cout << paths[i] << ": " << result.toString() << std::endl;
+		}
+
+		return exitCode;
+	}
+}
@@ -2,11 +2,20 @@
 
 #include "lexer.h"
 
+#include <string>
+#include <vector>
+
 namespace Delve::Script {
 
 class Console {
 public:
 	void runInteractive();
+
+	int compile(const std::string& output, const std::vector<std::string>& paths);
+	int run(const std::string& image, const std::vector<std::string>& paths, const std::string& trace = std::string());
+
+private:
+	int runScripts(const std::string& image, const std::vector<std::string>& paths);
 };
 
-}
\ No newline at end of file
+} 
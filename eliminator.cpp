@@ -0,0 +1,477 @@
+#include "eliminator.h"
+#include "folder.h"
+#include "resolver.h"
+#include "trace.h"
+
+#include <algorithm>
+
+namespace Delve::Script {
+	DeadCodeEliminator::DeadCodeEliminator() : DeadCodeEliminator(Settings())
+	{
+	}
+
+	DeadCodeEliminator::DeadCodeEliminator(const Settings& eliminatorSettings) : settings(eliminatorSettings)
+	{
+	}
+
+	/**
+	* Removes dead code from the program in place.  Names which are used but never declared are treated as globals, so a
+	* program may be optimized before the host functions it calls are known.  Statistics are reset each time this method
+	* is called.
+	* @param ast the program to optimize
+	*/
+	void DeadCodeEliminator::eliminate(Ast::Program& ast)
+	{
+		DELVE_SCRIPT_TRACE("eliminate dead code", "optimize");
+
+		statistics = Statistics();
+		program = &ast;
+
+		size_t nodeCount = 0;
+		for (auto& statement : program->statements) {
+			nodeCount += ConstantFolder::countNodes(statement.get());
+		}
+
+		Resolver resolver;
+
+		do {
+			// undeclared names are left for the compiler to report
+			resolver.resolve(ast);
+
+			reads.clear();
+			scopes.assign(1, nullptr);
+
+			for (auto& statement : program->statements) {
+				countReads(statement.get());
+			}
+
+			removed = false;
+			removeStatements(program->statements, true, true);
+		} while (removed);
+
+		for (auto& statement : program->statements) {
+			nodeCount -= ConstantFolder::countNodes(statement.get());
+		}
+
+		statistics.nodesEliminated = static_cast<uint32_t>(nodeCount);
+		program = nullptr;
+	}
+
+	/*
+	* Counts the reads of every variable, apart from those by the function a variable is bound to.
+	*/
+	void DeadCodeEliminator::countReads(const Ast::Node* node)
+	{
+		if (!node) {
+			return;
+		}
+
+		switch (node->kind) {
+		case Ast::Node::Kind::Identifier: {
+			Variable variable;
+
+			if (findVariable(static_cast<const Ast::Identifier*>(node)->binding, variable) && std::find(defining.begin(), defining.end(), variable) == defining.end()) {
+				reads[variable] += 1;
+			}
+
+			break;
+		}
+
+		case Ast::Node::Kind::PrefixExpression:
+			countReads(static_cast<const Ast::PrefixExpression*>(node)->rightExpression.get());
+			break;
+
+		case Ast::Node::Kind::InfixExpression: {
+			auto* infixExpression = static_cast<const Ast::InfixExpression*>(node);
+			countReads(infixExpression->left.get());
+			countReads(infixExpression->right.get());
+			break;
+		}
+
+		case Ast::Node::Kind::CallExpression: {
+			auto* callExpression = static_cast<const Ast::CallExpression*>(node);
+			countReads(callExpression->function.get());
+
+			for (auto& argument : callExpression->arguments) {
+				countReads(argument.get());
+			}
+
+			break;
+		}
+
+		case Ast::Node::Kind::FunctionLiteral:
+			scopes.push_back(static_cast<const Ast::FunctionLiteral*>(node));
+			countReads(scopes.back()->body.get());
+			scopes.pop_back();
+			break;
+
+		case Ast::Node::Kind::LetStatement: {
+			auto* letStatement = static_cast<const Ast::LetStatement*>(node);
+			auto* expression = letStatement->expression.get();
+			Variable variable;
+
+			if (expression && expression->kind == Ast::Node::Kind::FunctionLiteral && findVariable(letStatement->identifier->binding, variable)) {
+				defining.push_back(variable);
+				countReads(expression);
+				defining.pop_back();
+			}
+			else {
+				countReads(expression);
+			}
+
+			break;
+		}
+
+		case Ast::Node::Kind::ReturnStatement:
+			countReads(static_cast<const Ast::ReturnStatement*>(node)->expression.get());
+			break;
+
+		case Ast::Node::Kind::ExpressionStatement:
+			countReads(static_cast<const Ast::ExpressionStatement*>(node)->expression.get());
+			break;
+
+		case Ast::Node::Kind::BlockStatement:
+			for (auto& statement : static_cast<const Ast::BlockStatement*>(node)->statements) {
+				countReads(statement.get());
+			}
+
+			break;
+
+		case Ast::Node::Kind::IfStatement: {
+			auto* ifStatement = static_cast<const Ast::IfStatement*>(node);
+			countReads(ifStatement->condition.get());
+			countReads(ifStatement->consequence.get());
+			countReads(ifStatement->alternative.get());
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	/*
+	* Finds the variable a binding in the innermost function refers to.
+	* @returns false for a function's reference to itself
+	*/
+	bool DeadCodeEliminator::findVariable(const Ast::Binding& binding, Variable& variable) const
+	{
+		switch (binding.kind) {
+		case Ast::Binding::Kind::Global:
+			variable = Variable(nullptr, binding.index);
+			return true;
+
+		case Ast::Binding::Kind::Local:
+			variable = Variable(scopes.back() ? static_cast<const void*>(scopes.back()) : program, binding.index);
+			return true;
+
+		case Ast::Binding::Kind::Capture:
+			return findCapture(scopes.size() - 1, binding.index, variable);
+
+		default:
+			return false;
+		}
+	}
+
+	// Follows a capture out through the enclosing functions to the variable it copies.
+	bool DeadCodeEliminator::findCapture(size_t depth, uint32_t index, Variable& variable) const
+	{
+		const Ast::Capture& capture = scopes[depth]->captures[index];
+
+		switch (capture.source) {
+		case Ast::Capture::Source::Local:
+			variable = Variable(scopes[depth - 1] ? static_cast<const void*>(scopes[depth - 1]) : program, capture.index);
+			return true;
+
+		case Ast::Capture::Source::Capture:
+			return findCapture(depth - 1, capture.index, variable);
+
+		default:
+			return false;
+		}
+	}
+
+	/*
+	* Removes the dead statements from a list and from within the statements which remain.
+	* @param valueUsed whether the value of the list may be used, in which case its last statement is kept
+	* @param topLevel whether the list is the outermost block of the program, where let statements declare globals
+	*/
+	void DeadCodeEliminator::removeStatements(std::vector<std::unique_ptr<Ast::Statement>>& statements, bool valueUsed, bool topLevel)
+	{
+		std::vector<std::unique_ptr<Ast::Statement>> kept;
+		bool reachable = true;
+
+		for (size_t i = 0; i < statements.size(); i++) {
+			auto& statement = statements[i];
+			bool last = i + 1 == statements.size();
+
+			if (!reachable) {
+				// a global is declared even if its let statement never runs, so one which is read elsewhere must stay
+				Variable variable;
+
+				if (topLevel && statement && statement->kind == Ast::Node::Kind::LetStatement &&
+					findVariable(static_cast<Ast::LetStatement*>(statement.get())->identifier->binding, variable) && reads.count(variable)) {
+					kept.push_back(std::move(statement));
+					continue;
+				}
+
+				statistics.unreachableStatements += 1;
+				statistics.functionsRemoved += countFunctions(statement.get());
+				removed = true;
+				continue;
+			}
+
+			if ((!last || !valueUsed) && isUnused(statement.get())) {
+				if (statement->kind == Ast::Node::Kind::LetStatement) {
+					statistics.unusedBindings += 1;
+				}
+				else {
+					statistics.unusedExpressions += 1;
+				}
+
+				statistics.functionsRemoved += countFunctions(statement.get());
+				removed = true;
+				continue;
+			}
+
+			removeFromStatement(statement.get(), valueUsed && last);
+			reachable = !returns(statement.get());
+			kept.push_back(std::move(statement));
+		}
+
+		statements = std::move(kept);
+	}
+
+	void DeadCodeEliminator::removeFromStatement(Ast::Statement* statement, bool valueUsed)
+	{
+		if (!statement) {
+			return;
+		}
+
+		switch (statement->kind) {
+		case Ast::Node::Kind::LetStatement:
+			removeFromExpression(static_cast<Ast::LetStatement*>(statement)->expression.get());
+			break;
+
+		case Ast::Node::Kind::ReturnStatement:
+			removeFromExpression(static_cast<Ast::ReturnStatement*>(statement)->expression.get());
+			break;
+
+		case Ast::Node::Kind::ExpressionStatement:
+			removeFromExpression(static_cast<Ast::ExpressionStatement*>(statement)->expression.get());
+			break;
+
+		case Ast::Node::Kind::BlockStatement:
+			removeStatements(static_cast<Ast::BlockStatement*>(statement)->statements, valueUsed, false);
+			break;
+
+		case Ast::Node::Kind::IfStatement: {
+			auto* ifStatement = static_cast<Ast::IfStatement*>(statement);
+			removeFromExpression(ifStatement->condition.get());
+			removeFromStatement(ifStatement->consequence.get(), valueUsed);
+			removeFromStatement(ifStatement->alternative.get(), valueUsed);
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	void DeadCodeEliminator::removeFromExpression(Ast::Expression* expression)
+	{
+		if (!expression) {
+			return;
+		}
+
+		switch (expression->kind) {
+		case Ast::Node::Kind::PrefixExpression:
+			removeFromExpression(static_cast<Ast::PrefixExpression*>(expression)->rightExpression.get());
+			break;
+
+		case Ast::Node::Kind::InfixExpression: {
+			auto* infixExpression = static_cast<Ast::InfixExpression*>(expression);
+			removeFromExpression(infixExpression->left.get());
+			removeFromExpression(infixExpression->right.get());
+			break;
+		}
+
+		case Ast::Node::Kind::CallExpression: {
+			auto* callExpression = static_cast<Ast::CallExpression*>(expression);
+			removeFromExpression(callExpression->function.get());
+
+			for (auto& argument : callExpression->arguments) {
+				removeFromExpression(argument.get());
+			}
+
+			break;
+		}
+
+		case Ast::Node::Kind::FunctionLiteral: {
+			auto* function = static_cast<Ast::FunctionLiteral*>(expression);
+
+			if (function->body) {
+				scopes.push_back(function);
+				removeStatements(function->body->statements, true, false);
+				scopes.pop_back();
+			}
+
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	/*
+	* A let statement is unused if its name is never read, and an expression statement is unused if its value is not
+	* needed.  Either may only be removed if evaluating its expression could not raise an error.
+	*/
+	bool DeadCodeEliminator::isUnused(const Ast::Statement* statement) const
+	{
+		if (!statement) {
+			return false;
+		}
+
+		if (statement->kind == Ast::Node::Kind::LetStatement) {
+			auto* letStatement = static_cast<const Ast::LetStatement*>(statement);
+			Variable variable;
+
+			if (!findVariable(letStatement->identifier->binding, variable) || (!variable.first && !settings.removeGlobals)) {
+				return false;
+			}
+
+			return reads.count(variable) == 0 && isPure(letStatement->expression.get());
+		}
+
+		if (statement->kind == Ast::Node::Kind::ExpressionStatement) {
+			return isPure(static_cast<const Ast::ExpressionStatement*>(statement)->expression.get());
+		}
+
+		return false;
+	}
+
+	/*
+	* Reading a variable or creating a closure never fails.  Operators may raise errors unless TypeInference has proven
+	* their operand types, and even then division may divide by zero.
+	*/
+	bool DeadCodeEliminator::isPure(const Ast::Expression* expression)
+	{
+		if (!expression) {
+			return false;
+		}
+
+		switch (expression->kind) {
+		case Ast::Node::Kind::Identifier:
+		case Ast::Node::Kind::IntegerLiteral:
+		case Ast::Node::Kind::BooleanLiteral:
+		case Ast::Node::Kind::FunctionLiteral:
+			return true;
+
+		case Ast::Node::Kind::PrefixExpression: {
+			auto* right = static_cast<const Ast::PrefixExpression*>(expression)->rightExpression.get();
+
+			if (expression->token->type == Token::Type::Negate) {
+				return isPure(right);
+			}
+
+			return right && right->kind == Ast::Node::Kind::IntegerLiteral;
+		}
+
+		case Ast::Node::Kind::InfixExpression: {
+			auto* infixExpression = static_cast<const Ast::InfixExpression*>(expression);
+
+			return infixExpression->operandType != Ast::OperandType::Unknown && infixExpression->token->type != Token::Type::Divide &&
+				isPure(infixExpression->left.get()) && isPure(infixExpression->right.get());
+		}
+
+		default:
+			return false;
+		}
+	}
+
+	// Whether a statement always ends with a return, so that nothing after it can run.
+	bool DeadCodeEliminator::returns(const Ast::Statement* statement)
+	{
+		if (!statement) {
+			return false;
+		}
+
+		switch (statement->kind) {
+		case Ast::Node::Kind::ReturnStatement:
+			return true;
+
+		case Ast::Node::Kind::BlockStatement: {
+			auto& statements = static_cast<const Ast::BlockStatement*>(statement)->statements;
+			return std::any_of(statements.begin(), statements.end(), [](const auto& inner) { return returns(inner.get()); });
+		}
+
+		case Ast::Node::Kind::IfStatement: {
+			auto* ifStatement = static_cast<const Ast::IfStatement*>(statement);
+			return ifStatement->alternative && returns(ifStatement->consequence.get()) && returns(ifStatement->alternative.get());
+		}
+
+		default:
+			return false;
+		}
+	}
+
+	uint32_t DeadCodeEliminator::countFunctions(const Ast::Node* node)
+	{
+		if (!node) {
+			return 0;
+		}
+
+		switch (node->kind) {
+		case Ast::Node::Kind::PrefixExpression:
+			return countFunctions(static_cast<const Ast::PrefixExpression*>(node)->rightExpression.get());
+
+		case Ast::Node::Kind::InfixExpression: {
+			auto* infixExpression = static_cast<const Ast::InfixExpression*>(node);
+			return countFunctions(infixExpression->left.get()) + countFunctions(infixExpression->right.get());
+		}
+
+		case Ast::Node::Kind::CallExpression: {
+			auto* callExpression = static_cast<const Ast::CallExpression*>(node);
+			uint32_t count = countFunctions(callExpression->function.get());
+
+			for (auto& argument : callExpression->arguments) {
+				count += countFunctions(argument.get());
+			}
+
+			return count;
+		}
+
+		case Ast::Node::Kind::FunctionLiteral:
+			return 1 + countFunctions(static_cast<const Ast::FunctionLiteral*>(node)->body.get());
+
+		case Ast::Node::Kind::LetStatement:
+			return countFunctions(static_cast<const Ast::LetStatement*>(node)->expression.get());
+
+		case Ast::Node::Kind::ReturnStatement:
+			return countFunctions(static_cast<const Ast::ReturnStatement*>(node)->expression.get());
+
+		case Ast::Node::Kind::ExpressionStatement:
+			return countFunctions(static_cast<const Ast::ExpressionStatement*>(node)->expression.get());
+
+		case Ast::Node::Kind::BlockStatement: {
+			uint32_t count = 0;
+
+			for (auto& statement : static_cast<const Ast::BlockStatement*>(node)->statements) {
+				count += countFunctions(statement.get());
+			}
+
+			return count;
+		}
+
+		case Ast::Node::Kind::IfStatement: {
+			auto* ifStatement = static_cast<const Ast::IfStatement*>(node);
+			return countFunctions(ifStatement->condition.get()) + countFunctions(ifStatement->consequence.get()) + countFunctions(ifStatement->alternative.get());
+		}
+
+		default:
+			return 0;
+		}
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "ast.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* Optimization pass which removes code that can never affect a program: statements after a return, let statements
+* binding names which are never read and expression statements whose value is never used, so long as evaluating them
+* could not have raised an error.  Functions which are only referred to by removed code are removed with it.
+*
+* A variable only read by the function it is bound to counts as unused, since the function can never be called.  The
+* pass repeats until nothing more can be removed, as removing one binding may leave the names it read unused.
+*/
+class DeadCodeEliminator
+{
+public:
+	struct Settings
+	{
+		// whether unused globals are removed, which is only safe if the host never looks them up
+		bool removeGlobals = false;
+	};
+
+	struct Statistics
+	{
+		uint32_t unreachableStatements = 0;
+		uint32_t unusedBindings = 0;
+		uint32_t unusedExpressions = 0;
+		uint32_t functionsRemoved = 0;
+		uint32_t nodesEliminated = 0;
+	};
+
+public:
+	DeadCodeEliminator();
+	DeadCodeEliminator(const Settings& settings);
+
+public:
+	void eliminate(Ast::Program& program);
+
+	inline const Statistics& getStatistics() const { return statistics; }
+
+private:
+	// a global is identified by a null owner, a local by the function whose frame holds it or the program
+	using Variable = std::pair<const void*, uint32_t>;
+
+private:
+	void countReads(const Ast::Node* node);
+	bool findVariable(const Ast::Binding& binding, Variable& variable) const;
+	bool findCapture(size_t depth, uint32_t index, Variable& variable) const;
+
+	void removeStatements(std::vector<std::unique_ptr<Ast::Statement>>& statements, bool valueUsed, bool topLevel);
+	void removeFromStatement(Ast::Statement* statement, bool valueUsed);
+	void removeFromExpression(Ast::Expression* expression);
+	bool isUnused(const Ast::Statement* statement) const;
+
+	static bool isPure(const Ast::Expression* expression);
+	static bool returns(const Ast::Statement* statement);
+	static uint32_t countFunctions(const Ast::Node* node);
+
+private:
+	Settings settings;
+
+	Ast::Program* program = nullptr;
+
+	// the functions enclosing the node being visited, outermost first, starting with null for the top level code
+	std::vector<const Ast::FunctionLiteral*> scopes;
+
+	// variables whose let statement is binding the function being visited
+	std::vector<Variable> defining;
+
+	std::map<Variable, uint32_t> reads;
+	bool removed = false;
+
+	Statistics statistics;
+};
+
+}
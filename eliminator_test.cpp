@@ -0,0 +1,178 @@
+#include "eliminator.h"
+#include "type_inference.h"
+#include "parser.h"
+#include "lexer.h"
+#include "script.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace Delve::Script;
+
+// helper function that removes dead code from each input program and compares its string representation to the expected output
+void compareEliminatedToExpectedOutput(const std::vector<std::string>& inputs, const std::vector<std::string>& expectedOutput, const DeadCodeEliminator::Settings& settings = DeadCodeEliminator::Settings());
+
+TEST(DeadCodeEliminator, UnreachableStatements)
+{
+	std::vector<std::string> inputs = {
+		"let f = function(x) { return x; x + 1; let y = 2; };",
+		"let f = function(x) { if (x) { return 1; } else { return 2; } 3; };",
+		"let f = function(x) { if (x) { return 1; } 3; };",
+		"return 1; let x = 2; 3;",
+		"let f = function() { x; }; return f(); let x = 1;"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"let f = function(x) {\nreturn x;\n};\n",
+		"let f = function(x) {\nif x {\nreturn 1;\n} else {\nreturn 2;\n}\n};\n",
+		"let f = function(x) {\nif x {\nreturn 1;\n}\n3;\n};\n",
+		"return 1;\n",
+		"let f = function() {\nx;\n};\nreturn f();\nlet x = 1;\n"
+	};
+
+	compareEliminatedToExpectedOutput(inputs, expectedOutput);
+}
+
+TEST(DeadCodeEliminator, UnusedBindingsAndExpressions)
+{
+	std::vector<std::string> inputs = {
+		"let f = function(x) { let unused = 5; let g = function() { 1; }; x; };",
+		"let f = function(x) { 1; x; true; !x; x; };",
+		"let f = function() { let loop = function(n) { loop(n - 1); }; 5; };",
+		"let f = function() { let a = 1; let b = a; let c = function() { b; }; 0; };",
+		"let f = function() { 5; let y = 1; };",
+		"let f = function(x) { if (x) { 1; 2; } 3; };"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"let f = function(x) {\nx;\n};\n",
+		"let f = function(x) {\nx;\n};\n",
+		"let f = function() {\n5;\n};\n",
+		"let f = function() {\n0;\n};\n",
+		"let f = function() {\nlet y = 1;\n};\n",
+		"let f = function(x) {\nif x {\n}\n3;\n};\n"
+	};
+
+	compareEliminatedToExpectedOutput(inputs, expectedOutput);
+}
+
+/*
+* Tests that code which could raise an error is kept even if its result is unused.
+*/
+TEST(DeadCodeEliminator, ImpureCodeIsKept)
+{
+	std::vector<std::string> inputs = {
+		"let f = function(x) { let a = x + 1; let b = g(); x / 0; -x; x; };"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"let f = function(x) {\nlet a = (x + 1);\nlet b = g();\n(x / 0);\n(-x);\nx;\n};\n"
+	};
+
+	compareEliminatedToExpectedOutput(inputs, expectedOutput);
+}
+
+/*
+* Tests that unused globals are only removed when the settings allow it, since the host may look them up.
+*/
+TEST(DeadCodeEliminator, Globals)
+{
+	std::vector<std::string> inputs = {
+		"let unused = 5; let onEvent = function(x) { x; }; 1;"
+	};
+
+	compareEliminatedToExpectedOutput(inputs, { "let unused = 5;\nlet onEvent = function(x) {\nx;\n};\n1;\n" });
+
+	DeadCodeEliminator::Settings settings;
+	settings.removeGlobals = true;
+	compareEliminatedToExpectedOutput(inputs, { "1;\n" }, settings);
+}
+
+/*
+* Tests that operators whose operand types have been inferred are known not to fail, apart from division.
+*/
+TEST(DeadCodeEliminator, TypedOperations)
+{
+	std::string code = "let f = function(x) { let y = x * 2; let z = x / 2; x; }; f(1);";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+
+	TypeInference inference;
+	inference.infer(*parser.getProgram());
+
+	DeadCodeEliminator eliminator;
+	eliminator.eliminate(*parser.getProgram());
+
+	EXPECT_EQ(parser.getProgram()->toString(), "let f = function(x) {\nlet z = (x / 2);\nx;\n};\nf(1);\n");
+	EXPECT_EQ(eliminator.getStatistics().unusedBindings, 1);
+}
+
+TEST(DeadCodeEliminator, Statistics)
+{
+	std::string code = "let f = function(x) { return x; 1; }; let g = function() { 2; }; let a = 1; a; f(a);";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+
+	DeadCodeEliminator::Settings settings;
+	settings.removeGlobals = true;
+	DeadCodeEliminator eliminator(settings);
+	eliminator.eliminate(*parser.getProgram());
+
+	const auto& statistics = eliminator.getStatistics();
+	EXPECT_EQ(statistics.unreachableStatements, 1);
+	EXPECT_EQ(statistics.unusedBindings, 1);
+	EXPECT_EQ(statistics.unusedExpressions, 1);
+	EXPECT_EQ(statistics.functionsRemoved, 1);
+
+	// let g = function() { 2; } has 6 nodes, counting its body block, and each expression statement has 2
+	EXPECT_EQ(statistics.nodesEliminated, 10);
+	EXPECT_EQ(parser.getProgram()->toString(), "let f = function(x) {\nreturn x;\n};\nlet a = 1;\nf(a);\n");
+}
+
+/*
+* Tests that programs produce the same results and errors once dead code is removed.
+*/
+TEST(DeadCodeEliminator, PreservesResults)
+{
+	std::vector<std::string> inputs = {
+		"let f = function(x) { return x * 2; x; }; f(4);",
+		"let f = function() { 5; let y = 1; }; f();",
+		"let f = function(x) { let y = x; if (x) { return y; } else { return 0; } 1; }; f(3);",
+		"let f = function(n) { let unused = function() { n; }; if (n < 1) { return 0; } n + f(n - 1); }; f(10);",
+		"let f = function(x) { x + true; 1; }; f(1);",
+		"let x = 1; let y = 2; if (x < y) { x; 7; }",
+		"let unused = 5; return 3; unused;"
+	};
+
+	for (auto& input : inputs) {
+		for (auto mode : { ExecutionMode::TreeWalk, ExecutionMode::Closure, ExecutionMode::Bytecode }) {
+			Script original(input);
+			Script optimized(input);
+			optimized.optimize();
+
+			EXPECT_EQ(original.run(mode).toString(), optimized.run(mode).toString()) << input;
+			EXPECT_EQ(original.getErrors(), optimized.getErrors()) << input;
+		}
+	}
+}
+
+void compareEliminatedToExpectedOutput(const std::vector<std::string>& inputs, const std::vector<std::string>& expectedOutput, const DeadCodeEliminator::Settings& settings)
+{
+	ASSERT_EQ(inputs.size(), expectedOutput.size());
+
+	DeadCodeEliminator eliminator(settings);
+
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		Lexer lexer(inputs[i]);
+		Parser parser(lexer.tokens());
+
+		ASSERT_EQ(parser.getErrors().size(), 0);
+
+		auto* program = parser.getProgram();
+		eliminator.eliminate(*program);
+
+		EXPECT_EQ(program->toString(), expectedOutput[i]) << inputs[i];
+	}
+}
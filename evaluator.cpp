@@ -0,0 +1,293 @@
+#include "evaluator.h"
+#include "trace.h"
+
+#include <sstream>
+
+namespace Delve::Script {
+	Evaluator::Evaluator()
+	{
+		callDepth = 0;
+	}
+
+	/**
+	* Releases all objects created by previous evaluations and clears the error list.
+	*/
+	void Evaluator::clear()
+	{
+		heap.clear();
+		errors.clear();
+		callDepth = 0;
+	}
+
+	/**
+	* Runs a program to completion.
+	* The returned value remains valid until the next call to evaluate or clear.
+	* @param program the program to run
+	* @param host functions the program may call
+	* @returns the value of the first top level return statement, or the value of the last statement executed.
+	* Returns null if a runtime error occurred, in which case it is available through getErrors()
+	*/
+	Value Evaluator::evaluate(const Ast::Program* program, const Host* host)
+	{
+		DELVE_SCRIPT_TRACE("evaluate", "execute");
+
+		clear();
+
+		if (!program) {
+			return Value();
+		}
+
+		try {
+			// host functions live in a scope outside the globals so that scripts can shadow them
+			auto* hostFunctions = heap.allocate<Environment>(nullptr);
+
+			for (size_t i = 0; host && i < host->functionCount(); ++i) {
+				const auto* function = host->getFunction(i);
+				hostFunctions->values[function->name] = Value::fromHostFunction(function);
+			}
+
+			auto* globals = heap.allocate<Environment>(hostFunctions);
+			bool returned = false;
+
+			return evaluateStatements(program->statements, globals, returned);
+		}
+		catch (const RuntimeError& error) {
+			errors.push_back(error.what());
+		}
+
+		return Value();
+	}
+
+	/*
+	* Evaluates a list of statements in order, stopping early if one of them returns.
+	* @param returned set to true if a return statement was executed
+	* @returns the value of the return statement or the last statement in the list
+	*/
+	Value Evaluator::evaluateStatements(const std::vector<std::unique_ptr<Ast::Statement>>& statements, Environment* environment, bool& returned)
+	{
+		Value result;
+
+		for (auto& statement : statements) {
+			if (!statement) {
+				continue;
+			}
+
+			result = evaluateStatement(statement.get(), environment, returned);
+
+			if (returned) {
+				break;
+			}
+		}
+
+		return result;
+	}
+
+	Value Evaluator::evaluateStatement(const Ast::Statement* statement, Environment* environment, bool& returned)
+	{
+		switch (statement->kind) {
+		case Ast::Node::Kind::LetStatement: {
+			auto* letStatement = static_cast<const Ast::LetStatement*>(statement);
+			Value value = evaluateExpression(letStatement->expression.get(), environment);
+			environment->values[letStatement->identifier->token->literal] = value;
+
+			return Value();
+		}
+
+		case Ast::Node::Kind::ReturnStatement: {
+			auto* returnStatement = static_cast<const Ast::ReturnStatement*>(statement);
+			Value value = evaluateExpression(returnStatement->expression.get(), environment);
+			returned = true;
+
+			return value;
+		}
+
+		case Ast::Node::Kind::ExpressionStatement: {
+			auto* expressionStatement = static_cast<const Ast::ExpressionStatement*>(statement);
+			return evaluateExpression(expressionStatement->expression.get(), environment);
+		}
+
+		case Ast::Node::Kind::BlockStatement: {
+			auto* blockStatement = static_cast<const Ast::BlockStatement*>(statement);
+			auto* blockEnvironment = heap.allocate<Environment>(environment);
+
+			return evaluateStatements(blockStatement->statements, blockEnvironment, returned);
+		}
+
+		case Ast::Node::Kind::IfStatement: {
+			auto* ifStatement = static_cast<const Ast::IfStatement*>(statement);
+
+			if (!ifStatement->condition || !ifStatement->consequence) {
+				missingNodeError(ifStatement);
+			}
+
+			if (evaluateExpression(ifStatement->condition.get(), environment).isTruthy()) {
+				return evaluateStatement(ifStatement->consequence.get(), environment, returned);
+			}
+			else if (ifStatement->alternative) {
+				return evaluateStatement(ifStatement->alternative.get(), environment, returned);
+			}
+
+			return Value();
+		}
+
+		default:
+			return evaluateExpression(statement, environment);
+		}
+	}
+
+	Value Evaluator::evaluateExpression(const Ast::Expression* expression, Environment* environment)
+	{
+		if (!expression) {
+			throw RuntimeError("Incomplete expression.");
+		}
+
+		switch (expression->kind) {
+		case Ast::Node::Kind::Identifier:
+			return lookup(static_cast<const Ast::Identifier*>(expression), environment);
+
+		case Ast::Node::Kind::IntegerLiteral:
+			return Value::fromInteger(static_cast<const Ast::IntegerLiteral*>(expression)->value);
+
+		case Ast::Node::Kind::BooleanLiteral:
+			return Value::fromBoolean(expression->token->type == Token::Type::True);
+
+		case Ast::Node::Kind::PrefixExpression:
+			return evaluatePrefixExpression(static_cast<const Ast::PrefixExpression*>(expression), environment);
+
+		case Ast::Node::Kind::InfixExpression:
+			return evaluateInfixExpression(static_cast<const Ast::InfixExpression*>(expression), environment);
+
+		case Ast::Node::Kind::CallExpression:
+			return evaluateCallExpression(static_cast<const Ast::CallExpression*>(expression), environment);
+
+		case Ast::Node::Kind::FunctionLiteral: {
+			auto* function = heap.allocate<Function>(static_cast<const Ast::FunctionLiteral*>(expression), environment);
+			return Value::fromFunction(function);
+		}
+
+		default:
+			throw RuntimeError("Statement used as an expression.");
+		}
+	}
+
+	Value Evaluator::evaluatePrefixExpression(const Ast::PrefixExpression* expression, Environment* environment)
+	{
+		if (!expression->rightExpression) {
+			missingNodeError(expression);
+		}
+
+		Value right = evaluateExpression(expression->rightExpression.get(), environment);
+
+		switch (expression->token->type) {
+		case Token::Type::Negate:
+			return Operators::negate(right);
+		default:
+			return Operators::minus(right);
+		}
+	}
+
+	Value Evaluator::evaluateInfixExpression(const Ast::InfixExpression* expression, Environment* environment)
+	{
+		if (!expression->left || !expression->right) {
+			missingNodeError(expression);
+		}
+
+		Value left = evaluateExpression(expression->left.get(), environment);
+		Value right = evaluateExpression(expression->right.get(), environment);
+
+		switch (expression->token->type) {
+		case Token::Type::Plus:
+			return Operators::add(left, right);
+		case Token::Type::Minus:
+			return Operators::subtract(left, right);
+		case Token::Type::Multiply:
+			return Operators::multiply(left, right);
+		case Token::Type::Divide:
+			return Operators::divide(left, right);
+		case Token::Type::LessThan:
+			return Operators::lessThan(left, right);
+		case Token::Type::GreaterThan:
+			return Operators::greaterThan(left, right);
+		case Token::Type::Equal:
+			return Operators::equal(left, right);
+		default:
+			return Operators::notEqual(left, right);
+		}
+	}
+
+	/*
+	* Calls a function.  Arguments are evaluated in the caller's environment and bound to the parameter names in a new
+	* environment enclosed by the one the function was created in.  The body runs directly in that environment.
+	*/
+	Value Evaluator::evaluateCallExpression(const Ast::CallExpression* expression, Environment* environment)
+	{
+		Value callee = evaluateExpression(expression->function.get(), environment);
+
+		if (callee.type == Value::Type::HostFunction) {
+			callee.host->checkArgumentCount(expression->arguments.size());
+
+			std::vector<Value> arguments;
+			for (auto& argument : expression->arguments) {
+				arguments.push_back(evaluateExpression(argument.get(), environment));
+			}
+
+			return callee.host->callBlocking(arguments.data(), arguments.size());
+		}
+
+		if (callee.type != Value::Type::Function) {
+			throw RuntimeError("Attempted to call a value of type " + Value::getTypeName(callee.type) + '.');
+		}
+
+		auto* function = static_cast<Function*>(callee.object);
+		const auto& parameters = function->literal->parameters;
+
+		if (parameters.size() != expression->arguments.size()) {
+			std::ostringstream error;
+			error << "Expected " << parameters.size() << " arguments but got " << expression->arguments.size() << '.';
+			throw RuntimeError(error.str());
+		}
+
+		auto* callEnvironment = heap.allocate<Environment>(function->environment);
+
+		for (size_t i = 0; i < parameters.size(); ++i) {
+			callEnvironment->values[parameters[i]->token->literal] = evaluateExpression(expression->arguments[i].get(), environment);
+		}
+
+		if (callDepth >= maxCallDepth) {
+			throw RuntimeError("Maximum call depth exceeded.");
+		}
+
+		callDepth += 1;
+		bool returned = false;
+		Value result = evaluateStatements(function->literal->body->statements, callEnvironment, returned);
+		callDepth -= 1;
+
+		return result;
+	}
+
+	/*
+	* Searches for an identifier starting in the supplied environment and moving outwards.
+	*/
+	Value Evaluator::lookup(const Ast::Identifier* identifier, Environment* environment)
+	{
+		const std::string& name = identifier->token->literal;
+
+		for (auto* scope = environment; scope != nullptr; scope = scope->outer) {
+			auto result = scope->values.find(name);
+
+			if (result != scope->values.end()) {
+				return result->second;
+			}
+		}
+
+		throw RuntimeError("Undefined identifier " + name + '.');
+	}
+
+	void Evaluator::missingNodeError(const Ast::Node* parent)
+	{
+		std::ostringstream error;
+		error << "Incomplete expression at " << parent->token->lineNum << ", " << parent->token->colNum << '.';
+
+		throw RuntimeError(error.str());
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "ast.h"
+#include "heap.h"
+#include "host.h"
+#include "value.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace Delve::Script {
+
+/*
+* Executes a program by walking its AST directly.  Names are looked up in hash maps at runtime and every node is
+* dispatched on its kind, which makes this the simplest and slowest way to run a script.
+*/
+class Evaluator
+{
+public:
+	using ErrorList = std::vector<std::string>;
+
+public:
+	Evaluator();
+
+public:
+	Value evaluate(const Ast::Program* program, const Host* host = nullptr);
+	void clear();
+
+	inline const ErrorList& getErrors() const { return errors; }
+
+	static constexpr uint32_t maxCallDepth = 2048;
+
+private:
+	struct Environment : public Object
+	{
+		Environment(Environment* o) : outer(o) {}
+
+		std::unordered_map<std::string, Value> values;
+		Environment* outer;
+	};
+
+	struct Function : public Object
+	{
+		Function(const Ast::FunctionLiteral* l, Environment* e) : literal(l), environment(e) {}
+
+		const Ast::FunctionLiteral* literal;
+		Environment* environment;
+	};
+
+private:
+	Value evaluateStatements(const std::vector<std::unique_ptr<Ast::Statement>>& statements, Environment* environment, bool& returned);
+	Value evaluateStatement(const Ast::Statement* statement, Environment* environment, bool& returned);
+	Value evaluateExpression(const Ast::Expression* expression, Environment* environment);
+	Value evaluatePrefixExpression(const Ast::PrefixExpression* expression, Environment* environment);
+	Value evaluateInfixExpression(const Ast::InfixExpression* expression, Environment* environment);
+	Value evaluateCallExpression(const Ast::CallExpression* expression, Environment* environment);
+
+	Value lookup(const Ast::Identifier* identifier, Environment* environment);
+
+	void missingNodeError(const Ast::Node* parent);
+
+private:
+	Heap heap;
+	ErrorList errors;
+	uint32_t callDepth;
+};
+
+}
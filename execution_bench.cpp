@@ -0,0 +1,902 @@
+#include "script.h"
+#include "batch.h"
+#include "bytecode_file.h"
+#include "executor.h"
+#include "program_cache.h"
+#include "script_function.h"
+#include "single_pass_compiler.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Delve::Script;
+
+// GCC sees the replacement operator delete below call free on memory from operator new and reports a mismatch
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace {
+	// counts every allocation made by the process so benchmarks can report allocations per iteration
+	std::atomic<uint64_t> allocationCount(0);
+}
+
+void* operator new(std::size_t size)
+{
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+	if (void* memory = std::malloc(size ? size : 1)) {
+		return memory;
+	}
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+namespace {
+	const std::string fibonacci =
+		"let fib = function(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2); };"
+		"fib(20);";
+
+	const std::string arithmetic =
+		"let sum = function(n, total) { if (n == 0) { return total; } sum(n - 1, total + n * 3 / 2 - 1); };"
+		"sum(1000, 0);";
+
+	const std::string closures =
+		"let adder = function(x) { function(y) { x + y; }; };"
+		"let apply = function(n, total) { if (n == 0) { return total; } apply(n - 1, adder(n)(total)); };"
+		"apply(1000, 0);";
+
+	const std::string churn =
+		"let adder = function(x) { function(y) { x + y; }; };"
+		"let churn = function(n) { if (n < 2) { return adder(n)(1); } let f = adder(n); churn(n - 1) + churn(n - 2) + f(0) - n; };"
+		"churn(22);";
+
+	const std::string polymorphic =
+		"let double = function(x) { x * 2; }; let square = function(x) { x * x; }; let negate = function(x) { -x; };"
+		"let apply = function(f, x) { f(x); };"
+		"let run = function(n, total) { if (n == 0) { return total; } run(n - 1, total + apply(double, n) + apply(square, n) + apply(negate, n)); };"
+		"run(1000, 0);";
+
+	// ten thousand calls to a host function, and the same loop with the call replaced by the operator it performs
+	const std::string hostCalls =
+		"let loop = function(n, total) { if (n == 0) { return total; } loop(n - 1, add(total, n)); };"
+		"loop(10000, 0);";
+
+	const std::string inlineCalls =
+		"let loop = function(n, total) { if (n == 0) { return total; } loop(n - 1, total + n); };"
+		"loop(10000, 0);";
+
+	int64_t add(int64_t a, int64_t b)
+	{
+		return a + b;
+	}
+
+	// two lookups against a slow store with a little computation in between
+	const std::string lookups =
+		"let fib = function(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2); };"
+		"let key = lookup(1); fib(10) + lookup(key);";
+
+	/*
+	* Simulates a store which answers lookups after a fixed latency.  Requests are completed in order by a single timer
+	* thread, so the store itself never holds up the threads running scripts.
+	*/
+	class SlowStore
+	{
+	public:
+		SlowStore(std::chrono::microseconds l) : latency(l), thread([this]() { run(); }) {}
+
+		~SlowStore()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+
+			condition.notify_one();
+			thread.join();
+		}
+
+		void lookup(int64_t key, HostCompletion completion)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				requests.push({ std::chrono::steady_clock::now() + latency, key, std::move(completion) });
+			}
+
+			condition.notify_one();
+		}
+
+	private:
+		struct Request
+		{
+			std::chrono::steady_clock::time_point due;
+			int64_t key;
+			HostCompletion completion;
+		};
+
+		void run()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			while (!stopping) {
+				if (requests.empty()) {
+					condition.wait(lock);
+					continue;
+				}
+
+				if (std::chrono::steady_clock::now() < requests.front().due) {
+					condition.wait_until(lock, requests.front().due);
+					continue;
+				}
+
+				Request request = std::move(requests.front());
+				requests.pop();
+
+				lock.unlock();
+				request.completion.resolve(Value::fromInteger(request.key + 1));
+				lock.lock();
+			}
+		}
+
+	private:
+		std::chrono::microseconds latency;
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::queue<Request> requests;
+		bool stopping = false;
+		std::thread thread;
+	};
+
+	const size_t scriptThreads = 4;
+	const std::chrono::microseconds storeLatency(1000);
+
+	const std::string constants =
+		"let timeout = function(n, total) { if (n == 0) { return total; } if (1 < 2) { timeout(n - 1, total + (2 * 60) * 1000 * 1); } else { 0; } };"
+		"timeout(1000, 0);";
+
+	// a loop whose body computes values it never uses and keeps a helper it never calls
+	const std::string deadCode =
+		"let count = function(n, total) {"
+		"	let unused = function(x) { unused(x - 1); };"
+		"	let half = n * 2; let label = true; n; !label; half;"
+		"	if (n == 0) { return total; } else { return count(n - 1, total + 1); }"
+		"	total * 3;"
+		"};"
+		"count(1000, 0);";
+
+	// a loop which spends most of its time calling tiny helpers
+	const std::string helpers =
+		"let isAdult = function(age) { return age > 17; };"
+		"let bonus = function(age, adult) { if (adult) { return age * 2; } age; };"
+		"let score = function(age) { bonus(age, isAdult(age)) + 1; };"
+		"let count = function(n, total) { if (n == 0) { return total; } count(n - 1, total + score(n)); };"
+		"count(1000, 0);";
+}
+
+/*
+* Runs a script repeatedly in a given execution mode.  Preparation work (parsing, compilation) happens once up front
+* so only execution is measured.
+*/
+static void runScript(benchmark::State& state, const std::string& source, ExecutionMode mode)
+{
+	Script script(source);
+	script.run(mode);
+
+	uint64_t allocations = allocationCount.load();
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(script.run(mode));
+	}
+
+	state.counters["allocs"] = benchmark::Counter(static_cast<double>(allocationCount.load() - allocations), benchmark::Counter::kAvgIterations);
+}
+
+/*
+* Runs a script after it has been through the optimization passes.
+*/
+static void runOptimizedScript(benchmark::State& state, const std::string& source, ExecutionMode mode)
+{
+	Script script(source);
+	script.optimize();
+	script.run(mode);
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(script.run(mode));
+	}
+}
+
+/*
+* Runs a script with calls to its pure functions memoized.  The remembered results are forgotten before each run so
+* that every run fills the cache again, rather than returning the result of the first run.
+*/
+static void runMemoizedScript(benchmark::State& state, const std::string& source)
+{
+	MemoCache::Settings settings;
+	settings.enabled = true;
+
+	Script script(source);
+	script.setMemoSettings(settings);
+	script.run();
+
+	for (auto _ : state) {
+		script.setMemoSettings(settings);
+		benchmark::DoNotOptimize(script.run());
+	}
+
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+
+	for (const auto& function : script.getMemoStatistics()) {
+		hits += function.hits;
+		misses += function.misses;
+	}
+
+	state.counters["hitRate"] = hits + misses ? static_cast<double>(hits) / static_cast<double>(hits + misses) : 0.0;
+}
+
+/*
+* Infers the types of a script and reports the fraction of its operators which could be specialized.
+*/
+static void inferTypes(benchmark::State& state, const std::string& source)
+{
+	Lexer lexer(source);
+	Parser parser(lexer.tokens());
+	TypeInference inference;
+
+	for (auto _ : state) {
+		inference.infer(*parser.getProgram());
+	}
+
+	const auto& statistics = inference.getStatistics();
+	state.counters["operations"] = statistics.operations;
+	state.counters["specialized"] = static_cast<double>(statistics.integerOperations + statistics.booleanOperations) / statistics.operations;
+}
+
+/*
+* Removes dead code from a fresh copy of a script each iteration and reports how much was removed.
+*/
+static void eliminateDeadCode(benchmark::State& state, const std::string& source)
+{
+	DeadCodeEliminator::Statistics statistics;
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		Lexer lexer(source);
+		Parser parser(lexer.tokens());
+		TypeInference inference;
+		inference.infer(*parser.getProgram());
+		DeadCodeEliminator eliminator;
+		state.ResumeTiming();
+
+		eliminator.eliminate(*parser.getProgram());
+		statistics = eliminator.getStatistics();
+	}
+
+	state.counters["statements"] = statistics.unreachableStatements + statistics.unusedBindings + statistics.unusedExpressions;
+	state.counters["nodes"] = statistics.nodesEliminated;
+}
+
+/*
+* Runs a script with fuel and deadline limits which it never reaches, to compare against runScript.  Both pay for
+* metering; the limits themselves are only examined every few thousand ticks.
+*/
+static void runLimitedScript(benchmark::State& state, const std::string& source)
+{
+	Script script(source);
+
+	ExecutionLimits limits;
+	limits.fuel = uint64_t(1) << 40;
+	limits.timeout = std::chrono::seconds(10);
+	script.setLimits(limits);
+	script.run();
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(script.run());
+	}
+}
+
+/*
+* Runs a call heavy script in the closure engine and reports how often call sites hit their inline cache.
+*/
+static void runCalls(benchmark::State& state, const std::string& source)
+{
+	Lexer lexer(source);
+	Parser parser(lexer.tokens());
+	Compiler compiler(parser.getProgram());
+	Isolate isolate(compiler.getProgram());
+
+	isolate.run();
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(isolate.run());
+	}
+
+	auto statistics = isolate.getCallStatistics();
+	state.counters["callsPerRun"] = static_cast<double>(statistics.hits + statistics.misses) / static_cast<double>(state.iterations() + 1);
+	state.counters["hitRate"] = static_cast<double>(statistics.hits) / static_cast<double>(statistics.hits + statistics.misses);
+}
+
+/*
+* Runs one compiled program on every benchmark thread at once, each thread in its own isolate.  Since isolates share
+* only immutable data, throughput should scale with the number of cores.
+*/
+static void runIsolates(benchmark::State& state, const std::string& source)
+{
+	static std::shared_ptr<const CompiledProgram> program = [&source]() {
+		Lexer lexer(source);
+		Parser parser(lexer.tokens());
+		Compiler compiler(parser.getProgram());
+
+		return compiler.getProgram();
+	}();
+
+	Isolate isolate(program);
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(isolate.run());
+	}
+
+	state.SetItemsProcessed(state.iterations());
+}
+
+/*
+* Calls a host function directly, the way the engines do, to measure the cost of the call itself.  The function is
+* either bound by its signature or defined with a callback taking the raw arguments.
+*/
+static void callHostFunction(benchmark::State& state, bool bound)
+{
+	Host host;
+
+	if (bound) {
+		host.bind("add", &add);
+	}
+	else {
+		host.define("add", 2, [](const Value* arguments, size_t) { return Value::fromInteger(add(arguments[0].integer, arguments[1].integer)); });
+	}
+
+	const HostFunction* function = host.find("add");
+	Value arguments[2] = { Value::fromInteger(0), Value::fromInteger(1) };
+
+	for (auto _ : state) {
+		arguments[0] = function->call(arguments);
+		benchmark::DoNotOptimize(arguments[0]);
+	}
+}
+
+/*
+* Runs a script which makes ten thousand host calls, reporting the time per call including the script's own work.
+* Compare with inlineCalls to find the overhead of the calls.
+*/
+static void runHostCalls(benchmark::State& state, const std::string& source, ExecutionMode mode)
+{
+	Host host;
+	host.bind("add", &add);
+
+	Script script(source);
+	script.setHost(&host);
+	script.run(mode);
+
+	uint64_t allocations = allocationCount.load();
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(script.run(mode));
+	}
+
+	state.counters["perCall"] = benchmark::Counter(10000, benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+	state.counters["allocs"] = benchmark::Counter(static_cast<double>(allocationCount.load() - allocations), benchmark::Counter::kAvgIterations);
+}
+
+/*
+* Calls a small script function from C++ through a typed handle, the way a host would for every event it handles.
+* The time per iteration is the cost of one call into the script, including the function's own few operations.
+*/
+static void callScriptFunction(benchmark::State& state)
+{
+	std::string source = "let onEvent = function(x, negate) { if (negate) { return -x; } x + 1; };";
+
+	Lexer lexer(source);
+	Parser parser(lexer.tokens());
+	Compiler compiler(parser.getProgram());
+	Isolate isolate(compiler.getProgram());
+	isolate.run();
+
+	ScriptFunction<int64_t(int64_t, bool)> onEvent(isolate, "onEvent");
+	int64_t total = 0;
+	uint64_t allocations = allocationCount.load();
+
+	for (auto _ : state) {
+		total = onEvent(total, false);
+		benchmark::DoNotOptimize(total);
+	}
+
+	state.counters["allocs"] = benchmark::Counter(static_cast<double>(allocationCount.load() - allocations), benchmark::Counter::kAvgIterations);
+}
+
+/*
+* Selects the rows of a table which pass a rule, either by evaluating the rule over whole columns in batches or by
+* calling a script function for each row.  Items are rows, so the two rates can be compared directly.
+*/
+static void selectRows(benchmark::State& state, bool batch)
+{
+	const size_t rows = 1000000;
+	std::vector<int64_t> scores(rows);
+	std::vector<int64_t> limits(rows);
+
+	for (size_t i = 0; i < rows; i++) {
+		scores[i] = static_cast<int64_t>(i * 7919 % 1000);
+		limits[i] = static_cast<int64_t>(i * 104729 % 3000);
+	}
+
+	std::vector<uint64_t> selected((rows + 63) / 64);
+
+	if (batch) {
+		BatchEvaluator evaluator;
+		evaluator.bindIntegers("score", scores.data(), rows);
+		evaluator.bindIntegers("limit", limits.data(), rows);
+		evaluator.compile("score * 3 > limit == true");
+
+		for (auto _ : state) {
+			evaluator.select(selected);
+			benchmark::DoNotOptimize(selected.data());
+		}
+	}
+	else {
+		std::string source = "let rule = function(score, limit) { score * 3 > limit == true; };";
+
+		Lexer lexer(source);
+		Parser parser(lexer.tokens());
+		Compiler compiler(parser.getProgram());
+		Isolate isolate(compiler.getProgram());
+		isolate.run();
+
+		ScriptFunction<bool(int64_t, int64_t)> rule(isolate, "rule");
+
+		for (auto _ : state) {
+			std::fill(selected.begin(), selected.end(), 0);
+
+			for (size_t i = 0; i < rows; i++) {
+				selected[i / 64] |= static_cast<uint64_t>(rule(scores[i], limits[i])) << (i % 64);
+			}
+
+			benchmark::DoNotOptimize(selected.data());
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations() * rows);
+}
+
+/*
+* Lexes a script, for comparison with looking it up in a program cache.
+*/
+static void lexScript(benchmark::State& state, const std::string& source)
+{
+	for (auto _ : state) {
+		Lexer lexer(source);
+		benchmark::DoNotOptimize(lexer.tokens().data());
+	}
+
+	state.SetBytesProcessed(state.iterations() * source.size());
+}
+
+/*
+* Lexes, parses and compiles a script for the closure engine, which is the work a program cache hit saves.
+*/
+static void compileScript(benchmark::State& state, const std::string& source)
+{
+	for (auto _ : state) {
+		Lexer lexer(source);
+		Parser parser(lexer.tokens());
+		Compiler compiler(parser.getProgram());
+		benchmark::DoNotOptimize(compiler.getProgram());
+	}
+}
+
+/*
+* Looks up a script which is already in a program cache.
+*/
+static void lookupCachedScript(benchmark::State& state, const std::string& source)
+{
+	ProgramCache cache;
+	cache.getCompiled(source);
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(cache.getCompiled(source));
+	}
+
+	state.SetBytesProcessed(state.iterations() * source.size());
+	state.counters["hitRate"] = static_cast<double>(cache.getStatistics().hits) / static_cast<double>(cache.getStatistics().hits + cache.getStatistics().misses);
+}
+
+namespace {
+	// a few hundred scripts of varying size, standing in for the scripts an application loads when it starts
+	const std::vector<BytecodeFile::Script>& getScriptSet()
+	{
+		static std::vector<BytecodeFile::Script> scripts = []() {
+			std::vector<BytecodeFile::Script> set;
+			std::vector<std::string> bodies = { fibonacci, arithmetic, closures, churn, polymorphic };
+
+			for (int i = 0; i < 500; ++i) {
+				BytecodeFile::Script script;
+				script.name = "script" + std::to_string(i) + ".ds";
+
+				for (int j = 0; j <= i % 4; ++j) {
+					script.source += bodies[(i + j) % bodies.size()] + "\n";
+				}
+
+				script.source += "let id = " + std::to_string(i) + ";";
+				set.push_back(std::move(script));
+			}
+
+			return set;
+		}();
+
+		return scripts;
+	}
+
+	const std::string& getScriptSetFile()
+	{
+		static std::string path = []() {
+			std::string file = (std::filesystem::temp_directory_path() / "delve_bench_scripts.dbc").string();
+			BytecodeFile::ErrorList errors;
+			BytecodeFile::write(file, getScriptSet(), nullptr, errors);
+
+			return file;
+		}();
+
+		return path;
+	}
+}
+
+/*
+* Starts up by compiling every script in a large set from source.
+*/
+static void startFromSource(benchmark::State& state)
+{
+	const auto& scripts = getScriptSet();
+	size_t bytes = 0;
+
+	for (const auto& script : scripts) {
+		bytes += script.source.size();
+	}
+
+	for (auto _ : state) {
+		for (const auto& script : scripts) {
+			Lexer lexer(script.source);
+			Parser parser(lexer.tokens());
+			BytecodeCompiler compiler(parser.getProgram());
+			benchmark::DoNotOptimize(compiler.getProgram());
+		}
+	}
+
+	state.counters["scripts"] = static_cast<double>(scripts.size());
+	state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+/*
+* Starts up by compiling the same scripts straight from their tokens, without building a tree.
+*/
+static void startSinglePass(benchmark::State& state)
+{
+	const auto& scripts = getScriptSet();
+	size_t bytes = 0;
+	size_t parsed = 0;
+
+	for (const auto& script : scripts) {
+		bytes += script.source.size();
+	}
+
+	for (auto _ : state) {
+		for (const auto& script : scripts) {
+			Lexer lexer(script.source);
+			SinglePassCompiler compiler(lexer.tokens());
+			parsed += compiler.getStatistics().parsed ? 1 : 0;
+			benchmark::DoNotOptimize(compiler.getProgram());
+		}
+	}
+
+	state.counters["scripts"] = static_cast<double>(scripts.size());
+	state.counters["parsed"] = static_cast<double>(parsed) / static_cast<double>(state.iterations());
+	state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+/*
+* Measures the time from source to the result of a script which is run once, compiling it either through the tree
+* or in a single pass.
+*/
+static void runFromSource(benchmark::State& state, const std::string& source, bool singlePass)
+{
+	for (auto _ : state) {
+		Lexer lexer(source);
+		std::shared_ptr<const BytecodeProgram> program;
+
+		if (singlePass) {
+			program = SinglePassCompiler(lexer.tokens()).getProgram();
+		}
+		else {
+			Parser parser(lexer.tokens());
+			program = BytecodeCompiler(parser.getProgram()).getProgram();
+		}
+
+		Task task(program);
+		benchmark::DoNotOptimize(task.runToCompletion());
+	}
+}
+
+/*
+* Starts up by mapping a precompiled bytecode file of the same scripts.  With the argument set, each script's source
+* is also hashed to check that the file is up to date, as load does.
+*/
+static void startFromFile(benchmark::State& state)
+{
+	const auto& scripts = getScriptSet();
+	const auto& path = getScriptSetFile();
+	bool checkSources = state.range(0) != 0;
+
+	for (auto _ : state) {
+		BytecodeFile file;
+		file.open(path);
+
+		for (const auto& script : scripts) {
+			benchmark::DoNotOptimize(checkSources ? file.load(script.name, script.source) : file.find(script.name));
+		}
+	}
+
+	state.counters["fileBytes"] = static_cast<double>(std::filesystem::file_size(path));
+}
+
+/*
+* Runs a script which creates closures far faster than it keeps them, with a small collection threshold so that the
+* collector runs many times per iteration.  Reports the peak heap size and pause times.
+*/
+static void collectGarbage(benchmark::State& state, const std::string& source)
+{
+	Script script(source);
+
+	Heap::Settings settings;
+	settings.initialThreshold = static_cast<size_t>(state.range(0));
+	script.setHeapSettings(settings);
+	script.run();
+
+	auto before = script.getHeapStatistics();
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(script.run());
+	}
+
+	auto after = script.getHeapStatistics();
+	uint32_t collections = after.collections - before.collections;
+	auto pauses = after.totalPause - before.totalPause;
+
+	state.counters["collections"] = benchmark::Counter(static_cast<double>(collections), benchmark::Counter::kAvgIterations);
+	state.counters["allocBytes"] = benchmark::Counter(static_cast<double>(after.bytesAllocated - before.bytesAllocated), benchmark::Counter::kIsRate);
+	state.counters["peakKB"] = static_cast<double>(after.peakBytes) / 1024.0;
+	state.counters["maxPauseUs"] = static_cast<double>(after.maxPause.count()) / 1000.0;
+	state.counters["avgPauseUs"] = collections ? static_cast<double>(pauses.count()) / collections / 1000.0 : 0.0;
+}
+
+/*
+* Runs a batch of scripts which make slow asynchronous host calls on an executor, which suspends scripts while their
+* calls are outstanding so that a few threads keep the whole batch in flight.
+*/
+static void runAsyncScripts(benchmark::State& state)
+{
+	SlowStore store(storeLatency);
+	Host host;
+	host.defineAsync("lookup", 1, [&store](std::vector<Value> arguments, HostCompletion completion) {
+		store.lookup(arguments[0].integer, std::move(completion));
+	});
+
+	Lexer lexer(lookups);
+	Parser parser(lexer.tokens());
+	BytecodeCompiler compiler(parser.getProgram(), &host);
+	auto program = compiler.getProgram();
+
+	size_t scriptCount = static_cast<size_t>(state.range(0));
+
+	Executor::Settings settings;
+	settings.threadCount = scriptThreads;
+	Executor executor(settings);
+
+	for (auto _ : state) {
+		for (size_t i = 0; i < scriptCount; ++i) {
+			executor.submit(std::make_shared<Task>(program));
+		}
+
+		executor.wait();
+	}
+
+	state.SetItemsProcessed(state.iterations() * scriptCount);
+	state.counters["suspensions"] = benchmark::Counter(static_cast<double>(executor.getStatistics().suspensions), benchmark::Counter::kAvgIterations);
+}
+
+/*
+* Runs the same batch with each thread blocking on the host calls of the script it is running, for comparison with
+* runAsyncScripts.
+*/
+static void runBlockingScripts(benchmark::State& state)
+{
+	SlowStore store(storeLatency);
+	Host host;
+	host.defineAsync("lookup", 1, [&store](std::vector<Value> arguments, HostCompletion completion) {
+		store.lookup(arguments[0].integer, std::move(completion));
+	});
+
+	Lexer lexer(lookups);
+	Parser parser(lexer.tokens());
+	BytecodeCompiler compiler(parser.getProgram(), &host);
+	auto program = compiler.getProgram();
+
+	size_t scriptCount = static_cast<size_t>(state.range(0));
+
+	for (auto _ : state) {
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> threads;
+
+		for (size_t i = 0; i < scriptThreads; ++i) {
+			threads.emplace_back([&]() {
+				while (next++ < scriptCount) {
+					Task task(program);
+					benchmark::DoNotOptimize(task.runToCompletion());
+				}
+			});
+		}
+
+		for (auto& thread : threads) {
+			thread.join();
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations() * scriptCount);
+}
+
+/*
+* Runs a synthetic mix of scripts with very uneven run times, mostly short scripts with a few long ones among them.
+* The argument is the executor's slice length in ticks, zero lets every script run to completion once started.
+* Reports throughput along with latency percentiles for all scripts and for the short ones alone.
+*/
+static void runMixedWorkload(benchmark::State& state)
+{
+	const size_t scriptCount = 10000;
+	const size_t longEvery = 20;
+
+	auto compile = [](const std::string& source) {
+		Lexer lexer(source);
+		Parser parser(lexer.tokens());
+		BytecodeCompiler compiler(parser.getProgram());
+
+		return compiler.getProgram();
+	};
+
+	auto shortProgram = compile("let fib = function(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2); }; fib(5);");
+	auto longProgram = compile("let fib = function(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2); }; fib(18);");
+
+	Executor::Settings settings;
+	settings.threadCount = scriptThreads;
+	settings.sliceTicks = static_cast<uint64_t>(state.range(0));
+	Executor executor(settings);
+
+	std::vector<std::chrono::nanoseconds> shortLatencies;
+
+	for (auto _ : state) {
+		std::vector<std::future<Executor::Result>> futures;
+		futures.reserve(scriptCount);
+
+		for (size_t i = 0; i < scriptCount; ++i) {
+			futures.push_back(executor.submit(std::make_shared<Task>(i % longEvery == 0 ? longProgram : shortProgram)));
+		}
+
+		for (size_t i = 0; i < scriptCount; ++i) {
+			auto result = futures[i].get();
+
+			if (i % longEvery != 0) {
+				shortLatencies.push_back(result.latency);
+			}
+		}
+	}
+
+	std::sort(shortLatencies.begin(), shortLatencies.end());
+	auto latencies = executor.getLatencies();
+	auto microseconds = [](std::chrono::nanoseconds duration) { return static_cast<double>(duration.count()) / 1000.0; };
+
+	state.SetItemsProcessed(state.iterations() * scriptCount);
+	state.counters["p50Us"] = microseconds(latencies.p50);
+	state.counters["p99Us"] = microseconds(latencies.p99);
+	state.counters["shortP50Us"] = microseconds(shortLatencies[shortLatencies.size() / 2]);
+	state.counters["shortP99Us"] = microseconds(shortLatencies[shortLatencies.size() * 99 / 100]);
+	state.counters["steals"] = benchmark::Counter(static_cast<double>(executor.getStatistics().steals), benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK_CAPTURE(runScript, FibonacciTreeWalk, fibonacci, ExecutionMode::TreeWalk)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(runScript, FibonacciClosure, fibonacci, ExecutionMode::Closure)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(runScript, FibonacciBytecode, fibonacci, ExecutionMode::Bytecode)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(runScript, ArithmeticTreeWalk, arithmetic, ExecutionMode::TreeWalk)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runScript, ArithmeticClosure, arithmetic, ExecutionMode::Closure)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runScript, ArithmeticBytecode, arithmetic, ExecutionMode::Bytecode)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runScript, ClosuresTreeWalk, closures, ExecutionMode::TreeWalk)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runScript, ClosuresClosure, closures, ExecutionMode::Closure)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runScript, ClosuresBytecode, closures, ExecutionMode::Bytecode)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runScript, ConstantsTreeWalk, constants, ExecutionMode::TreeWalk)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runOptimizedScript, ConstantsTreeWalk, constants, ExecutionMode::TreeWalk)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runScript, ConstantsClosure, constants, ExecutionMode::Closure)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runOptimizedScript, ConstantsClosure, constants, ExecutionMode::Closure)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runOptimizedScript, FibonacciClosure, fibonacci, ExecutionMode::Closure)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(runOptimizedScript, FibonacciBytecode, fibonacci, ExecutionMode::Bytecode)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(runOptimizedScript, ArithmeticClosure, arithmetic, ExecutionMode::Closure)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runOptimizedScript, ArithmeticBytecode, arithmetic, ExecutionMode::Bytecode)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runScript, DeadCodeClosure, deadCode, ExecutionMode::Closure)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runOptimizedScript, DeadCodeClosure, deadCode, ExecutionMode::Closure)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runScript, DeadCodeBytecode, deadCode, ExecutionMode::Bytecode)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runOptimizedScript, DeadCodeBytecode, deadCode, ExecutionMode::Bytecode)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(eliminateDeadCode, DeadCode, deadCode)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runScript, HelpersClosure, helpers, ExecutionMode::Closure)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runOptimizedScript, HelpersClosure, helpers, ExecutionMode::Closure)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runScript, HelpersBytecode, helpers, ExecutionMode::Bytecode)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runOptimizedScript, HelpersBytecode, helpers, ExecutionMode::Bytecode)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(inferTypes, Fibonacci, fibonacci);
+BENCHMARK_CAPTURE(inferTypes, Arithmetic, arithmetic);
+BENCHMARK_CAPTURE(inferTypes, Closures, closures);
+BENCHMARK_CAPTURE(inferTypes, Churn, churn);
+BENCHMARK_CAPTURE(inferTypes, Polymorphic, polymorphic);
+BENCHMARK_CAPTURE(inferTypes, Constants, constants);
+
+BENCHMARK_CAPTURE(runMemoizedScript, Fibonacci, fibonacci)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runLimitedScript, Fibonacci, fibonacci)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(runLimitedScript, Arithmetic, arithmetic)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runCalls, Fibonacci, fibonacci)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(runCalls, Closures, closures)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runCalls, Polymorphic, polymorphic)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runIsolates, Fibonacci, fibonacci)->ThreadRange(1, 16)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(callHostFunction, Bound, true);
+BENCHMARK_CAPTURE(callHostFunction, Defined, false);
+BENCHMARK_CAPTURE(runHostCalls, HostClosure, hostCalls, ExecutionMode::Closure)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runHostCalls, InlineClosure, inlineCalls, ExecutionMode::Closure)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runHostCalls, HostBytecode, hostCalls, ExecutionMode::Bytecode)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runHostCalls, InlineBytecode, inlineCalls, ExecutionMode::Bytecode)->Unit(benchmark::kMicrosecond);
+BENCHMARK(callScriptFunction);
+BENCHMARK_CAPTURE(selectRows, Batch, true)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(selectRows, PerRow, false)->Unit(benchmark::kMillisecond);
+BENCHMARK(startFromSource)->Unit(benchmark::kMillisecond);
+BENCHMARK(startSinglePass)->Unit(benchmark::kMillisecond);
+BENCHMARK(startFromFile)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(runFromSource, ArithmeticTree, arithmetic, false)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runFromSource, ArithmeticSinglePass, arithmetic, true)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runFromSource, ClosuresTree, closures, false)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runFromSource, ClosuresSinglePass, closures, true)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runFromSource, ConstantsTree, constants, false)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(runFromSource, ConstantsSinglePass, constants, true)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(lexScript, Smallest, std::string("1;"));
+BENCHMARK_CAPTURE(lookupCachedScript, Smallest, std::string("1;"));
+BENCHMARK_CAPTURE(lexScript, Fibonacci, fibonacci);
+BENCHMARK_CAPTURE(compileScript, Fibonacci, fibonacci);
+BENCHMARK_CAPTURE(lookupCachedScript, Fibonacci, fibonacci);
+BENCHMARK_CAPTURE(compileScript, Polymorphic, polymorphic);
+BENCHMARK_CAPTURE(lookupCachedScript, Polymorphic, polymorphic);
+BENCHMARK_CAPTURE(collectGarbage, Churn, churn)->Arg(16 * 1024)->Arg(256 * 1024)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+BENCHMARK(runAsyncScripts)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(runBlockingScripts)->Arg(1000)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(runMixedWorkload)->Arg(0)->Arg(1000)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,315 @@
+#include "executor.h"
+
+#include <algorithm>
+
+namespace Delve::Script {
+
+	namespace {
+		bool isUnlimited(const ExecutionLimits& limits)
+		{
+			return limits.fuel == 0 && limits.timeout.count() == 0;
+		}
+	}
+
+	Executor::Executor() : Executor(Settings())
+	{
+	}
+
+	/**
+	* Starts the worker threads.
+	* @param executorSettings thread count, slice length and default budget.  At least one thread is always started
+	*/
+	Executor::Executor(const Settings& executorSettings) : settings(executorSettings)
+	{
+		size_t threadCount = std::max<size_t>(settings.threadCount, 1);
+
+		for (size_t i = 0; i < threadCount; ++i) {
+			workers.push_back(std::make_unique<Worker>());
+		}
+
+		for (size_t i = 0; i < threadCount; ++i) {
+			threads.emplace_back([this, i]() { work(i); });
+		}
+	}
+
+	/**
+	* Waits for every submitted task to finish, then stops the worker threads.
+	*/
+	Executor::~Executor()
+	{
+		wait();
+
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping = true;
+		}
+
+		sleepCondition.notify_all();
+
+		for (auto& thread : threads) {
+			thread.join();
+		}
+	}
+
+	/**
+	* Queues a task to be run.  The task must not be resumed by anything else until it finishes.  The executor replaces
+	* the task's waker while it runs it, and gives it the default budget if it has no limits of its own.
+	* @param task a task which has not started
+	* @returns a future which receives the outcome of the task once it completes or fails
+	*/
+	std::future<Executor::Result> Executor::submit(std::shared_ptr<Task> task)
+	{
+		auto entry = std::make_shared<Entry>();
+		entry->task = std::move(task);
+		entry->hasPromise = true;
+
+		auto future = entry->promise.get_future();
+		start(std::move(entry));
+
+		return future;
+	}
+
+	/**
+	* Queues a task to be run, calling a handler instead of fulfilling a future when it finishes.
+	* @param task a task which has not started
+	* @param onComplete called on a worker thread once the task has completed or failed
+	*/
+	void Executor::submit(std::shared_ptr<Task> task, CompletionHandler onComplete)
+	{
+		auto entry = std::make_shared<Entry>();
+		entry->task = std::move(task);
+		entry->onComplete = std::move(onComplete);
+
+		start(std::move(entry));
+	}
+
+	/**
+	* Blocks until every submitted task has finished.
+	*/
+	void Executor::wait()
+	{
+		std::unique_lock<std::mutex> lock(idleMutex);
+		idleCondition.wait(lock, [this]() { return inFlight == 0; });
+	}
+
+	/**
+	* Totals the counters of every worker.  These accumulate until resetStatistics is called.
+	*/
+	Executor::Statistics Executor::getStatistics() const
+	{
+		Statistics total;
+
+		for (const auto& worker : workers) {
+			std::lock_guard<std::mutex> lock(worker->mutex);
+			total.completed += worker->statistics.completed;
+			total.failed += worker->statistics.failed;
+			total.suspensions += worker->statistics.suspensions;
+			total.yields += worker->statistics.yields;
+			total.steals += worker->statistics.steals;
+		}
+
+		return total;
+	}
+
+	/**
+	* Summarizes the time from submission to completion of every task finished since the statistics were last reset.
+	*/
+	Executor::LatencySummary Executor::getLatencies() const
+	{
+		std::vector<std::chrono::nanoseconds> latencies;
+
+		for (const auto& worker : workers) {
+			std::lock_guard<std::mutex> lock(worker->mutex);
+			latencies.insert(latencies.end(), worker->latencies.begin(), worker->latencies.end());
+		}
+
+		LatencySummary summary;
+		summary.count = latencies.size();
+
+		if (latencies.empty()) {
+			return summary;
+		}
+
+		std::sort(latencies.begin(), latencies.end());
+
+		std::chrono::nanoseconds total{ 0 };
+		for (auto latency : latencies) {
+			total += latency;
+		}
+
+		auto percentile = [&latencies](double fraction) {
+			return latencies[std::min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()))];
+		};
+
+		summary.mean = total / static_cast<int64_t>(latencies.size());
+		summary.p50 = percentile(0.5);
+		summary.p90 = percentile(0.9);
+		summary.p99 = percentile(0.99);
+		summary.max = latencies.back();
+
+		return summary;
+	}
+
+	void Executor::resetStatistics()
+	{
+		for (auto& worker : workers) {
+			std::lock_guard<std::mutex> lock(worker->mutex);
+			worker->statistics = Statistics();
+			worker->latencies.clear();
+		}
+	}
+
+	void Executor::start(std::shared_ptr<Entry> entry)
+	{
+		if (isUnlimited(entry->task->getLimits())) {
+			entry->task->setLimits(settings.limits);
+		}
+
+		// the waker keeps the entry alive while its task is suspended, it is cleared when the task finishes
+		entry->task->setWaker([this, entry]() { schedule(entry, true); });
+		entry->worker = nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+		entry->submitted = std::chrono::steady_clock::now();
+
+		{
+			std::lock_guard<std::mutex> lock(idleMutex);
+			inFlight += 1;
+		}
+
+		schedule(entry, false);
+	}
+
+	/*
+	* Queues a task on the worker which last ran it.
+	* @param woken true if the task is being woken from a suspended host call, in which case it is counted here rather than
+	* by the worker it suspended on, which may not get to it before the task finishes
+	*/
+	void Executor::schedule(const std::shared_ptr<Entry>& entry, bool woken)
+	{
+		auto& worker = *workers[entry->worker];
+
+		{
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			worker.queue.push_back(entry);
+			worker.statistics.suspensions += woken ? 1 : 0;
+		}
+
+		queued.fetch_add(1);
+
+		// taking the lock orders the increment before any sleeping worker's check of it
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+
+		sleepCondition.notify_one();
+	}
+
+	/*
+	* Takes the next task for a worker, from its own queue if possible and otherwise from another worker's.
+	* @returns the task, or null if every queue is empty
+	*/
+	std::shared_ptr<Executor::Entry> Executor::take(size_t index)
+	{
+		for (size_t i = 0; i < workers.size(); ++i) {
+			auto& worker = *workers[(index + i) % workers.size()];
+			std::shared_ptr<Entry> entry;
+
+			{
+				std::lock_guard<std::mutex> lock(worker.mutex);
+
+				if (worker.queue.empty()) {
+					continue;
+				}
+
+				entry = std::move(worker.queue.front());
+				worker.queue.pop_front();
+			}
+
+			queued.fetch_sub(1);
+
+			if (i != 0) {
+				std::lock_guard<std::mutex> lock(workers[index]->mutex);
+				workers[index]->statistics.steals += 1;
+			}
+
+			entry->worker = index;
+			return entry;
+		}
+
+		return nullptr;
+	}
+
+	void Executor::finish(size_t index, const std::shared_ptr<Entry>& entry, Task::Status status)
+	{
+		Task& task = *entry->task;
+		task.setWaker(nullptr);
+
+		auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - entry->submitted);
+
+		{
+			auto& worker = *workers[index];
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			worker.statistics.completed += status == Task::Status::Completed ? 1 : 0;
+			worker.statistics.failed += status == Task::Status::Failed ? 1 : 0;
+			worker.latencies.push_back(latency);
+		}
+
+		if (entry->onComplete) {
+			entry->onComplete(task);
+		}
+
+		if (entry->hasPromise) {
+			Result result;
+			result.status = status;
+			result.task = entry->task;
+			result.value = task.getResult();
+			result.errors = task.getErrors();
+			result.latency = latency;
+
+			entry->promise.set_value(std::move(result));
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(idleMutex);
+			inFlight -= 1;
+		}
+
+		idleCondition.notify_all();
+	}
+
+	void Executor::work(size_t index)
+	{
+		for (;;) {
+			auto entry = take(index);
+
+			if (!entry) {
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				sleepCondition.wait(lock, [this]() { return stopping || queued.load() != 0; });
+
+				if (stopping && queued.load() == 0) {
+					return;
+				}
+
+				continue;
+			}
+
+			Task::Status status = entry->task->resume(settings.sliceTicks);
+
+			// a suspended task belongs to whichever thread its host call wakes, which may already be running it
+			if (status == Task::Status::Suspended) {
+				continue;
+			}
+
+			if (status == Task::Status::Ready) {
+				{
+					std::lock_guard<std::mutex> lock(workers[index]->mutex);
+					workers[index]->statistics.yields += 1;
+				}
+
+				schedule(entry, false);
+				continue;
+			}
+
+			finish(index, entry, status);
+		}
+	}
+}
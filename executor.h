@@ -0,0 +1,148 @@
+#pragma once
+
+#include "budget.h"
+#include "task.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* Runs tasks on a fixed pool of threads.  A task which calls an asynchronous host function gives up its thread until
+* the function completes, and a task which runs for longer than its slice goes to the back of its worker's queue, so a
+* few threads can keep thousands of tasks in flight and long tasks cannot hold up short ones.
+*
+* Each worker has its own queue of tasks.  Workers take from the front of their own queue and, once it is empty, steal
+* from the front of the others', so uneven run times do not leave threads idle while tasks are waiting.
+*/
+class Executor
+{
+public:
+	using ErrorList = std::vector<std::string>;
+	using CompletionHandler = std::function<void(Task&)>;
+
+	struct Settings
+	{
+		size_t threadCount = std::thread::hardware_concurrency();
+
+		// ticks a task may run for before it yields to the next task in the queue, zero to never yield
+		uint64_t sliceTicks = 10000;
+
+		// budget given to every submitted task which has no limits of its own
+		ExecutionLimits limits;
+	};
+
+	// The outcome of a task, delivered through the future returned by submit.
+	struct Result
+	{
+		Task::Status status = Task::Status::Ready;
+
+		// holds the task so that a function result stays valid
+		std::shared_ptr<Task> task;
+		Value value;
+		ErrorList errors;
+
+		// time from submission to completion
+		std::chrono::nanoseconds latency{ 0 };
+	};
+
+	struct Statistics
+	{
+		uint64_t completed = 0;
+		uint64_t failed = 0;
+
+		// number of times tasks were suspended at a host call or yielded at the end of a slice
+		uint64_t suspensions = 0;
+		uint64_t yields = 0;
+
+		// number of tasks taken from another worker's queue
+		uint64_t steals = 0;
+	};
+
+	struct LatencySummary
+	{
+		size_t count = 0;
+		std::chrono::nanoseconds mean{ 0 };
+		std::chrono::nanoseconds p50{ 0 };
+		std::chrono::nanoseconds p90{ 0 };
+		std::chrono::nanoseconds p99{ 0 };
+		std::chrono::nanoseconds max{ 0 };
+	};
+
+public:
+	Executor();
+	Executor(const Settings& settings);
+	~Executor();
+
+	Executor(const Executor&) = delete;
+	Executor& operator=(const Executor&) = delete;
+
+public:
+	std::future<Result> submit(std::shared_ptr<Task> task);
+	void submit(std::shared_ptr<Task> task, CompletionHandler onComplete);
+	void wait();
+
+	Statistics getStatistics() const;
+	LatencySummary getLatencies() const;
+	void resetStatistics();
+
+	inline size_t threadCount() const { return workers.size(); }
+
+private:
+	struct Entry
+	{
+		std::shared_ptr<Task> task;
+		CompletionHandler onComplete;
+		std::promise<Result> promise;
+		bool hasPromise = false;
+		std::chrono::steady_clock::time_point submitted;
+
+		// the worker which last ran the task, where it is queued again when it wakes
+		size_t worker = 0;
+	};
+
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<std::shared_ptr<Entry>> queue;
+		Statistics statistics;
+		std::vector<std::chrono::nanoseconds> latencies;
+	};
+
+private:
+	void start(std::shared_ptr<Entry> entry);
+	void schedule(const std::shared_ptr<Entry>& entry, bool woken);
+	std::shared_ptr<Entry> take(size_t worker);
+	void finish(size_t worker, const std::shared_ptr<Entry>& entry, Task::Status status);
+	void work(size_t worker);
+
+private:
+	Settings settings;
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<size_t> nextWorker{ 0 };
+
+	// number of tasks waiting in queues, idle workers sleep until it is non zero
+	std::atomic<size_t> queued{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable sleepCondition;
+	bool stopping = false;
+
+	mutable std::mutex idleMutex;
+	std::condition_variable idleCondition;
+	size_t inFlight = 0;
+
+	std::vector<std::thread> threads;
+};
+
+}
@@ -0,0 +1,233 @@
+#include "executor.h"
+#include "parser.h"
+#include "lexer.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Delve::Script;
+
+namespace {
+	std::shared_ptr<const BytecodeProgram> compile(const std::string& code, const Host* host = nullptr)
+	{
+		Lexer lexer(code);
+		Parser parser(lexer.tokens());
+		BytecodeCompiler compiler(parser.getProgram(), host);
+
+		return compiler.getProgram();
+	}
+
+	Executor::Settings withThreads(size_t threadCount, uint64_t sliceTicks = 10000)
+	{
+		Executor::Settings settings;
+		settings.threadCount = threadCount;
+		settings.sliceTicks = sliceTicks;
+
+		return settings;
+	}
+}
+
+/*
+* Tests that many more tasks than threads can be waiting on host calls at once.  Every call is completed by a single
+* thread which only answers once all of the tasks have made their first call, which would deadlock if a waiting task
+* held on to its thread.
+*/
+TEST(Executor, MultiplexesWaitingTasks)
+{
+	const size_t taskCount = 1000;
+
+	std::mutex mutex;
+	std::vector<std::pair<int64_t, HostCompletion>> requests;
+
+	Host host;
+	host.defineAsync("lookup", 1, [&](std::vector<Value> arguments, HostCompletion completion) {
+		std::lock_guard<std::mutex> lock(mutex);
+		requests.emplace_back(arguments[0].integer, completion);
+	});
+
+	auto program = compile("let n = lookup(1); let m = lookup(n); n + m;", &host);
+	ASSERT_NE(program, nullptr);
+
+	std::atomic<bool> finished(false);
+
+	std::thread store([&]() {
+		bool firstRound = true;
+
+		while (!finished) {
+			std::vector<std::pair<int64_t, HostCompletion>> batch;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				if (!firstRound || requests.size() == taskCount) {
+					batch.swap(requests);
+					firstRound = false;
+				}
+			}
+
+			for (auto& request : batch) {
+				request.second.resolve(Value::fromInteger(request.first * 10));
+			}
+
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	});
+
+	std::atomic<int64_t> total(0);
+
+	{
+		Executor executor(withThreads(2));
+
+		for (size_t i = 0; i < taskCount; ++i) {
+			executor.submit(std::make_shared<Task>(program), [&total](Task& task) {
+				total += task.getResult().integer;
+			});
+		}
+
+		executor.wait();
+
+		auto statistics = executor.getStatistics();
+		EXPECT_EQ(statistics.completed, taskCount);
+		EXPECT_EQ(statistics.failed, 0);
+
+		// every first lookup waits for the others, a second lookup may complete before its task gets to suspend
+		EXPECT_GE(statistics.suspensions, taskCount);
+		EXPECT_LE(statistics.suspensions, 2 * taskCount);
+	}
+
+	finished = true;
+	store.join();
+
+	EXPECT_EQ(total, static_cast<int64_t>(taskCount) * (10 + 100));
+}
+
+/*
+* Tests that a long running task yields its thread at the end of each slice, so that short tasks submitted after it
+* are not held up until it finishes.
+*/
+TEST(Executor, Slices)
+{
+	auto longProgram = compile("let spin = function(n) { if (n == 0) { return 0; } spin(n - 1); }; spin(2000000);");
+	auto shortProgram = compile("let spin = function(n) { if (n == 0) { return 0; } spin(n - 1); }; spin(10);");
+	ASSERT_NE(longProgram, nullptr);
+	ASSERT_NE(shortProgram, nullptr);
+
+	std::atomic<bool> longFinished(false);
+	std::atomic<bool> shortFinishedFirst(false);
+
+	Executor executor(withThreads(1, 1000));
+	executor.submit(std::make_shared<Task>(longProgram), [&longFinished](Task&) { longFinished = true; });
+	executor.submit(std::make_shared<Task>(shortProgram), [&](Task&) { shortFinishedFirst = !longFinished; });
+	executor.wait();
+
+	EXPECT_TRUE(longFinished);
+	EXPECT_TRUE(shortFinishedFirst);
+	EXPECT_GT(executor.getStatistics().yields, 1000);
+}
+
+/*
+* Tests that tasks which fail are reported as finished with their errors.
+*/
+TEST(Executor, Failures)
+{
+	auto program = compile("let f = function(n) { n / 0; }; f(1);");
+	ASSERT_NE(program, nullptr);
+
+	auto task = std::make_shared<Task>(program);
+
+	Executor executor(withThreads(2));
+	auto result = executor.submit(task).get();
+
+	EXPECT_EQ(result.status, Task::Status::Failed);
+	ASSERT_EQ(result.errors.size(), 1);
+	EXPECT_EQ(result.errors[0], "Division by zero.");
+	EXPECT_EQ(task->getStatus(), Task::Status::Failed);
+	EXPECT_EQ(executor.getStatistics().failed, 1);
+}
+
+/*
+* Tests that submitting a task returns a future which receives its result.
+*/
+TEST(Executor, Futures)
+{
+	auto program = compile("let fib = function(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2); }; fib(15);");
+	ASSERT_NE(program, nullptr);
+
+	Executor executor(withThreads(4, 100));
+	std::vector<std::future<Executor::Result>> futures;
+
+	for (int i = 0; i < 100; ++i) {
+		futures.push_back(executor.submit(std::make_shared<Task>(program)));
+	}
+
+	for (auto& future : futures) {
+		auto result = future.get();
+
+		EXPECT_EQ(result.status, Task::Status::Completed);
+		EXPECT_EQ(result.value.integer, 610);
+		EXPECT_GT(result.latency.count(), 0);
+	}
+
+	executor.wait();
+
+	auto statistics = executor.getStatistics();
+	EXPECT_EQ(statistics.completed, 100);
+	EXPECT_GT(statistics.yields, 100);
+
+	auto latencies = executor.getLatencies();
+	EXPECT_EQ(latencies.count, 100);
+	EXPECT_LE(latencies.p50, latencies.p90);
+	EXPECT_LE(latencies.p90, latencies.p99);
+	EXPECT_LE(latencies.p99, latencies.max);
+
+	executor.resetStatistics();
+	EXPECT_EQ(executor.getStatistics().completed, 0);
+	EXPECT_EQ(executor.getLatencies().count, 0);
+}
+
+/*
+* Tests that tasks without limits of their own are given the executor's budget, so a runaway script is stopped while
+* the others complete.
+*/
+TEST(Executor, Budgets)
+{
+	auto runaway = compile("let spin = function(n) { spin(n + 1); }; spin(0);");
+	auto program = compile("let count = function(n) { if (n == 0) { return 0; } count(n - 1); }; count(100);");
+	ASSERT_NE(runaway, nullptr);
+	ASSERT_NE(program, nullptr);
+
+	auto settings = withThreads(2);
+	settings.limits.fuel = 100000;
+	Executor executor(settings);
+
+	auto runawayResult = executor.submit(std::make_shared<Task>(runaway));
+
+	// a task's own limits take precedence
+	auto limited = std::make_shared<Task>(program);
+	ExecutionLimits limits;
+	limits.fuel = 10;
+	limited->setLimits(limits);
+	auto limitedResult = executor.submit(limited);
+
+	auto result = executor.submit(std::make_shared<Task>(program));
+
+	auto outcome = runawayResult.get();
+	EXPECT_EQ(outcome.status, Task::Status::Failed);
+	ASSERT_EQ(outcome.errors.size(), 1);
+	EXPECT_EQ(outcome.errors[0], "Fuel exhausted.");
+
+	outcome = limitedResult.get();
+	EXPECT_EQ(outcome.status, Task::Status::Failed);
+
+	outcome = result.get();
+	EXPECT_EQ(outcome.status, Task::Status::Completed);
+	EXPECT_EQ(outcome.task->getFuelUsed(), 202);
+}
@@ -0,0 +1,585 @@
+#include "folder.h"
+#include "trace.h"
+
+#include <iterator>
+
+namespace Delve::Script {
+	namespace {
+		Value applyOperator(Token::Type op, const Value& left, const Value& right)
+		{
+			switch (op) {
+			case Token::Type::Plus:
+				return Operators::add(left, right);
+			case Token::Type::Minus:
+				return Operators::subtract(left, right);
+			case Token::Type::Multiply:
+				return Operators::multiply(left, right);
+			case Token::Type::Divide:
+				return Operators::divide(left, right);
+			case Token::Type::LessThan:
+				return Operators::lessThan(left, right);
+			case Token::Type::GreaterThan:
+				return Operators::greaterThan(left, right);
+			case Token::Type::Equal:
+				return Operators::equal(left, right);
+			default:
+				return Operators::notEqual(left, right);
+			}
+		}
+
+		bool isIntegerConstant(const Ast::Expression* expression, int64_t value)
+		{
+			return expression->kind == Ast::Node::Kind::IntegerLiteral && static_cast<const Ast::IntegerLiteral*>(expression)->value == value;
+		}
+
+		bool isBooleanConstant(const Ast::Expression* expression, bool value)
+		{
+			return expression->kind == Ast::Node::Kind::BooleanLiteral && (expression->token->type == Token::Type::True) == value;
+		}
+
+		// Returns true if the block declares names which would leak into the enclosing scope if its statements were moved there.
+		bool declaresNames(const Ast::BlockStatement* block)
+		{
+			for (auto& statement : block->statements) {
+				if (statement && statement->kind == Ast::Node::Kind::LetStatement) {
+					return true;
+				}
+			}
+
+			return false;
+		}
+	}
+
+	/**
+	* Folds the program in place.  Nodes which are replaced are destroyed, and any tokens needed for new nodes are
+	* added to the program's token list.  Statistics are reset each time this method is called.
+	* @param ast the program to optimize
+	*/
+	void ConstantFolder::fold(Ast::Program& ast)
+	{
+		DELVE_SCRIPT_TRACE("fold constants", "optimize");
+
+		statistics = Statistics();
+		program = &ast;
+
+		size_t nodeCount = 0;
+		for (auto& statement : program->statements) {
+			nodeCount += countNodes(statement.get());
+		}
+
+		foldStatements(program->statements);
+
+		for (auto& statement : program->statements) {
+			nodeCount -= countNodes(statement.get());
+		}
+
+		statistics.nodesEliminated = static_cast<uint32_t>(nodeCount);
+		program = nullptr;
+	}
+
+	/*
+	* Folds each statement in a list.  Blocks which do not declare any names, including those left behind by pruned if
+	* statements, are spliced into the list.  An empty block is kept if it is the final statement since the list then
+	* evaluates to null.
+	*/
+	void ConstantFolder::foldStatements(std::vector<std::unique_ptr<Ast::Statement>>& statements)
+	{
+		size_t i = 0;
+
+		while (i < statements.size()) {
+			auto& statement = statements[i];
+
+			if (!statement) {
+				i += 1;
+				continue;
+			}
+
+			foldStatement(statement);
+
+			if (statement->kind != Ast::Node::Kind::BlockStatement) {
+				i += 1;
+				continue;
+			}
+
+			auto* block = static_cast<Ast::BlockStatement*>(statement.get());
+
+			if (declaresNames(block) || (block->statements.empty() && i + 1 == statements.size())) {
+				i += 1;
+				continue;
+			}
+
+			auto inner = std::move(block->statements);
+			statements.erase(statements.begin() + i);
+			statements.insert(statements.begin() + i, std::make_move_iterator(inner.begin()), std::make_move_iterator(inner.end()));
+			i += inner.size();
+		}
+	}
+
+	void ConstantFolder::foldStatement(std::unique_ptr<Ast::Statement>& statement)
+	{
+		switch (statement->kind) {
+		case Ast::Node::Kind::LetStatement:
+			foldExpression(static_cast<Ast::LetStatement*>(statement.get())->expression);
+			break;
+
+		case Ast::Node::Kind::ReturnStatement:
+			foldExpression(static_cast<Ast::ReturnStatement*>(statement.get())->expression);
+			break;
+
+		case Ast::Node::Kind::ExpressionStatement:
+			foldExpression(static_cast<Ast::ExpressionStatement*>(statement.get())->expression);
+			break;
+
+		case Ast::Node::Kind::BlockStatement:
+			foldStatements(static_cast<Ast::BlockStatement*>(statement.get())->statements);
+			break;
+
+		case Ast::Node::Kind::IfStatement: {
+			auto* ifStatement = static_cast<Ast::IfStatement*>(statement.get());
+			foldExpression(ifStatement->condition);
+
+			if (ifStatement->consequence) {
+				foldStatements(ifStatement->consequence->statements);
+			}
+
+			if (ifStatement->alternative) {
+				foldStatements(ifStatement->alternative->statements);
+			}
+
+			if (!ifStatement->condition || !ifStatement->consequence || !isLiteral(ifStatement->condition.get())) {
+				break;
+			}
+
+			// The branch which will run replaces the if statement.  The blocks keep their own scope until the enclosing
+			// statement list decides whether they can be spliced in.
+			std::unique_ptr<Ast::BlockStatement> branch;
+
+			if (literalValue(ifStatement->condition.get()).isTruthy()) {
+				branch = std::move(ifStatement->consequence);
+			}
+			else if (ifStatement->alternative) {
+				branch = std::move(ifStatement->alternative);
+			}
+			else {
+				branch = std::move(ifStatement->consequence);
+				branch->statements.clear();
+			}
+
+			statement = std::move(branch);
+			statistics.branchesPruned += 1;
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	void ConstantFolder::foldExpression(std::unique_ptr<Ast::Expression>& expression)
+	{
+		if (!expression) {
+			return;
+		}
+
+		switch (expression->kind) {
+		case Ast::Node::Kind::PrefixExpression:
+			foldPrefixExpression(expression);
+			break;
+
+		case Ast::Node::Kind::InfixExpression:
+			foldInfixExpression(expression);
+			break;
+
+		case Ast::Node::Kind::CallExpression: {
+			auto* callExpression = static_cast<Ast::CallExpression*>(expression.get());
+			foldExpression(callExpression->function);
+
+			for (auto& argument : callExpression->arguments) {
+				foldExpression(argument);
+			}
+
+			break;
+		}
+
+		case Ast::Node::Kind::FunctionLiteral: {
+			auto* function = static_cast<Ast::FunctionLiteral*>(expression.get());
+
+			if (function->body) {
+				foldStatements(function->body->statements);
+			}
+
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	void ConstantFolder::foldPrefixExpression(std::unique_ptr<Ast::Expression>& expression)
+	{
+		auto* prefixExpression = static_cast<Ast::PrefixExpression*>(expression.get());
+		foldExpression(prefixExpression->rightExpression);
+
+		auto* right = prefixExpression->rightExpression.get();
+
+		if (!right) {
+			return;
+		}
+
+		if (isLiteral(right)) {
+			Value value = literalValue(right);
+
+			// Operations which would fail are left for the runtime to report.
+			try {
+				Value result = prefixExpression->token->type == Token::Type::Negate ? Operators::negate(value) : Operators::minus(value);
+				expression = createLiteral(result, prefixExpression->token);
+				statistics.expressionsFolded += 1;
+			}
+			catch (const RuntimeError&) {}
+
+			return;
+		}
+
+		// !!x => x when x is known to be a boolean
+		if (prefixExpression->token->type == Token::Type::Negate && right->kind == Ast::Node::Kind::PrefixExpression && right->token->type == Token::Type::Negate) {
+			auto& inner = static_cast<Ast::PrefixExpression*>(right)->rightExpression;
+
+			if (inner && isBooleanTyped(inner.get())) {
+				auto replacement = std::move(inner);
+				expression = std::move(replacement);
+				statistics.identitiesApplied += 1;
+			}
+		}
+	}
+
+	void ConstantFolder::foldInfixExpression(std::unique_ptr<Ast::Expression>& expression)
+	{
+		auto* infixExpression = static_cast<Ast::InfixExpression*>(expression.get());
+		foldExpression(infixExpression->left);
+		foldExpression(infixExpression->right);
+
+		if (!infixExpression->left || !infixExpression->right) {
+			return;
+		}
+
+		if (isLiteral(infixExpression->left.get()) && isLiteral(infixExpression->right.get())) {
+			try {
+				Value result = applyOperator(infixExpression->token->type, literalValue(infixExpression->left.get()), literalValue(infixExpression->right.get()));
+				expression = createLiteral(result, infixExpression->token);
+				statistics.expressionsFolded += 1;
+			}
+			catch (const RuntimeError&) {}
+
+			return;
+		}
+
+		if (reassociateInfixExpression(infixExpression)) {
+			statistics.expressionsFolded += 1;
+		}
+
+		if (simplifyInfixExpression(expression)) {
+			statistics.identitiesApplied += 1;
+		}
+	}
+
+	/*
+	* Combines the constants in chains such as (x + 1) + 2 or (2 * x) * 3.  Integer arithmetic wraps so these operators
+	* are associative, and the non constant operand stays on the same side so that if it is not an integer the same
+	* type mismatch is reported.
+	* @returns true if the expression was rewritten
+	*/
+	bool ConstantFolder::reassociateInfixExpression(Ast::InfixExpression* infixExpression)
+	{
+		Token::Type op = infixExpression->token->type;
+
+		if ((op != Token::Type::Plus && op != Token::Type::Multiply) || infixExpression->right->kind != Ast::Node::Kind::IntegerLiteral) {
+			return false;
+		}
+
+		auto* left = infixExpression->left.get();
+		if (left->kind != Ast::Node::Kind::InfixExpression || left->token->type != op) {
+			return false;
+		}
+
+		auto* inner = static_cast<Ast::InfixExpression*>(left);
+		if (!inner->left || !inner->right) {
+			return false;
+		}
+
+		// (x op c1) op c2 => x op (c1 op c2)
+		if (inner->right->kind == Ast::Node::Kind::IntegerLiteral) {
+			Value combined = applyOperator(op, literalValue(inner->right.get()), literalValue(infixExpression->right.get()));
+			infixExpression->right = createLiteral(combined, infixExpression->right->token);
+
+			auto innerLeft = std::move(inner->left);
+			infixExpression->left = std::move(innerLeft);
+
+			return true;
+		}
+
+		// (c1 op x) op c2 => (c1 op c2) op x
+		if (inner->left->kind == Ast::Node::Kind::IntegerLiteral) {
+			Value combined = applyOperator(op, literalValue(inner->left.get()), literalValue(infixExpression->right.get()));
+			auto innerRight = std::move(inner->right);
+
+			infixExpression->left = createLiteral(combined, inner->left->token);
+			infixExpression->right = std::move(innerRight);
+
+			return true;
+		}
+
+		return false;
+	}
+
+	/*
+	* Applies identities such as x * 1 => x and x == true => x.  These are only applied when the other operand is known
+	* to have the right type, otherwise the rewrite would hide a type mismatch the program is expected to report.
+	* @returns true if the expression was rewritten
+	*/
+	bool ConstantFolder::simplifyInfixExpression(std::unique_ptr<Ast::Expression>& expression)
+	{
+		auto* infixExpression = static_cast<Ast::InfixExpression*>(expression.get());
+		const auto* left = infixExpression->left.get();
+		const auto* right = infixExpression->right.get();
+		const Token* position = infixExpression->token;
+
+		std::unique_ptr<Ast::Expression> replacement;
+
+		switch (infixExpression->token->type) {
+		case Token::Type::Plus:
+			if (isIntegerConstant(right, 0) && isIntegerTyped(left)) {
+				replacement = std::move(infixExpression->left);
+			}
+			else if (isIntegerConstant(left, 0) && isIntegerTyped(right)) {
+				replacement = std::move(infixExpression->right);
+			}
+			break;
+
+		case Token::Type::Minus:
+			if (isIntegerConstant(right, 0) && isIntegerTyped(left)) {
+				replacement = std::move(infixExpression->left);
+			}
+			break;
+
+		case Token::Type::Multiply:
+			if (isIntegerConstant(right, 1) && isIntegerTyped(left)) {
+				replacement = std::move(infixExpression->left);
+			}
+			else if (isIntegerConstant(left, 1) && isIntegerTyped(right)) {
+				replacement = std::move(infixExpression->right);
+			}
+			break;
+
+		case Token::Type::Divide:
+			if (isIntegerConstant(right, 1) && isIntegerTyped(left)) {
+				replacement = std::move(infixExpression->left);
+			}
+			break;
+
+		case Token::Type::Equal:
+			if (isBooleanConstant(right, true) && isBooleanTyped(left)) {
+				replacement = std::move(infixExpression->left);
+			}
+			else if (isBooleanConstant(left, true) && isBooleanTyped(right)) {
+				replacement = std::move(infixExpression->right);
+			}
+			else if (isBooleanConstant(right, false) && isBooleanTyped(left)) {
+				replacement = createNegation(std::move(infixExpression->left), position);
+			}
+			else if (isBooleanConstant(left, false) && isBooleanTyped(right)) {
+				replacement = createNegation(std::move(infixExpression->right), position);
+			}
+			break;
+
+		case Token::Type::NotEqual:
+			if (isBooleanConstant(right, false) && isBooleanTyped(left)) {
+				replacement = std::move(infixExpression->left);
+			}
+			else if (isBooleanConstant(left, false) && isBooleanTyped(right)) {
+				replacement = std::move(infixExpression->right);
+			}
+			else if (isBooleanConstant(right, true) && isBooleanTyped(left)) {
+				replacement = createNegation(std::move(infixExpression->left), position);
+			}
+			else if (isBooleanConstant(left, true) && isBooleanTyped(right)) {
+				replacement = createNegation(std::move(infixExpression->right), position);
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		if (!replacement) {
+			return false;
+		}
+
+		expression = std::move(replacement);
+		return true;
+	}
+
+	std::unique_ptr<Ast::Expression> ConstantFolder::createLiteral(const Value& value, const Token* position)
+	{
+		if (value.type == Value::Type::Boolean) {
+			const Token* token = value.boolean ? createToken(Token::Type::True, "true", position) : createToken(Token::Type::False, "false", position);
+			return std::make_unique<Ast::BooleanLiteral>(token);
+		}
+
+		auto integerLiteral = std::make_unique<Ast::IntegerLiteral>(createToken(Token::Type::Integer, std::to_string(value.integer), position));
+		integerLiteral->value = value.integer;
+
+		return integerLiteral;
+	}
+
+	std::unique_ptr<Ast::Expression> ConstantFolder::createNegation(std::unique_ptr<Ast::Expression> expression, const Token* position)
+	{
+		auto prefixExpression = std::make_unique<Ast::PrefixExpression>(createToken(Token::Type::Negate, "!", position));
+		prefixExpression->rightExpression = std::move(expression);
+
+		return prefixExpression;
+	}
+
+	/*
+	* Creates a token owned by the program being folded.  The new token takes its line and column from the token of the
+	* node it replaces so that errors are still reported at a sensible location.
+	*/
+	const Token* ConstantFolder::createToken(Token::Type type, const std::string& literal, const Token* position)
+	{
+		auto token = std::make_unique<Token>(type, literal);
+		token->lineNum = position->lineNum;
+		token->colNum = position->colNum;
+
+		program->tokens.push_back(std::move(token));
+
+		return program->tokens.back().get();
+	}
+
+	bool ConstantFolder::isLiteral(const Ast::Expression* expression)
+	{
+		return expression->kind == Ast::Node::Kind::IntegerLiteral || expression->kind == Ast::Node::Kind::BooleanLiteral;
+	}
+
+	Value ConstantFolder::literalValue(const Ast::Expression* expression)
+	{
+		if (expression->kind == Ast::Node::Kind::IntegerLiteral) {
+			return Value::fromInteger(static_cast<const Ast::IntegerLiteral*>(expression)->value);
+		}
+
+		return Value::fromBoolean(expression->token->type == Token::Type::True);
+	}
+
+	// Returns true if the expression can only ever produce an integer.
+	bool ConstantFolder::isIntegerTyped(const Ast::Expression* expression)
+	{
+		switch (expression->kind) {
+		case Ast::Node::Kind::IntegerLiteral:
+			return true;
+
+		case Ast::Node::Kind::PrefixExpression:
+			return expression->token->type == Token::Type::Minus;
+
+		case Ast::Node::Kind::InfixExpression: {
+			Token::Type op = expression->token->type;
+			return op == Token::Type::Plus || op == Token::Type::Minus || op == Token::Type::Multiply || op == Token::Type::Divide;
+		}
+
+		default:
+			return false;
+		}
+	}
+
+	// Returns true if the expression can only ever produce a boolean.
+	bool ConstantFolder::isBooleanTyped(const Ast::Expression* expression)
+	{
+		switch (expression->kind) {
+		case Ast::Node::Kind::BooleanLiteral:
+			return true;
+
+		case Ast::Node::Kind::PrefixExpression:
+			return expression->token->type == Token::Type::Negate;
+
+		case Ast::Node::Kind::InfixExpression: {
+			Token::Type op = expression->token->type;
+			return op == Token::Type::LessThan || op == Token::Type::GreaterThan || op == Token::Type::Equal || op == Token::Type::NotEqual;
+		}
+
+		default:
+			return false;
+		}
+	}
+
+	/**
+	* Counts the nodes in a subtree.
+	* @param node root of the subtree, may be null
+	* @returns the number of nodes in the subtree including the root
+	*/
+	size_t ConstantFolder::countNodes(const Ast::Node* node)
+	{
+		if (!node) {
+			return 0;
+		}
+
+		size_t count = 1;
+
+		switch (node->kind) {
+		case Ast::Node::Kind::PrefixExpression:
+			count += countNodes(static_cast<const Ast::PrefixExpression*>(node)->rightExpression.get());
+			break;
+
+		case Ast::Node::Kind::InfixExpression: {
+			auto* infixExpression = static_cast<const Ast::InfixExpression*>(node);
+			count += countNodes(infixExpression->left.get()) + countNodes(infixExpression->right.get());
+			break;
+		}
+
+		case Ast::Node::Kind::CallExpression: {
+			auto* callExpression = static_cast<const Ast::CallExpression*>(node);
+			count += countNodes(callExpression->function.get());
+
+			for (auto& argument : callExpression->arguments) {
+				count += countNodes(argument.get());
+			}
+
+			break;
+		}
+
+		case Ast::Node::Kind::FunctionLiteral: {
+			auto* function = static_cast<const Ast::FunctionLiteral*>(node);
+			count += function->parameters.size() + countNodes(function->body.get());
+			break;
+		}
+
+		case Ast::Node::Kind::LetStatement: {
+			auto* letStatement = static_cast<const Ast::LetStatement*>(node);
+			count += countNodes(letStatement->identifier.get()) + countNodes(letStatement->expression.get());
+			break;
+		}
+
+		case Ast::Node::Kind::ReturnStatement:
+			count += countNodes(static_cast<const Ast::ReturnStatement*>(node)->expression.get());
+			break;
+
+		case Ast::Node::Kind::ExpressionStatement:
+			count += countNodes(static_cast<const Ast::ExpressionStatement*>(node)->expression.get());
+			break;
+
+		case Ast::Node::Kind::BlockStatement:
+			for (auto& statement : static_cast<const Ast::BlockStatement*>(node)->statements) {
+				count += countNodes(statement.get());
+			}
+			break;
+
+		case Ast::Node::Kind::IfStatement: {
+			auto* ifStatement = static_cast<const Ast::IfStatement*>(node);
+			count += countNodes(ifStatement->condition.get()) + countNodes(ifStatement->consequence.get()) + countNodes(ifStatement->alternative.get());
+			break;
+		}
+
+		default:
+			break;
+		}
+
+		return count;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "ast.h"
+#include "value.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* Optimization pass which evaluates constant subexpressions at compile time, applies algebraic identities which are
+* guaranteed not to change the behavior of the program and removes if statement branches that can never run.
+*/
+class ConstantFolder
+{
+public:
+	struct Statistics
+	{
+		uint32_t expressionsFolded = 0;
+		uint32_t identitiesApplied = 0;
+		uint32_t branchesPruned = 0;
+		uint32_t nodesEliminated = 0;
+	};
+
+public:
+	void fold(Ast::Program& program);
+
+	inline const Statistics& getStatistics() const { return statistics; }
+
+	static size_t countNodes(const Ast::Node* node);
+
+private:
+	void foldStatements(std::vector<std::unique_ptr<Ast::Statement>>& statements);
+	void foldStatement(std::unique_ptr<Ast::Statement>& statement);
+	void foldExpression(std::unique_ptr<Ast::Expression>& expression);
+	void foldPrefixExpression(std::unique_ptr<Ast::Expression>& expression);
+	void foldInfixExpression(std::unique_ptr<Ast::Expression>& expression);
+
+	bool simplifyInfixExpression(std::unique_ptr<Ast::Expression>& expression);
+	bool reassociateInfixExpression(Ast::InfixExpression* infixExpression);
+
+	std::unique_ptr<Ast::Expression> createLiteral(const Value& value, const Token* position);
+	std::unique_ptr<Ast::Expression> createNegation(std::unique_ptr<Ast::Expression> expression, const Token* position);
+	const Token* createToken(Token::Type type, const std::string& literal, const Token* position);
+
+	static bool isLiteral(const Ast::Expression* expression);
+	static Value literalValue(const Ast::Expression* expression);
+	static bool isIntegerTyped(const Ast::Expression* expression);
+	static bool isBooleanTyped(const Ast::Expression* expression);
+
+private:
+	Ast::Program* program = nullptr;
+	Statistics statistics;
+};
+
+}
@@ -0,0 +1,182 @@
+#include "folder.h"
+#include "parser.h"
+#include "lexer.h"
+#include "script.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace Delve::Script;
+
+// helper function that folds each input program and compares its string representation to the expected output
+void compareFoldedToExpectedOutput(const std::vector<std::string>& inputs, const std::vector<std::string>& expectedOutput);
+
+TEST(ConstantFolder, ConstantExpressions)
+{
+	std::vector<std::string> inputs = {
+		"(2 * 60) * 1000;",
+		"!true;",
+		"-(3 - 5);",
+		"1 < 2 == true;",
+		"let x = 10 / 2 + 1;",
+		"f(1 + 1, 2 * 3);",
+		"function(x) { return 2 + 2; };"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"120000;\n",
+		"false;\n",
+		"2;\n",
+		"true;\n",
+		"let x = 6;\n",
+		"f(2, 6);\n",
+		"function(x) {\nreturn 4;\n};\n"
+	};
+
+	compareFoldedToExpectedOutput(inputs, expectedOutput);
+}
+
+/*
+* Tests that operations which fail at runtime are left in place so that the error is still reported.
+*/
+TEST(ConstantFolder, FailingOperationsAreNotFolded)
+{
+	std::vector<std::string> inputs = {
+		"1 / 0;",
+		"1 + true;",
+		"-false;"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"(1 / 0);\n",
+		"(1 + true);\n",
+		"(-false);\n"
+	};
+
+	compareFoldedToExpectedOutput(inputs, expectedOutput);
+}
+
+TEST(ConstantFolder, AlgebraicIdentities)
+{
+	std::vector<std::string> inputs = {
+		"(x + y) * 1;",
+		"1 * (x - y);",
+		"(x * y) + 0;",
+		"(x / y) / 1;",
+		"x * 1;",
+		"(x < y) == true;",
+		"(x < y) == false;",
+		"true != (x == y);",
+		"!!(x > y);",
+		"!!x;",
+		"x + 1 + 2 + 3;",
+		"2 * 60 * x * 1000;"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"(x + y);\n",
+		"(x - y);\n",
+		"(x * y);\n",
+		"(x / y);\n",
+		"(x * 1);\n",
+		"(x < y);\n",
+		"(!(x < y));\n",
+		"(!(x == y));\n",
+		"(x > y);\n",
+		"(!(!x));\n",
+		"(x + 6);\n",
+		"(120000 * x);\n"
+	};
+
+	compareFoldedToExpectedOutput(inputs, expectedOutput);
+}
+
+TEST(ConstantFolder, IfStatementPruning)
+{
+	std::vector<std::string> inputs = {
+		"if (1 < 2) { x; }",
+		"if (1 > 2) { x; } else { y; }",
+		"if (false) { x; } y;",
+		"y; if (false) { x; }",
+		"if (true) { let z = 1; z; }",
+		"if (x) { if (true) { y; } }"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"x;\n",
+		"y;\n",
+		"y;\n",
+		"y;\n\n",
+		"let z = 1;\nz;\n\n",
+		"if x {\ny;\n}\n"
+	};
+
+	compareFoldedToExpectedOutput(inputs, expectedOutput);
+}
+
+TEST(ConstantFolder, Statistics)
+{
+	std::string code = "let x = (2 * 60) * 1000; if (1 < 2) { x; } else { 0; }";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+
+	ConstantFolder folder;
+	folder.fold(*parser.getProgram());
+
+	const auto& statistics = folder.getStatistics();
+	EXPECT_EQ(statistics.expressionsFolded, 3);
+	EXPECT_EQ(statistics.branchesPruned, 1);
+
+	// (2 * 60) * 1000 loses 4 nodes and the if statement is reduced from 10 nodes to the 2 in its consequence.
+	EXPECT_EQ(statistics.nodesEliminated, 12);
+	EXPECT_EQ(parser.getProgram()->toString(), "let x = 120000;\nx;\n");
+}
+
+/*
+* Tests that folded programs produce the same results as the originals.
+*/
+TEST(ConstantFolder, PreservesResults)
+{
+	std::vector<std::string> inputs = {
+		"let x = 5; (x * 2) * 1 + 0;",
+		"let f = function(n) { if (2 > 1) { return n * (60 * 60); } 0; }; f(2);",
+		"let b = 3 < 4; b == false;",
+		"let x = 1; if (true) { let x = 2; } x;",
+		"5; if (false) { 6; }",
+		"let x = 2; x + 1 + 2;"
+	};
+
+	for (auto& input : inputs) {
+		for (auto mode : { ExecutionMode::TreeWalk, ExecutionMode::Closure }) {
+			Script original(input);
+			Script optimized(input);
+			optimized.optimize();
+
+			EXPECT_EQ(original.run(mode).toString(), optimized.run(mode).toString()) << input;
+			EXPECT_EQ(optimized.getErrors().size(), 0);
+		}
+	}
+}
+
+void compareFoldedToExpectedOutput(const std::vector<std::string>& inputs, const std::vector<std::string>& expectedOutput)
+{
+	ASSERT_EQ(inputs.size(), expectedOutput.size());
+
+	Lexer lexer;
+	Parser parser;
+	ConstantFolder folder;
+
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		lexer.tokenize(inputs[i]);
+		parser.parse(lexer.tokens());
+
+		ASSERT_EQ(parser.getErrors().size(), 0);
+
+		auto* program = parser.getProgram();
+		folder.fold(*program);
+
+		EXPECT_EQ(program->toString(), expectedOutput[i]) << inputs[i];
+	}
+}
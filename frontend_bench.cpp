@@ -0,0 +1,357 @@
+#include "lexer.h"
+#include "parser.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace Delve::Script;
+
+/*
+* Benchmarks of the front end, lexing and parsing generated scripts of a given size and shape.  Results are reported as
+* bytes, tokens and nodes per second.  Run with --benchmark_format=json, or --benchmark_out=<file> and
+* --benchmark_out_format=json, to keep results for comparison with later runs.
+*/
+
+namespace {
+	enum class Shape
+	{
+		// functions whose bodies are ifs and blocks nested many levels deep
+		DeepNesting,
+
+		// statements which are each one long chain of infix operators
+		LongExpressions,
+
+		// many small functions, each calling some of the ones before it
+		ManyFunctions,
+
+		// long names declared and referred to many times
+		IdentifierHeavy,
+
+		// literals combined with every operator, prefix operators and parentheses
+		OperatorHeavy
+	};
+
+	// A small linear congruential generator, so that a corpus is the same on every platform and standard library.
+	class Random
+	{
+	public:
+		Random(uint64_t seed) : state(seed) {}
+
+		uint32_t next(uint32_t bound)
+		{
+			state = state * 6364136223846793005ull + 1442695040888963407ull;
+			return static_cast<uint32_t>(state >> 33) % bound;
+		}
+
+	private:
+		uint64_t state;
+	};
+
+	const char* const infixOperators[] = { " + ", " - ", " * ", " / ", " < ", " > ", " == ", " != " };
+
+	std::string makeName(Random& random, size_t index, size_t length)
+	{
+		std::string name = "v";
+
+		while (name.size() < length) {
+			name += static_cast<char>('a' + random.next(26));
+		}
+
+		return name + std::to_string(index);
+	}
+
+	// Appends a single statement of the given shape, numbered so that the names it declares are unique.
+	void appendStatement(std::string& source, Shape shape, Random& random, size_t index)
+	{
+		switch (shape) {
+		case Shape::DeepNesting: {
+			size_t depth = 16 + random.next(48);
+			source += "let f" + std::to_string(index) + " = function(x) {\n";
+
+			for (size_t i = 0; i < depth; i++) {
+				source += random.next(2) ? "if (x > " + std::to_string(i) + ") {\n" : "{\n";
+			}
+
+			source += "x;\n";
+
+			for (size_t i = 0; i < depth; i++) {
+				source += "}\n";
+			}
+
+			source += "};\n";
+			break;
+		}
+
+		case Shape::LongExpressions: {
+			size_t length = 64 + random.next(192);
+			source += "let e" + std::to_string(index) + " = 1";
+
+			for (size_t i = 0; i < length; i++) {
+				source += infixOperators[random.next(4)];
+				source += random.next(2) ? std::to_string(random.next(1000)) : "e" + std::to_string(random.next(static_cast<uint32_t>(index) + 1));
+			}
+
+			source += ";\n";
+			break;
+		}
+
+		case Shape::ManyFunctions: {
+			source += "let f" + std::to_string(index) + " = function(a, b) { ";
+
+			for (size_t calls = random.next(3); calls > 0 && index > 0; calls--) {
+				source += "let c = f" + std::to_string(random.next(static_cast<uint32_t>(index))) + "(a, b); ";
+			}
+
+			source += "if (a < b) { return a; } a + b; };\n";
+			break;
+		}
+
+		case Shape::IdentifierHeavy: {
+			size_t length = 8 + random.next(24);
+			std::string name = makeName(random, index, length);
+			source += "let " + name + " = " + (index > 0 ? "v" + std::to_string(index - 1) + "x" : "1") + ";\n";
+			source += "let v" + std::to_string(index) + "x = " + name;
+
+			for (size_t i = random.next(8); i > 0; i--) {
+				source += " + " + name;
+			}
+
+			source += ";\n";
+			break;
+		}
+
+		case Shape::OperatorHeavy: {
+			size_t length = 8 + random.next(24);
+
+			for (size_t i = 0; i < length; i++) {
+				if (i > 0) {
+					source += infixOperators[random.next(8)];
+				}
+
+				switch (random.next(4)) {
+				case 0:
+					source += "-" + std::to_string(random.next(100));
+					break;
+				case 1:
+					source += "!true";
+					break;
+				case 2:
+					source += "(" + std::to_string(random.next(100)) + infixOperators[random.next(8)] + std::to_string(random.next(100)) + ")";
+					break;
+				default:
+					source += std::to_string(random.next(100000));
+					break;
+				}
+			}
+
+			source += ";\n";
+			break;
+		}
+		}
+	}
+
+	/*
+	* Generates a script of at least the given size made of statements of one shape.  The same arguments always give
+	* the same script.
+	*/
+	std::string generateCorpus(Shape shape, size_t bytes, uint64_t seed = 1)
+	{
+		Random random(seed);
+		std::string source;
+		source.reserve(bytes + 4096);
+
+		for (size_t index = 0; source.size() < bytes; index++) {
+			appendStatement(source, shape, random, index);
+		}
+
+		return source;
+	}
+
+	size_t countNodes(const Ast::Node* node)
+	{
+		if (!node) {
+			return 0;
+		}
+
+		size_t count = 1;
+
+		switch (node->kind) {
+		case Ast::Node::Kind::PrefixExpression:
+			count += countNodes(static_cast<const Ast::PrefixExpression*>(node)->rightExpression.get());
+			break;
+		case Ast::Node::Kind::InfixExpression: {
+			auto* infix = static_cast<const Ast::InfixExpression*>(node);
+			count += countNodes(infix->left.get()) + countNodes(infix->right.get());
+			break;
+		}
+		case Ast::Node::Kind::LetStatement: {
+			auto* let = static_cast<const Ast::LetStatement*>(node);
+			count += countNodes(let->identifier.get()) + countNodes(let->expression.get());
+			break;
+		}
+		case Ast::Node::Kind::ReturnStatement:
+			count += countNodes(static_cast<const Ast::ReturnStatement*>(node)->expression.get());
+			break;
+		case Ast::Node::Kind::ExpressionStatement:
+			count += countNodes(static_cast<const Ast::ExpressionStatement*>(node)->expression.get());
+			break;
+		case Ast::Node::Kind::CallExpression: {
+			auto* call = static_cast<const Ast::CallExpression*>(node);
+			count += countNodes(call->function.get());
+
+			for (const auto& argument : call->arguments) {
+				count += countNodes(argument.get());
+			}
+
+			break;
+		}
+		case Ast::Node::Kind::BlockStatement:
+			for (const auto& statement : static_cast<const Ast::BlockStatement*>(node)->statements) {
+				count += countNodes(statement.get());
+			}
+
+			break;
+		case Ast::Node::Kind::FunctionLiteral: {
+			auto* literal = static_cast<const Ast::FunctionLiteral*>(node);
+
+			for (const auto& parameter : literal->parameters) {
+				count += countNodes(parameter.get());
+			}
+
+			count += countNodes(literal->body.get());
+			break;
+		}
+		case Ast::Node::Kind::IfStatement: {
+			auto* ifStatement = static_cast<const Ast::IfStatement*>(node);
+			count += countNodes(ifStatement->condition.get()) + countNodes(ifStatement->consequence.get()) + countNodes(ifStatement->alternative.get());
+			break;
+		}
+		default:
+			break;
+		}
+
+		return count;
+	}
+
+	// the number of nodes in the tree of a program, for reporting nodes per second
+	size_t countNodes(const Ast::Program& program)
+	{
+		size_t count = 0;
+
+		for (const auto& statement : program.statements) {
+			count += countNodes(statement.get());
+		}
+
+		return count;
+	}
+
+	// reports the throughput of a benchmark which processed a script once per iteration
+	void setRates(benchmark::State& state, const std::string& source, size_t tokens, size_t nodes)
+	{
+		state.SetBytesProcessed(state.iterations() * source.size());
+		state.counters["tokens"] = benchmark::Counter(static_cast<double>(tokens), benchmark::Counter::kIsIterationInvariantRate);
+
+		if (nodes) {
+			state.counters["nodes"] = benchmark::Counter(static_cast<double>(nodes), benchmark::Counter::kIsIterationInvariantRate);
+		}
+	}
+
+	void applyCorpusSizes(benchmark::internal::Benchmark* benchmark)
+	{
+		benchmark->Arg(16 << 10)->Arg(256 << 10)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+	}
+}
+
+static void tokenizeCorpus(benchmark::State& state, Shape shape)
+{
+	std::string source = generateCorpus(shape, state.range(0));
+	Lexer lexer;
+
+	for (auto _ : state) {
+		lexer.tokenize(source);
+		benchmark::DoNotOptimize(lexer.tokens().data());
+	}
+
+	setRates(state, source, lexer.tokens().size(), 0);
+}
+
+static void parseCorpus(benchmark::State& state, Shape shape)
+{
+	std::string source = generateCorpus(shape, state.range(0));
+	Lexer lexer(source);
+	Parser parser;
+
+	for (auto _ : state) {
+		parser.parse(lexer.tokens());
+		benchmark::DoNotOptimize(parser.getProgram());
+	}
+
+	if (!parser.getErrors().empty()) {
+		state.SkipWithError(parser.getErrors().front().c_str());
+		return;
+	}
+
+	setRates(state, source, lexer.tokens().size(), countNodes(*parser.getProgram()));
+}
+
+// Prints the tree of a parsed script back to source, as the console does.
+static void printCorpus(benchmark::State& state, Shape shape)
+{
+	std::string source = generateCorpus(shape, state.range(0));
+	Lexer lexer(source);
+	Parser parser(lexer.tokens());
+	size_t printed = 0;
+
+	for (auto _ : state) {
+		std::string text = parser.getProgram()->toString();
+		printed = text.size();
+		benchmark::DoNotOptimize(text.data());
+	}
+
+	setRates(state, source, lexer.tokens().size(), countNodes(*parser.getProgram()));
+	state.counters["printedBytes"] = static_cast<double>(printed);
+}
+
+// Destroys the tree of a parsed script, the parsing itself is not timed.
+static void destroyCorpus(benchmark::State& state, Shape shape)
+{
+	std::string source = generateCorpus(shape, state.range(0));
+	Lexer lexer(source);
+	Parser parser;
+	size_t nodes = 0;
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		parser.parse(lexer.tokens());
+		nodes = countNodes(*parser.getProgram());
+		state.ResumeTiming();
+
+		parser.clear();
+	}
+
+	setRates(state, source, lexer.tokens().size(), nodes);
+}
+
+BENCHMARK_CAPTURE(tokenizeCorpus, DeepNesting, Shape::DeepNesting)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(tokenizeCorpus, LongExpressions, Shape::LongExpressions)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(tokenizeCorpus, ManyFunctions, Shape::ManyFunctions)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(tokenizeCorpus, IdentifierHeavy, Shape::IdentifierHeavy)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(tokenizeCorpus, OperatorHeavy, Shape::OperatorHeavy)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(parseCorpus, DeepNesting, Shape::DeepNesting)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(parseCorpus, LongExpressions, Shape::LongExpressions)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(parseCorpus, ManyFunctions, Shape::ManyFunctions)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(parseCorpus, IdentifierHeavy, Shape::IdentifierHeavy)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(parseCorpus, OperatorHeavy, Shape::OperatorHeavy)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(printCorpus, DeepNesting, Shape::DeepNesting)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(printCorpus, LongExpressions, Shape::LongExpressions)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(printCorpus, ManyFunctions, Shape::ManyFunctions)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(printCorpus, IdentifierHeavy, Shape::IdentifierHeavy)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(printCorpus, OperatorHeavy, Shape::OperatorHeavy)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(destroyCorpus, DeepNesting, Shape::DeepNesting)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(destroyCorpus, LongExpressions, Shape::LongExpressions)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(destroyCorpus, ManyFunctions, Shape::ManyFunctions)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(destroyCorpus, IdentifierHeavy, Shape::IdentifierHeavy)->Apply(applyCorpusSizes);
+BENCHMARK_CAPTURE(destroyCorpus, OperatorHeavy, Shape::OperatorHeavy)->Apply(applyCorpusSizes);
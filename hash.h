@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Delve::Script {
+
+/*
+* A fast non-cryptographic hash which consumes eight bytes per step.  Used to key cached programs by their source and
+* to checksum bytecode files, neither of which need protection against deliberate collisions.
+*/
+inline uint64_t hashBytes(const void* data, size_t size)
+{
+	const uint64_t multiplier = 0xff51afd7ed558ccdull;
+	const auto* bytes = static_cast<const unsigned char*>(data);
+	uint64_t result = 0x9e3779b97f4a7c15ull ^ size;
+
+	for (; size >= 8; bytes += 8, size -= 8) {
+		uint64_t chunk;
+		std::memcpy(&chunk, bytes, 8);
+		result = (result ^ chunk) * multiplier;
+		result ^= result >> 32;
+	}
+
+	if (size != 0) {
+		uint64_t chunk = 0;
+		std::memcpy(&chunk, bytes, size);
+		result = (result ^ chunk) * multiplier;
+	}
+
+	result ^= result >> 29;
+	result *= 0xbf58476d1ce4e5b9ull;
+	result ^= result >> 32;
+
+	return result;
+}
+
+}
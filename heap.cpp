@@ -0,0 +1,154 @@
+#include "heap.h"
+
+#include <algorithm>
+
+namespace Delve::Script {
+
+void Box::trace(Heap& heap)
+{
+	heap.mark(value);
+}
+
+Heap::Heap()
+{
+	nextCollection = settings.initialThreshold;
+	statisticsStart = std::chrono::steady_clock::now();
+}
+
+/**
+* Changes the limits of the heap.  Takes effect from the next allocation.
+* @param newSettings the limits and collection thresholds to use
+*/
+void Heap::configure(const Settings& newSettings)
+{
+	settings = newSettings;
+	nextCollection = std::max(settings.initialThreshold, statistics.liveBytes);
+}
+
+/**
+* Releases every object owned by the heap.  Any value referencing a heap object is invalid after this call.
+*/
+void Heap::clear()
+{
+	for (auto& object : objects) {
+		release(object);
+	}
+
+	objects.clear();
+	nextCollection = settings.initialThreshold;
+}
+
+/**
+* Frees every object which is not reachable from the roots reported by the root marker.  Does nothing if no root
+* marker has been registered, since the heap cannot tell which objects are in use.
+*/
+void Heap::collect()
+{
+	if (!rootMarker) {
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	rootMarker(*this);
+
+	while (!grayObjects.empty()) {
+		Object* object = grayObjects.back();
+		grayObjects.pop_back();
+		object->trace(*this);
+	}
+
+	size_t live = 0;
+
+	for (auto& object : objects) {
+		if (object->marked) {
+			object->marked = false;
+			objects[live++] = std::move(object);
+		}
+		else {
+			release(object);
+		}
+	}
+
+	objects.resize(live);
+
+	nextCollection = std::max(settings.initialThreshold, static_cast<size_t>(statistics.liveBytes * settings.growthFactor));
+
+	auto pause = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+	statistics.collections += 1;
+	statistics.lastPause = pause;
+	statistics.maxPause = std::max(statistics.maxPause, pause);
+	statistics.totalPause += pause;
+}
+
+/**
+* Calculates the average rate of allocation since the statistics were last reset.
+* @returns allocated bytes per second
+*/
+double Heap::getAllocationRate() const
+{
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - statisticsStart;
+
+	if (elapsed.count() <= 0.0) {
+		return 0.0;
+	}
+
+	return static_cast<double>(statistics.bytesAllocated) / elapsed.count();
+}
+
+/**
+* Zeroes the cumulative statistics.  The live and peak sizes are set to the current contents of the heap.
+*/
+void Heap::resetStatistics()
+{
+	size_t liveObjects = statistics.liveObjects;
+	size_t liveBytes = statistics.liveBytes;
+
+	statistics = Statistics();
+	statistics.liveObjects = liveObjects;
+	statistics.liveBytes = liveBytes;
+	statistics.peakBytes = liveBytes;
+	statisticsStart = std::chrono::steady_clock::now();
+}
+
+/*
+* Accounts for an allocation which is about to be made, collecting first if the collection threshold has been reached.
+* Throws a RuntimeError if the allocation would take the heap past its limit.
+*/
+void Heap::reserve(size_t size)
+{
+	bool collected = false;
+
+	if (statistics.liveBytes + size > nextCollection && rootMarker) {
+		collect();
+		collected = true;
+	}
+
+	if (settings.maxBytes != 0 && statistics.liveBytes + size > settings.maxBytes) {
+		if (!collected) {
+			collect();
+		}
+
+		if (statistics.liveBytes + size > settings.maxBytes) {
+			throw RuntimeError("Heap limit exceeded.");
+		}
+	}
+
+	statistics.objectsAllocated += 1;
+	statistics.bytesAllocated += size;
+	statistics.liveObjects += 1;
+	statistics.liveBytes += size;
+	statistics.peakBytes = std::max(statistics.peakBytes, statistics.liveBytes);
+}
+
+void Heap::release(std::unique_ptr<Object>& object)
+{
+	statistics.objectsFreed += 1;
+	statistics.bytesFreed += object->size;
+	statistics.liveObjects -= 1;
+	statistics.liveBytes -= object->size;
+
+	object.reset();
+}
+
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "value.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace Delve::Script {
+
+class Heap;
+
+/*
+* Base class for all values whose storage lives on the script heap.  Objects which refer to other objects override
+* trace so that the collector can find them.
+*/
+struct Object
+{
+	virtual ~Object() {}
+
+	virtual void trace(Heap&) {}
+
+	size_t size = 0;
+	bool marked = false;
+};
+
+/*
+* Holds a captured variable which is declared again after it is captured, so that closures and frames share its value.
+*/
+struct Box : public Object
+{
+	Box(const Value& v) : value(v) {}
+
+	Value value;
+
+	void trace(Heap& heap) override;
+};
+
+/*
+* Owns every object allocated while running a script.
+*
+* When the owner of the heap registers a root marker, unreachable objects are reclaimed by a precise, non-moving
+* mark-sweep collector.  A collection runs when the heap grows past a threshold derived from the amount of data which
+* survived the previous collection.  Every value which refers to an object must be reachable from the roots
+* whenever an allocation could happen.  Without a root marker objects live until the heap is cleared.
+*/
+class Heap
+{
+public:
+	using RootMarker = std::function<void(Heap&)>;
+
+	struct Settings
+	{
+		// live bytes the heap may hold before allocations fail, zero for no limit
+		size_t maxBytes = 0;
+
+		// bytes allocated before the first collection
+		size_t initialThreshold = 1 << 20;
+
+		// after a collection the next one happens once the live size has grown by this factor
+		double growthFactor = 2.0;
+	};
+
+	struct Statistics
+	{
+		uint64_t objectsAllocated = 0;
+		uint64_t bytesAllocated = 0;
+		uint64_t objectsFreed = 0;
+		uint64_t bytesFreed = 0;
+
+		size_t liveObjects = 0;
+		size_t liveBytes = 0;
+		size_t peakBytes = 0;
+
+		uint32_t collections = 0;
+		std::chrono::nanoseconds lastPause{ 0 };
+		std::chrono::nanoseconds maxPause{ 0 };
+		std::chrono::nanoseconds totalPause{ 0 };
+	};
+
+public:
+	Heap();
+
+	Heap(const Heap&) = delete;
+	Heap& operator=(const Heap&) = delete;
+
+public:
+	template <typename T, typename... Args>
+	T* allocate(Args&&... args)
+	{
+		reserve(sizeof(T));
+
+		auto object = std::make_unique<T>(std::forward<Args>(args)...);
+		T* result = object.get();
+		result->size = sizeof(T);
+		objects.emplace_back(std::move(object));
+
+		return result;
+	}
+
+	void collect();
+	void clear();
+
+	inline void mark(const Value& value)
+	{
+		if (value.type == Value::Type::Function || value.type == Value::Type::Box) {
+			mark(value.object);
+		}
+	}
+
+	inline void mark(Object* object)
+	{
+		if (object && !object->marked) {
+			object->marked = true;
+			grayObjects.push_back(object);
+		}
+	}
+
+	inline void setRootMarker(RootMarker marker) { rootMarker = std::move(marker); }
+	void configure(const Settings& settings);
+
+	inline const Settings& getSettings() const { return settings; }
+	inline const Statistics& getStatistics() const { return statistics; }
+	double getAllocationRate() const;
+	void resetStatistics();
+
+	inline size_t objectCount() const { return objects.size(); }
+
+private:
+	void reserve(size_t size);
+	void release(std::unique_ptr<Object>& object);
+
+private:
+	std::vector<std::unique_ptr<Object>> objects;
+	std::vector<Object*> grayObjects;
+	RootMarker rootMarker;
+
+	Settings settings;
+	size_t nextCollection;
+
+	Statistics statistics;
+	std::chrono::steady_clock::time_point statisticsStart;
+};
+
+}
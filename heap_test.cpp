@@ -0,0 +1,159 @@
+#include "heap.h"
+#include "script.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace Delve::Script;
+
+namespace {
+	struct Node : public Object
+	{
+		Node* next = nullptr;
+
+		void trace(Heap& heap) override { heap.mark(next); }
+	};
+}
+
+TEST(Heap, NoCollectionWithoutRoots)
+{
+	Heap heap;
+	heap.allocate<Node>();
+	heap.allocate<Node>();
+	heap.collect();
+
+	EXPECT_EQ(heap.objectCount(), 2);
+	EXPECT_EQ(heap.getStatistics().collections, 0);
+}
+
+TEST(Heap, CollectsUnreachableObjects)
+{
+	Heap heap;
+	std::vector<Node*> roots;
+	heap.setRootMarker([&roots](Heap& h) {
+		for (auto* root : roots) {
+			h.mark(root);
+		}
+	});
+
+	auto* a = heap.allocate<Node>();
+	a->next = heap.allocate<Node>();
+	a->next->next = heap.allocate<Node>();
+
+	// an unreachable cycle
+	auto* b = heap.allocate<Node>();
+	b->next = heap.allocate<Node>();
+	b->next->next = b;
+
+	roots.push_back(a);
+	heap.collect();
+
+	EXPECT_EQ(heap.objectCount(), 3);
+
+	const auto& statistics = heap.getStatistics();
+	EXPECT_EQ(statistics.collections, 1);
+	EXPECT_EQ(statistics.objectsAllocated, 5);
+	EXPECT_EQ(statistics.objectsFreed, 2);
+	EXPECT_EQ(statistics.liveObjects, 3);
+	EXPECT_EQ(statistics.liveBytes, 3 * sizeof(Node));
+	EXPECT_EQ(statistics.peakBytes, 5 * sizeof(Node));
+
+	roots.clear();
+	heap.collect();
+
+	EXPECT_EQ(heap.objectCount(), 0);
+	EXPECT_EQ(heap.getStatistics().liveBytes, 0);
+}
+
+TEST(Heap, CollectsAtThreshold)
+{
+	Heap heap;
+	heap.setRootMarker([](Heap&) {});
+
+	Heap::Settings settings;
+	settings.initialThreshold = 10 * sizeof(Node);
+	heap.configure(settings);
+
+	for (int i = 0; i < 100; ++i) {
+		heap.allocate<Node>();
+	}
+
+	EXPECT_GE(heap.getStatistics().collections, 9);
+	EXPECT_LE(heap.getStatistics().peakBytes, 10 * sizeof(Node));
+	EXPECT_LE(heap.objectCount(), 10);
+}
+
+TEST(Heap, Limit)
+{
+	Heap heap;
+	Node* root = nullptr;
+	heap.setRootMarker([&root](Heap& h) { h.mark(root); });
+
+	Heap::Settings settings;
+	settings.maxBytes = 4 * sizeof(Node);
+	heap.configure(settings);
+
+	// garbage does not count against the limit
+	for (int i = 0; i < 20; ++i) {
+		heap.allocate<Node>();
+	}
+
+	for (int i = 0; i < 4; ++i) {
+		auto* node = heap.allocate<Node>();
+		node->next = root;
+		root = node;
+	}
+
+	EXPECT_THROW(heap.allocate<Node>(), RuntimeError);
+	EXPECT_EQ(heap.objectCount(), 4);
+}
+
+/*
+* Tests that closures which are still reachable from frames, globals and other closures survive collections that happen
+* while a script is running.
+*/
+TEST(Heap, ScriptCollection)
+{
+	std::string source =
+		"let adder = function(x) { function(y) { x + y; }; };"
+		"let keep = adder(1000);"
+		"let churn = function(n) { if (n < 2) { return adder(n)(1); } let f = adder(n); churn(n - 1) + churn(n - 2) + f(0) - n; };"
+		"keep(churn(15));";
+
+	Script script(source);
+
+	Heap::Settings settings;
+	settings.initialThreshold = 256;
+	script.setHeapSettings(settings);
+
+	Value result = script.run();
+	ASSERT_EQ(script.getErrors().size(), 0);
+	EXPECT_EQ(result.toString(), "2597");
+
+	auto statistics = script.getHeapStatistics();
+	EXPECT_GT(statistics.collections, 10);
+	EXPECT_LT(statistics.peakBytes, 16 * 1024);
+	EXPECT_GT(statistics.objectsFreed, 0);
+	EXPECT_EQ(statistics.objectsAllocated - statistics.objectsFreed, statistics.liveObjects);
+}
+
+TEST(Heap, ScriptLimit)
+{
+	std::string source =
+		"let adder = function(x) { function(y) { x + y; }; };"
+		"let hold = function(n) { if (n == 0) { return 0; } let f = adder(n); hold(n - 1) + f(0); };"
+		"hold(1000);";
+
+	Script script(source);
+
+	Heap::Settings settings;
+	settings.maxBytes = 4096;
+	script.setHeapSettings(settings);
+
+	Value result = script.run();
+	EXPECT_EQ(result.type, Value::Type::Null);
+	ASSERT_EQ(script.getErrors().size(), 1);
+	EXPECT_EQ(script.getErrors()[0], "Heap limit exceeded.");
+}
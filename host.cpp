@@ -0,0 +1,142 @@
+#include "host.h"
+
+#include <future>
+#include <sstream>
+
+namespace Delve::Script {
+
+namespace {
+	Value callCallback(const HostFunction& function, const Value* arguments)
+	{
+		return function.callback(arguments, function.parameterCount);
+	}
+}
+
+/**
+* Throws a RuntimeError for an argument to a bound function which does not have the type of its parameter.
+* @param index the position of the argument, from zero
+*/
+void Binding::argumentTypeMismatch(const HostFunction& function, size_t index, Value::Type expected, Value::Type actual)
+{
+	std::ostringstream error;
+	error << "Expected " << Value::getTypeName(expected) << " for argument " << index + 1 << " of " << function.name << " but got " << Value::getTypeName(actual) << '.';
+	throw RuntimeError(error.str());
+}
+
+void HostCompletion::resolve(const Value& result) const
+{
+	handler(result, std::string());
+}
+
+void HostCompletion::reject(const std::string& error) const
+{
+	handler(Value(), error.empty() ? "Host function failed." : error);
+}
+
+/**
+* Throws a RuntimeError if the function cannot be called with the given number of arguments.
+*/
+void HostFunction::checkArgumentCount(size_t argumentCount) const
+{
+	if (argumentCount != parameterCount) {
+		std::ostringstream error;
+		error << "Expected " << parameterCount << " arguments but got " << argumentCount << '.';
+		throw RuntimeError(error.str());
+	}
+}
+
+/**
+* Calls the function and waits for its result.  Engines which run scripts on the native stack use this for asynchronous
+* host functions, blocking the calling thread until the function completes.
+* @returns the result of the function.  Throws a RuntimeError if the function rejects its completion.
+*/
+Value HostFunction::callBlocking(const Value* arguments, size_t argumentCount) const
+{
+	if (!isAsync()) {
+		return call(arguments);
+	}
+
+	auto promise = std::make_shared<std::promise<Value>>();
+	auto future = promise->get_future();
+
+	asyncCallback(std::vector<Value>(arguments, arguments + argumentCount), HostCompletion([promise](const Value& result, const std::string& error) {
+		if (error.empty()) {
+			promise->set_value(result);
+		}
+		else {
+			promise->set_exception(std::make_exception_ptr(RuntimeError(error)));
+		}
+	}));
+
+	return future.get();
+}
+
+/**
+* Adds a function which returns its result immediately.  Defining a name a second time replaces the earlier function.
+* @param name the name scripts call the function by
+* @param parameterCount the number of arguments the function must be called with
+* @param callback the implementation
+*/
+void Host::define(const std::string& name, size_t parameterCount, HostFunction::Callback callback)
+{
+	HostFunction* function = add(name, parameterCount);
+	function->callback = std::move(callback);
+	function->thunk = &callCallback;
+}
+
+/**
+* Adds a function which completes at some later point, possibly on another thread.
+* @param name the name scripts call the function by
+* @param parameterCount the number of arguments the function must be called with
+* @param callback the implementation, which must eventually resolve or reject the completion it is given
+*/
+void Host::defineAsync(const std::string& name, size_t parameterCount, HostFunction::AsyncCallback callback)
+{
+	add(name, parameterCount)->asyncCallback = std::move(callback);
+}
+
+const HostFunction* Host::find(const std::string& name) const
+{
+	for (const auto& function : functions) {
+		if (function->name == name) {
+			return function.get();
+		}
+	}
+
+	return nullptr;
+}
+
+/**
+* Returns the names of all functions in the order they were defined, which is the order of their global indices.
+*/
+std::vector<std::string> Host::getNames() const
+{
+	std::vector<std::string> names;
+
+	for (const auto& function : functions) {
+		names.push_back(function->name);
+	}
+
+	return names;
+}
+
+HostFunction* Host::add(const std::string& name, size_t parameterCount)
+{
+	for (auto& function : functions) {
+		if (function->name == name) {
+			*function = HostFunction();
+			function->name = name;
+			function->parameterCount = parameterCount;
+
+			return function.get();
+		}
+	}
+
+	functions.push_back(std::make_unique<HostFunction>());
+	functions.back()->name = name;
+	functions.back()->parameterCount = parameterCount;
+
+	return functions.back().get();
+}
+
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include "value.h"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* Hands the result of an asynchronous host function back to the script which called it.  May be invoked from any thread
+* but exactly once, with either resolve or reject.
+*/
+class HostCompletion
+{
+public:
+	using Handler = std::function<void(const Value& result, const std::string& error)>;
+
+public:
+	HostCompletion(Handler h) : handler(std::move(h)) {}
+
+	void resolve(const Value& result) const;
+	void reject(const std::string& error) const;
+
+private:
+	Handler handler;
+};
+
+/*
+* A function implemented by the application which scripts can call by name.  Synchronous functions return their result
+* directly.  Asynchronous functions are given a completion to call once their result is ready, which allows the bytecode
+* engine to suspend the script rather than block a thread while it waits.
+*
+* Host functions may only return integers, booleans and null, since script heap objects cannot outlive the run which
+* created them.  Arguments which are script functions must not be kept after the host function completes.
+*/
+struct HostFunction
+{
+	using Callback = std::function<Value(const Value* arguments, size_t argumentCount)>;
+	using AsyncCallback = std::function<void(std::vector<Value> arguments, HostCompletion completion)>;
+
+	// Calls a synchronous function with exactly parameterCount arguments.
+	using Thunk = Value(*)(const HostFunction& function, const Value* arguments);
+
+	std::string name;
+	size_t parameterCount = 0;
+	Callback callback;
+	AsyncCallback asyncCallback;
+
+	// set for every synchronous function, either to call callback or to call a bound C++ function directly
+	Thunk thunk = nullptr;
+
+	// the function or callable given to Host::bind, only ever read by its thunk
+	void (*boundFunction)() = nullptr;
+	std::shared_ptr<void> boundCallable;
+
+	inline bool isAsync() const { return static_cast<bool>(asyncCallback); }
+	inline Value call(const Value* arguments) const { return thunk(*this, arguments); }
+
+	void checkArgumentCount(size_t argumentCount) const;
+	Value callBlocking(const Value* arguments, size_t argumentCount) const;
+};
+
+/*
+* Converts between script values and the C++ types host functions can be bound with: int64_t, bool and Value, which
+* is passed through unchecked.  Bound functions may also return void, which scripts see as null.
+*/
+namespace Binding {
+	[[noreturn]] void argumentTypeMismatch(const HostFunction& function, size_t index, Value::Type expected, Value::Type actual);
+
+	template <typename T>
+	struct Convert
+	{
+		static_assert(sizeof(T) == 0, "Host functions may only take and return int64_t, bool and Value.");
+	};
+
+	template <>
+	struct Convert<int64_t>
+	{
+		static constexpr Value::Type type = Value::Type::Integer;
+		static inline int64_t from(const Value& value) { return value.integer; }
+		static inline Value to(int64_t result) { return Value::fromInteger(result); }
+	};
+
+	template <>
+	struct Convert<bool>
+	{
+		static constexpr Value::Type type = Value::Type::Boolean;
+		static inline bool from(const Value& value) { return value.boolean; }
+		static inline Value to(bool result) { return Value::fromBoolean(result); }
+	};
+
+	template <>
+	struct Convert<Value>
+	{
+		static inline const Value& from(const Value& value) { return value; }
+		static inline Value to(const Value& result) { return result; }
+	};
+
+	template <typename T>
+	inline void check(const HostFunction& function, const Value* arguments, size_t index)
+	{
+		if constexpr (!std::is_same_v<T, Value>) {
+			if (arguments[index].type != Convert<T>::type) {
+				argumentTypeMismatch(function, index, Convert<T>::type, arguments[index].type);
+			}
+		}
+	}
+
+	// Checks every argument against the parameter types, then calls the target with them unboxed.
+	template <typename Return, typename... Parameters, typename Target, size_t... Indices>
+	inline Value invoke(Target&& target, const HostFunction& function, const Value* arguments, std::index_sequence<Indices...>)
+	{
+		(check<std::decay_t<Parameters>>(function, arguments, Indices), ...);
+
+		if constexpr (std::is_void_v<Return>) {
+			target(Convert<std::decay_t<Parameters>>::from(arguments[Indices])...);
+			return Value();
+		}
+		else {
+			return Convert<std::decay_t<Return>>::to(target(Convert<std::decay_t<Parameters>>::from(arguments[Indices])...));
+		}
+	}
+
+	// Finds the signature of a callable from its call operator.
+	template <typename Callable>
+	struct Signature : Signature<decltype(&Callable::operator())> {};
+
+	template <typename Class, typename Return, typename... Parameters>
+	struct Signature<Return(Class::*)(Parameters...) const>
+	{
+		template <typename Callable>
+		static Value call(const HostFunction& function, const Value* arguments)
+		{
+			const auto& target = *static_cast<const Callable*>(function.boundCallable.get());
+			return invoke<Return, Parameters...>(target, function, arguments, std::index_sequence_for<Parameters...>());
+		}
+
+		static constexpr size_t parameterCount = sizeof...(Parameters);
+	};
+
+	template <typename Class, typename Return, typename... Parameters>
+	struct Signature<Return(Class::*)(Parameters...)>
+	{
+		template <typename Callable>
+		static Value call(const HostFunction& function, const Value* arguments)
+		{
+			auto& target = *static_cast<Callable*>(function.boundCallable.get());
+			return invoke<Return, Parameters...>(target, function, arguments, std::index_sequence_for<Parameters...>());
+		}
+
+		static constexpr size_t parameterCount = sizeof...(Parameters);
+	};
+}
+
+/*
+* The set of host functions available to a script.  Host functions are bound to globals of the same name before the
+* script runs, so scripts may shadow them.  A Host must outlive every program compiled against it and must not be
+* changed once a program has been compiled against it.
+*/
+class Host
+{
+public:
+	void define(const std::string& name, size_t parameterCount, HostFunction::Callback callback);
+	void defineAsync(const std::string& name, size_t parameterCount, HostFunction::AsyncCallback callback);
+
+	template <typename Return, typename... Parameters>
+	void bind(const std::string& name, Return(*function)(Parameters...));
+
+	template <typename Callable>
+	void bind(const std::string& name, Callable callable);
+
+	const HostFunction* find(const std::string& name) const;
+	std::vector<std::string> getNames() const;
+
+	inline size_t functionCount() const { return functions.size(); }
+	inline const HostFunction* getFunction(size_t index) const { return functions[index].get(); }
+
+private:
+	HostFunction* add(const std::string& name, size_t parameterCount);
+
+private:
+	std::vector<std::unique_ptr<HostFunction>> functions;
+};
+
+/*
+* Binds a C++ function to a name.  Argument and result conversions are generated from the function's signature, and
+* calls go straight from the engine to the function without any std::function or allocation in between.  Arguments of
+* the wrong type are reported as runtime errors.
+* @param name the name scripts call the function by
+* @param function a function taking and returning int64_t, bool or Value, or returning void
+*/
+template <typename Return, typename... Parameters>
+void Host::bind(const std::string& name, Return(*function)(Parameters...))
+{
+	using Target = Return(*)(Parameters...);
+
+	HostFunction* bound = add(name, sizeof...(Parameters));
+	bound->boundFunction = reinterpret_cast<void(*)()>(function);
+	bound->thunk = [](const HostFunction& self, const Value* arguments) {
+		auto target = reinterpret_cast<Target>(self.boundFunction);
+		return Binding::invoke<Return, Parameters...>(target, self, arguments, std::index_sequence_for<Parameters...>());
+	};
+}
+
+/*
+* Binds a lambda or other callable with a single call operator to a name, in the same way as a function.  The callable
+* is stored in the host, and may be called from several threads at once if scripts run concurrently.
+*/
+template <typename Callable>
+void Host::bind(const std::string& name, Callable callable)
+{
+	using Signature = Binding::Signature<Callable>;
+
+	HostFunction* bound = add(name, Signature::parameterCount);
+	bound->boundCallable = std::make_shared<Callable>(std::move(callable));
+	bound->thunk = &Signature::template call<Callable>;
+}
+
+}
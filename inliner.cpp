@@ -0,0 +1,605 @@
+#include "inliner.h"
+#include "folder.h"
+#include "trace.h"
+
+#include <algorithm>
+
+namespace Delve::Script {
+	Inliner::Inliner() : Inliner(Settings())
+	{
+	}
+
+	Inliner::Inliner(const Settings& inlinerSettings) : settings(inlinerSettings)
+	{
+	}
+
+	/**
+	* Inlines calls throughout the program in place.  The functions themselves are left where they are, for the
+	* DeadCodeEliminator to remove once nothing calls them.  Statistics are reset each time this method is called.
+	* @param program the program to optimize
+	*/
+	void Inliner::inlineCalls(Ast::Program& program)
+	{
+		DELVE_SCRIPT_TRACE("inline calls", "optimize");
+
+		statistics = Statistics();
+		inlined.clear();
+
+		while (statistics.rounds < settings.maxRounds) {
+			statistics.rounds += 1;
+
+			if (!inlineRound(program)) {
+				break;
+			}
+		}
+
+		statistics.functionsInlined = static_cast<uint32_t>(inlined.size());
+
+		declarations.clear();
+		globals.clear();
+		candidates.clear();
+		sites.clear();
+	}
+
+	/*
+	* Finds every call which may be inlined and then inlines them, innermost and last first so that replacing a call
+	* never destroys one which is still to be visited.
+	* @returns true if any call was inlined
+	*/
+	bool Inliner::inlineRound(Ast::Program& program)
+	{
+		declarations.clear();
+		globals.clear();
+		candidates.clear();
+		sites.clear();
+
+		// the outermost block of the top level code holds globals
+		functions.assign(1, FunctionScope());
+		functions.back().blocks.emplace_back();
+
+		for (statementIndex = 0; statementIndex < program.statements.size(); statementIndex++) {
+			visitStatement(program.statements[statementIndex].get());
+		}
+
+		functions.clear();
+
+		bool changed = false;
+
+		for (auto site = sites.rbegin(); site != sites.rend(); ++site) {
+			// a name declared more than once may hold some other function by the time it is called
+			if (site->callee->count == 1 && inlineCall(*site)) {
+				changed = true;
+			}
+		}
+
+		return changed;
+	}
+
+	void Inliner::visitStatements(std::vector<std::unique_ptr<Ast::Statement>>& statements)
+	{
+		for (auto& statement : statements) {
+			visitStatement(statement.get());
+		}
+	}
+
+	/*
+	* Declares names following the same rules as the Resolver, so that a name refers to the same declaration here as it
+	* does once the program is resolved.
+	*/
+	void Inliner::visitStatement(Ast::Statement* statement)
+	{
+		if (!statement) {
+			return;
+		}
+
+		switch (statement->kind) {
+		case Ast::Node::Kind::LetStatement: {
+			auto* letStatement = static_cast<Ast::LetStatement*>(statement);
+			auto& expression = letStatement->expression;
+
+			if (expression && expression->kind == Ast::Node::Kind::FunctionLiteral) {
+				auto* function = static_cast<Ast::FunctionLiteral*>(expression.get());
+				Declaration* declaration = declare(letStatement->identifier.get());
+
+				if (declaration && declaration->count == 1) {
+					declaration->function = function;
+				}
+
+				visitFunctionLiteral(function);
+			}
+			else {
+				visitExpression(expression);
+				declare(letStatement->identifier.get());
+			}
+
+			break;
+		}
+
+		case Ast::Node::Kind::ReturnStatement:
+			visitExpression(static_cast<Ast::ReturnStatement*>(statement)->expression);
+			break;
+
+		case Ast::Node::Kind::ExpressionStatement:
+			visitExpression(static_cast<Ast::ExpressionStatement*>(statement)->expression);
+			break;
+
+		case Ast::Node::Kind::BlockStatement:
+			visitBlock(static_cast<Ast::BlockStatement*>(statement));
+			break;
+
+		case Ast::Node::Kind::IfStatement: {
+			auto* ifStatement = static_cast<Ast::IfStatement*>(statement);
+			visitExpression(ifStatement->condition);
+			visitBlock(ifStatement->consequence.get());
+			visitBlock(ifStatement->alternative.get());
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	void Inliner::visitBlock(Ast::BlockStatement* block)
+	{
+		if (!block) {
+			return;
+		}
+
+		functions.back().blocks.emplace_back();
+		visitStatements(block->statements);
+		functions.back().blocks.pop_back();
+	}
+
+	void Inliner::visitExpression(std::unique_ptr<Ast::Expression>& expression)
+	{
+		if (!expression) {
+			return;
+		}
+
+		switch (expression->kind) {
+		case Ast::Node::Kind::PrefixExpression:
+			visitExpression(static_cast<Ast::PrefixExpression*>(expression.get())->rightExpression);
+			break;
+
+		case Ast::Node::Kind::InfixExpression: {
+			auto* infixExpression = static_cast<Ast::InfixExpression*>(expression.get());
+			visitExpression(infixExpression->left);
+			visitExpression(infixExpression->right);
+			break;
+		}
+
+		case Ast::Node::Kind::CallExpression:
+			visitCall(expression);
+			break;
+
+		case Ast::Node::Kind::FunctionLiteral:
+			visitFunctionLiteral(static_cast<Ast::FunctionLiteral*>(expression.get()));
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	void Inliner::visitFunctionLiteral(Ast::FunctionLiteral* function)
+	{
+		functions.emplace_back();
+		functions.back().blocks.emplace_back();
+
+		for (auto& parameter : function->parameters) {
+			declare(parameter.get());
+		}
+
+		addCandidate(function);
+
+		if (function->body) {
+			visitStatements(function->body->statements);
+		}
+
+		functions.pop_back();
+	}
+
+	/*
+	* Records a call to a function which may be inlined.  The call must come after the function is declared, which for a
+	* global means a later top level statement, and every name in the function's body must mean the same thing here.  A
+	* function which refers to itself is never inlined.
+	*/
+	void Inliner::visitCall(std::unique_ptr<Ast::Expression>& expression)
+	{
+		auto* callExpression = static_cast<Ast::CallExpression*>(expression.get());
+		auto* callee = callExpression->function.get();
+
+		if (callee && callee->kind == Ast::Node::Kind::Identifier) {
+			Declaration* declaration = lookup(callee->token->literal);
+			auto candidate = declaration->function ? candidates.find(declaration->function) : candidates.end();
+
+			if (candidate != candidates.end() && (!declaration->global || statementIndex > declaration->statement)) {
+				bool sameNames = std::all_of(candidate->second.names.begin(), candidate->second.names.end(), [&](const auto& name) {
+					return name.second != declaration && lookup(name.first) == name.second;
+				});
+
+				if (sameNames) {
+					sites.push_back(CallSite{ &expression, declaration });
+				}
+			}
+		}
+
+		visitExpression(callExpression->function);
+
+		for (auto& argument : callExpression->arguments) {
+			visitExpression(argument);
+		}
+	}
+
+	/*
+	* Binds a name in the innermost scope.  Redeclaring a name in the same scope reuses its declaration.
+	*/
+	Inliner::Declaration* Inliner::declare(const Ast::Identifier* identifier)
+	{
+		if (!identifier) {
+			return nullptr;
+		}
+
+		const std::string& name = identifier->token->literal;
+		auto& blocks = functions.back().blocks;
+		Declaration*& declaration = functions.size() == 1 && blocks.size() == 1 ? globals[name] : blocks.back()[name];
+
+		if (!declaration) {
+			declaration = &declarations.emplace_back();
+			declaration->global = functions.size() == 1 && blocks.size() == 1;
+		}
+
+		if (declaration->count == 0) {
+			declaration->statement = statementIndex;
+		}
+
+		declaration->count += 1;
+		return declaration;
+	}
+
+	// Finds the declaration a name refers to in the current scope.  Names which are not declared locally are globals.
+	Inliner::Declaration* Inliner::lookup(const std::string& name)
+	{
+		for (size_t f = functions.size(); f-- > 0;) {
+			auto& blocks = functions[f].blocks;
+			size_t outermostBlock = f == 0 ? 1 : 0;
+
+			for (size_t b = blocks.size(); b-- > outermostBlock;) {
+				auto result = blocks[b].find(name);
+
+				if (result != blocks[b].end()) {
+					return result->second;
+				}
+			}
+		}
+
+		Declaration*& declaration = globals[name];
+
+		if (!declaration) {
+			declaration = &declarations.emplace_back();
+			declaration->global = true;
+		}
+
+		return declaration;
+	}
+
+	/*
+	* Records what the names in a function's body refer to, if the function could be inlined.  Must be called with the
+	* parameters declared and before the body is visited.
+	*/
+	void Inliner::addCandidate(const Ast::FunctionLiteral* function)
+	{
+		const Ast::Expression* body = findBody(function);
+		std::vector<const Ast::Identifier*> names;
+
+		if (!body || !collectNames(body, names)) {
+			return;
+		}
+
+		Candidate candidate;
+
+		for (auto* name : names) {
+			const std::string& literal = name->token->literal;
+
+			if (findParameter(function, literal) < 0) {
+				candidate.names.emplace_back(literal, lookup(literal));
+			}
+		}
+
+		candidates[function] = std::move(candidate);
+	}
+
+	/*
+	* Replaces a call with a copy of the called function's body if it fits the size budget and its arguments can be
+	* substituted without changing the order in which anything that could fail is evaluated.
+	* @returns true if the call was inlined
+	*/
+	bool Inliner::inlineCall(const CallSite& site)
+	{
+		auto* callExpression = static_cast<Ast::CallExpression*>(site.expression->get());
+		const Ast::FunctionLiteral* function = site.callee->function;
+		const Ast::Expression* body = findBody(function);
+		auto& arguments = callExpression->arguments;
+
+		if (!body || arguments.size() != function->parameters.size()) {
+			return false;
+		}
+
+		size_t size = ConstantFolder::countNodes(body);
+
+		std::vector<int> order;
+		for (size_t i = 0; i < arguments.size(); i++) {
+			if (!isCopyable(arguments[i].get())) {
+				order.push_back(static_cast<int>(i));
+			}
+		}
+
+		size_t next = 0;
+		bool failable = false;
+
+		if (!checkOrder(body, function, order, next, failable) || next != order.size()) {
+			return false;
+		}
+
+		// each use of a parameter is replaced by its argument, and the call and its arguments are replaced by the body
+		std::vector<const Ast::Identifier*> names;
+		collectNames(body, names);
+
+		int64_t growth = static_cast<int64_t>(size) - static_cast<int64_t>(ConstantFolder::countNodes(callExpression));
+
+		for (auto* name : names) {
+			int parameter = findParameter(function, name->token->literal);
+
+			if (parameter >= 0) {
+				growth += static_cast<int64_t>(ConstantFolder::countNodes(arguments[parameter].get())) - 1;
+			}
+		}
+
+		if (size > settings.maxFunctionSize || statistics.nodesAdded + growth > static_cast<int64_t>(settings.maxGrowth)) {
+			statistics.callsOverBudget += 1;
+			return false;
+		}
+
+		*site.expression = substitute(body, function, &arguments);
+
+		statistics.callsInlined += 1;
+		statistics.nodesAdded += static_cast<int32_t>(growth);
+		inlined.insert(function);
+
+		return true;
+	}
+
+	/*
+	* Walks an expression in evaluation order, checking that the parameters whose arguments are moved are each used once,
+	* in order, before anything which could raise an error.  Calls are treated as failing as soon as the callee is known,
+	* since the argument count is checked before the arguments are evaluated.
+	* @param order the parameters whose arguments are moved
+	* @param next the index into order of the next parameter expected
+	* @param failable set once an operation that could fail has been evaluated
+	* @returns false if a moved argument would be evaluated out of order
+	*/
+	bool Inliner::checkOrder(const Ast::Expression* expression, const Ast::FunctionLiteral* function, const std::vector<int>& order, size_t& next, bool& failable)
+	{
+		if (!expression) {
+			return false;
+		}
+
+		switch (expression->kind) {
+		case Ast::Node::Kind::Identifier: {
+			int parameter = findParameter(function, expression->token->literal);
+
+			if (std::find(order.begin(), order.end(), parameter) == order.end()) {
+				return true;
+			}
+
+			if (failable || next >= order.size() || order[next] != parameter) {
+				return false;
+			}
+
+			next += 1;
+			return true;
+		}
+
+		case Ast::Node::Kind::PrefixExpression: {
+			if (!checkOrder(static_cast<const Ast::PrefixExpression*>(expression)->rightExpression.get(), function, order, next, failable)) {
+				return false;
+			}
+
+			// only negation accepts any type
+			failable = failable || expression->token->type != Token::Type::Negate;
+			return true;
+		}
+
+		case Ast::Node::Kind::InfixExpression: {
+			auto* infixExpression = static_cast<const Ast::InfixExpression*>(expression);
+
+			if (!checkOrder(infixExpression->left.get(), function, order, next, failable) || !checkOrder(infixExpression->right.get(), function, order, next, failable)) {
+				return false;
+			}
+
+			failable = failable || infixExpression->operandType == Ast::OperandType::Unknown || infixExpression->token->type == Token::Type::Divide;
+			return true;
+		}
+
+		case Ast::Node::Kind::CallExpression: {
+			auto* callExpression = static_cast<const Ast::CallExpression*>(expression);
+
+			if (!checkOrder(callExpression->function.get(), function, order, next, failable)) {
+				return false;
+			}
+
+			failable = true;
+
+			for (auto& argument : callExpression->arguments) {
+				if (!checkOrder(argument.get(), function, order, next, failable)) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		default:
+			return true;
+		}
+	}
+
+	/*
+	* Copies an expression, replacing uses of the function's parameters with its arguments.  Arguments which are used once
+	* are moved into place, others are copied.
+	* @param function the function whose parameters are replaced, or null to copy the expression as is
+	*/
+	std::unique_ptr<Ast::Expression> Inliner::substitute(const Ast::Expression* expression, const Ast::FunctionLiteral* function, std::vector<std::unique_ptr<Ast::Expression>>* arguments)
+	{
+		if (!expression) {
+			return nullptr;
+		}
+
+		switch (expression->kind) {
+		case Ast::Node::Kind::Identifier: {
+			int parameter = function ? findParameter(function, expression->token->literal) : -1;
+
+			if (parameter >= 0) {
+				auto& argument = (*arguments)[parameter];
+				return isCopyable(argument.get()) ? substitute(argument.get(), nullptr, nullptr) : std::move(argument);
+			}
+
+			auto identifier = std::make_unique<Ast::Identifier>(expression->token);
+			identifier->binding = static_cast<const Ast::Identifier*>(expression)->binding;
+			return identifier;
+		}
+
+		case Ast::Node::Kind::IntegerLiteral: {
+			auto literal = std::make_unique<Ast::IntegerLiteral>(expression->token);
+			literal->value = static_cast<const Ast::IntegerLiteral*>(expression)->value;
+			return literal;
+		}
+
+		case Ast::Node::Kind::BooleanLiteral:
+			return std::make_unique<Ast::BooleanLiteral>(expression->token);
+
+		case Ast::Node::Kind::PrefixExpression: {
+			auto prefixExpression = std::make_unique<Ast::PrefixExpression>(expression->token);
+			prefixExpression->rightExpression = substitute(static_cast<const Ast::PrefixExpression*>(expression)->rightExpression.get(), function, arguments);
+			return prefixExpression;
+		}
+
+		case Ast::Node::Kind::InfixExpression: {
+			auto* original = static_cast<const Ast::InfixExpression*>(expression);
+			auto infixExpression = std::make_unique<Ast::InfixExpression>(expression->token);
+			infixExpression->left = substitute(original->left.get(), function, arguments);
+			infixExpression->right = substitute(original->right.get(), function, arguments);
+			infixExpression->operandType = original->operandType;
+			return infixExpression;
+		}
+
+		case Ast::Node::Kind::CallExpression: {
+			auto* original = static_cast<const Ast::CallExpression*>(expression);
+			auto callExpression = std::make_unique<Ast::CallExpression>(expression->token);
+			callExpression->function = substitute(original->function.get(), function, arguments);
+
+			for (auto& argument : original->arguments) {
+				callExpression->arguments.push_back(substitute(argument.get(), function, arguments));
+			}
+
+			return callExpression;
+		}
+
+		default:
+			return nullptr;
+		}
+	}
+
+	// Returns the expression a function's body consists of, or null if it has any other statements.
+	const Ast::Expression* Inliner::findBody(const Ast::FunctionLiteral* function)
+	{
+		if (!function || !function->body || function->body->statements.size() != 1) {
+			return nullptr;
+		}
+
+		const Ast::Statement* statement = function->body->statements[0].get();
+
+		if (!statement) {
+			return nullptr;
+		}
+
+		switch (statement->kind) {
+		case Ast::Node::Kind::ReturnStatement:
+			return static_cast<const Ast::ReturnStatement*>(statement)->expression.get();
+
+		case Ast::Node::Kind::ExpressionStatement:
+			return static_cast<const Ast::ExpressionStatement*>(statement)->expression.get();
+
+		default:
+			return nullptr;
+		}
+	}
+
+	// Literals and names always evaluate to the same value without error during a single expression, so may be copied.
+	bool Inliner::isCopyable(const Ast::Expression* expression)
+	{
+		return expression && (expression->kind == Ast::Node::Kind::Identifier || expression->kind == Ast::Node::Kind::IntegerLiteral ||
+			expression->kind == Ast::Node::Kind::BooleanLiteral);
+	}
+
+	int Inliner::findParameter(const Ast::FunctionLiteral* function, const std::string& name)
+	{
+		for (size_t i = 0; i < function->parameters.size(); i++) {
+			if (function->parameters[i]->token->literal == name) {
+				return static_cast<int>(i);
+			}
+		}
+
+		return -1;
+	}
+
+	/*
+	* Collects the identifiers in an expression.
+	* @returns false if the expression is incomplete or contains a function literal, which would need its captures
+	* resolved again and so is never inlined
+	*/
+	bool Inliner::collectNames(const Ast::Expression* expression, std::vector<const Ast::Identifier*>& names)
+	{
+		if (!expression) {
+			return false;
+		}
+
+		switch (expression->kind) {
+		case Ast::Node::Kind::Identifier:
+			names.push_back(static_cast<const Ast::Identifier*>(expression));
+			return true;
+
+		case Ast::Node::Kind::IntegerLiteral:
+		case Ast::Node::Kind::BooleanLiteral:
+			return true;
+
+		case Ast::Node::Kind::PrefixExpression:
+			return collectNames(static_cast<const Ast::PrefixExpression*>(expression)->rightExpression.get(), names);
+
+		case Ast::Node::Kind::InfixExpression: {
+			auto* infixExpression = static_cast<const Ast::InfixExpression*>(expression);
+			return collectNames(infixExpression->left.get(), names) && collectNames(infixExpression->right.get(), names);
+		}
+
+		case Ast::Node::Kind::CallExpression: {
+			auto* callExpression = static_cast<const Ast::CallExpression*>(expression);
+
+			if (!collectNames(callExpression->function.get(), names)) {
+				return false;
+			}
+
+			for (auto& argument : callExpression->arguments) {
+				if (!collectNames(argument.get(), names)) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		default:
+			return false;
+		}
+	}
+}
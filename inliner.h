@@ -0,0 +1,131 @@
+#pragma once
+
+#include "ast.h"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* Optimization pass which replaces calls to small functions with their bodies.  A function may be inlined when a let
+* statement binds it to a name which is never declared again, and its body is a single expression or return statement,
+* since a call is an expression and a body with other statements has nothing to be substituted for.  Each argument takes
+* the place of its parameter in a copy of the body, so no names are introduced at the call site.
+*
+* Arguments other than literals and names are moved rather than copied, so they must be used exactly once and in the
+* order they were passed, before the body does anything which could fail.  A call is only inlined where every other name
+* in the body refers to the same variable it did where the function was declared.  Inlined calls no longer count
+* towards the maximum call depth.
+*/
+class Inliner
+{
+public:
+	struct Settings
+	{
+		// the largest function body, in nodes, which will be inlined
+		uint32_t maxFunctionSize = 16;
+
+		// how many nodes inlining may add to the program in total
+		uint32_t maxGrowth = 1000;
+
+		// passes over the program, each of which may inline calls left in the bodies inlined by the last
+		uint32_t maxRounds = 4;
+	};
+
+	struct Statistics
+	{
+		uint32_t callsInlined = 0;
+		uint32_t functionsInlined = 0;
+
+		// calls which could have been inlined but were over the size budget
+		uint32_t callsOverBudget = 0;
+
+		int32_t nodesAdded = 0;
+		uint32_t rounds = 0;
+	};
+
+public:
+	Inliner();
+	Inliner(const Settings& settings);
+
+public:
+	void inlineCalls(Ast::Program& program);
+
+	inline const Statistics& getStatistics() const { return statistics; }
+
+private:
+	struct Declaration
+	{
+		uint32_t count = 0;
+		bool global = false;
+
+		// the top level statement which declares a global
+		size_t statement = 0;
+
+		// the function a let statement binds the name to, if it is one that could be inlined
+		const Ast::FunctionLiteral* function = nullptr;
+	};
+
+	struct Candidate
+	{
+		// the variables the names in the body which are not parameters refer to
+		std::vector<std::pair<std::string, Declaration*>> names;
+	};
+
+	struct CallSite
+	{
+		std::unique_ptr<Ast::Expression>* expression;
+		Declaration* callee;
+	};
+
+	struct FunctionScope
+	{
+		std::vector<std::unordered_map<std::string, Declaration*>> blocks;
+	};
+
+private:
+	bool inlineRound(Ast::Program& program);
+
+	void visitStatements(std::vector<std::unique_ptr<Ast::Statement>>& statements);
+	void visitStatement(Ast::Statement* statement);
+	void visitBlock(Ast::BlockStatement* block);
+	void visitExpression(std::unique_ptr<Ast::Expression>& expression);
+	void visitFunctionLiteral(Ast::FunctionLiteral* function);
+	void visitCall(std::unique_ptr<Ast::Expression>& expression);
+
+	Declaration* declare(const Ast::Identifier* identifier);
+	Declaration* lookup(const std::string& name);
+	void addCandidate(const Ast::FunctionLiteral* function);
+
+	bool inlineCall(const CallSite& site);
+
+	static bool checkOrder(const Ast::Expression* expression, const Ast::FunctionLiteral* function, const std::vector<int>& order, size_t& next, bool& failable);
+	static std::unique_ptr<Ast::Expression> substitute(const Ast::Expression* expression, const Ast::FunctionLiteral* function, std::vector<std::unique_ptr<Ast::Expression>>* arguments);
+	static const Ast::Expression* findBody(const Ast::FunctionLiteral* function);
+	static bool isCopyable(const Ast::Expression* expression);
+	static int findParameter(const Ast::FunctionLiteral* function, const std::string& name);
+	static bool collectNames(const Ast::Expression* expression, std::vector<const Ast::Identifier*>& names);
+
+private:
+	Settings settings;
+
+	std::deque<Declaration> declarations;
+	std::unordered_map<std::string, Declaration*> globals;
+	std::unordered_map<const Ast::FunctionLiteral*, Candidate> candidates;
+	std::unordered_set<const Ast::FunctionLiteral*> inlined;
+
+	std::vector<FunctionScope> functions;
+	std::vector<CallSite> sites;
+	size_t statementIndex = 0;
+
+	Statistics statistics;
+};
+
+}
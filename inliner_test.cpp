@@ -0,0 +1,188 @@
+#include "inliner.h"
+#include "parser.h"
+#include "lexer.h"
+#include "script.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace Delve::Script;
+
+// helper function that inlines calls in each input program and compares the string representation of its last statement to the expected output
+void compareInlinedToExpectedOutput(const std::vector<std::string>& inputs, const std::vector<std::string>& expectedOutput, const Inliner::Settings& settings = Inliner::Settings());
+
+TEST(Inliner, SmallFunctions)
+{
+	std::vector<std::string> inputs = {
+		"let isAdult = function(age) { return age > 17; }; isAdult(20);",
+		"let double = function(x) { x * 2; }; let f = function(y) { double(y + 1); };",
+		"let square = function(x) { x * x; }; square(3);",
+		"let sub = function(a, b) { b - a; }; sub(1, 2);",
+		"let first = function(a, b) { a; }; first(true, 2);",
+		"let f = function(n) { let isSmall = function(x) { x < 10; }; isSmall(n); };",
+		"let k = 1; let h = function(x) { x + k; }; let g = function(y) { h(y); };"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"(20 > 17);",
+		"let f = function(y) {\n((y + 1) * 2);\n};",
+		"(3 * 3);",
+		"(2 - 1);",
+		"true;",
+		"let f = function(n) {\nlet isSmall = function(x) {\n(x < 10);\n};\n(n < 10);\n};",
+		"let g = function(y) {\n(y + k);\n};"
+	};
+
+	compareInlinedToExpectedOutput(inputs, expectedOutput);
+}
+
+/*
+* Tests that calls are left alone when inlining them could change which function is called, what its names refer to,
+* or the order in which its arguments are evaluated.
+*/
+TEST(Inliner, UnsafeCalls)
+{
+	std::vector<std::string> inputs = {
+		"let loop = function(n) { loop(n); }; loop(1);",
+		"let f = function(x) { x; }; f(1); let f = function(x) { x + 1; }; f(2);",
+		"let g = function() { f(1); }; let f = function(x) { x; };",
+		"let k = 1; let h = function(x) { x + k; }; let g = function(k) { h(k); };",
+		"let square = function(x) { x * x; }; square(g());",
+		"let sub = function(a, b) { b - a; }; sub(f(), g());",
+		"let check = function(a, b) { f() + a; }; check(g(), 1);",
+		"let ignore = function(a) { 1; }; ignore(g());",
+		"let f = function(x) { let y = x; y; }; f(1);",
+		"let f = function(x) { x; }; f(1, 2);",
+		"let adder = function(x) { function(y) { x + y; }; }; adder(1);"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"loop(1);",
+		"f(2);",
+		"let f = function(x) {\nx;\n};",
+		"let g = function(k) {\nh(k);\n};",
+		"square(g());",
+		"sub(f(), g());",
+		"check(g(), 1);",
+		"ignore(g());",
+		"f(1);",
+		"f(1, 2);",
+		"adder(1);"
+	};
+
+	compareInlinedToExpectedOutput(inputs, expectedOutput);
+}
+
+/*
+* Tests that calls left in the bodies of inlined functions are inlined by later rounds.
+*/
+TEST(Inliner, NestedCalls)
+{
+	std::string code = "let inc = function(x) { x + 1; }; let twice = function(x) { inc(inc(x)); }; twice(5);";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+
+	Inliner inliner;
+	inliner.inlineCalls(*parser.getProgram());
+
+	EXPECT_EQ(parser.getProgram()->statements.back()->toString(), "((5 + 1) + 1);");
+
+	const auto& statistics = inliner.getStatistics();
+	EXPECT_EQ(statistics.callsInlined, 5);
+	EXPECT_EQ(statistics.functionsInlined, 2);
+	EXPECT_EQ(statistics.rounds, 3);
+}
+
+TEST(Inliner, SizeBudget)
+{
+	std::vector<std::string> inputs = {
+		"let f = function(a, b) { a * a + b * b; }; f(1, 2);"
+	};
+
+	compareInlinedToExpectedOutput(inputs, { "((1 * 1) + (2 * 2));" });
+
+	Inliner::Settings settings;
+	settings.maxFunctionSize = 6;
+	compareInlinedToExpectedOutput(inputs, { "f(1, 2);" }, settings);
+
+	settings = Inliner::Settings();
+	settings.maxGrowth = 2;
+	compareInlinedToExpectedOutput(inputs, { "f(1, 2);" }, settings);
+
+	Lexer lexer(inputs[0]);
+	Parser parser(lexer.tokens());
+	Inliner inliner(settings);
+	inliner.inlineCalls(*parser.getProgram());
+
+	EXPECT_EQ(inliner.getStatistics().callsInlined, 0);
+	EXPECT_EQ(inliner.getStatistics().callsOverBudget, 1);
+}
+
+/*
+* Tests that programs produce the same results and errors with and without inlining, for every combination of a set of
+* function bodies and arguments which may fail, have effects or be evaluated more than once.
+*/
+TEST(Inliner, PreservesResults)
+{
+	std::vector<std::string> bodies = {
+		"a - b;",
+		"return b * a;",
+		"a == b;",
+		"-a + b / 2;",
+		"apply(a) + b;",
+		"!b;",
+		"b;"
+	};
+
+	std::vector<std::string> arguments = {
+		"1", "true", "n", "n + 1", "apply(2)", "apply(true)", "0 - n", "fail()"
+	};
+
+	const std::string prelude = "let n = 5; let apply = function(x) { x * 3; }; let fail = function() { 1 / 0; };";
+	uint32_t callsInlined = 0;
+
+	for (const auto& body : bodies) {
+		for (const auto& first : arguments) {
+			for (const auto& second : arguments) {
+				std::string input = prelude + "let f = function(a, b) { " + body + " }; f(" + first + ", " + second + ");";
+
+				for (auto mode : { ExecutionMode::TreeWalk, ExecutionMode::Closure, ExecutionMode::Bytecode }) {
+					Script original(input);
+					Script optimized(input);
+					optimized.optimize();
+
+					EXPECT_EQ(original.run(mode).toString(), optimized.run(mode).toString()) << input;
+					EXPECT_EQ(original.getErrors(), optimized.getErrors()) << input;
+				}
+
+				Script inlined(input);
+				inlined.optimize();
+				callsInlined += inlined.getInliningStatistics().callsInlined;
+			}
+		}
+	}
+
+	// most combinations are inlined, so the comparisons above are not just between two copies of the same program
+	EXPECT_GT(callsInlined, bodies.size() * arguments.size() * arguments.size() / 2);
+}
+
+void compareInlinedToExpectedOutput(const std::vector<std::string>& inputs, const std::vector<std::string>& expectedOutput, const Inliner::Settings& settings)
+{
+	ASSERT_EQ(inputs.size(), expectedOutput.size());
+
+	Inliner inliner(settings);
+
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		Lexer lexer(inputs[i]);
+		Parser parser(lexer.tokens());
+
+		ASSERT_EQ(parser.getErrors().size(), 0);
+
+		auto* program = parser.getProgram();
+		inliner.inlineCalls(*program);
+
+		EXPECT_EQ(program->statements.back()->toString(), expectedOutput[i]) << inputs[i];
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <chrono>
+
+// The front end counts and times its phases unless this is defined to 0, in which case the counters and timers compile
+// to nothing and the statistics of the Lexer and Parser stay zero.
+#ifndef DELVE_SCRIPT_INSTRUMENTATION
+#define DELVE_SCRIPT_INSTRUMENTATION 1
+#endif
+
+namespace Delve::Script::Instrumentation {
+
+constexpr bool enabled = DELVE_SCRIPT_INSTRUMENTATION != 0;
+
+// Adds the time from its construction to its destruction to a total.
+class ScopedTimer
+{
+public:
+	explicit ScopedTimer(std::chrono::nanoseconds& t) : total(t), start(std::chrono::steady_clock::now()) {}
+	~ScopedTimer() { total += std::chrono::steady_clock::now() - start; }
+
+	ScopedTimer(const ScopedTimer&) = delete;
+	ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+	std::chrono::nanoseconds& total;
+	std::chrono::steady_clock::time_point start;
+};
+
+}
+
+#if DELVE_SCRIPT_INSTRUMENTATION
+
+// runs a statement which updates a counter
+#define DELVE_SCRIPT_COUNT(statement) do { statement; } while (false)
+
+// adds the time until the end of the enclosing scope to a total, at most once per scope
+#define DELVE_SCRIPT_TIME(total) ::Delve::Script::Instrumentation::ScopedTimer phaseTimer(total)
+
+#else
+
+#define DELVE_SCRIPT_COUNT(statement) do {} while (false)
+#define DELVE_SCRIPT_TIME(total) do {} while (false)
+
+#endif
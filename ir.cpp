@@ -0,0 +1,509 @@
+#include "ir.h"
+
+#include <algorithm>
+#include <sstream>
+#include <unordered_set>
+
+namespace Delve::Script {
+
+	using Ir::OpCode;
+
+	namespace {
+		// Follows a chain of replacements to the instruction which finally takes the place of another.
+		Ir::Instruction* resolve(Ir::Instruction* instruction, const std::unordered_map<const Ir::Instruction*, Ir::Instruction*>& replacements)
+		{
+			auto replacement = replacements.find(instruction);
+
+			while (replacement != replacements.end()) {
+				instruction = replacement->second;
+				replacement = replacements.find(instruction);
+			}
+
+			return instruction;
+		}
+
+		bool dominates(const Ir::Block* dominator, const Ir::Block* block, const std::unordered_map<const Ir::Block*, Ir::Block*>& dominators)
+		{
+			while (block != dominator) {
+				auto parent = dominators.find(block);
+
+				if (parent == dominators.end() || parent->second == block) {
+					return false;
+				}
+
+				block = parent->second;
+			}
+
+			return true;
+		}
+	}
+
+	const char* Ir::opCodeName(OpCode op)
+	{
+		static const char* names[] = {
+			"Constant", "Parameter", "Copy", "Phi", "Negate", "Minus", "Add", "Subtract", "Multiply", "Divide", "LessThan",
+			"GreaterThan", "Equal", "NotEqual", "LoadGlobal", "StoreGlobal", "LoadCapture", "NewBox", "LoadBox", "StoreBox",
+			"Closure", "Call", "Jump", "Branch", "Return"
+		};
+
+		return names[static_cast<size_t>(op)];
+	}
+
+	bool Ir::Instruction::hasValue() const
+	{
+		switch (op) {
+		case OpCode::StoreGlobal:
+		case OpCode::StoreBox:
+		case OpCode::Jump:
+		case OpCode::Branch:
+		case OpCode::Return:
+			return false;
+		default:
+			return true;
+		}
+	}
+
+	bool Ir::Instruction::isTerminator() const
+	{
+		return op == OpCode::Jump || op == OpCode::Branch || op == OpCode::Return;
+	}
+
+	/*
+	* Operators only depend on their operands, and a capture which is not boxed never changes once the closure is
+	* created.  Globals and boxes may be changed by any call, and every closure is a new object.
+	*/
+	bool Ir::Instruction::isDeterministic() const
+	{
+		switch (op) {
+		case OpCode::Constant:
+		case OpCode::Parameter:
+		case OpCode::Copy:
+		case OpCode::Phi:
+		case OpCode::Negate:
+		case OpCode::Minus:
+		case OpCode::Add:
+		case OpCode::Subtract:
+		case OpCode::Multiply:
+		case OpCode::Divide:
+		case OpCode::LessThan:
+		case OpCode::GreaterThan:
+		case OpCode::Equal:
+		case OpCode::NotEqual:
+		case OpCode::LoadCapture:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	Ir::Instruction* Ir::Block::getTerminator() const
+	{
+		if (instructions.empty() || !instructions.back()->isTerminator()) {
+			return nullptr;
+		}
+
+		return instructions.back().get();
+	}
+
+	std::vector<Ir::Block*> Ir::Block::getSuccessors() const
+	{
+		auto* terminator = getTerminator();
+
+		if (!terminator || terminator->op == OpCode::Return) {
+			return {};
+		}
+
+		if (terminator->op == OpCode::Jump) {
+			return { terminator->targets[0] };
+		}
+
+		return { terminator->targets[0], terminator->targets[1] };
+	}
+
+	size_t Ir::Block::firstNonPhi() const
+	{
+		size_t position = 0;
+
+		while (position < instructions.size() && instructions[position]->op == OpCode::Phi) {
+			position++;
+		}
+
+		return position;
+	}
+
+	Ir::Instruction* Ir::Block::append(OpCode op, std::vector<Instruction*> operands)
+	{
+		return insert(instructions.size(), op, std::move(operands));
+	}
+
+	Ir::Instruction* Ir::Block::insert(size_t position, OpCode op, std::vector<Instruction*> operands)
+	{
+		auto instruction = std::make_unique<Instruction>(op);
+		instruction->operands = std::move(operands);
+		instruction->block = this;
+
+		return instructions.insert(instructions.begin() + position, std::move(instruction))->get();
+	}
+
+	// Removes an edge into the block, along with the operand each phi has for it.
+	void Ir::Block::removePredecessor(Block* predecessor)
+	{
+		auto edge = std::find(predecessors.begin(), predecessors.end(), predecessor);
+
+		if (edge == predecessors.end()) {
+			return;
+		}
+
+		size_t index = edge - predecessors.begin();
+		predecessors.erase(edge);
+
+		for (size_t i = 0; i < firstNonPhi(); i++) {
+			auto& operands = instructions[i]->operands;
+			operands.erase(operands.begin() + index);
+		}
+	}
+
+	Ir::Block* Ir::Function::createBlock()
+	{
+		blocks.push_back(std::make_unique<Block>());
+		return blocks.back().get();
+	}
+
+	size_t Ir::Function::instructionCount() const
+	{
+		size_t count = 0;
+
+		for (const auto& block : blocks) {
+			count += block->instructions.size();
+		}
+
+		return count;
+	}
+
+	// Orders the blocks reachable from the entry so that each comes before its successors, apart from along back edges.
+	std::vector<Ir::Block*> Ir::Function::reversePostorder() const
+	{
+		std::vector<Block*> order;
+
+		if (blocks.empty()) {
+			return order;
+		}
+
+		std::unordered_set<const Block*> visited;
+		std::vector<std::pair<Block*, size_t>> stack;
+
+		stack.emplace_back(blocks.front().get(), 0);
+		visited.insert(blocks.front().get());
+
+		while (!stack.empty()) {
+			auto& top = stack.back();
+			auto successors = top.first->getSuccessors();
+
+			if (top.second < successors.size()) {
+				Block* successor = successors[top.second++];
+
+				if (visited.insert(successor).second) {
+					stack.emplace_back(successor, 0);
+				}
+
+				continue;
+			}
+
+			order.push_back(top.first);
+			stack.pop_back();
+		}
+
+		std::reverse(order.begin(), order.end());
+		return order;
+	}
+
+	/*
+	* Finds the immediate dominator of every reachable block, using the iterative algorithm of Cooper, Harvey and Kennedy.
+	* @returns a map from each block to its immediate dominator, where the entry block is its own
+	*/
+	std::unordered_map<const Ir::Block*, Ir::Block*> Ir::Function::findDominators() const
+	{
+		auto order = reversePostorder();
+		std::unordered_map<const Block*, size_t> position;
+		std::unordered_map<const Block*, Block*> dominators;
+
+		for (size_t i = 0; i < order.size(); i++) {
+			position[order[i]] = i;
+		}
+
+		if (order.empty()) {
+			return dominators;
+		}
+
+		dominators[order[0]] = order[0];
+		bool changed = true;
+
+		while (changed) {
+			changed = false;
+
+			for (size_t i = 1; i < order.size(); i++) {
+				Block* dominator = nullptr;
+
+				for (auto* predecessor : order[i]->predecessors) {
+					if (!dominators.count(predecessor)) {
+						continue;
+					}
+
+					if (!dominator) {
+						dominator = predecessor;
+						continue;
+					}
+
+					Block* other = predecessor;
+
+					while (dominator != other) {
+						while (position[dominator] > position[other]) {
+							dominator = dominators[dominator];
+						}
+
+						while (position[other] > position[dominator]) {
+							other = dominators[other];
+						}
+					}
+				}
+
+				if (dominator && dominators[order[i]] != dominator) {
+					dominators[order[i]] = dominator;
+					changed = true;
+				}
+			}
+		}
+
+		return dominators;
+	}
+
+	/*
+	* Replaces every use of an instruction with another, following chains of replacements, and then removes the
+	* instructions which were replaced.
+	*/
+	void Ir::Function::replace(const std::unordered_map<const Instruction*, Instruction*>& replacements)
+	{
+		if (replacements.empty()) {
+			return;
+		}
+
+		for (auto& block : blocks) {
+			for (auto& instruction : block->instructions) {
+				for (auto& operand : instruction->operands) {
+					operand = resolve(operand, replacements);
+				}
+			}
+
+			auto& instructions = block->instructions;
+			instructions.erase(std::remove_if(instructions.begin(), instructions.end(), [&](const auto& instruction) {
+				return replacements.count(instruction.get()) != 0;
+			}), instructions.end());
+		}
+	}
+
+	// Removes a block and its edges into its successors.  Nothing outside the block may use its instructions.
+	void Ir::Function::removeBlock(Block* block)
+	{
+		for (auto* successor : block->getSuccessors()) {
+			successor->removePredecessor(block);
+		}
+
+		blocks.erase(std::remove_if(blocks.begin(), blocks.end(), [block](const auto& b) { return b.get() == block; }), blocks.end());
+	}
+
+	/**
+	* Lists the blocks and instructions of every function in the module.  Values are numbered in order through each
+	* function, so the text only depends on the shape of the code.
+	* @returns one line per instruction, with each block headed by its index and predecessors
+	*/
+	std::string Ir::Module::toString() const
+	{
+		std::ostringstream out;
+
+		for (size_t f = 0; f < functions.size(); ++f) {
+			const auto& function = *functions[f];
+			std::unordered_map<const Block*, size_t> blockNumbers;
+			std::unordered_map<const Instruction*, size_t> valueNumbers;
+
+			for (const auto& block : function.blocks) {
+				blockNumbers[block.get()] = blockNumbers.size();
+
+				for (const auto& instruction : block->instructions) {
+					if (instruction->hasValue()) {
+						valueNumbers[instruction.get()] = valueNumbers.size();
+					}
+				}
+			}
+
+			auto value = [&](const Instruction* instruction) {
+				auto number = valueNumbers.find(instruction);
+				return number == valueNumbers.end() ? std::string("%?") : '%' + std::to_string(number->second);
+			};
+
+			auto block = [&](const Block* target) {
+				auto number = blockNumbers.find(target);
+				return number == blockNumbers.end() ? std::string("block ?") : "block " + std::to_string(number->second);
+			};
+
+			out << "function " << f << " (parameters " << function.parameterCount << ")\n";
+
+			for (const auto& b : function.blocks) {
+				out << block(b.get());
+
+				if (!b->predecessors.empty()) {
+					out << " (predecessors";
+
+					for (auto* predecessor : b->predecessors) {
+						out << ' ' << blockNumbers[predecessor];
+					}
+
+					out << ')';
+				}
+
+				out << '\n';
+
+				for (const auto& instruction : b->instructions) {
+					out << "  ";
+
+					if (instruction->hasValue()) {
+						out << value(instruction.get()) << " = ";
+					}
+
+					out << opCodeName(instruction->op);
+
+					switch (instruction->op) {
+					case OpCode::Constant:
+						out << ' ' << instruction->constant.toString();
+						break;
+					case OpCode::Parameter:
+					case OpCode::LoadGlobal:
+					case OpCode::StoreGlobal:
+					case OpCode::LoadCapture:
+						out << ' ' << instruction->index;
+						break;
+					case OpCode::Closure:
+						out << " function " << instruction->index;
+						break;
+					default:
+						break;
+					}
+
+					for (auto* operand : instruction->operands) {
+						out << ' ' << value(operand);
+					}
+
+					if (instruction->op == OpCode::Jump || instruction->op == OpCode::Branch) {
+						for (auto* target : b->getSuccessors()) {
+							out << ' ' << block(target);
+						}
+					}
+
+					out << '\n';
+				}
+			}
+		}
+
+		return out.str();
+	}
+
+	/**
+	* Checks that every function is well formed: blocks end in a single terminator, phis match their block's
+	* predecessors, edges agree in both directions and every operand is defined somewhere that dominates its use.
+	* @returns a description of each problem found, empty if there are none
+	*/
+	std::vector<std::string> Ir::Module::verify() const
+	{
+		std::vector<std::string> errors;
+
+		for (size_t f = 0; f < functions.size(); ++f) {
+			const auto& function = *functions[f];
+			auto dominators = function.findDominators();
+			std::unordered_map<const Instruction*, size_t> positions;
+
+			auto report = [&](size_t b, const std::string& problem) {
+				std::ostringstream error;
+				error << "function " << f << " block " << b << ": " << problem;
+				errors.push_back(error.str());
+			};
+
+			if (function.blocks.empty()) {
+				report(0, "function has no blocks.");
+				continue;
+			}
+
+			for (const auto& block : function.blocks) {
+				for (size_t i = 0; i < block->instructions.size(); i++) {
+					positions[block->instructions[i].get()] = i;
+				}
+			}
+
+			for (size_t b = 0; b < function.blocks.size(); b++) {
+				const Block* block = function.blocks[b].get();
+				const auto& instructions = block->instructions;
+
+				if (!block->getTerminator()) {
+					report(b, "block does not end with a terminator.");
+				}
+
+				if (b > 0 && !dominators.count(block)) {
+					report(b, "block is unreachable.");
+				}
+
+				for (auto* successor : block->getSuccessors()) {
+					if (std::find(successor->predecessors.begin(), successor->predecessors.end(), block) == successor->predecessors.end()) {
+						report(b, "successor does not list the block as a predecessor.");
+					}
+				}
+
+				for (auto* predecessor : block->predecessors) {
+					auto successors = predecessor->getSuccessors();
+
+					if (std::find(successors.begin(), successors.end(), block) == successors.end()) {
+						report(b, "predecessor does not branch to the block.");
+					}
+				}
+
+				for (size_t i = 0; i < instructions.size(); i++) {
+					const Instruction* instruction = instructions[i].get();
+
+					if (instruction->block != block) {
+						report(b, "instruction does not belong to the block.");
+					}
+
+					if (instruction->isTerminator() && i + 1 != instructions.size()) {
+						report(b, "terminator is not the last instruction.");
+					}
+
+					if (instruction->op == OpCode::Phi && (i >= block->firstNonPhi() || instruction->operands.size() != block->predecessors.size())) {
+						report(b, "phi does not match the block's predecessors.");
+					}
+
+					if (instruction->op == OpCode::Closure && instruction->index >= functions.size()) {
+						report(b, "closure of a function which does not exist.");
+					}
+
+					for (size_t o = 0; o < instruction->operands.size(); o++) {
+						const Instruction* operand = instruction->operands[o];
+
+						if (!operand || !positions.count(operand) || !operand->hasValue() || (instruction->op == OpCode::Phi && o >= block->predecessors.size())) {
+							report(b, std::string(opCodeName(instruction->op)) + " has an operand which is not a value in the function.");
+							continue;
+						}
+
+						// a phi's operand only needs to be available at the end of the corresponding predecessor
+						const Block* user = instruction->op == OpCode::Phi ? block->predecessors[o] : block;
+						bool available = operand->block == user
+							? instruction->op == OpCode::Phi || positions[operand] < i || operand == instruction
+							: dominates(operand->block, user, dominators);
+
+						if (!available) {
+							report(b, std::string(opCodeName(instruction->op)) + " uses a value which does not dominate it.");
+						}
+					}
+				}
+			}
+		}
+
+		return errors;
+	}
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "value.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* A mid-level intermediate representation in static single assignment form, lowered from the AST by the IrBuilder.  Each
+* function is a graph of basic blocks; each block is a list of instructions ending in exactly one terminator, with any
+* phis first.  A phi has one operand per predecessor of its block, in the same order.
+*
+* Locals and parameters become SSA values.  Globals and boxed variables, which may change behind the back of the
+* function, are reached through load and store instructions instead.
+*/
+namespace Ir {
+	enum class OpCode : uint8_t
+	{
+		// constant holds the value
+		Constant,
+
+		// index is the parameter's position
+		Parameter,
+
+		Copy,
+		Phi,
+
+		// operators, which raise the same errors as the engines when their operands have the wrong type
+		Negate,
+		Minus,
+		Add,
+		Subtract,
+		Multiply,
+		Divide,
+		LessThan,
+		GreaterThan,
+		Equal,
+		NotEqual,
+
+		// index is into the program's globals, StoreGlobal's operand is the value stored
+		LoadGlobal,
+		StoreGlobal,
+
+		// index is into the values captured by the function's closure
+		LoadCapture,
+
+		// NewBox's operand is the initial value, StoreBox's operands are the box and the value stored
+		NewBox,
+		LoadBox,
+		StoreBox,
+
+		// index is into the module's functions and the operands are the values captured.  A closure which captures
+		// itself has itself as an operand.
+		Closure,
+
+		// the first operand is the callee, the rest are the arguments
+		Call,
+
+		// terminators, targets hold the successors.  Branch goes to its first target if its operand is truthy.
+		Jump,
+		Branch,
+		Return
+	};
+
+	struct Block;
+
+	struct Instruction
+	{
+		Instruction(OpCode o) : op(o) {}
+
+		OpCode op;
+		std::vector<Instruction*> operands;
+
+		Value constant;
+		uint32_t index = 0;
+		Block* targets[2] = { nullptr, nullptr };
+
+		Block* block = nullptr;
+
+		bool hasValue() const;
+		bool isTerminator() const;
+
+		// whether evaluating the instruction twice with the same operands must give the same result or the same error
+		bool isDeterministic() const;
+	};
+
+	struct Block
+	{
+		std::vector<std::unique_ptr<Instruction>> instructions;
+		std::vector<Block*> predecessors;
+
+		Instruction* getTerminator() const;
+		std::vector<Block*> getSuccessors() const;
+
+		// the position of the first instruction which is not a phi
+		size_t firstNonPhi() const;
+
+		Instruction* append(OpCode op, std::vector<Instruction*> operands = {});
+		Instruction* insert(size_t position, OpCode op, std::vector<Instruction*> operands = {});
+		void removePredecessor(Block* predecessor);
+	};
+
+	struct Function
+	{
+		uint32_t parameterCount = 0;
+
+		// the entry block is first
+		std::vector<std::unique_ptr<Block>> blocks;
+
+		Block* createBlock();
+		size_t instructionCount() const;
+		std::vector<Block*> reversePostorder() const;
+		std::unordered_map<const Block*, Block*> findDominators() const;
+		void replace(const std::unordered_map<const Instruction*, Instruction*>& replacements);
+		void removeBlock(Block* block);
+	};
+
+	/*
+	* The functions of a program, with the top level code first.  A Closure instruction refers to the function it creates
+	* by its index here.
+	*/
+	struct Module
+	{
+		std::vector<std::unique_ptr<Function>> functions;
+
+		std::string toString() const;
+		std::vector<std::string> verify() const;
+	};
+
+	const char* opCodeName(OpCode op);
+}
+
+}
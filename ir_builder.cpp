@@ -0,0 +1,418 @@
+#include "ir_builder.h"
+
+namespace Delve::Script {
+
+	using Ir::OpCode;
+
+	/**
+	* Lowers a program to a new module.  Names which are used but never declared are reported through getErrors(), the
+	* module is built regardless with them treated as globals.
+	* @param program the program to lower, which is annotated in place by the Resolver
+	* @param host the host whose functions the program may call, these are given the first global indices
+	* @returns the module, with the top level code as its first function
+	*/
+	std::unique_ptr<Ir::Module> IrBuilder::build(Ast::Program& program, const Host* host)
+	{
+		auto result = std::make_unique<Ir::Module>();
+		module = result.get();
+		functions.clear();
+
+		resolver.resolve(program, host ? host->getNames() : std::vector<std::string>());
+		errors = resolver.getErrors();
+
+		beginFunction(0, program.boxedSlots);
+		endFunction(lowerStatements(program.statements));
+
+		module = nullptr;
+		return result;
+	}
+
+	/*
+	* Starts lowering a function.  Parameters are the first slots, and boxed slots hold a box from the start of the call
+	* so that closures can capture it before the variable is declared.
+	* @returns the index of the new function in the module
+	*/
+	uint32_t IrBuilder::beginFunction(uint32_t parameterCount, const std::vector<uint32_t>& boxedSlots)
+	{
+		uint32_t index = static_cast<uint32_t>(module->functions.size());
+		module->functions.push_back(std::make_unique<Ir::Function>());
+
+		functions.emplace_back();
+		auto& state = functions.back();
+		state.function = module->functions.back().get();
+		state.function->parameterCount = parameterCount;
+		state.current = state.function->createBlock();
+
+		for (uint32_t i = 0; i < parameterCount; i++) {
+			auto* parameter = emit(OpCode::Parameter);
+			parameter->index = i;
+			writeVariable(state.current, i, parameter);
+		}
+
+		for (uint32_t slot : boxedSlots) {
+			writeVariable(state.current, slot, emit(OpCode::NewBox, { readVariable(state.current, slot) }));
+		}
+
+		return index;
+	}
+
+	// Returns the value of the body if the end of the function can be reached.
+	void IrBuilder::endFunction(Ir::Instruction* value)
+	{
+		if (functions.back().current) {
+			emit(OpCode::Return, { value ? value : getNull() });
+		}
+
+		functions.pop_back();
+	}
+
+	/*
+	* Lowers a list of statements, stopping once the rest can no longer be reached.
+	* @returns the value of the last statement, which is null for an empty list, or null once a return is lowered
+	*/
+	Ir::Instruction* IrBuilder::lowerStatements(const std::vector<std::unique_ptr<Ast::Statement>>& statements)
+	{
+		Ir::Instruction* value = getNull();
+
+		for (auto& statement : statements) {
+			if (!functions.back().current) {
+				return nullptr;
+			}
+
+			if (statement) {
+				value = lowerStatement(statement.get());
+			}
+		}
+
+		return value;
+	}
+
+	Ir::Instruction* IrBuilder::lowerStatement(const Ast::Statement* statement)
+	{
+		switch (statement->kind) {
+		case Ast::Node::Kind::LetStatement:
+			return lowerLetStatement(static_cast<const Ast::LetStatement*>(statement));
+
+		case Ast::Node::Kind::ReturnStatement: {
+			auto* value = lowerExpression(static_cast<const Ast::ReturnStatement*>(statement)->expression.get());
+			emit(OpCode::Return, { value });
+			functions.back().current = nullptr;
+			return nullptr;
+		}
+
+		case Ast::Node::Kind::ExpressionStatement:
+			return lowerExpression(static_cast<const Ast::ExpressionStatement*>(statement)->expression.get());
+
+		case Ast::Node::Kind::BlockStatement:
+			return lowerStatements(static_cast<const Ast::BlockStatement*>(statement)->statements);
+
+		case Ast::Node::Kind::IfStatement:
+			return lowerIfStatement(static_cast<const Ast::IfStatement*>(statement));
+
+		default:
+			return lowerExpression(statement);
+		}
+	}
+
+	/*
+	* A global is stored, a boxed local is written through its box and any other local is renamed to a copy of the
+	* value it is bound to.
+	*/
+	Ir::Instruction* IrBuilder::lowerLetStatement(const Ast::LetStatement* statement)
+	{
+		auto* expression = statement->expression.get();
+		const Ast::Binding& binding = statement->identifier->binding;
+
+		Ir::Instruction* value = expression && expression->kind == Ast::Node::Kind::FunctionLiteral
+			? lowerFunctionLiteral(static_cast<const Ast::FunctionLiteral*>(expression))
+			: lowerExpression(expression);
+
+		auto& state = functions.back();
+
+		switch (binding.kind) {
+		case Ast::Binding::Kind::Global:
+			emit(OpCode::StoreGlobal, { value })->index = binding.index;
+			break;
+
+		case Ast::Binding::Kind::Local:
+			if (binding.boxed) {
+				emit(OpCode::StoreBox, { readVariable(state.current, binding.index), value });
+			}
+			else {
+				writeVariable(state.current, binding.index, emit(OpCode::Copy, { value }));
+			}
+
+			break;
+
+		default:
+			break;
+		}
+
+		return getNull();
+	}
+
+	/*
+	* Branches to the consequence and alternative and joins them again, with a phi for the value of the statement.  A
+	* missing alternative is an edge straight to the join, along which the statement evaluates to null.
+	*/
+	Ir::Instruction* IrBuilder::lowerIfStatement(const Ast::IfStatement* statement)
+	{
+		Ir::Function* function = functions.back().function;
+		Ir::Instruction* condition = lowerExpression(statement->condition.get());
+		Ir::Block* branchBlock = functions.back().current;
+		Ir::Instruction* branch = emit(OpCode::Branch, { condition });
+
+		// the blocks which reach the join, the value of the statement along each and the jumps still to be pointed at it
+		std::vector<std::pair<Ir::Block*, Ir::Instruction*>> incoming;
+		std::vector<Ir::Instruction*> jumps;
+
+		for (size_t i = 0; i < 2; i++) {
+			const Ast::BlockStatement* block = i == 0 ? statement->consequence.get() : statement->alternative.get();
+
+			if (!block) {
+				incoming.emplace_back(branchBlock, getNull());
+				continue;
+			}
+
+			Ir::Block* start = function->createBlock();
+			start->predecessors.push_back(branchBlock);
+			branch->targets[i] = start;
+			functions.back().current = start;
+
+			// lowering may begin new functions, moving the state, so it is looked up again afterwards
+			Ir::Instruction* value = lowerStatements(block->statements);
+
+			if (functions.back().current) {
+				incoming.emplace_back(functions.back().current, value);
+				jumps.push_back(emit(OpCode::Jump));
+			}
+		}
+
+		if (incoming.empty()) {
+			functions.back().current = nullptr;
+			return nullptr;
+		}
+
+		Ir::Block* join = function->createBlock();
+
+		for (auto& edge : incoming) {
+			join->predecessors.push_back(edge.first);
+		}
+
+		for (auto* jump : jumps) {
+			jump->targets[0] = join;
+		}
+
+		for (auto& target : branch->targets) {
+			if (!target) {
+				target = join;
+			}
+		}
+
+		functions.back().current = join;
+
+		if (incoming.size() == 1) {
+			return incoming[0].second;
+		}
+
+		return emit(OpCode::Phi, { incoming[0].second, incoming[1].second });
+	}
+
+	Ir::Instruction* IrBuilder::lowerExpression(const Ast::Expression* expression)
+	{
+		if (!expression) {
+			return getNull();
+		}
+
+		switch (expression->kind) {
+		case Ast::Node::Kind::Identifier:
+			return lowerIdentifier(static_cast<const Ast::Identifier*>(expression));
+
+		case Ast::Node::Kind::IntegerLiteral:
+			return emitConstant(Value::fromInteger(static_cast<const Ast::IntegerLiteral*>(expression)->value));
+
+		case Ast::Node::Kind::BooleanLiteral:
+			return emitConstant(Value::fromBoolean(expression->token->type == Token::Type::True));
+
+		case Ast::Node::Kind::PrefixExpression: {
+			auto* right = lowerExpression(static_cast<const Ast::PrefixExpression*>(expression)->rightExpression.get());
+			return emit(expression->token->type == Token::Type::Negate ? OpCode::Negate : OpCode::Minus, { right });
+		}
+
+		case Ast::Node::Kind::InfixExpression: {
+			auto* infixExpression = static_cast<const Ast::InfixExpression*>(expression);
+			auto* left = lowerExpression(infixExpression->left.get());
+			auto* right = lowerExpression(infixExpression->right.get());
+
+			switch (expression->token->type) {
+			case Token::Type::Plus:
+				return emit(OpCode::Add, { left, right });
+			case Token::Type::Minus:
+				return emit(OpCode::Subtract, { left, right });
+			case Token::Type::Multiply:
+				return emit(OpCode::Multiply, { left, right });
+			case Token::Type::Divide:
+				return emit(OpCode::Divide, { left, right });
+			case Token::Type::LessThan:
+				return emit(OpCode::LessThan, { left, right });
+			case Token::Type::GreaterThan:
+				return emit(OpCode::GreaterThan, { left, right });
+			case Token::Type::Equal:
+				return emit(OpCode::Equal, { left, right });
+			default:
+				return emit(OpCode::NotEqual, { left, right });
+			}
+		}
+
+		case Ast::Node::Kind::CallExpression: {
+			auto* callExpression = static_cast<const Ast::CallExpression*>(expression);
+			std::vector<Ir::Instruction*> operands = { lowerExpression(callExpression->function.get()) };
+
+			for (auto& argument : callExpression->arguments) {
+				operands.push_back(lowerExpression(argument.get()));
+			}
+
+			return emit(OpCode::Call, std::move(operands));
+		}
+
+		case Ast::Node::Kind::FunctionLiteral:
+			return lowerFunctionLiteral(static_cast<const Ast::FunctionLiteral*>(expression));
+
+		default:
+			return getNull();
+		}
+	}
+
+	Ir::Instruction* IrBuilder::lowerIdentifier(const Ast::Identifier* identifier)
+	{
+		const Ast::Binding& binding = identifier->binding;
+		Ir::Instruction* value;
+
+		switch (binding.kind) {
+		case Ast::Binding::Kind::Global:
+			value = emit(OpCode::LoadGlobal);
+			value->index = binding.index;
+			return value;
+
+		case Ast::Binding::Kind::Local:
+			value = readVariable(functions.back().current, binding.index);
+			break;
+
+		case Ast::Binding::Kind::Capture:
+			value = emit(OpCode::LoadCapture);
+			value->index = binding.index;
+			break;
+
+		default:
+			return getNull();
+		}
+
+		return binding.boxed ? emit(OpCode::LoadBox, { value }) : value;
+	}
+
+	/*
+	* Lowers the body of a function literal to a new function, and creates its closure where the literal appears.  The
+	* captured values are read when the closure is created, apart from a capture of the closure itself.
+	*/
+	Ir::Instruction* IrBuilder::lowerFunctionLiteral(const Ast::FunctionLiteral* function)
+	{
+		uint32_t index = beginFunction(static_cast<uint32_t>(function->parameters.size()), function->boxedSlots);
+		endFunction(function->body ? lowerStatements(function->body->statements) : getNull());
+
+		std::vector<Ir::Instruction*> captures;
+
+		for (const auto& capture : function->captures) {
+			switch (capture.source) {
+			case Ast::Capture::Source::Local:
+				captures.push_back(readVariable(functions.back().current, capture.index));
+				break;
+
+			case Ast::Capture::Source::Capture:
+				captures.push_back(emit(OpCode::LoadCapture));
+				captures.back()->index = capture.index;
+				break;
+
+			default:
+				captures.push_back(nullptr);
+				break;
+			}
+		}
+
+		auto* closure = emit(OpCode::Closure, captures);
+		closure->index = index;
+
+		for (auto& operand : closure->operands) {
+			if (!operand) {
+				operand = closure;
+			}
+		}
+
+		return closure;
+	}
+
+	Ir::Instruction* IrBuilder::emit(OpCode op, std::vector<Ir::Instruction*> operands)
+	{
+		return functions.back().current->append(op, std::move(operands));
+	}
+
+	Ir::Instruction* IrBuilder::emitConstant(const Value& value)
+	{
+		auto* constant = emit(OpCode::Constant);
+		constant->constant = value;
+		return constant;
+	}
+
+	// The null constant of the current function, placed at the start of its entry block so it is available everywhere.
+	Ir::Instruction* IrBuilder::getNull()
+	{
+		auto& state = functions.back();
+
+		if (!state.null) {
+			state.null = state.function->blocks.front()->insert(0, OpCode::Constant);
+		}
+
+		return state.null;
+	}
+
+	void IrBuilder::writeVariable(Ir::Block* block, uint32_t slot, Ir::Instruction* value)
+	{
+		functions.back().definitions[block][slot] = value;
+	}
+
+	/*
+	* Finds the value a slot holds at the end of a block.  A slot which is never written along some path holds null, as
+	* frame slots start out null.
+	*/
+	Ir::Instruction* IrBuilder::readVariable(Ir::Block* block, uint32_t slot)
+	{
+		auto& state = functions.back();
+		auto& definitions = state.definitions[block];
+		auto definition = definitions.find(slot);
+
+		if (definition != definitions.end()) {
+			return definition->second;
+		}
+
+		Ir::Instruction* value;
+
+		if (block->predecessors.empty()) {
+			value = getNull();
+		}
+		else if (block->predecessors.size() == 1) {
+			value = readVariable(block->predecessors[0], slot);
+		}
+		else {
+			// recorded before the operands are read so that a path back to this block would find the phi
+			value = block->insert(block->firstNonPhi(), OpCode::Phi);
+			state.definitions[block][slot] = value;
+
+			for (auto* predecessor : block->predecessors) {
+				auto* operand = readVariable(predecessor, slot);
+				value->operands.push_back(operand);
+			}
+		}
+
+		state.definitions[block][slot] = value;
+		return value;
+	}
+}
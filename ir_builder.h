@@ -0,0 +1,76 @@
+#pragma once
+
+#include "ast.h"
+#include "host.h"
+#include "ir.h"
+#include "resolver.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* Lowers a program to the SSA intermediate representation.  The program is first run through the Resolver, and each
+* frame slot is then tracked as an SSA variable using the algorithm of Braun et al: a read looks for the slot's
+* definition in the current block and then through its predecessors, placing a phi where paths join.  Since if
+* statements are the only control flow, every block's predecessors are known before anything in it is lowered.
+*
+* Lowering is deliberately naive; each let of a local produces a copy and phis are placed even where every path
+* agrees, leaving the passes in ir_passes.h to clean up.
+*/
+class IrBuilder
+{
+public:
+	using ErrorList = std::vector<std::string>;
+
+public:
+	std::unique_ptr<Ir::Module> build(Ast::Program& program, const Host* host = nullptr);
+
+	inline const ErrorList& getErrors() const { return errors; }
+
+private:
+	struct FunctionState
+	{
+		Ir::Function* function = nullptr;
+
+		// null once the code being lowered can no longer be reached, after a return
+		Ir::Block* current = nullptr;
+
+		// the value each slot holds at the end of each block, filled in as reads and writes are lowered
+		std::unordered_map<const Ir::Block*, std::unordered_map<uint32_t, Ir::Instruction*>> definitions;
+
+		Ir::Instruction* null = nullptr;
+	};
+
+private:
+	uint32_t beginFunction(uint32_t parameterCount, const std::vector<uint32_t>& boxedSlots);
+	void endFunction(Ir::Instruction* value);
+
+	Ir::Instruction* lowerStatements(const std::vector<std::unique_ptr<Ast::Statement>>& statements);
+	Ir::Instruction* lowerStatement(const Ast::Statement* statement);
+	Ir::Instruction* lowerLetStatement(const Ast::LetStatement* statement);
+	Ir::Instruction* lowerIfStatement(const Ast::IfStatement* statement);
+	Ir::Instruction* lowerExpression(const Ast::Expression* expression);
+	Ir::Instruction* lowerIdentifier(const Ast::Identifier* identifier);
+	Ir::Instruction* lowerFunctionLiteral(const Ast::FunctionLiteral* function);
+
+	Ir::Instruction* emit(Ir::OpCode op, std::vector<Ir::Instruction*> operands = {});
+	Ir::Instruction* emitConstant(const Value& value);
+	Ir::Instruction* getNull();
+
+	void writeVariable(Ir::Block* block, uint32_t slot, Ir::Instruction* value);
+	Ir::Instruction* readVariable(Ir::Block* block, uint32_t slot);
+
+private:
+	Ir::Module* module = nullptr;
+	std::vector<FunctionState> functions;
+
+	Resolver resolver;
+	ErrorList errors;
+};
+
+}
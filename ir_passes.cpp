@@ -0,0 +1,561 @@
+#include "ir_passes.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <unordered_set>
+#include <utility>
+
+namespace Delve::Script {
+
+	using Ir::OpCode;
+
+	namespace {
+		Ir::Instruction* resolve(Ir::Instruction* instruction, const std::unordered_map<const Ir::Instruction*, Ir::Instruction*>& replacements)
+		{
+			auto replacement = replacements.find(instruction);
+
+			while (replacement != replacements.end()) {
+				instruction = replacement->second;
+				replacement = replacements.find(instruction);
+			}
+
+			return instruction;
+		}
+
+		bool isCommutative(OpCode op)
+		{
+			return op == OpCode::Add || op == OpCode::Multiply || op == OpCode::Equal || op == OpCode::NotEqual;
+		}
+
+		// Constants only ever hold null, integers and booleans.
+		bool sameConstant(const Value& left, const Value& right)
+		{
+			if (left.type != right.type) {
+				return false;
+			}
+
+			switch (left.type) {
+			case Value::Type::Integer:
+				return left.integer == right.integer;
+			case Value::Type::Boolean:
+				return left.boolean == right.boolean;
+			default:
+				return true;
+			}
+		}
+
+		/*
+		* Evaluates an operator on constant operands with the same functions the engines use.
+		* @returns false if the operator would raise an error, which is left to happen at run time
+		*/
+		bool evaluate(OpCode op, const std::vector<Value>& operands, Value& result)
+		{
+			try {
+				switch (op) {
+				case OpCode::Negate:
+					result = Operators::negate(operands[0]);
+					break;
+				case OpCode::Minus:
+					result = Operators::minus(operands[0]);
+					break;
+				case OpCode::Add:
+					result = Operators::add(operands[0], operands[1]);
+					break;
+				case OpCode::Subtract:
+					result = Operators::subtract(operands[0], operands[1]);
+					break;
+				case OpCode::Multiply:
+					result = Operators::multiply(operands[0], operands[1]);
+					break;
+				case OpCode::Divide:
+					result = Operators::divide(operands[0], operands[1]);
+					break;
+				case OpCode::LessThan:
+					result = Operators::lessThan(operands[0], operands[1]);
+					break;
+				case OpCode::GreaterThan:
+					result = Operators::greaterThan(operands[0], operands[1]);
+					break;
+				case OpCode::Equal:
+					result = Operators::equal(operands[0], operands[1]);
+					break;
+				case OpCode::NotEqual:
+					result = Operators::notEqual(operands[0], operands[1]);
+					break;
+				default:
+					return false;
+				}
+			}
+			catch (const RuntimeError&) {
+				return false;
+			}
+
+			return true;
+		}
+
+		/*
+		* The state of one run of value numbering.  The table maps the key of each value to the instruction which first
+		* computed it, and only holds entries from the blocks which dominate the one being visited.
+		*/
+		struct ValueNumbering
+		{
+			using Key = std::vector<uint64_t>;
+
+			std::unordered_map<const Ir::Block*, std::vector<Ir::Block*>> children;
+			std::map<Key, Ir::Instruction*> table;
+			std::unordered_map<const Ir::Instruction*, Ir::Instruction*> replacements;
+
+			Key makeKey(const Ir::Instruction* instruction)
+			{
+				Key key = { static_cast<uint64_t>(instruction->op), instruction->index, static_cast<uint64_t>(instruction->constant.type) };
+
+				if (instruction->op == OpCode::Constant) {
+					key.push_back(instruction->constant.type == Value::Type::Boolean
+						? static_cast<uint64_t>(instruction->constant.boolean)
+						: static_cast<uint64_t>(instruction->constant.integer));
+				}
+
+				// a phi depends on which edge reached its block, so only phis in the same block can be the same value
+				if (instruction->op == OpCode::Phi) {
+					key.push_back(reinterpret_cast<uintptr_t>(instruction->block));
+				}
+
+				size_t first = key.size();
+
+				for (auto* operand : instruction->operands) {
+					key.push_back(reinterpret_cast<uintptr_t>(resolve(operand, replacements)));
+				}
+
+				// the order only matters for which error is raised, and the instruction found in the table has already
+				// run without one
+				if (isCommutative(instruction->op)) {
+					std::sort(key.begin() + first, key.end());
+				}
+
+				return key;
+			}
+
+			void visit(Ir::Block* block)
+			{
+				std::vector<Key> added;
+
+				for (auto& instruction : block->instructions) {
+					if (!instruction->isDeterministic() || instruction->op == OpCode::Copy) {
+						continue;
+					}
+
+					Key key = makeKey(instruction.get());
+					auto existing = table.find(key);
+
+					if (existing != table.end()) {
+						replacements[instruction.get()] = existing->second;
+					}
+					else {
+						table.emplace(key, instruction.get());
+						added.push_back(std::move(key));
+					}
+				}
+
+				for (auto* child : children[block]) {
+					visit(child);
+				}
+
+				for (const auto& key : added) {
+					table.erase(key);
+				}
+			}
+		};
+
+		struct Lattice
+		{
+			enum class State : uint8_t
+			{
+				// not yet known to be reached, or with operands not yet known
+				Unknown,
+				Constant,
+				Overdefined
+			};
+
+			State state = State::Unknown;
+			Value value;
+		};
+	}
+
+	Ir::PassManager::PassManager() : PassManager(Settings())
+	{
+	}
+
+	Ir::PassManager::PassManager(const Settings& managerSettings) : settings(managerSettings)
+	{
+	}
+
+	void Ir::PassManager::add(std::unique_ptr<Pass> pass)
+	{
+		passes.push_back(std::move(pass));
+	}
+
+	// Adds the passes in the order which lets each clean up after the last.
+	void Ir::PassManager::addStandardPasses()
+	{
+		add(std::make_unique<SparseConstantPropagation>());
+		add(std::make_unique<CopyPropagation>());
+		add(std::make_unique<GlobalValueNumbering>());
+	}
+
+	/**
+	* Optimizes every function of a module in place.  Statistics are reset each time this method is called.
+	* @param module the module to optimize
+	*/
+	void Ir::PassManager::run(Module& module)
+	{
+		DELVE_SCRIPT_TRACE("run ir passes", "optimize");
+
+		statistics = Statistics();
+
+		for (const auto& pass : passes) {
+			statistics.passes.push_back({ pass->getName(), 0 });
+		}
+
+		for (const auto& function : module.functions) {
+			statistics.instructionsBefore += function->instructionCount();
+
+			for (uint32_t iteration = 0; iteration < settings.maxIterations; iteration++) {
+				statistics.iterations += 1;
+				uint32_t changes = 0;
+
+				for (size_t i = 0; i < passes.size(); i++) {
+					uint32_t passChanges = passes[i]->run(*function);
+					statistics.passes[i].changes += passChanges;
+					changes += passChanges;
+				}
+
+				if (changes == 0) {
+					break;
+				}
+			}
+
+			statistics.instructionsAfter += function->instructionCount();
+		}
+	}
+
+	/*
+	* Visits the dominator tree with each block's children in reverse postorder, so that the predecessors of a join are
+	* numbered before its phis.
+	* @returns the number of instructions removed
+	*/
+	uint32_t Ir::GlobalValueNumbering::run(Function& function)
+	{
+		auto order = function.reversePostorder();
+		auto dominators = function.findDominators();
+		ValueNumbering numbering;
+
+		for (size_t i = 1; i < order.size(); i++) {
+			numbering.children[dominators[order[i]]].push_back(order[i]);
+		}
+
+		if (!order.empty()) {
+			numbering.visit(order[0]);
+		}
+
+		function.replace(numbering.replacements);
+		return static_cast<uint32_t>(numbering.replacements.size());
+	}
+
+	// Returns the number of instructions removed.
+	uint32_t Ir::CopyPropagation::run(Function& function)
+	{
+		std::unordered_map<const Instruction*, Instruction*> replacements;
+
+		for (auto& block : function.blocks) {
+			for (auto& instruction : block->instructions) {
+				if (instruction->op == OpCode::Copy) {
+					replacements[instruction.get()] = resolve(instruction->operands[0], replacements);
+					continue;
+				}
+
+				if (instruction->op != OpCode::Phi) {
+					continue;
+				}
+
+				Instruction* value = nullptr;
+				bool trivial = true;
+
+				for (auto* operand : instruction->operands) {
+					Instruction* resolved = resolve(operand, replacements);
+
+					if (resolved == instruction.get() || resolved == value) {
+						continue;
+					}
+
+					trivial = value == nullptr;
+					value = resolved;
+
+					if (!trivial) {
+						break;
+					}
+				}
+
+				if (trivial && value) {
+					replacements[instruction.get()] = value;
+				}
+			}
+		}
+
+		function.replace(replacements);
+		return static_cast<uint32_t>(replacements.size());
+	}
+
+	/*
+	* Finds the value of every instruction and which edges can be taken, and then rewrites the function with what was
+	* found.
+	* @returns the number of instructions replaced, branches turned into jumps and blocks removed
+	*/
+	uint32_t Ir::SparseConstantPropagation::run(Function& function)
+	{
+		if (function.blocks.empty()) {
+			return 0;
+		}
+
+		std::unordered_map<const Instruction*, Lattice> values;
+		std::unordered_map<const Instruction*, std::vector<Instruction*>> users;
+		std::unordered_set<const Block*> executableBlocks;
+		std::set<std::pair<const Block*, const Block*>> executableEdges;
+
+		std::vector<std::pair<Block*, Block*>> flowWorklist = { { nullptr, function.blocks.front().get() } };
+		std::vector<Instruction*> ssaWorklist;
+
+		for (auto& block : function.blocks) {
+			for (auto& instruction : block->instructions) {
+				for (auto* operand : instruction->operands) {
+					users[operand].push_back(instruction.get());
+				}
+			}
+		}
+
+		auto update = [&](Instruction* instruction, const Lattice& value) {
+			Lattice& current = values[instruction];
+
+			if (current.state == value.state && (value.state != Lattice::State::Constant || sameConstant(current.value, value.value))) {
+				return;
+			}
+
+			current = value;
+
+			for (auto* user : users[instruction]) {
+				ssaWorklist.push_back(user);
+			}
+		};
+
+		auto visit = [&](Instruction* instruction) {
+			Lattice result;
+			Block* block = instruction->block;
+
+			switch (instruction->op) {
+			case OpCode::Jump:
+				flowWorklist.emplace_back(block, instruction->targets[0]);
+				return;
+
+			case OpCode::Branch: {
+				const Lattice& condition = values[instruction->operands[0]];
+
+				if (condition.state == Lattice::State::Constant) {
+					flowWorklist.emplace_back(block, instruction->targets[condition.value.isTruthy() ? 0 : 1]);
+				}
+				else if (condition.state == Lattice::State::Overdefined) {
+					flowWorklist.emplace_back(block, instruction->targets[0]);
+					flowWorklist.emplace_back(block, instruction->targets[1]);
+				}
+
+				return;
+			}
+
+			case OpCode::Return:
+			case OpCode::StoreGlobal:
+			case OpCode::StoreBox:
+				return;
+
+			case OpCode::Constant:
+				result.state = Lattice::State::Constant;
+				result.value = instruction->constant;
+				break;
+
+			case OpCode::Copy:
+				result = values[instruction->operands[0]];
+				break;
+
+			case OpCode::Phi:
+				for (size_t i = 0; i < instruction->operands.size(); i++) {
+					if (!executableEdges.count({ block->predecessors[i], block })) {
+						continue;
+					}
+
+					const Lattice& operand = values[instruction->operands[i]];
+
+					if (operand.state == Lattice::State::Unknown) {
+						continue;
+					}
+
+					if (result.state == Lattice::State::Unknown) {
+						result = operand;
+					}
+					else if (operand.state == Lattice::State::Overdefined || !sameConstant(result.value, operand.value)) {
+						result.state = Lattice::State::Overdefined;
+						break;
+					}
+				}
+
+				break;
+
+			case OpCode::Negate:
+			case OpCode::Minus:
+			case OpCode::Add:
+			case OpCode::Subtract:
+			case OpCode::Multiply:
+			case OpCode::Divide:
+			case OpCode::LessThan:
+			case OpCode::GreaterThan:
+			case OpCode::Equal:
+			case OpCode::NotEqual: {
+				std::vector<Value> operands;
+
+				for (auto* operand : instruction->operands) {
+					const Lattice& value = values[operand];
+
+					if (value.state == Lattice::State::Overdefined) {
+						result.state = Lattice::State::Overdefined;
+						break;
+					}
+
+					if (value.state == Lattice::State::Unknown) {
+						break;
+					}
+
+					operands.push_back(value.value);
+				}
+
+				if (operands.size() == instruction->operands.size()) {
+					result.state = evaluate(instruction->op, operands, result.value) ? Lattice::State::Constant : Lattice::State::Overdefined;
+				}
+
+				break;
+			}
+
+			default:
+				result.state = Lattice::State::Overdefined;
+				break;
+			}
+
+			update(instruction, result);
+		};
+
+		while (!flowWorklist.empty() || !ssaWorklist.empty()) {
+			if (!flowWorklist.empty()) {
+				auto edge = flowWorklist.back();
+				flowWorklist.pop_back();
+
+				if (edge.first && !executableEdges.insert(edge).second) {
+					continue;
+				}
+
+				// the first time a block is reached everything in it is visited, after that only its phis can change
+				bool first = executableBlocks.insert(edge.second).second;
+				size_t end = first ? edge.second->instructions.size() : edge.second->firstNonPhi();
+
+				for (size_t i = 0; i < end; i++) {
+					visit(edge.second->instructions[i].get());
+				}
+
+				continue;
+			}
+
+			Instruction* instruction = ssaWorklist.back();
+			ssaWorklist.pop_back();
+
+			if (executableBlocks.count(instruction->block)) {
+				visit(instruction);
+			}
+		}
+
+		uint32_t changes = 0;
+		std::unordered_map<const Instruction*, Instruction*> replacements;
+
+		for (auto& block : function.blocks) {
+			if (!executableBlocks.count(block.get())) {
+				continue;
+			}
+
+			std::vector<Instruction*> constants;
+
+			for (auto& instruction : block->instructions) {
+				auto value = values.find(instruction.get());
+
+				if (instruction->op != OpCode::Constant && instruction->hasValue() && value != values.end() && value->second.state == Lattice::State::Constant) {
+					constants.push_back(instruction.get());
+				}
+			}
+
+			for (auto* instruction : constants) {
+				if (instruction->op == OpCode::Copy && instruction->operands[0]->op == OpCode::Constant) {
+					replacements[instruction] = instruction->operands[0];
+					continue;
+				}
+
+				size_t position = block->firstNonPhi();
+
+				if (instruction->op != OpCode::Phi) {
+					auto found = std::find_if(block->instructions.begin(), block->instructions.end(), [instruction](const auto& i) { return i.get() == instruction; });
+					position = found - block->instructions.begin();
+				}
+
+				Instruction* constant = block->insert(position, OpCode::Constant);
+				constant->constant = values[instruction].value;
+				replacements[instruction] = constant;
+			}
+
+			Instruction* terminator = block->getTerminator();
+
+			if (terminator && terminator->op == OpCode::Branch && values[terminator->operands[0]].state == Lattice::State::Constant) {
+				size_t taken = values[terminator->operands[0]].value.isTruthy() ? 0 : 1;
+				Block* target = terminator->targets[taken];
+				Block* other = terminator->targets[1 - taken];
+
+				if (other != target) {
+					other->removePredecessor(block.get());
+				}
+
+				terminator->op = OpCode::Jump;
+				terminator->operands.clear();
+				terminator->targets[0] = target;
+				terminator->targets[1] = nullptr;
+				changes += 1;
+			}
+		}
+
+		function.replace(replacements);
+		changes += static_cast<uint32_t>(replacements.size());
+
+		// edges out of blocks which never run are removed before any block is, so no successor is already gone
+		std::unordered_set<const Block*> removed;
+
+		for (auto& block : function.blocks) {
+			if (executableBlocks.count(block.get())) {
+				continue;
+			}
+
+			for (auto* successor : block->getSuccessors()) {
+				if (executableBlocks.count(successor)) {
+					successor->removePredecessor(block.get());
+				}
+			}
+
+			removed.insert(block.get());
+		}
+
+		auto& blocks = function.blocks;
+		blocks.erase(std::remove_if(blocks.begin(), blocks.end(), [&](const auto& block) { return removed.count(block.get()) != 0; }), blocks.end());
+
+		return changes + static_cast<uint32_t>(removed.size());
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "ir.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Delve::Script {
+
+namespace Ir {
+	/*
+	* A transformation of a single function.  Passes must leave the function well formed, as checked by Module::verify(),
+	* and must not change what it returns or which errors it raises.
+	*/
+	class Pass
+	{
+	public:
+		virtual ~Pass() = default;
+
+		virtual const char* getName() const = 0;
+
+		// Transforms the function in place, returning the number of changes made.
+		virtual uint32_t run(Function& function) = 0;
+	};
+
+	/*
+	* Runs a sequence of passes over every function of a module, repeating the sequence while any pass still finds
+	* something to change, since each pass can expose work for the others.
+	*/
+	class PassManager
+	{
+	public:
+		struct Settings
+		{
+			// the most times the sequence of passes is run over a function
+			uint32_t maxIterations = 4;
+		};
+
+		struct PassStatistics
+		{
+			std::string name;
+			uint32_t changes = 0;
+		};
+
+		struct Statistics
+		{
+			// one entry per pass, in the order they were added
+			std::vector<PassStatistics> passes;
+
+			uint32_t iterations = 0;
+			size_t instructionsBefore = 0;
+			size_t instructionsAfter = 0;
+		};
+
+	public:
+		PassManager();
+		PassManager(const Settings& settings);
+
+	public:
+		void add(std::unique_ptr<Pass> pass);
+		void addStandardPasses();
+
+		void run(Module& module);
+
+		inline const Statistics& getStatistics() const { return statistics; }
+
+	private:
+		std::vector<std::unique_ptr<Pass>> passes;
+
+		Settings settings;
+		Statistics statistics;
+	};
+
+	/*
+	* Replaces instructions which compute the same value as one which dominates them, walking the dominator tree with a
+	* table of the values available at each block.  Operands of commutative operators are put in a fixed order first, so
+	* that a + b and b + a are recognised as the same value.
+	*/
+	class GlobalValueNumbering : public Pass
+	{
+	public:
+		const char* getName() const override { return "GlobalValueNumbering"; }
+		uint32_t run(Function& function) override;
+	};
+
+	/*
+	* Replaces copies with the value copied, and phis whose operands are all the same value (or the phi itself) with
+	* that value.
+	*/
+	class CopyPropagation : public Pass
+	{
+	public:
+		const char* getName() const override { return "CopyPropagation"; }
+		uint32_t run(Function& function) override;
+	};
+
+	/*
+	* Sparse conditional constant propagation, after Wegman and Zadeck.  Values and edges are assumed unreachable until
+	* shown otherwise, so constants are found through phis whose other operands only arrive along branches which are
+	* never taken.  Instructions found to be constant are replaced, branches on constants become jumps and blocks which
+	* can never run are removed.  An operator which would raise an error is left to raise it at run time.
+	*/
+	class SparseConstantPropagation : public Pass
+	{
+	public:
+		const char* getName() const override { return "SparseConstantPropagation"; }
+		uint32_t run(Function& function) override;
+	};
+}
+
+}
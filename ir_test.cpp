@@ -0,0 +1,320 @@
+#include "ir_builder.h"
+#include "ir_passes.h"
+#include "parser.h"
+#include "lexer.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace Delve::Script;
+
+// helper function that lowers a program, checking that it parses and that the module is well formed
+std::unique_ptr<Ir::Module> buildModule(const std::string& input);
+
+// helper function that runs a single pass over every function of a module, returning the total number of changes
+uint32_t runPass(Ir::Pass& pass, Ir::Module& module);
+
+TEST(Ir, StraightLineCode)
+{
+	auto module = buildModule("let a = 1; let b = -a; a * b;");
+
+	EXPECT_EQ(module->toString(),
+		"function 0 (parameters 0)\n"
+		"block 0\n"
+		"  %0 = Constant null\n"
+		"  %1 = Constant 1\n"
+		"  StoreGlobal 0 %1\n"
+		"  %2 = LoadGlobal 0\n"
+		"  %3 = Minus %2\n"
+		"  StoreGlobal 1 %3\n"
+		"  %4 = LoadGlobal 0\n"
+		"  %5 = LoadGlobal 1\n"
+		"  %6 = Multiply %4 %5\n"
+		"  Return %6\n");
+}
+
+/*
+* Tests that if statements branch and join again with a phi for their value, which is null along a missing
+* alternative, and that code after a return is never lowered.
+*/
+TEST(Ir, IfStatements)
+{
+	auto module = buildModule("let f = function(x) { let y = x; if (y) { let y = 2; 1; }; };");
+
+	EXPECT_EQ(module->functions.size(), 2);
+	EXPECT_EQ(module->toString(),
+		"function 0 (parameters 0)\n"
+		"block 0\n"
+		"  %0 = Constant null\n"
+		"  %1 = Closure function 1\n"
+		"  StoreGlobal 0 %1\n"
+		"  Return %0\n"
+		"function 1 (parameters 1)\n"
+		"block 0\n"
+		"  %0 = Constant null\n"
+		"  %1 = Parameter 0\n"
+		"  %2 = Copy %1\n"
+		"  Branch %2 block 1 block 2\n"
+		"block 1 (predecessors 0)\n"
+		"  %3 = Constant 2\n"
+		"  %4 = Copy %3\n"
+		"  %5 = Constant 1\n"
+		"  Jump block 2\n"
+		"block 2 (predecessors 1 0)\n"
+		"  %6 = Phi %5 %0\n"
+		"  Return %6\n");
+
+	module = buildModule("let f = function(x) { if (x) { return 1; } else { return 2; }; 3; };");
+
+	EXPECT_EQ(module->functions[1]->blocks.size(), 3);
+	EXPECT_EQ(module->toString().find("Constant 3"), std::string::npos);
+}
+
+/*
+* Tests that each variable read after an if statement is merged with a phi, alongside the phi for the statement's own
+* value, and that captured variables which are declared more than once are reached through a box.
+*/
+TEST(Ir, Variables)
+{
+	auto module = buildModule("let f = function(x) { if (x > 0) { let x = 0; }; let x = x + 1; x; };");
+
+	EXPECT_EQ(module->toString().substr(module->toString().find("function 1 (")),
+		"function 1 (parameters 1)\n"
+		"block 0\n"
+		"  %0 = Constant null\n"
+		"  %1 = Parameter 0\n"
+		"  %2 = Constant 0\n"
+		"  %3 = GreaterThan %1 %2\n"
+		"  Branch %3 block 1 block 2\n"
+		"block 1 (predecessors 0)\n"
+		"  %4 = Constant 0\n"
+		"  %5 = Copy %4\n"
+		"  Jump block 2\n"
+		"block 2 (predecessors 1 0)\n"
+		"  %6 = Phi %0 %0\n"
+		"  %7 = Phi %1 %1\n"
+		"  %8 = Constant 1\n"
+		"  %9 = Add %7 %8\n"
+		"  %10 = Copy %9\n"
+		"  Return %10\n");
+
+	module = buildModule("let counter = function() { let c = 0; let inc = function() { let c = c + 1; c; }; inc(); let c = 10; inc(); };");
+
+	EXPECT_EQ(module->toString().substr(module->toString().find("function 1 (")),
+		"function 1 (parameters 0)\n"
+		"block 0\n"
+		"  %0 = Constant null\n"
+		"  %1 = NewBox %0\n"
+		"  %2 = Constant 0\n"
+		"  StoreBox %1 %2\n"
+		"  %3 = Closure function 2 %1\n"
+		"  %4 = Copy %3\n"
+		"  %5 = Call %4\n"
+		"  %6 = Constant 10\n"
+		"  StoreBox %1 %6\n"
+		"  %7 = Call %4\n"
+		"  Return %7\n"
+		"function 2 (parameters 0)\n"
+		"block 0\n"
+		"  %0 = Constant null\n"
+		"  %1 = LoadCapture 0\n"
+		"  %2 = LoadBox %1\n"
+		"  %3 = Constant 1\n"
+		"  %4 = Add %2 %3\n"
+		"  %5 = Copy %4\n"
+		"  Return %5\n");
+
+	module = buildModule("let g = function(x) { let h = function() { x + h; }; h; };");
+	EXPECT_NE(module->toString().find("%2 = Closure function 2 %1 %2"), std::string::npos);
+}
+
+TEST(Ir, Verify)
+{
+	auto module = buildModule("let f = function(x) { if (x) { 1; } else { 2; }; };");
+	auto& blocks = module->functions[1]->blocks;
+
+	blocks[1]->instructions.pop_back();
+	EXPECT_EQ(module->verify(), std::vector<std::string>({
+		"function 1 block 1: block does not end with a terminator.",
+		"function 1 block 3: predecessor does not branch to the block."
+	}));
+
+	module = buildModule("let f = function(x) { if (x) { 1; } else { 2; }; };");
+	auto& otherBlocks = module->functions[1]->blocks;
+
+	// make the phi use the value of the consequence along both edges
+	auto* phi = otherBlocks[3]->instructions[0].get();
+	phi->operands[1] = phi->operands[0];
+	EXPECT_EQ(module->verify(), std::vector<std::string>({ "function 1 block 3: Phi uses a value which does not dominate it." }));
+}
+
+TEST(IrPasses, CopyPropagation)
+{
+	auto module = buildModule("let f = function(a) { let b = a; let c = b; if (c) { let d = 1; }; c; };");
+	Ir::CopyPropagation pass;
+
+	// three copies, the phi for c and the phi for the value of the if statement, which is null along both edges
+	EXPECT_EQ(runPass(pass, *module), 5);
+	EXPECT_EQ(module->verify(), std::vector<std::string>());
+	EXPECT_EQ(module->toString().substr(module->toString().find("function 1 (")),
+		"function 1 (parameters 1)\n"
+		"block 0\n"
+		"  %0 = Constant null\n"
+		"  %1 = Parameter 0\n"
+		"  Branch %1 block 1 block 2\n"
+		"block 1 (predecessors 0)\n"
+		"  %2 = Constant 1\n"
+		"  Jump block 2\n"
+		"block 2 (predecessors 1 0)\n"
+		"  Return %1\n");
+
+	EXPECT_EQ(runPass(pass, *module), 0);
+}
+
+TEST(IrPasses, GlobalValueNumbering)
+{
+	auto module = buildModule("let f = function(a, b) { let c = a + b; if (a) { let d = b + a; d * 2; } else { a - b; }; a - b; };");
+	Ir::CopyPropagation copyPropagation;
+	Ir::GlobalValueNumbering pass;
+	runPass(copyPropagation, *module);
+
+	// b + a is the same as a + b, but the second a - b is not dominated by the first
+	EXPECT_EQ(runPass(pass, *module), 1);
+	EXPECT_EQ(module->verify(), std::vector<std::string>());
+	EXPECT_EQ(module->toString().substr(module->toString().find("function 1 (")),
+		"function 1 (parameters 2)\n"
+		"block 0\n"
+		"  %0 = Constant null\n"
+		"  %1 = Parameter 0\n"
+		"  %2 = Parameter 1\n"
+		"  %3 = Add %1 %2\n"
+		"  Branch %1 block 1 block 2\n"
+		"block 1 (predecessors 0)\n"
+		"  %4 = Constant 2\n"
+		"  %5 = Multiply %3 %4\n"
+		"  Jump block 3\n"
+		"block 2 (predecessors 0)\n"
+		"  %6 = Subtract %1 %2\n"
+		"  Jump block 3\n"
+		"block 3 (predecessors 1 2)\n"
+		"  %7 = Phi %5 %6\n"
+		"  %8 = Subtract %1 %2\n"
+		"  Return %8\n");
+
+	// subtraction does not commute, and values which may change between loads are never merged
+	module = buildModule("let g = 1; let f = function(a, b) { a - b; b - a; g; g; };");
+	EXPECT_EQ(runPass(pass, *module), 0);
+}
+
+TEST(IrPasses, SparseConstantPropagation)
+{
+	auto module = buildModule("let f = function(n) { let x = 1; let y = x; if (y < 2) { let x = 5; } else { let x = 7; }; x + n; };");
+	Ir::SparseConstantPropagation pass;
+
+	// three copies, the comparison, the phis for x and the value of the if statement, the branch and the block for the
+	// alternative; the phi for n is left with a single operand for CopyPropagation
+	EXPECT_EQ(runPass(pass, *module), 8);
+	EXPECT_EQ(module->verify(), std::vector<std::string>());
+	EXPECT_EQ(module->toString().substr(module->toString().find("function 1 (")),
+		"function 1 (parameters 1)\n"
+		"block 0\n"
+		"  %0 = Constant null\n"
+		"  %1 = Parameter 0\n"
+		"  %2 = Constant 1\n"
+		"  %3 = Constant 1\n"
+		"  %4 = Constant 2\n"
+		"  %5 = Constant true\n"
+		"  Jump block 1\n"
+		"block 1 (predecessors 0)\n"
+		"  %6 = Constant 5\n"
+		"  Jump block 2\n"
+		"block 2 (predecessors 1)\n"
+		"  %7 = Phi %1\n"
+		"  %8 = Constant 1\n"
+		"  %9 = Constant null\n"
+		"  %10 = Add %8 %7\n"
+		"  Return %10\n");
+
+	// the phi is only reached along the edge which is taken, so its value is known
+	module = buildModule("let f = function() { let v = 0; if (1 > 2) { let v = 3; }; v * 4; };");
+	runPass(pass, *module);
+	EXPECT_EQ(module->verify(), std::vector<std::string>());
+	EXPECT_NE(module->toString().find("%8 = Constant 0\n  Return %8\n"), std::string::npos);
+
+	// operators which would fail are left to fail at run time
+	module = buildModule("let f = function() { let a = 1 / 0; let b = 1 + true; if (false) { 1; }; };");
+	runPass(pass, *module);
+	EXPECT_EQ(module->verify(), std::vector<std::string>());
+	EXPECT_NE(module->toString().find("Divide"), std::string::npos);
+	EXPECT_NE(module->toString().find("Add"), std::string::npos);
+	EXPECT_EQ(module->functions[1]->blocks.size(), 2);
+}
+
+/*
+* Tests that the standard passes leave every module well formed and smaller, on programs which exercise each part of
+* the language.
+*/
+TEST(IrPasses, PassManager)
+{
+	std::vector<std::string> inputs = {
+		"let fibonacci = function(n) { if (n < 2) { return n; }; fibonacci(n - 1) + fibonacci(n - 2); }; fibonacci(10);",
+		"let adder = function(x) { function(y) { x + y; }; }; let add = adder(1); add(2) * add(2);",
+		"let counter = function() { let c = 0; let inc = function() { let c = c + 1; c; }; inc(); let c = 10; inc(); };",
+		"let f = function(a) { let b = a * 2; if (b > a) { if (a == b) { let a = b; } else { let a = -b; }; a; } else { b * 2; }; };",
+		"let x = 1; if (x) { let x = 2; } else { if (!x) { return 3; }; }; x;",
+		"let f = function() { let a = 2; let b = a * 3; if (b == 6) { a + b; } else { fail(); }; }; f();"
+	};
+
+	for (const auto& input : inputs) {
+		auto module = buildModule(input);
+		Ir::PassManager manager;
+		manager.addStandardPasses();
+		manager.run(*module);
+
+		const auto& statistics = manager.getStatistics();
+		EXPECT_EQ(module->verify(), std::vector<std::string>()) << input;
+		EXPECT_LE(statistics.instructionsAfter, statistics.instructionsBefore) << input;
+		EXPECT_EQ(statistics.passes.size(), 3);
+		EXPECT_GE(statistics.iterations, module->functions.size());
+	}
+
+	auto module = buildModule(inputs.back());
+	Ir::PassManager manager;
+	manager.addStandardPasses();
+	manager.run(*module);
+
+	// the branch to fail() is removed and the sum is folded
+	EXPECT_EQ(module->toString().find("Call"), module->toString().rfind("Call"));
+	EXPECT_NE(module->toString().find("Return %"), std::string::npos);
+	EXPECT_NE(module->toString().find("Constant 8"), std::string::npos);
+	EXPECT_EQ(module->functions[1]->blocks.size(), 3);
+	EXPECT_EQ(manager.getStatistics().passes[0].name, "SparseConstantPropagation");
+	EXPECT_GT(manager.getStatistics().passes[0].changes, 0);
+}
+
+std::unique_ptr<Ir::Module> buildModule(const std::string& input)
+{
+	Lexer lexer(input);
+	Parser parser(lexer.tokens());
+	EXPECT_EQ(parser.getErrors().size(), 0) << input;
+
+	IrBuilder builder;
+	auto module = builder.build(*parser.getProgram());
+	EXPECT_EQ(module->verify(), std::vector<std::string>()) << input;
+
+	return module;
+}
+
+uint32_t runPass(Ir::Pass& pass, Ir::Module& module)
+{
+	uint32_t changes = 0;
+
+	for (auto& function : module.functions) {
+		changes += pass.run(*function);
+	}
+
+	return changes;
+}
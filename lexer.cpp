@@ -1,4 +1,5 @@
 #include "lexer.h"
+#include "trace.h"
 
 #include <cctype>
 
@@ -34,6 +35,7 @@ namespace Delve::Script {
 	{
 		init();
 		tokens_.clear();
+		statistics_ = Statistics();
 	}
 
 	/*
@@ -192,10 +194,14 @@ namespace Delve::Script {
 	*/
 	void Lexer::tokenize(const std::string& inputStr)
 	{
+		DELVE_SCRIPT_TRACE("tokenize", "frontend");
+
 		if (input_) {
 			clear();
 		}
 
+		DELVE_SCRIPT_TIME(statistics_.time);
+
 		input_ = &inputStr;
 		readNextChar();
 
@@ -208,6 +214,22 @@ namespace Delve::Script {
 				break;
 			}
 		};
+
+#if DELVE_SCRIPT_INSTRUMENTATION
+		// literals short enough for the string's own buffer take no memory of their own
+		size_t inlineCapacity = std::string().capacity();
+
+		statistics_.inputBytes = inputStr.size();
+		statistics_.tokens = tokens_.size();
+		statistics_.bytesAllocated = tokens_.capacity() * sizeof(Token::Vector::value_type) + tokens_.size() * sizeof(Token);
+		statistics_.illegalTokens = tokens_.back()->type == Token::Type::Illegal ? 1 : 0;
+
+		for (const auto& token : tokens_) {
+			if (token->literal.capacity() > inlineCapacity) {
+				statistics_.bytesAllocated += token->literal.capacity() + 1;
+			}
+		}
+#endif
 	}
 
 	/*
@@ -1,6 +1,10 @@
 #pragma once
 
+#include "instrumentation.h"
 #include "token.h"
+
+#include <chrono>
+#include <cstdint>
 #include <string>
 #include <memory>
 #include <unordered_map>
@@ -10,6 +14,22 @@ namespace Delve::Script{
 
 	class Lexer {
 
+	public:
+		// Counters for the last call to tokenize, which stay zero when instrumentation is compiled out.
+		struct Statistics
+		{
+			std::chrono::nanoseconds time{ 0 };
+
+			uint64_t inputBytes = 0;
+			uint64_t tokens = 0;
+
+			// the tokens and the heap memory of their literals
+			uint64_t bytesAllocated = 0;
+
+			// the lexer stops at the first token it does not recognize, so this is at most one
+			uint32_t illegalTokens = 0;
+		};
+
 	public:
 		Lexer();
 		Lexer(const std::string& inputStr);
@@ -17,6 +37,7 @@ namespace Delve::Script{
 	public:
 		void tokenize(const std::string& inputStr);
 		inline const Token::Vector& tokens() const { return tokens_; };
+		inline const Statistics& getStatistics() const { return statistics_; }
 
 		void clear();
 
@@ -51,6 +72,8 @@ namespace Delve::Script{
 
 		const std::string* input_;
 		Token::Vector tokens_;
+
+		Statistics statistics_;
 	};
 
 }
\ No newline at end of file
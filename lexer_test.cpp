@@ -190,6 +190,35 @@ TEST(Lexer, Clear)
 	EXPECT_EQ(tokens.size(), 0);
 }
 
+/*
+* Tests that the statistics describe the last input tokenized
+*/
+TEST(Lexer, Statistics)
+{
+	std::string input = "let averyveryverylongidentifiername = 7;";
+	Lexer lexer(input);
+	const auto& statistics = lexer.getStatistics();
+
+	if (!Instrumentation::enabled) {
+		EXPECT_EQ(statistics.tokens, 0);
+		return;
+	}
+
+	EXPECT_EQ(statistics.tokens, 6);
+	EXPECT_EQ(statistics.inputBytes, input.size());
+	EXPECT_EQ(statistics.illegalTokens, 0);
+	EXPECT_GT(statistics.bytesAllocated, 6 * sizeof(Token) + std::string("averyveryverylongidentifiername").size());
+
+	std::string illegal = "let x = 7 @ 3;";
+	lexer.tokenize(illegal);
+	EXPECT_EQ(statistics.tokens, 5);
+	EXPECT_EQ(statistics.inputBytes, illegal.size());
+	EXPECT_EQ(statistics.illegalTokens, 1);
+
+	lexer.clear();
+	EXPECT_EQ(statistics.tokens, 0);
+}
+
 void compareTokenTypeAndValues(const Lexer& lexer, const std::vector<Delve::Script::Token::Type>& expectedTokens, const std::vector<std::string>& expectedLiterals)
 {
 	ASSERT_EQ(expectedTokens.size(), expectedLiterals.size());
@@ -1,9 +1,51 @@
 #include "console.h"
 
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+* Usage:
+*   delvescript_console                                        interactive terminal
+*   delvescript_console --compile <output> <scripts...>        compile scripts to a bytecode file
+*   delvescript_console --run [--image <file>] [--trace <file>] <scripts...>
+*                                                              run scripts, loading them from a bytecode file if given
+*                                                              and writing Chrome trace events of each phase if asked
+*/
 int main(int argc, char** argv) 
 {
 	Delve::Script::Console console;
+	std::vector<std::string> arguments(argv + 1, argv + argc);
+
+	if (!arguments.empty() && arguments[0] == "--compile") {
+		if (arguments.size() < 3) {
+			std::cerr << "Usage: --compile <output> <scripts...>" << std::endl;
+			return 2;
+		}
+
+		return console.compile(arguments[1], std::vector<std::string>(arguments.begin() + 2, arguments.end()));
+	}
+
+	if (!arguments.empty() && arguments[0] == "--run") {
+		std::string image;
+		std::string trace;
+		size_t first = 1;
+
+		while (arguments.size() > first + 1 && (arguments[first] == "--image" || arguments[first] == "--trace")) {
+			if (arguments[first] == "--image") {
+				image = arguments[first + 1];
+			}
+			else {
+				trace = arguments[first + 1];
+			}
+
+			first += 2;
+		}
+
+		return console.run(image, std::vector<std::string>(arguments.begin() + first, arguments.end()), trace);
+	}
+
 	console.runInteractive();
 
 	return 0;
-}
\ No newline at end of file
+}
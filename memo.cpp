@@ -0,0 +1,211 @@
+#include "memo.h"
+
+#include <algorithm>
+
+namespace Delve::Script {
+
+	namespace {
+		// the part of a value which distinguishes it from others of the same type
+		inline uint64_t payload(const Value& value)
+		{
+			switch (value.type) {
+			case Value::Type::Integer:
+				return static_cast<uint64_t>(value.integer);
+			case Value::Type::Boolean:
+				return value.boolean ? 1 : 0;
+			default:
+				return 0;
+			}
+		}
+	}
+
+	double MemoCache::Statistics::getHitRate() const
+	{
+		uint64_t lookups = hits + misses;
+		return lookups ? static_cast<double>(hits) / static_cast<double>(lookups) : 0.0;
+	}
+
+	MemoCache::MemoCache()
+	{
+	}
+
+	/**
+	* Adds a table for a function.  Tables take no memory until the first result is stored in them.
+	* @param name the name statistics are reported under
+	* @param parameterCount the number of arguments every call passes, at most maxArguments
+	* @returns the index to pass to find and store
+	*/
+	uint32_t MemoCache::addFunction(const std::string& name, size_t parameterCount)
+	{
+		Table table;
+		table.arity = parameterCount;
+		table.statistics.function = name;
+		setCapacity(table);
+		tables.push_back(std::move(table));
+
+		return static_cast<uint32_t>(tables.size() - 1);
+	}
+
+	/**
+	* Looks up the result of an earlier call with equal arguments.
+	* @param function the index returned by addFunction
+	* @param arguments one value for each of the function's parameters
+	* @param result set to the remembered result if there is one
+	* @returns true if the call's result was remembered
+	*/
+	bool MemoCache::find(uint32_t function, const Value* arguments, Value& result)
+	{
+		Table& table = tables[function];
+
+		for (size_t i = 0; i < table.arity; i++) {
+			if (!isCacheable(arguments[i])) {
+				table.statistics.uncacheable += 1;
+				return false;
+			}
+		}
+
+		if (table.capacity && !table.used.empty()) {
+			size_t index = hash(arguments, table.arity) & (table.capacity - 1);
+			const Value* entry = &table.entries[index * (table.arity + 1)];
+
+			if (table.used[index] && equal(entry, arguments, table.arity)) {
+				table.statistics.hits += 1;
+				result = entry[table.arity];
+				return true;
+			}
+		}
+
+		table.statistics.misses += 1;
+		return false;
+	}
+
+	/**
+	* Remembers the result of a call, replacing the entry which has the same place in the table.  Calls whose arguments
+	* or result cannot be remembered are ignored.
+	* @param function the index returned by addFunction
+	* @param arguments the arguments the function was called with
+	* @param result the value the call returned
+	*/
+	void MemoCache::store(uint32_t function, const Value* arguments, const Value& result)
+	{
+		Table& table = tables[function];
+
+		if (!table.capacity || !isCacheable(result)) {
+			return;
+		}
+
+		for (size_t i = 0; i < table.arity; i++) {
+			if (!isCacheable(arguments[i])) {
+				return;
+			}
+		}
+
+		if (table.used.empty()) {
+			table.entries.resize(table.capacity * (table.arity + 1));
+			table.used.resize(table.capacity);
+			table.statistics.bytes = table.entries.size() * sizeof(Value) + table.used.size();
+		}
+
+		size_t index = hash(arguments, table.arity) & (table.capacity - 1);
+		Value* entry = &table.entries[index * (table.arity + 1)];
+
+		if (table.used[index]) {
+			table.statistics.evictions += 1;
+		}
+		else {
+			table.used[index] = 1;
+			table.statistics.entries += 1;
+		}
+
+		std::copy(arguments, arguments + table.arity, entry);
+		entry[table.arity] = result;
+	}
+
+	/**
+	* Changes the settings and forgets every result, since the tables are sized from the bound.  Statistics are kept.
+	* @param newSettings whether calls are memoized and how much memory each function may use
+	*/
+	void MemoCache::configure(const Settings& newSettings)
+	{
+		settings = newSettings;
+
+		for (auto& table : tables) {
+			setCapacity(table);
+		}
+
+		clear();
+	}
+
+	// Forgets every result and releases the memory of the tables.
+	void MemoCache::clear()
+	{
+		for (auto& table : tables) {
+			table.entries = std::vector<Value>();
+			table.used = std::vector<uint8_t>();
+			table.statistics.entries = 0;
+			table.statistics.bytes = 0;
+		}
+	}
+
+	/**
+	* Reports the counters of each function's table.  These accumulate until the cache is destroyed.
+	* @returns one entry for each function, in the order they were added
+	*/
+	std::vector<MemoCache::Statistics> MemoCache::getStatistics() const
+	{
+		std::vector<Statistics> statistics;
+
+		for (const auto& table : tables) {
+			statistics.push_back(table.statistics);
+		}
+
+		return statistics;
+	}
+
+	bool MemoCache::isCacheable(const Value& value)
+	{
+		return value.type == Value::Type::Null || value.type == Value::Type::Integer || value.type == Value::Type::Boolean;
+	}
+
+	size_t MemoCache::hash(const Value* arguments, size_t count)
+	{
+		uint64_t hash = 0x9e3779b97f4a7c15ull;
+
+		for (size_t i = 0; i < count; i++) {
+			hash ^= payload(arguments[i]) + static_cast<uint64_t>(arguments[i].type) + (hash << 6) + (hash >> 2);
+		}
+
+		// mix the high bits into the low ones, which are the ones used to pick a place
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdull;
+		hash ^= hash >> 33;
+
+		return static_cast<size_t>(hash);
+	}
+
+	bool MemoCache::equal(const Value* left, const Value* right, size_t count)
+	{
+		for (size_t i = 0; i < count; i++) {
+			if (left[i].type != right[i].type || payload(left[i]) != payload(right[i])) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Sizes a table to the largest power of two entries which fit in the bound.
+	void MemoCache::setCapacity(Table& table)
+	{
+		size_t entryBytes = (table.arity + 1) * sizeof(Value) + sizeof(uint8_t);
+		table.capacity = 0;
+
+		if (settings.maxBytesPerFunction >= entryBytes) {
+			table.capacity = 1;
+
+			while (table.capacity * 2 * entryBytes <= settings.maxBytesPerFunction) {
+				table.capacity *= 2;
+			}
+		}
+	}
+}
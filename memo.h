@@ -0,0 +1,100 @@
+#pragma once
+
+#include "value.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* Remembers the results of calls to pure functions, keyed on their arguments, so that calling one again with the same
+* arguments returns the earlier result without running it.  Each function has its own fixed size table in which every
+* key has a single place, so a new entry replaces whichever entry was there and a table never grows past its bound.
+*
+* Only calls whose arguments and result are null, integers or booleans are remembered, since a function value as a key
+* or a result would have to be kept alive for the collector.  A call which fails is never remembered.
+*/
+class MemoCache
+{
+public:
+	struct Settings
+	{
+		// calls are only memoized once this is set
+		bool enabled = false;
+
+		// bytes of entries each function may hold
+		size_t maxBytesPerFunction = 64 * 1024;
+	};
+
+	struct Statistics
+	{
+		// the name the function is bound to, or where it is declared
+		std::string function;
+
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+
+		// calls which were not looked up because an argument cannot be a key
+		uint64_t uncacheable = 0;
+
+		// entries replaced by a newer entry with the same place in the table
+		uint64_t evictions = 0;
+
+		size_t entries = 0;
+		size_t bytes = 0;
+
+		double getHitRate() const;
+	};
+
+	// functions with more parameters than this are never memoized
+	static constexpr size_t maxArguments = 8;
+
+public:
+	MemoCache();
+
+	MemoCache(const MemoCache&) = delete;
+	MemoCache& operator=(const MemoCache&) = delete;
+
+public:
+	uint32_t addFunction(const std::string& name, size_t parameterCount);
+
+	bool find(uint32_t function, const Value* arguments, Value& result);
+	void store(uint32_t function, const Value* arguments, const Value& result);
+
+	void configure(const Settings& settings);
+	void clear();
+
+	inline bool isEnabled() const { return settings.enabled; }
+	inline const Settings& getSettings() const { return settings; }
+	std::vector<Statistics> getStatistics() const;
+
+private:
+	struct Table
+	{
+		size_t arity = 0;
+
+		// a power of two, zero if not even one entry fits in the bound
+		size_t capacity = 0;
+
+		// the arguments of each entry are stored together, followed by its result
+		std::vector<Value> entries;
+		std::vector<uint8_t> used;
+
+		Statistics statistics;
+	};
+
+private:
+	static bool isCacheable(const Value& value);
+	static size_t hash(const Value* arguments, size_t count);
+	static bool equal(const Value* left, const Value* right, size_t count);
+	void setCapacity(Table& table);
+
+private:
+	std::vector<Table> tables;
+	Settings settings;
+};
+
+}
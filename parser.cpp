@@ -1,4 +1,5 @@
 #include "parser.h"
+#include "trace.h"
 
 #include <cassert>
 #include <sstream>
@@ -32,10 +33,13 @@ namespace Delve::Script {
 		init();
 		program.reset(nullptr);
 		errors.clear();
+		statistics = Statistics();
 	}
 
 	void Parser::parse(const Token::Vector& tokenVec)
 	{
+		DELVE_SCRIPT_TRACE("parse", "frontend");
+
 		if (tokens) {
 			clear();
 		}
@@ -48,24 +52,44 @@ namespace Delve::Script {
 			return;
 		}
 
+		DELVE_SCRIPT_TIME(statistics.time);
+
 		nextToken();
 		program = std::make_unique<Ast::Program>();
 
 		while (currentToken->type != Token::Type::Eof) {
+			DELVE_SCRIPT_TRACE_LINE("statement", "frontend", currentToken->lineNum);
+
 			try {
 				std::unique_ptr<Ast::Statement> statement = parseStatement();
 				program->statements.push_back(std::move(statement));
 			}
 			catch (const ParsingError& error) {
+				DELVE_SCRIPT_TIME(statistics.recoveryTime);
 				errors.push_back(error.what());
 
 				// if there was error parsing the statement, we will eat all the tokens that
 				// remain from the error location to the end of that statement.
 				advanceUntil(Token::Type::Semicolon);
+				DELVE_SCRIPT_COUNT(statistics.recoveredStatements += 1);
 			}
 
 			nextToken();
 		}
+
+		DELVE_SCRIPT_COUNT(statistics.tokens = tokens->size(); statistics.errors = static_cast<uint32_t>(errors.size()));
+	}
+
+	// the total number of nodes created of every kind
+	uint64_t Parser::Statistics::getNodeCount() const
+	{
+		uint64_t count = 0;
+
+		for (uint64_t kindCount : nodes) {
+			count += kindCount;
+		}
+
+		return count;
 	}
 
 	void Parser::advanceUntil(Token::Type tokenType)
@@ -119,7 +143,7 @@ namespace Delve::Script {
 	std::unique_ptr<Ast::LetStatement> Parser::parseLetStatement()
 	{
 		assert(currentToken->type == Token::Type::Let);
-		std::unique_ptr<Ast::LetStatement> statement = std::make_unique<Ast::LetStatement>(currentToken);
+		std::unique_ptr<Ast::LetStatement> statement = makeNode<Ast::LetStatement>(currentToken);
 
 		nextToken();
 
@@ -151,7 +175,7 @@ namespace Delve::Script {
 	std::unique_ptr<Ast::ReturnStatement> Parser::parseReturnStatement()
 	{
 		assert(currentToken->type == Token::Type::Return);
-		std::unique_ptr<Ast::ReturnStatement> statement = std::make_unique<Ast::ReturnStatement>(currentToken);
+		std::unique_ptr<Ast::ReturnStatement> statement = makeNode<Ast::ReturnStatement>(currentToken);
 
 		nextToken();
 
@@ -173,7 +197,7 @@ namespace Delve::Script {
 		auto expression = parseExpression(Precedence::Lowest);
 
 		if (expression) {
-			statement = std::make_unique<Ast::ExpressionStatement>(expressionStartToken);
+			statement = makeNode<Ast::ExpressionStatement>(expressionStartToken);
 			statement->expression = std::move(expression);
 		}
 		else {
@@ -192,7 +216,7 @@ namespace Delve::Script {
 	{
 		assert(currentToken->type == Token::Type::LBrace);
 
-		auto blockStatement = std::make_unique<Ast::BlockStatement>(currentToken);
+		auto blockStatement = makeNode<Ast::BlockStatement>(currentToken);
 
 		nextToken();
 
@@ -268,13 +292,13 @@ namespace Delve::Script {
 	std::unique_ptr<Ast::Identifier> Parser::parseIdentifierExpression()
 	{
 		assert(currentToken->type == Token::Type::Identifier);
-		return std::make_unique<Ast::Identifier>( this->currentToken);
+		return makeNode<Ast::Identifier>(currentToken);
 	}
 
 	std::unique_ptr<Ast::IntegerLiteral> Parser::parseIntegerLiteralExpression()
 	{
 		assert(currentToken->type == Token::Type::Integer);
-		auto integerLiteral = std::make_unique<Ast::IntegerLiteral>(currentToken);
+		auto integerLiteral = makeNode<Ast::IntegerLiteral>(currentToken);
 		integerLiteral->value = std::stoll(currentToken->literal);
 
 		return integerLiteral;
@@ -283,13 +307,13 @@ namespace Delve::Script {
 	std::unique_ptr<Ast::BooleanLiteral> Parser::parseBooleanLiteralExpression()
 	{
 		assert(currentToken->type == Token::Type::True || currentToken->type == Token::Type::False);
-		return std::make_unique<Ast::BooleanLiteral>(currentToken);
+		return makeNode<Ast::BooleanLiteral>(currentToken);
 	}
 
 	std::unique_ptr<Ast::FunctionLiteral> Parser::parseFunctionLiteralExpression()
 	{
 		assert(currentToken->type == Token::Type::Function);
-		auto function = std::make_unique<Ast::FunctionLiteral>(currentToken);
+		auto function = makeNode<Ast::FunctionLiteral>(currentToken);
 		nextToken();
 
 		if (currentToken->type != Token::Type::LParen) {
@@ -329,7 +353,7 @@ namespace Delve::Script {
 	std::unique_ptr<Ast::CallExpression> Parser::parseCallExpression(std::unique_ptr<Ast::Expression> leftExpression)
 	{
 		assert(currentToken->type == Token::Type::LParen);
-		auto callExpression = std::make_unique<Ast::CallExpression>(currentToken);
+		auto callExpression = makeNode<Ast::CallExpression>(currentToken);
 		callExpression->function = std::move(leftExpression);
 
 		nextToken();
@@ -355,7 +379,7 @@ namespace Delve::Script {
 	std::unique_ptr<Ast::PrefixExpression> Parser::parsePrefixExpression()
 	{
 		assert(currentToken->type == Token::Type::Negate || currentToken->type == Token::Type::Minus);
-		auto prefixExpression = std::make_unique<Ast::PrefixExpression>(currentToken);
+		auto prefixExpression = makeNode<Ast::PrefixExpression>(currentToken);
 
 		nextToken();
 
@@ -365,7 +389,7 @@ namespace Delve::Script {
 	}
 
 	std::unique_ptr<Ast::InfixExpression> Parser::parseInfixExpression(std::unique_ptr<Ast::Expression> leftExpression) {
-		auto infixExpression = std::make_unique<Ast::InfixExpression>(currentToken);
+		auto infixExpression = makeNode<Ast::InfixExpression>(currentToken);
 		infixExpression->left = std::move(leftExpression);
 
 		Precedence currentPrecedence = getTokenPrecedence(currentToken);
@@ -400,7 +424,7 @@ namespace Delve::Script {
 	std::unique_ptr<Ast::IfStatement> Parser::parseIfStatement()
 	{
 		assert(currentToken->type == Token::Type::If);
-		auto expression = std::make_unique<Ast::IfStatement>(currentToken);
+		auto expression = makeNode<Ast::IfStatement>(currentToken);
 
 		if (peekToken->type != Token::Type::LParen) {
 			expectedTypeError(Token::Type::LParen, peekToken);
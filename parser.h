@@ -1,8 +1,12 @@
 #pragma once
 
 #include "ast.h"
+#include "instrumentation.h"
 #include "lexer.h"
 
+#include <array>
+#include <chrono>
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <unordered_map>
@@ -16,6 +20,27 @@ class Parser
 public:
 	using ErrorList = std::vector<std::string>;
 
+	// Counters for the last call to parse, which stay zero when instrumentation is compiled out.
+	struct Statistics
+	{
+		std::chrono::nanoseconds time{ 0 };
+
+		// time spent skipping the rest of statements which had errors, included in time
+		std::chrono::nanoseconds recoveryTime{ 0 };
+
+		uint64_t tokens = 0;
+
+		// nodes created, indexed by their kind, and the memory of the nodes themselves
+		std::array<uint64_t, Ast::Node::kindCount> nodes{};
+		uint64_t bytesAllocated = 0;
+
+		uint32_t errors = 0;
+		uint32_t recoveredStatements = 0;
+
+		inline uint64_t getNodeCount(Ast::Node::Kind kind) const { return nodes[static_cast<size_t>(kind)]; }
+		uint64_t getNodeCount() const;
+	};
+
 public:
 	Parser();
 	Parser(const Token::Vector& tokenVec);
@@ -25,9 +50,12 @@ public:
 	void clear();
 
 	inline const Ast::Program* getProgram() const { return program.get(); }
+	inline Ast::Program* getProgram() { return program.get(); }
 	inline const ErrorList& getErrors() const { return errors; }
+	inline const Statistics& getStatistics() const { return statistics; }
 
-private:
+public:
+	// binding strength of operators, shared with the SinglePassCompiler which parses expressions the same way
 	enum class Precedence
 	{
 		Lowest = 0,
@@ -39,10 +67,11 @@ private:
 		Call
 	};
 
-	static std::unordered_map<Token::Type, Precedence> precedenceMap;
-
 	static Precedence getTokenPrecedence(const Token* token);
 
+private:
+	static std::unordered_map<Token::Type, Precedence> precedenceMap;
+
 private:
 	class ParsingError : public std::runtime_error {
 	public:
@@ -65,6 +94,16 @@ private:
 	
 	void advanceUntil(Token::Type tokenType);
 
+	// creates a node of the tree, counting it in the statistics
+	template <typename T>
+	std::unique_ptr<T> makeNode(const Token* token)
+	{
+		auto node = std::make_unique<T>(token);
+		DELVE_SCRIPT_COUNT(statistics.nodes[static_cast<size_t>(node->kind)] += 1; statistics.bytesAllocated += sizeof(T));
+
+		return node;
+	}
+
 	void expectedTypeError(Token::Type expectedType, const Token* actualToken);
 
 private:
@@ -97,6 +136,7 @@ private:
 
 	std::unique_ptr<Ast::Program> program;
 	std::vector<std::string> errors;
+	Statistics statistics;
 
 	uint32_t currentTokenPos;
 	uint32_t currentTokenReadPos;
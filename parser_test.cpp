@@ -371,6 +371,41 @@ TEST(Parser, CallExpression)
 	compareStatementsToExpectedOutput(inputs, expectedOutput);;
 }
 
+/*
+* Tests that nodes are counted by kind and that statements skipped after an error are counted
+*/
+TEST(Parser, Statistics)
+{
+	Lexer lexer("let f = function(x) { if (x < 1) { return -x; } f(x - 1); };\nlet = 5;\nlet y 2;\nf(3);");
+	Parser parser(lexer.tokens());
+	const auto& statistics = parser.getStatistics();
+
+	ASSERT_EQ(parser.getErrors().size(), 2);
+
+	if (!Instrumentation::enabled) {
+		EXPECT_EQ(statistics.getNodeCount(), 0);
+		return;
+	}
+
+	EXPECT_EQ(statistics.errors, 2);
+	EXPECT_EQ(statistics.recoveredStatements, 2);
+	EXPECT_EQ(statistics.tokens, lexer.tokens().size());
+	EXPECT_LE(statistics.recoveryTime, statistics.time);
+
+	// the let statements with errors are created before their errors are found
+	EXPECT_EQ(statistics.getNodeCount(Ast::Node::Kind::LetStatement), 3);
+	EXPECT_EQ(statistics.getNodeCount(Ast::Node::Kind::Identifier), 8);
+	EXPECT_EQ(statistics.getNodeCount(Ast::Node::Kind::FunctionLiteral), 1);
+	EXPECT_EQ(statistics.getNodeCount(Ast::Node::Kind::IfStatement), 1);
+	EXPECT_EQ(statistics.getNodeCount(Ast::Node::Kind::BlockStatement), 2);
+	EXPECT_EQ(statistics.getNodeCount(Ast::Node::Kind::PrefixExpression), 1);
+	EXPECT_EQ(statistics.getNodeCount(Ast::Node::Kind::CallExpression), 2);
+	EXPECT_GE(statistics.bytesAllocated, statistics.getNodeCount() * sizeof(Ast::Identifier));
+
+	parser.clear();
+	EXPECT_EQ(parser.getStatistics().getNodeCount(), 0);
+}
+
 
 Token* createTokenForType(Token::Type type, const std::string& literal)
 {
@@ -0,0 +1,195 @@
+#include "program_cache.h"
+#include "hash.h"
+#include "lexer.h"
+#include "parser.h"
+
+#include <utility>
+
+namespace Delve::Script {
+
+	namespace {
+		// parses and compiles a script, returning null and reporting the errors if it could not be compiled
+		template <typename ProgramCompiler>
+		auto compile(const std::string& source, const Host* host, ProgramCache::ErrorList* errors)
+		{
+			using Program = decltype(std::declval<ProgramCompiler>().getProgram());
+
+			Lexer lexer(source);
+			Parser parser(lexer.tokens());
+
+			if (!parser.getErrors().empty()) {
+				if (errors) {
+					*errors = parser.getErrors();
+				}
+
+				return Program();
+			}
+
+			ProgramCompiler compiler(parser.getProgram(), host);
+
+			if (errors) {
+				*errors = compiler.getErrors();
+			}
+
+			return compiler.getProgram();
+		}
+	}
+
+	ProgramCache::ProgramCache() : ProgramCache(Settings())
+	{
+	}
+
+	ProgramCache::ProgramCache(const Settings& cacheSettings) : settings(cacheSettings)
+	{
+	}
+
+	/**
+	* Returns the closure engine's program for a script, compiling it if it is not in the cache.  Scripts which fail to
+	* compile are not cached.
+	* @param source the text of the script
+	* @param host functions the program may call, which must outlive the cache
+	* @param errors if given, receives the reasons the script could not be compiled
+	* @returns the program, or null if the script could not be compiled
+	*/
+	std::shared_ptr<const CompiledProgram> ProgramCache::getCompiled(const std::string& source, const Host* host, ErrorList* errors)
+	{
+		Key key{ hash(source), host, Engine::Closure };
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (const Entry* entry = find(key, source)) {
+				return entry->compiled;
+			}
+		}
+
+		Entry entry;
+		entry.key = key;
+		entry.compiled = compile<Compiler>(source, host, errors);
+
+		if (!entry.compiled) {
+			return nullptr;
+		}
+
+		auto program = entry.compiled;
+		entry.source = source;
+		entry.bytes = sizeof(Entry) + source.size() + program->getMemoryUsage();
+		insert(std::move(entry));
+
+		return program;
+	}
+
+	/**
+	* Returns the bytecode engine's program for a script, compiling it if it is not in the cache.
+	* @see getCompiled
+	*/
+	std::shared_ptr<const BytecodeProgram> ProgramCache::getBytecode(const std::string& source, const Host* host, ErrorList* errors)
+	{
+		Key key{ hash(source), host, Engine::Bytecode };
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (const Entry* entry = find(key, source)) {
+				return entry->bytecode;
+			}
+		}
+
+		Entry entry;
+		entry.key = key;
+		entry.bytecode = compile<BytecodeCompiler>(source, host, errors);
+
+		if (!entry.bytecode) {
+			return nullptr;
+		}
+
+		auto program = entry.bytecode;
+		entry.source = source;
+		entry.bytes = sizeof(Entry) + source.size() + program->getMemoryUsage();
+		insert(std::move(entry));
+
+		return program;
+	}
+
+	ProgramCache::Statistics ProgramCache::getStatistics() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return statistics;
+	}
+
+	/**
+	* Removes every program from the cache.  The counters are kept.
+	*/
+	void ProgramCache::clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		entries.clear();
+		index.clear();
+		statistics.entries = 0;
+		statistics.bytes = 0;
+	}
+
+	/**
+	* Hashes source text eight bytes at a time, so that hashing costs a small fraction of lexing the same text.
+	*/
+	uint64_t ProgramCache::hash(const std::string& source)
+	{
+		return hashBytes(source.data(), source.size());
+	}
+
+	/*
+	* Looks up a program and marks it as the most recently used.  Must be called with the mutex held.
+	* @returns the entry, or null if the program is not cached
+	*/
+	const ProgramCache::Entry* ProgramCache::find(const Key& key, const std::string& source)
+	{
+		auto found = index.find(key);
+
+		if (found == index.end() || found->second->source != source) {
+			statistics.misses += 1;
+			return nullptr;
+		}
+
+		statistics.hits += 1;
+		entries.splice(entries.begin(), entries, found->second);
+
+		return &*found->second;
+	}
+
+	/*
+	* Adds a newly compiled program and evicts the least recently used programs until the cache is within its capacity.
+	* A program which is larger than the whole cache is not kept.  If another thread cached the same key while this
+	* one was compiling, the newer program replaces it.
+	*/
+	void ProgramCache::insert(Entry entry)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (entry.bytes > settings.capacity) {
+			return;
+		}
+
+		auto found = index.find(entry.key);
+
+		if (found != index.end()) {
+			statistics.bytes -= found->second->bytes;
+			statistics.entries -= 1;
+			entries.erase(found->second);
+			index.erase(found);
+		}
+
+		while (!entries.empty() && statistics.bytes + entry.bytes > settings.capacity) {
+			statistics.bytes -= entries.back().bytes;
+			statistics.entries -= 1;
+			statistics.evictions += 1;
+			index.erase(entries.back().key);
+			entries.pop_back();
+		}
+
+		statistics.bytes += entry.bytes;
+		statistics.entries += 1;
+		entries.push_front(std::move(entry));
+		index[entries.front().key] = entries.begin();
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "bytecode.h"
+#include "compiler.h"
+#include "host.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* Keeps the programs compiled from recently seen source text so that submitting the same script again skips lexing,
+* parsing and compilation.  Programs are keyed by a hash of their source along with the host and engine they were
+* compiled for, and the source itself is kept to rule out hash collisions.
+*
+* Compiled programs are immutable, so one cached program may be run by any number of isolates or tasks at once.  The
+* cache may be used from any number of threads.  Once the estimated size of the cached programs exceeds the capacity,
+* the least recently used are evicted; programs still in use elsewhere stay alive until they are released.
+*/
+class ProgramCache
+{
+public:
+	using ErrorList = std::vector<std::string>;
+
+	struct Settings
+	{
+		// estimated bytes of source and compiled programs the cache may hold
+		size_t capacity = 64 << 20;
+	};
+
+	struct Statistics
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t evictions = 0;
+
+		size_t entries = 0;
+		size_t bytes = 0;
+	};
+
+public:
+	ProgramCache();
+	ProgramCache(const Settings& settings);
+
+	ProgramCache(const ProgramCache&) = delete;
+	ProgramCache& operator=(const ProgramCache&) = delete;
+
+public:
+	std::shared_ptr<const CompiledProgram> getCompiled(const std::string& source, const Host* host = nullptr, ErrorList* errors = nullptr);
+	std::shared_ptr<const BytecodeProgram> getBytecode(const std::string& source, const Host* host = nullptr, ErrorList* errors = nullptr);
+
+	Statistics getStatistics() const;
+	void clear();
+
+	static uint64_t hash(const std::string& source);
+
+private:
+	enum class Engine : uint8_t
+	{
+		Closure,
+		Bytecode
+	};
+
+	struct Key
+	{
+		uint64_t hash;
+		const Host* host;
+		Engine engine;
+
+		inline bool operator==(const Key& other) const { return hash == other.hash && host == other.host && engine == other.engine; }
+	};
+
+	struct KeyHash
+	{
+		inline size_t operator()(const Key& key) const { return static_cast<size_t>(key.hash ^ reinterpret_cast<uintptr_t>(key.host) ^ static_cast<uint64_t>(key.engine)); }
+	};
+
+	struct Entry
+	{
+		Key key;
+		std::string source;
+		std::shared_ptr<const CompiledProgram> compiled;
+		std::shared_ptr<const BytecodeProgram> bytecode;
+		size_t bytes = 0;
+	};
+
+	using EntryList = std::list<Entry>;
+
+private:
+	const Entry* find(const Key& key, const std::string& source);
+	void insert(Entry entry);
+
+private:
+	Settings settings;
+
+	mutable std::mutex mutex;
+
+	// most recently used first
+	EntryList entries;
+	std::unordered_map<Key, EntryList::iterator, KeyHash> index;
+	Statistics statistics;
+};
+
+}
@@ -0,0 +1,171 @@
+#include "program_cache.h"
+#include "task.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Delve::Script;
+
+TEST(ProgramCache, HitsAndMisses)
+{
+	ProgramCache cache;
+	std::string source = "let f = function(x) { x * 2; }; f(21);";
+
+	auto first = cache.getCompiled(source);
+	ASSERT_NE(first, nullptr);
+
+	auto second = cache.getCompiled(std::string(source));
+	EXPECT_EQ(first, second);
+
+	Isolate isolate(second);
+	EXPECT_EQ(isolate.run().integer, 42);
+
+	// each engine has its own entry
+	auto bytecode = cache.getBytecode(source);
+	ASSERT_NE(bytecode, nullptr);
+	EXPECT_EQ(cache.getBytecode(source), bytecode);
+
+	auto statistics = cache.getStatistics();
+	EXPECT_EQ(statistics.hits, 2);
+	EXPECT_EQ(statistics.misses, 2);
+	EXPECT_EQ(statistics.entries, 2);
+	EXPECT_GT(statistics.bytes, source.size() * 2);
+
+	cache.clear();
+	EXPECT_EQ(cache.getStatistics().entries, 0);
+	EXPECT_EQ(cache.getStatistics().bytes, 0);
+	EXPECT_NE(cache.getCompiled(source), first);
+}
+
+/*
+* Tests that programs compiled against different hosts are cached separately, since hosts change global indices.
+*/
+TEST(ProgramCache, Hosts)
+{
+	Host first;
+	first.bind("value", []() { return int64_t(1); });
+
+	Host second;
+	second.bind("other", []() { return int64_t(0); });
+	second.bind("value", []() { return int64_t(2); });
+
+	ProgramCache cache;
+	std::string source = "value() * 10;";
+
+	auto program = cache.getCompiled(source, &first);
+	auto otherProgram = cache.getCompiled(source, &second);
+	ASSERT_NE(program, nullptr);
+	ASSERT_NE(otherProgram, nullptr);
+	EXPECT_NE(program, otherProgram);
+
+	EXPECT_EQ(Isolate(program).run().integer, 10);
+	EXPECT_EQ(Isolate(otherProgram).run().integer, 20);
+	EXPECT_EQ(cache.getStatistics().misses, 2);
+}
+
+/*
+* Tests that scripts which fail to compile report their errors and are not cached.
+*/
+TEST(ProgramCache, Errors)
+{
+	ProgramCache cache;
+	ProgramCache::ErrorList errors;
+
+	EXPECT_EQ(cache.getCompiled("let x = ;", nullptr, &errors), nullptr);
+	EXPECT_FALSE(errors.empty());
+
+	EXPECT_EQ(cache.getBytecode("undefined;", nullptr, &errors), nullptr);
+	ASSERT_EQ(errors.size(), 1);
+	EXPECT_EQ(errors[0], "Undefined identifier undefined at 1, 1.");
+
+	// errors are cleared by a successful compile
+	EXPECT_NE(cache.getCompiled("1;", nullptr, &errors), nullptr);
+	EXPECT_TRUE(errors.empty());
+
+	EXPECT_EQ(cache.getStatistics().entries, 1);
+}
+
+/*
+* Tests that the least recently used programs are evicted once the cache is over its capacity.
+*/
+TEST(ProgramCache, Eviction)
+{
+	auto script = [](int i) { return "let f = function(x) { x + " + std::to_string(i) + "; }; f(1);"; };
+
+	ProgramCache sizing;
+	sizing.getCompiled(script(0));
+	size_t entryBytes = sizing.getStatistics().bytes;
+
+	ProgramCache::Settings settings;
+	settings.capacity = entryBytes * 3 + entryBytes / 2;
+	ProgramCache cache(settings);
+
+	auto zero = cache.getCompiled(script(0));
+	cache.getCompiled(script(1));
+	cache.getCompiled(script(2));
+
+	// using the first script makes the second the least recently used
+	EXPECT_EQ(cache.getCompiled(script(0)), zero);
+	cache.getCompiled(script(3));
+
+	auto statistics = cache.getStatistics();
+	EXPECT_EQ(statistics.entries, 3);
+	EXPECT_EQ(statistics.evictions, 1);
+	EXPECT_LE(statistics.bytes, settings.capacity);
+
+	uint64_t misses = statistics.misses;
+	EXPECT_EQ(cache.getCompiled(script(0)), zero);
+	cache.getCompiled(script(2));
+	EXPECT_EQ(cache.getStatistics().misses, misses);
+
+	cache.getCompiled(script(1));
+	EXPECT_EQ(cache.getStatistics().misses, misses + 1);
+
+	// evicted programs stay alive while they are in use
+	EXPECT_EQ(Isolate(zero).run().integer, 1);
+}
+
+TEST(ProgramCache, Hash)
+{
+	EXPECT_EQ(ProgramCache::hash("let x = 1;"), ProgramCache::hash(std::string("let x = 1;")));
+	EXPECT_NE(ProgramCache::hash("let x = 1;"), ProgramCache::hash("let x = 2;"));
+	EXPECT_NE(ProgramCache::hash("1;"), ProgramCache::hash("1; "));
+	EXPECT_NE(ProgramCache::hash(""), ProgramCache::hash(std::string(1, '\0')));
+}
+
+/*
+* Tests that many threads can share a cache, with every thread receiving a working program.
+*/
+TEST(ProgramCache, Threads)
+{
+	ProgramCache cache;
+	std::atomic<int> failures(0);
+	std::vector<std::thread> threads;
+
+	for (int t = 0; t < 4; ++t) {
+		threads.emplace_back([&cache, &failures]() {
+			for (int i = 0; i < 200; ++i) {
+				int n = i % 10;
+				auto program = cache.getBytecode("let n = " + std::to_string(n) + "; n * n;");
+
+				if (!program || Task(program).runToCompletion().integer != n * n) {
+					failures += 1;
+				}
+			}
+		});
+	}
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(failures, 0);
+
+	auto statistics = cache.getStatistics();
+	EXPECT_EQ(statistics.entries, 10);
+	EXPECT_EQ(statistics.hits + statistics.misses, 800);
+}
@@ -0,0 +1,205 @@
+#include "purity.h"
+#include "resolver.h"
+#include "trace.h"
+
+namespace Delve::Script {
+
+	/**
+	* Finds the pure functions in a program and sets the pure flag of every function literal.  Flags from an earlier run
+	* are overwritten, and a program which does not resolve is left with no pure functions for the compiler to report.
+	* Statistics are reset each time this method is called.
+	* @param ast the program to annotate
+	* @param host the host functions the program will be compiled with, which are its first globals
+	*/
+	void PurityAnalysis::analyze(Ast::Program& ast, const Host* host)
+	{
+		DELVE_SCRIPT_TRACE("analyze purity", "optimize");
+
+		statistics = Statistics();
+
+		std::vector<std::string> hostNames = host ? host->getNames() : std::vector<std::string>();
+		Resolver resolver;
+		resolver.resolve(ast, hostNames);
+
+		globals.assign(ast.globalCount, Global());
+		functions.clear();
+		hostCount = hostNames.size();
+		current = nullptr;
+
+		for (auto& statement : ast.statements) {
+			visitStatement(statement.get());
+		}
+
+		if (!resolver.getErrors().empty()) {
+			for (auto& entry : functions) {
+				entry.second.pure = false;
+			}
+		}
+
+		// a function stops being pure once a global it calls may not hold a pure function, which may in turn affect
+		// the functions calling it
+		bool changed;
+
+		do {
+			changed = false;
+
+			for (auto& entry : functions) {
+				Function& function = entry.second;
+
+				for (size_t i = 0; function.pure && i < function.calledGlobals.size(); i++) {
+					const Global& global = globals[function.calledGlobals[i]];
+
+					if (global.declarations != 1 || !global.function || !functions.at(global.function).pure) {
+						function.pure = false;
+						changed = true;
+					}
+				}
+			}
+		} while (changed);
+
+		for (auto& entry : functions) {
+			entry.second.literal->pure = entry.second.pure;
+			statistics.functions += 1;
+			statistics.pureFunctions += entry.second.pure ? 1 : 0;
+		}
+	}
+
+	void PurityAnalysis::visitStatement(Ast::Statement* statement)
+	{
+		if (!statement) {
+			return;
+		}
+
+		switch (statement->kind) {
+		case Ast::Node::Kind::LetStatement: {
+			auto* letStatement = static_cast<Ast::LetStatement*>(statement);
+			const Ast::Binding& binding = letStatement->identifier->binding;
+			auto* expression = letStatement->expression.get();
+
+			if (binding.kind == Ast::Binding::Kind::Global && binding.index < globals.size()) {
+				Global& global = globals[binding.index];
+				global.declarations += 1;
+
+				if (expression && expression->kind == Ast::Node::Kind::FunctionLiteral) {
+					global.function = static_cast<const Ast::FunctionLiteral*>(expression);
+				}
+			}
+
+			visitExpression(expression);
+			break;
+		}
+
+		case Ast::Node::Kind::ReturnStatement:
+			visitExpression(static_cast<Ast::ReturnStatement*>(statement)->expression.get());
+			break;
+
+		case Ast::Node::Kind::ExpressionStatement:
+			visitExpression(static_cast<Ast::ExpressionStatement*>(statement)->expression.get());
+			break;
+
+		case Ast::Node::Kind::BlockStatement:
+			for (auto& child : static_cast<Ast::BlockStatement*>(statement)->statements) {
+				visitStatement(child.get());
+			}
+			break;
+
+		case Ast::Node::Kind::IfStatement: {
+			auto* ifStatement = static_cast<Ast::IfStatement*>(statement);
+			visitExpression(ifStatement->condition.get());
+			visitStatement(ifStatement->consequence.get());
+			visitStatement(ifStatement->alternative.get());
+			break;
+		}
+
+		default:
+			visitExpression(statement);
+			break;
+		}
+	}
+
+	void PurityAnalysis::visitExpression(Ast::Expression* expression)
+	{
+		if (!expression) {
+			return;
+		}
+
+		switch (expression->kind) {
+		case Ast::Node::Kind::Identifier:
+			// the function's own parameters and locals are the only values it may read
+			if (current && static_cast<Ast::Identifier*>(expression)->binding.kind != Ast::Binding::Kind::Local) {
+				current->pure = false;
+			}
+			break;
+
+		case Ast::Node::Kind::PrefixExpression:
+			visitExpression(static_cast<Ast::PrefixExpression*>(expression)->rightExpression.get());
+			break;
+
+		case Ast::Node::Kind::InfixExpression: {
+			auto* infix = static_cast<Ast::InfixExpression*>(expression);
+			visitExpression(infix->left.get());
+			visitExpression(infix->right.get());
+			break;
+		}
+
+		case Ast::Node::Kind::CallExpression: {
+			auto* call = static_cast<Ast::CallExpression*>(expression);
+			visitCallee(call->function.get());
+
+			for (auto& argument : call->arguments) {
+				visitExpression(argument.get());
+			}
+			break;
+		}
+
+		case Ast::Node::Kind::FunctionLiteral: {
+			auto* literal = static_cast<Ast::FunctionLiteral*>(expression);
+
+			// a closure created by the function may capture its arguments, so calls would not return equal values
+			if (current) {
+				current->pure = false;
+			}
+
+			Function& function = functions[literal];
+			function.literal = literal;
+
+			for (const auto& capture : literal->captures) {
+				if (capture.source != Ast::Capture::Source::Self) {
+					function.pure = false;
+				}
+			}
+
+			Function* enclosing = current;
+			current = &function;
+			visitStatement(literal->body.get());
+			current = enclosing;
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	/*
+	* A function may call itself, through the name it is bound to, and globals which are checked once every function
+	* has been visited.  Any other callee may be impure.
+	*/
+	void PurityAnalysis::visitCallee(Ast::Expression* callee)
+	{
+		if (!current || !callee || callee->kind != Ast::Node::Kind::Identifier) {
+			visitExpression(callee);
+			return;
+		}
+
+		const Ast::Binding& binding = static_cast<Ast::Identifier*>(callee)->binding;
+
+		if (binding.kind == Ast::Binding::Kind::Global && binding.index >= hostCount) {
+			current->calledGlobals.push_back(binding.index);
+		}
+		else if (binding.kind != Ast::Binding::Kind::Capture || binding.index >= current->literal->captures.size() ||
+				current->literal->captures[binding.index].source != Ast::Capture::Source::Self) {
+			current->pure = false;
+		}
+	}
+}
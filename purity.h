@@ -0,0 +1,69 @@
+#pragma once
+
+#include "ast.h"
+#include "host.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* Analysis pass which finds the functions whose result depends only on their arguments, and marks them pure so that
+* the closure engine may memoize calls to them.
+*
+* A function is pure when it creates no closures, captures nothing but itself, reads no globals and calls nothing but
+* itself and pure functions bound to globals which are declared exactly once.  Reading a global or calling a host
+* function could give a different result on each call, and so could calling a captured or passed in function, since
+* it may be impure.  Functions which call each other are assumed pure until one of them is found not to be.
+*/
+class PurityAnalysis
+{
+public:
+	struct Statistics
+	{
+		uint32_t functions = 0;
+		uint32_t pureFunctions = 0;
+	};
+
+public:
+	void analyze(Ast::Program& program, const Host* host = nullptr);
+
+	inline const Statistics& getStatistics() const { return statistics; }
+
+private:
+	struct Function
+	{
+		Ast::FunctionLiteral* literal = nullptr;
+		bool pure = true;
+
+		// globals the function calls, which must hold pure functions for it to stay pure
+		std::vector<uint32_t> calledGlobals;
+	};
+
+	struct Global
+	{
+		uint32_t declarations = 0;
+
+		// the function literal the global is declared with, if any
+		const Ast::FunctionLiteral* function = nullptr;
+	};
+
+private:
+	void visitStatement(Ast::Statement* statement);
+	void visitExpression(Ast::Expression* expression);
+	void visitCallee(Ast::Expression* callee);
+
+private:
+	std::vector<Global> globals;
+	std::unordered_map<const Ast::FunctionLiteral*, Function> functions;
+	size_t hostCount = 0;
+
+	// the function enclosing the node being visited, null in the top level code
+	Function* current = nullptr;
+
+	Statistics statistics;
+};
+
+}
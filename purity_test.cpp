@@ -0,0 +1,234 @@
+#include "purity.h"
+#include "script.h"
+#include "parser.h"
+#include "lexer.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace Delve::Script;
+
+namespace {
+	const std::string fib = "let fib = function(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2); };";
+
+	// finds the pure functions in a program, listing for each function literal in the order it appears whether it is pure
+	std::vector<bool> findPureFunctions(const std::string& code, const Host* host = nullptr)
+	{
+		Lexer lexer(code);
+		Parser parser(lexer.tokens());
+		EXPECT_EQ(parser.getErrors().size(), 0) << code;
+
+		PurityAnalysis analysis;
+		analysis.analyze(*parser.getProgram(), host);
+
+		std::vector<bool> pure;
+		std::vector<const Ast::Node*> nodes;
+
+		for (auto statement = parser.getProgram()->statements.rbegin(); statement != parser.getProgram()->statements.rend(); ++statement) {
+			nodes.push_back(statement->get());
+		}
+
+		// visits the literals depth first, which is the order they appear in the source
+		while (!nodes.empty()) {
+			const Ast::Node* node = nodes.back();
+			nodes.pop_back();
+
+			if (!node) {
+				continue;
+			}
+
+			std::vector<const Ast::Node*> children;
+
+			switch (node->kind) {
+			case Ast::Node::Kind::LetStatement:
+				children.push_back(static_cast<const Ast::LetStatement*>(node)->expression.get());
+				break;
+			case Ast::Node::Kind::ExpressionStatement:
+				children.push_back(static_cast<const Ast::ExpressionStatement*>(node)->expression.get());
+				break;
+			case Ast::Node::Kind::ReturnStatement:
+				children.push_back(static_cast<const Ast::ReturnStatement*>(node)->expression.get());
+				break;
+			case Ast::Node::Kind::BlockStatement:
+				for (auto& statement : static_cast<const Ast::BlockStatement*>(node)->statements) {
+					children.push_back(statement.get());
+				}
+				break;
+			case Ast::Node::Kind::IfStatement: {
+				auto* ifStatement = static_cast<const Ast::IfStatement*>(node);
+				children.push_back(ifStatement->consequence.get());
+				children.push_back(ifStatement->alternative.get());
+				break;
+			}
+			case Ast::Node::Kind::CallExpression:
+				for (auto& argument : static_cast<const Ast::CallExpression*>(node)->arguments) {
+					children.push_back(argument.get());
+				}
+				break;
+			case Ast::Node::Kind::FunctionLiteral: {
+				auto* literal = static_cast<const Ast::FunctionLiteral*>(node);
+				pure.push_back(literal->pure);
+				children.push_back(literal->body.get());
+				break;
+			}
+			default:
+				break;
+			}
+
+			nodes.insert(nodes.end(), children.rbegin(), children.rend());
+		}
+
+		EXPECT_EQ(analysis.getStatistics().functions, pure.size()) << code;
+		return pure;
+	}
+}
+
+TEST(PurityAnalysis, FindsPureFunctions)
+{
+	std::vector<std::pair<std::string, std::vector<bool>>> cases = {
+		{ fib + " fib(10);", { true } },
+		{ "let square = function(x) { let y = x * x; y; }; let f = function(x) { square(x) + 1; };", { true, true } },
+		{ "let isEven = function(n) { if (n == 0) { return true; } isOdd(n - 1); }; let isOdd = function(n) { if (n == 0) { return false; } isEven(n - 1); };", { true, true } },
+		{ "let f = function(x) { let count = function(n) { if (n < 1) { return 0; } count(n - 1) + 1; }; count(x); };", { false, true } },
+		{ "let f = function(n) { n + 1; }; f(function(x) { x; });", { true, true } },
+
+		// reads a global, which holds null until it is declared
+		{ "let limit = 10; let f = function(x) { x < limit; };", { false } },
+
+		// calls a function which may be impure
+		{ "let apply = function(f, x) { f(x); };", { false } },
+		{ "let f = function(x) { x + 1; }; let f = function(x) { x + 2; }; let g = function(x) { f(x); };", { true, true, false } },
+		{ "let f = 1; let g = function(x) { f(x); };", { false } },
+		{ "let g = function(x) { h(x); };", { false } },
+		{ "let f = function(x) { g(x); }; let g = function(x) { let h = function() { x; }; h(); };", { false, false, false } },
+
+		// closures capture their arguments
+		{ "let adder = function(x) { function(y) { x + y; }; };", { false, false } },
+		{ "let f = function(x) { let y = x; function() { 1; }; };", { false, true } }
+	};
+
+	for (const auto& test : cases) {
+		EXPECT_EQ(findPureFunctions(test.first), test.second) << test.first;
+	}
+}
+
+TEST(PurityAnalysis, HostFunctions)
+{
+	Host host;
+	host.bind("random", []() { return int64_t(4); });
+
+	EXPECT_EQ(findPureFunctions("let f = function(x) { x + random(); };", &host), std::vector<bool>({ false }));
+	EXPECT_EQ(findPureFunctions("let g = function(x) { x; }; let f = function(x) { g(x) + random; };", &host), std::vector<bool>({ true, false }));
+
+	// a global the script declares with the name of a host function holds the host function until then
+	EXPECT_EQ(findPureFunctions("let f = function(x) { random(x); }; let random = function(x) { x; };", &host), std::vector<bool>({ false, true }));
+}
+
+/*
+* Tests that memoized calls give the same results as running the functions, and that each distinct call runs once.
+*/
+TEST(Memoization, Fib)
+{
+	Script plain(fib + " fib(25);");
+	Value expected = plain.run();
+	ASSERT_EQ(expected.toString(), "75025");
+
+	MemoCache::Settings settings;
+	settings.enabled = true;
+
+	Script script(fib + " fib(25);");
+	script.setMemoSettings(settings);
+	EXPECT_EQ(script.run().toString(), expected.toString());
+	EXPECT_EQ(script.getPurityStatistics().pureFunctions, 1);
+
+	auto statistics = script.getMemoStatistics();
+	ASSERT_EQ(statistics.size(), 1);
+	EXPECT_EQ(statistics[0].function, "fib");
+	EXPECT_EQ(statistics[0].misses, 26);
+	EXPECT_EQ(statistics[0].hits, 23);
+	EXPECT_EQ(statistics[0].entries + statistics[0].evictions, 26);
+	EXPECT_LE(statistics[0].bytes, settings.maxBytesPerFunction);
+
+	// results are remembered across runs
+	EXPECT_EQ(script.run().toString(), expected.toString());
+	statistics = script.getMemoStatistics();
+	EXPECT_EQ(statistics[0].hits, 24);
+	EXPECT_NEAR(statistics[0].getHitRate(), 24.0 / 50.0, 1e-9);
+
+	// far beyond what could run without memoization
+	Script large(fib + " fib(90);");
+	large.setMemoSettings(settings);
+	EXPECT_EQ(large.run().toString(), "2880067194370816120");
+}
+
+TEST(Memoization, MemoryBound)
+{
+	MemoCache::Settings settings;
+	settings.enabled = true;
+	settings.maxBytesPerFunction = 300;
+
+	Script script("let sum = function(n, total) { if (n == 0) { return total; } sum(n - 1, total + n); }; let f = function(n) { if (n == 0) { return 0; } f(n - 1) + sum(n, 0); }; f(60);");
+	script.setMemoSettings(settings);
+	EXPECT_EQ(script.run().toString(), "37820");
+
+	auto statistics = script.getMemoStatistics();
+	ASSERT_EQ(statistics.size(), 2);
+
+	for (const auto& function : statistics) {
+		EXPECT_LE(function.bytes, settings.maxBytesPerFunction) << function.function;
+		EXPECT_GT(function.entries, 0) << function.function;
+	}
+
+	// sum is only looked up when f calls it, its tail calls are not, and there are more distinct calls than entries
+	EXPECT_EQ(statistics[0].function, "sum");
+	EXPECT_EQ(statistics[0].misses, 60);
+	EXPECT_GT(statistics[0].evictions, 0);
+
+	// too small for a single entry, so nothing is remembered
+	settings.maxBytesPerFunction = 8;
+	script.setMemoSettings(settings);
+	EXPECT_EQ(script.run().toString(), "37820");
+
+	for (const auto& function : script.getMemoStatistics()) {
+		EXPECT_EQ(function.entries, 0) << function.function;
+		EXPECT_EQ(function.bytes, 0) << function.function;
+	}
+}
+
+/*
+* Tests that calls are not remembered when they fail or when an argument or the result is a function, and that
+* memoization is off unless it is enabled.
+*/
+TEST(Memoization, Uncacheable)
+{
+	MemoCache::Settings settings;
+	settings.enabled = true;
+
+	Script script("let f = function(x) { x; }; let g = function(x) { 10 / x; }; f(f); f(f); f(1) + f(1);");
+	script.setMemoSettings(settings);
+	EXPECT_EQ(script.run().toString(), "2");
+
+	auto statistics = script.getMemoStatistics();
+	ASSERT_EQ(statistics.size(), 2);
+	EXPECT_EQ(statistics[0].uncacheable, 2);
+	EXPECT_EQ(statistics[0].misses, 1);
+	EXPECT_EQ(statistics[0].hits, 1);
+	EXPECT_EQ(statistics[0].entries, 1);
+
+	Script failing("let g = function(x) { 10 / x; }; g(0) + g(0);");
+	failing.setMemoSettings(settings);
+
+	for (int i = 0; i < 2; i++) {
+		failing.run();
+		EXPECT_EQ(failing.getErrors(), std::vector<std::string>({ "Division by zero." }));
+	}
+
+	EXPECT_EQ(failing.getMemoStatistics()[0].entries, 0);
+	EXPECT_EQ(failing.getMemoStatistics()[0].misses, 2);
+
+	Script disabled(fib + " fib(10);");
+	EXPECT_EQ(disabled.run().toString(), "55");
+	EXPECT_TRUE(disabled.getMemoStatistics().empty());
+}
@@ -0,0 +1,369 @@
+#include "resolver.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace Delve::Script {
+	/**
+	* Resolves all identifiers in the program.  Any names which are used but never declared are reported through
+	* getErrors(), in the order they are first used.
+	* @param program the program to annotate
+	* @param predefinedGlobals names which are defined before the program runs, such as host functions.  These are given
+	* the first global indices, in order.
+	*/
+	void Resolver::resolve(Ast::Program& program, const std::vector<std::string>& predefinedGlobals)
+	{
+		DELVE_SCRIPT_TRACE("resolve", "compile");
+
+		functions.clear();
+		finishedFunctions.clear();
+		variables.clear();
+		uses.clear();
+		globals.clear();
+		errors.clear();
+
+		// the outermost block of the top level code holds globals rather than frame slots
+		functions.emplace_back();
+		functions.back().blocks.emplace_back();
+
+		for (const auto& name : predefinedGlobals) {
+			globals.try_emplace(name, Global{ static_cast<uint32_t>(globals.size()), true, nullptr });
+		}
+
+		resolveStatements(program.statements);
+
+		program.slotCount = functions.back().slotCount;
+		program.globalCount = static_cast<uint32_t>(globals.size());
+		finishedFunctions.push_back(std::move(functions.back()));
+		functions.clear();
+
+		annotate(program);
+
+		std::vector<const Token*> undefinedGlobals;
+		for (auto& global : globals) {
+			if (!global.second.defined) {
+				undefinedGlobals.push_back(global.second.firstUse);
+			}
+		}
+
+		std::sort(undefinedGlobals.begin(), undefinedGlobals.end(), [](const Token* a, const Token* b) {
+			return a->lineNum < b->lineNum || (a->lineNum == b->lineNum && a->colNum < b->colNum);
+		});
+
+		for (auto* token : undefinedGlobals) {
+			std::ostringstream error;
+			error << "Undefined identifier " << token->literal << " at " << token->lineNum << ", " << token->colNum << '.';
+			errors.push_back(error.str());
+		}
+	}
+
+	/**
+	* Returns the name of every global in the last program resolved, indexed by global index.
+	*/
+	std::vector<std::string> Resolver::getGlobalNames() const
+	{
+		std::vector<std::string> names(globals.size());
+
+		for (const auto& global : globals) {
+			names[global.second.index] = global.first;
+		}
+
+		return names;
+	}
+
+	void Resolver::resolveStatements(std::vector<std::unique_ptr<Ast::Statement>>& statements)
+	{
+		for (auto& statement : statements) {
+			resolveStatement(statement.get());
+		}
+	}
+
+	/*
+	* A let statement binds its name after the initializer is resolved, so the initializer sees any outer binding with the
+	* same name.  Function initializers are the exception: the name is bound first so that the function can call itself.
+	*/
+	void Resolver::resolveStatement(Ast::Statement* statement)
+	{
+		if (!statement) {
+			return;
+		}
+
+		switch (statement->kind) {
+		case Ast::Node::Kind::LetStatement: {
+			auto* letStatement = static_cast<Ast::LetStatement*>(statement);
+			auto* expression = letStatement->expression.get();
+
+			if (expression && expression->kind == Ast::Node::Kind::FunctionLiteral) {
+				Variable* variable = declare(letStatement->identifier.get());
+				resolveFunctionLiteral(static_cast<Ast::FunctionLiteral*>(expression), variable);
+			}
+			else {
+				resolveExpression(expression);
+				declare(letStatement->identifier.get());
+			}
+
+			break;
+		}
+
+		case Ast::Node::Kind::ReturnStatement:
+			resolveExpression(static_cast<Ast::ReturnStatement*>(statement)->expression.get());
+			break;
+
+		case Ast::Node::Kind::ExpressionStatement:
+			resolveExpression(static_cast<Ast::ExpressionStatement*>(statement)->expression.get());
+			break;
+
+		case Ast::Node::Kind::BlockStatement:
+			resolveBlock(static_cast<Ast::BlockStatement*>(statement));
+			break;
+
+		case Ast::Node::Kind::IfStatement: {
+			auto* ifStatement = static_cast<Ast::IfStatement*>(statement);
+			resolveExpression(ifStatement->condition.get());
+			resolveBlock(ifStatement->consequence.get());
+			resolveBlock(ifStatement->alternative.get());
+			break;
+		}
+
+		default:
+			resolveExpression(statement);
+		}
+	}
+
+	void Resolver::resolveBlock(Ast::BlockStatement* block)
+	{
+		if (!block) {
+			return;
+		}
+
+		functions.back().blocks.emplace_back();
+		resolveStatements(block->statements);
+		functions.back().blocks.pop_back();
+	}
+
+	void Resolver::resolveExpression(Ast::Expression* expression)
+	{
+		if (!expression) {
+			return;
+		}
+
+		switch (expression->kind) {
+		case Ast::Node::Kind::Identifier:
+			resolveIdentifier(static_cast<Ast::Identifier*>(expression));
+			break;
+
+		case Ast::Node::Kind::PrefixExpression:
+			resolveExpression(static_cast<Ast::PrefixExpression*>(expression)->rightExpression.get());
+			break;
+
+		case Ast::Node::Kind::InfixExpression: {
+			auto* infixExpression = static_cast<Ast::InfixExpression*>(expression);
+			resolveExpression(infixExpression->left.get());
+			resolveExpression(infixExpression->right.get());
+			break;
+		}
+
+		case Ast::Node::Kind::CallExpression: {
+			auto* callExpression = static_cast<Ast::CallExpression*>(expression);
+			resolveExpression(callExpression->function.get());
+
+			for (auto& argument : callExpression->arguments) {
+				resolveExpression(argument.get());
+			}
+
+			break;
+		}
+
+		case Ast::Node::Kind::FunctionLiteral:
+			resolveFunctionLiteral(static_cast<Ast::FunctionLiteral*>(expression), nullptr);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	/*
+	* Parameters occupy the first slots of the function's frame and the body is resolved directly in the parameter scope.
+	* @param function the function literal to resolve
+	* @param self the local variable which a let statement is binding this function to, or null
+	*/
+	void Resolver::resolveFunctionLiteral(Ast::FunctionLiteral* function, Variable* self)
+	{
+		functions.emplace_back();
+		functions.back().function = function;
+		functions.back().self = self;
+		functions.back().blocks.emplace_back();
+
+		for (auto& parameter : function->parameters) {
+			declare(parameter.get());
+		}
+
+		if (function->body) {
+			resolveStatements(function->body->statements);
+		}
+
+		function->slotCount = functions.back().slotCount;
+		finishedFunctions.push_back(std::move(functions.back()));
+		functions.pop_back();
+	}
+
+	/*
+	* Binds a name in the innermost scope.  Redeclaring a name in the same scope reuses its slot.
+	* @returns the variable the name is bound to, or null for globals
+	*/
+	Resolver::Variable* Resolver::declare(Ast::Identifier* identifier)
+	{
+		if (!identifier) {
+			return nullptr;
+		}
+
+		const std::string& name = identifier->token->literal;
+		auto& function = functions.back();
+
+		if (functions.size() == 1 && function.blocks.size() == 1) {
+			auto result = globals.try_emplace(name, Global{ static_cast<uint32_t>(globals.size()), true, nullptr });
+			result.first->second.defined = true;
+
+			identifier->binding = Ast::Binding{ Ast::Binding::Kind::Global, result.first->second.index };
+			return nullptr;
+		}
+
+		auto& block = function.blocks.back();
+		auto result = block.find(name);
+		Variable* variable;
+
+		if (result != block.end()) {
+			variable = result->second;
+		}
+		else {
+			variable = &variables.emplace_back();
+			variable->slot = function.slotCount++;
+			function.variables.push_back(variable);
+			block[name] = variable;
+		}
+
+		variable->declarations += 1;
+		identifier->binding = Ast::Binding{ Ast::Binding::Kind::Local, variable->slot };
+		uses.emplace_back(identifier, variable);
+
+		return variable;
+	}
+
+	/*
+	* Finds the binding for an identifier by searching scopes from the innermost outwards.  A local of an enclosing
+	* function is added to the captures of every function between its declaration and the use.  Names which are not
+	* declared locally are assumed to be globals; any that are never declared are reported once resolution is complete.
+	*/
+	void Resolver::resolveIdentifier(Ast::Identifier* identifier)
+	{
+		const std::string& name = identifier->token->literal;
+
+		for (size_t f = functions.size(); f-- > 0;) {
+			auto& blocks = functions[f].blocks;
+			size_t outermostBlock = f == 0 ? 1 : 0;
+
+			for (size_t b = blocks.size(); b-- > outermostBlock;) {
+				auto result = blocks[b].find(name);
+
+				if (result == blocks[b].end()) {
+					continue;
+				}
+
+				Variable* variable = result->second;
+				uses.emplace_back(identifier, variable);
+
+				if (f == functions.size() - 1) {
+					identifier->binding = Ast::Binding{ Ast::Binding::Kind::Local, variable->slot };
+					return;
+				}
+
+				variable->captured = true;
+
+				auto& capturingFunction = functions[f + 1];
+				Ast::Capture capture = capturingFunction.self == variable
+					? Ast::Capture{ Ast::Capture::Source::Self, 0 }
+					: Ast::Capture{ Ast::Capture::Source::Local, variable->slot };
+
+				uint32_t index = addCapture(capturingFunction, variable, capture);
+
+				for (size_t g = f + 2; g < functions.size(); g++) {
+					index = addCapture(functions[g], variable, Ast::Capture{ Ast::Capture::Source::Capture, index });
+				}
+
+				identifier->binding = Ast::Binding{ Ast::Binding::Kind::Capture, index };
+				return;
+			}
+		}
+
+		auto result = globals.try_emplace(name, Global{ static_cast<uint32_t>(globals.size()), false, identifier->token });
+		identifier->binding = Ast::Binding{ Ast::Binding::Kind::Global, result.first->second.index };
+	}
+
+	/*
+	* Adds a variable to the values captured by a function's closure.
+	* @returns the index of the variable in the function's captures
+	*/
+	uint32_t Resolver::addCapture(FunctionScope& function, Variable* variable, Ast::Capture capture)
+	{
+		for (size_t i = 0; i < function.captures.size(); i++) {
+			if (function.captures[i].first == variable) {
+				return static_cast<uint32_t>(i);
+			}
+		}
+
+		function.captures.emplace_back(variable, capture);
+		return static_cast<uint32_t>(function.captures.size() - 1);
+	}
+
+	/*
+	* A captured variable which is declared more than once could change after a closure copied it, so it is shared
+	* through a box instead.
+	*/
+	bool Resolver::isBoxed(const Variable* variable)
+	{
+		return variable->captured && variable->declarations > 1;
+	}
+
+	/*
+	* Writes the captures and boxed slots of every function, which are only known once the whole program is resolved.
+	*/
+	void Resolver::annotate(Ast::Program& program)
+	{
+		for (auto& scope : finishedFunctions) {
+			std::vector<uint32_t> boxedSlots;
+			std::vector<Ast::Capture> captures;
+
+			for (auto* variable : scope.variables) {
+				if (isBoxed(variable)) {
+					boxedSlots.push_back(variable->slot);
+				}
+			}
+
+			// a boxed variable exists before the function is created so the box can be captured instead of the closure
+			for (auto& capture : scope.captures) {
+				if (capture.second.source == Ast::Capture::Source::Self && isBoxed(capture.first)) {
+					capture.second = Ast::Capture{ Ast::Capture::Source::Local, capture.first->slot };
+				}
+
+				captures.push_back(capture.second);
+			}
+
+			if (scope.function) {
+				scope.function->boxedSlots = std::move(boxedSlots);
+				scope.function->captures = std::move(captures);
+			}
+			else {
+				program.boxedSlots = std::move(boxedSlots);
+			}
+		}
+
+		for (auto& use : uses) {
+			use.first->binding.boxed = isBoxed(use.second);
+		}
+
+		finishedFunctions.clear();
+		uses.clear();
+	}
+}
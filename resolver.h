@@ -0,0 +1,88 @@
+#pragma once
+
+#include "ast.h"
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unordered_map>
+
+namespace Delve::Script {
+
+/*
+* Resolves every identifier in a program to the storage it refers to.  Names declared in the outermost scope of the
+* program are given a global index, all other names are given a slot in the frame of the function which declares them.
+* Blocks introduce a new scope but share the frame of their function.
+*
+* Functions refer to the locals of enclosing functions through flat closures: each function literal is annotated with the
+* list of values its closure copies when it is created, and uses of those names index into that list.  Since nothing
+* refers to a frame once its call returns, frames can live on a stack.  A captured variable which is declared again
+* after it was captured is boxed so that the closure sees the new value.
+*/
+class Resolver
+{
+public:
+	using ErrorList = std::vector<std::string>;
+
+public:
+	void resolve(Ast::Program& program, const std::vector<std::string>& predefinedGlobals = {});
+
+	std::vector<std::string> getGlobalNames() const;
+
+	inline const ErrorList& getErrors() const { return errors; }
+
+private:
+	struct Variable
+	{
+		uint32_t slot = 0;
+		uint32_t declarations = 0;
+		bool captured = false;
+	};
+
+	struct FunctionScope
+	{
+		// null for the top level code
+		Ast::FunctionLiteral* function = nullptr;
+
+		// the variable a let statement is binding this function to, if any
+		Variable* self = nullptr;
+
+		std::vector<std::unordered_map<std::string, Variable*>> blocks;
+		std::vector<Variable*> variables;
+		std::vector<std::pair<Variable*, Ast::Capture>> captures;
+		uint32_t slotCount = 0;
+	};
+
+	struct Global
+	{
+		uint32_t index;
+		bool defined;
+		const Token* firstUse;
+	};
+
+private:
+	void resolveStatements(std::vector<std::unique_ptr<Ast::Statement>>& statements);
+	void resolveStatement(Ast::Statement* statement);
+	void resolveBlock(Ast::BlockStatement* block);
+	void resolveExpression(Ast::Expression* expression);
+	void resolveFunctionLiteral(Ast::FunctionLiteral* function, Variable* self);
+
+	Variable* declare(Ast::Identifier* identifier);
+	void resolveIdentifier(Ast::Identifier* identifier);
+	uint32_t addCapture(FunctionScope& function, Variable* variable, Ast::Capture capture);
+	static bool isBoxed(const Variable* variable);
+
+	void annotate(Ast::Program& program);
+
+private:
+	std::vector<FunctionScope> functions;
+	std::vector<FunctionScope> finishedFunctions;
+	std::deque<Variable> variables;
+	std::vector<std::pair<Ast::Identifier*, Variable*>> uses;
+
+	std::unordered_map<std::string, Global> globals;
+	ErrorList errors;
+};
+
+}
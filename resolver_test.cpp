@@ -0,0 +1,240 @@
+#include "resolver.h"
+#include "parser.h"
+#include "lexer.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+using namespace Delve::Script;
+
+// helper functions that dig the expression out of an expression statement or let statement
+const Ast::Expression* statementExpression(const Ast::Statement* statement);
+
+TEST(Resolver, Globals)
+{
+	std::string code = "let x = 1; let y = x; y;";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+
+	Resolver resolver;
+	auto* program = parser.getProgram();
+	resolver.resolve(*program);
+
+	ASSERT_EQ(resolver.getErrors().size(), 0);
+	EXPECT_EQ(program->globalCount, 2);
+	EXPECT_EQ(program->slotCount, 0);
+
+	auto* letY = static_cast<const Ast::LetStatement*>(program->statements[1].get());
+	EXPECT_EQ(letY->identifier->binding.kind, Ast::Binding::Kind::Global);
+	EXPECT_EQ(letY->identifier->binding.index, 1);
+
+	auto* x = static_cast<const Ast::Identifier*>(letY->expression.get());
+	EXPECT_EQ(x->binding.kind, Ast::Binding::Kind::Global);
+	EXPECT_EQ(x->binding.index, 0);
+
+	auto* y = static_cast<const Ast::Identifier*>(statementExpression(program->statements[2].get()));
+	EXPECT_EQ(y->binding.kind, Ast::Binding::Kind::Global);
+	EXPECT_EQ(y->binding.index, 1);
+}
+
+/*
+* Tests that locals are given frame slots and that locals of enclosing functions are reached through captures.
+*/
+TEST(Resolver, LocalsAndCaptures)
+{
+	std::string code = "let f = function(a, b) { let c = a; function(d) { a + d; }; };";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+
+	Resolver resolver;
+	auto* program = parser.getProgram();
+	resolver.resolve(*program);
+
+	ASSERT_EQ(resolver.getErrors().size(), 0);
+
+	auto* outer = static_cast<const Ast::FunctionLiteral*>(statementExpression(program->statements[0].get()));
+	EXPECT_EQ(outer->slotCount, 3);
+	EXPECT_EQ(outer->parameters[0]->binding.index, 0);
+	EXPECT_EQ(outer->parameters[1]->binding.index, 1);
+
+	auto* letC = static_cast<const Ast::LetStatement*>(outer->body->statements[0].get());
+	EXPECT_EQ(letC->identifier->binding.kind, Ast::Binding::Kind::Local);
+	EXPECT_EQ(letC->identifier->binding.index, 2);
+
+	auto* inner = static_cast<const Ast::FunctionLiteral*>(statementExpression(outer->body->statements[1].get()));
+	EXPECT_EQ(inner->slotCount, 1);
+	ASSERT_EQ(inner->captures.size(), 1);
+	EXPECT_EQ(inner->captures[0].source, Ast::Capture::Source::Local);
+	EXPECT_EQ(inner->captures[0].index, 0);
+	EXPECT_TRUE(outer->captures.empty());
+
+	auto* sum = static_cast<const Ast::InfixExpression*>(statementExpression(inner->body->statements[0].get()));
+	auto* a = static_cast<const Ast::Identifier*>(sum->left.get());
+	auto* d = static_cast<const Ast::Identifier*>(sum->right.get());
+
+	EXPECT_EQ(a->binding.kind, Ast::Binding::Kind::Capture);
+	EXPECT_EQ(a->binding.index, 0);
+	EXPECT_FALSE(a->binding.boxed);
+
+	EXPECT_EQ(d->binding.kind, Ast::Binding::Kind::Local);
+	EXPECT_EQ(d->binding.index, 0);
+}
+
+/*
+* Tests that blocks scope their names but share the slots of the enclosing frame.
+*/
+TEST(Resolver, BlockScopes)
+{
+	std::string code = "let x = 1; { let x = 2; { let y = x; } } x;";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+
+	Resolver resolver;
+	auto* program = parser.getProgram();
+	resolver.resolve(*program);
+
+	ASSERT_EQ(resolver.getErrors().size(), 0);
+	EXPECT_EQ(program->globalCount, 1);
+	EXPECT_EQ(program->slotCount, 2);
+
+	auto* outerBlock = static_cast<const Ast::BlockStatement*>(program->statements[1].get());
+	auto* innerBlock = static_cast<const Ast::BlockStatement*>(outerBlock->statements[1].get());
+	auto* letY = static_cast<const Ast::LetStatement*>(innerBlock->statements[0].get());
+
+	auto* x = static_cast<const Ast::Identifier*>(letY->expression.get());
+	EXPECT_EQ(x->binding.kind, Ast::Binding::Kind::Local);
+	EXPECT_EQ(x->binding.index, 0);
+	EXPECT_EQ(letY->identifier->binding.index, 1);
+
+	auto* lastX = static_cast<const Ast::Identifier*>(statementExpression(program->statements[2].get()));
+	EXPECT_EQ(lastX->binding.kind, Ast::Binding::Kind::Global);
+	EXPECT_EQ(lastX->binding.index, 0);
+}
+
+/*
+* Tests that a function can refer to itself but other initializers see the outer binding of their name.
+*/
+TEST(Resolver, LetInitializers)
+{
+	std::string code = "let f = function() { let x = 1; { let x = x + 1; let g = function() { g(); }; } };";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+
+	Resolver resolver;
+	auto* program = parser.getProgram();
+	resolver.resolve(*program);
+
+	ASSERT_EQ(resolver.getErrors().size(), 0);
+
+	auto* f = static_cast<const Ast::FunctionLiteral*>(statementExpression(program->statements[0].get()));
+	auto* block = static_cast<const Ast::BlockStatement*>(f->body->statements[1].get());
+
+	auto* letX = static_cast<const Ast::LetStatement*>(block->statements[0].get());
+	auto* sum = static_cast<const Ast::InfixExpression*>(letX->expression.get());
+	EXPECT_EQ(static_cast<const Ast::Identifier*>(sum->left.get())->binding.index, 0);
+	EXPECT_EQ(letX->identifier->binding.index, 1);
+
+	auto* letG = static_cast<const Ast::LetStatement*>(block->statements[1].get());
+	auto* g = static_cast<const Ast::FunctionLiteral*>(letG->expression.get());
+	auto* call = static_cast<const Ast::CallExpression*>(statementExpression(g->body->statements[0].get()));
+	auto* callee = static_cast<const Ast::Identifier*>(call->function.get());
+
+	EXPECT_EQ(callee->binding.kind, Ast::Binding::Kind::Capture);
+	EXPECT_EQ(callee->binding.index, 0);
+
+	ASSERT_EQ(g->captures.size(), 1);
+	EXPECT_EQ(g->captures[0].source, Ast::Capture::Source::Self);
+}
+
+/*
+* Tests that captures are threaded through every function between a declaration and its use.
+*/
+TEST(Resolver, NestedCaptures)
+{
+	std::string code = "let f = function(a, b) { function() { function() { b + a; }; }; };";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+
+	Resolver resolver;
+	auto* program = parser.getProgram();
+	resolver.resolve(*program);
+
+	ASSERT_EQ(resolver.getErrors().size(), 0);
+
+	auto* f = static_cast<const Ast::FunctionLiteral*>(statementExpression(program->statements[0].get()));
+	auto* middle = static_cast<const Ast::FunctionLiteral*>(statementExpression(f->body->statements[0].get()));
+	auto* inner = static_cast<const Ast::FunctionLiteral*>(statementExpression(middle->body->statements[0].get()));
+
+	ASSERT_EQ(middle->captures.size(), 2);
+	EXPECT_EQ(middle->captures[0].source, Ast::Capture::Source::Local);
+	EXPECT_EQ(middle->captures[0].index, 1);
+	EXPECT_EQ(middle->captures[1].source, Ast::Capture::Source::Local);
+	EXPECT_EQ(middle->captures[1].index, 0);
+
+	ASSERT_EQ(inner->captures.size(), 2);
+	EXPECT_EQ(inner->captures[0].source, Ast::Capture::Source::Capture);
+	EXPECT_EQ(inner->captures[0].index, 0);
+	EXPECT_EQ(inner->captures[1].source, Ast::Capture::Source::Capture);
+	EXPECT_EQ(inner->captures[1].index, 1);
+
+	auto* sum = static_cast<const Ast::InfixExpression*>(statementExpression(inner->body->statements[0].get()));
+	EXPECT_EQ(static_cast<const Ast::Identifier*>(sum->left.get())->binding.index, 0);
+	EXPECT_EQ(static_cast<const Ast::Identifier*>(sum->right.get())->binding.index, 1);
+}
+
+/*
+* Tests that only captured variables which are declared more than once are boxed.
+*/
+TEST(Resolver, BoxedVariables)
+{
+	std::string code = "let f = function(a, b) { let g = function() { a + b; }; let a = 2; let b2 = b; };";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+
+	Resolver resolver;
+	auto* program = parser.getProgram();
+	resolver.resolve(*program);
+
+	ASSERT_EQ(resolver.getErrors().size(), 0);
+
+	auto* f = static_cast<const Ast::FunctionLiteral*>(statementExpression(program->statements[0].get()));
+	ASSERT_EQ(f->boxedSlots.size(), 1);
+	EXPECT_EQ(f->boxedSlots[0], 0);
+	EXPECT_TRUE(f->parameters[0]->binding.boxed);
+	EXPECT_FALSE(f->parameters[1]->binding.boxed);
+
+	auto* letA = static_cast<const Ast::LetStatement*>(f->body->statements[1].get());
+	EXPECT_TRUE(letA->identifier->binding.boxed);
+	EXPECT_EQ(letA->identifier->binding.index, 0);
+
+	auto* g = static_cast<const Ast::FunctionLiteral*>(statementExpression(f->body->statements[0].get()));
+	auto* sum = static_cast<const Ast::InfixExpression*>(statementExpression(g->body->statements[0].get()));
+	EXPECT_TRUE(static_cast<const Ast::Identifier*>(sum->left.get())->binding.boxed);
+	EXPECT_FALSE(static_cast<const Ast::Identifier*>(sum->right.get())->binding.boxed);
+}
+
+TEST(Resolver, UndefinedNames)
+{
+	std::string code = "let f = function() { missing + other; };\nmissing;\n{ let local = 1; }\nlocal;";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+
+	Resolver resolver;
+	resolver.resolve(*parser.getProgram());
+
+	const auto& errors = resolver.getErrors();
+	ASSERT_EQ(errors.size(), 3);
+	EXPECT_EQ(errors[0], "Undefined identifier missing at 1, 22.");
+	EXPECT_EQ(errors[1], "Undefined identifier other at 1, 32.");
+	EXPECT_EQ(errors[2], "Undefined identifier local at 4, 1.");
+}
+
+const Ast::Expression* statementExpression(const Ast::Statement* statement)
+{
+	if (statement->kind == Ast::Node::Kind::LetStatement) {
+		return static_cast<const Ast::LetStatement*>(statement)->expression.get();
+	}
+
+	return static_cast<const Ast::ExpressionStatement*>(statement)->expression.get();
+}
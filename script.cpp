@@ -0,0 +1,207 @@
+#include "script.h"
+
+namespace Delve::Script {
+	// the host never sees a script's globals, so unused ones may be removed
+	Script::Script(const std::string& src) : source(src), eliminator(DeadCodeEliminator::Settings{ true })
+	{
+		compiled = false;
+		bytecodeCompiled = false;
+		optimized = false;
+		host = nullptr;
+
+		lexer.tokenize(source);
+		parser.parse(lexer.tokens());
+	}
+
+	/**
+	* Runs the optimization passes over the parsed program.  This should be called before the script is first run; if it
+	* has already been compiled the compiled program is discarded and rebuilt on the next run.  Types are inferred each
+	* time the program is compiled, since they depend on the host functions.
+	*/
+	void Script::optimize()
+	{
+		auto* program = parser.getProgram();
+
+		if (!program || !parser.getErrors().empty()) {
+			return;
+		}
+
+		inliner.inlineCalls(*program);
+		folder.fold(*program);
+		eliminator.eliminate(*program);
+		optimized = true;
+		compiled = false;
+		bytecodeCompiled = false;
+	}
+
+	/**
+	* Runs the script.  If the script could not be parsed or compiled, or an error occurs while it is running, null is
+	* returned and the errors are available through getErrors().
+	* The returned value remains valid until the script is run again.
+	* @param mode the engine to use for this run
+	* @returns the value produced by the script
+	*/
+	Value Script::run(ExecutionMode mode)
+	{
+		errors = parser.getErrors();
+
+		if (!errors.empty() || !parser.getProgram()) {
+			return Value();
+		}
+
+		if (mode == ExecutionMode::TreeWalk) {
+			Value result = evaluator.evaluate(parser.getProgram(), host);
+			errors = evaluator.getErrors();
+
+			return result;
+		}
+
+		if (mode == ExecutionMode::Bytecode) {
+			return runBytecode();
+		}
+
+		if (!compiled) {
+			inferTypes();
+
+			if (memoSettings.enabled) {
+				purity.analyze(*parser.getProgram(), host);
+			}
+
+			compiler.compile(parser.getProgram(), host);
+			compiled = true;
+			isolate.reset();
+
+			if (compiler.getProgram()) {
+				isolate = std::make_unique<Isolate>(compiler.getProgram());
+				isolate->getMemoCache().configure(memoSettings);
+			}
+		}
+
+		if (!isolate) {
+			errors = compiler.getErrors();
+			return Value();
+		}
+
+		isolate->getHeap().configure(heapSettings);
+		isolate->setLimits(limits);
+		Value result = isolate->run();
+		errors = isolate->getErrors();
+
+		return result;
+	}
+
+	/*
+	* Runs the script on the bytecode engine, blocking while it waits for asynchronous host functions.
+	*/
+	Value Script::runBytecode()
+	{
+		if (!bytecodeCompiled) {
+			inferTypes();
+			bytecodeCompiler.compile(parser.getProgram(), host);
+			bytecodeCompiled = true;
+			task.reset();
+
+			if (bytecodeCompiler.getProgram()) {
+				task = std::make_unique<Task>(bytecodeCompiler.getProgram());
+			}
+		}
+
+		if (!task) {
+			errors = bytecodeCompiler.getErrors();
+			return Value();
+		}
+
+		task->reset();
+		task->getHeap().configure(heapSettings);
+		task->setLimits(limits);
+		Value result = task->runToCompletion();
+		errors = task->getErrors();
+
+		return result;
+	}
+
+	// Specializes the program's operators for the current host if the script has been optimized.
+	void Script::inferTypes()
+	{
+		if (optimized) {
+			inference.infer(*parser.getProgram(), host);
+		}
+	}
+
+	/**
+	* Sets the host functions the script may call.  Host functions are bound to globals of the same name, so the script
+	* is compiled again on its next run.
+	* @param scriptHost the functions to make available, which must outlive the script
+	*/
+	void Script::setHost(const Host* scriptHost)
+	{
+		host = scriptHost;
+		compiled = false;
+		bytecodeCompiled = false;
+	}
+
+	/**
+	* Bounds the fuel and time each run of the script may use.  Only applies to the compiled engines; the tree walking
+	* evaluator is a reference implementation and is not metered.
+	* @param executionLimits the limits to apply from the next run onwards
+	*/
+	void Script::setLimits(const ExecutionLimits& executionLimits)
+	{
+		limits = executionLimits;
+	}
+
+	/**
+	* Sets the limits used by the heap of the compiled program from the next run onwards.
+	* @param settings heap limits and collection thresholds
+	*/
+	void Script::setHeapSettings(const Heap::Settings& settings)
+	{
+		heapSettings = settings;
+	}
+
+	/**
+	* Enables or disables memoizing calls to pure functions on the closure engine and bounds the memory it may use.
+	* Functions are only found to be pure when the script is compiled, so enabling memoization compiles it again on its
+	* next run.  Changing the settings forgets every remembered result.
+	* @param settings whether to memoize and the bytes each function's results may use
+	*/
+	void Script::setMemoSettings(const MemoCache::Settings& settings)
+	{
+		if (settings.enabled && !memoSettings.enabled) {
+			compiled = false;
+		}
+
+		memoSettings = settings;
+
+		if (isolate) {
+			isolate->getMemoCache().configure(memoSettings);
+		}
+	}
+
+	/**
+	* Returns the hits, misses and memory used by each memoized function.  These accumulate across runs, and results are
+	* remembered across runs since pure functions give the same result each time.
+	* @returns one entry for each pure function, empty if the script has not been compiled with memoization enabled
+	*/
+	std::vector<MemoCache::Statistics> Script::getMemoStatistics() const
+	{
+		if (!isolate) {
+			return std::vector<MemoCache::Statistics>();
+		}
+
+		return isolate->getMemoCache().getStatistics();
+	}
+
+	/**
+	* Returns the allocation and collection statistics of the closure engine's heap.  These accumulate across runs.
+	* @returns the heap statistics, which are all zero if the script has not been compiled
+	*/
+	Heap::Statistics Script::getHeapStatistics() const
+	{
+		if (!isolate) {
+			return Heap::Statistics();
+		}
+
+		return isolate->getHeap().getStatistics();
+	}
+}
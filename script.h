@@ -0,0 +1,99 @@
+#pragma once
+
+#include "lexer.h"
+#include "parser.h"
+#include "evaluator.h"
+#include "compiler.h"
+#include "bytecode.h"
+#include "task.h"
+#include "folder.h"
+#include "eliminator.h"
+#include "inliner.h"
+#include "type_inference.h"
+#include "purity.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Delve::Script {
+
+enum class ExecutionMode
+{
+	// Walk the AST directly, resolving names and operators as each node is visited.
+	TreeWalk,
+
+	// Lower the AST to pre-bound closures once and run those.
+	Closure,
+
+	// Compile the AST to bytecode once and run it on a stack machine which can suspend at host calls.
+	Bytecode
+};
+
+/*
+* Holds a script's source along with everything produced from it and runs it in the requested execution mode.
+* Each mode only does its preparation work the first time the script is run in that mode.
+*/
+class Script
+{
+public:
+	using ErrorList = std::vector<std::string>;
+
+public:
+	Script(const std::string& source);
+
+public:
+	void optimize();
+	Value run(ExecutionMode mode = ExecutionMode::Closure);
+
+	void setHost(const Host* host);
+	void setLimits(const ExecutionLimits& limits);
+	void setHeapSettings(const Heap::Settings& settings);
+	Heap::Statistics getHeapStatistics() const;
+	void setMemoSettings(const MemoCache::Settings& settings);
+	std::vector<MemoCache::Statistics> getMemoStatistics() const;
+
+	inline const Lexer::Statistics& getLexerStatistics() const { return lexer.getStatistics(); }
+	inline const Parser::Statistics& getParserStatistics() const { return parser.getStatistics(); }
+	inline const ConstantFolder::Statistics& getFoldingStatistics() const { return folder.getStatistics(); }
+	inline const DeadCodeEliminator::Statistics& getEliminationStatistics() const { return eliminator.getStatistics(); }
+	inline const Inliner::Statistics& getInliningStatistics() const { return inliner.getStatistics(); }
+	inline const TypeInference::Statistics& getInferenceStatistics() const { return inference.getStatistics(); }
+	inline const PurityAnalysis::Statistics& getPurityStatistics() const { return purity.getStatistics(); }
+
+	inline const Ast::Program* getProgram() const { return parser.getProgram(); }
+	inline const ErrorList& getErrors() const { return errors; }
+
+private:
+	Value runBytecode();
+	void inferTypes();
+
+private:
+	std::string source;
+	Lexer lexer;
+	Parser parser;
+
+	Inliner inliner;
+	ConstantFolder folder;
+	DeadCodeEliminator eliminator;
+	TypeInference inference;
+	PurityAnalysis purity;
+	bool optimized;
+
+	Evaluator evaluator;
+	Compiler compiler;
+	bool compiled;
+	std::unique_ptr<Isolate> isolate;
+	BytecodeCompiler bytecodeCompiler;
+	bool bytecodeCompiled;
+	std::unique_ptr<Task> task;
+
+	const Host* host;
+	Heap::Settings heapSettings;
+	MemoCache::Settings memoSettings;
+	ExecutionLimits limits;
+
+	ErrorList errors;
+};
+
+}
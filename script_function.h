@@ -0,0 +1,85 @@
+#pragma once
+
+#include "compiler.h"
+#include "host.h"
+
+#include <array>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+namespace Delve::Script {
+
+/*
+* A typed handle to a script function stored in a global by the last run of an isolate, for host code which calls into
+* a script at a high rate.  The function is looked up once, and each call converts its arguments straight into values
+* and its result straight back, with the same conversions as Host::bind.
+*
+*     ScriptFunction<int64_t(int64_t, bool)> onEvent(isolate, "onEvent");
+*     int64_t result = onEvent(42, true);
+*
+* A handle is only valid until the isolate runs again.  Calls which fail, or return a value of the wrong type, return a
+* default constructed result and report an error through the isolate's getErrors().
+*/
+template <typename Signature>
+class ScriptFunction;
+
+template <typename Return, typename... Parameters>
+class ScriptFunction<Return(Parameters...)>
+{
+public:
+	ScriptFunction() = default;
+
+	ScriptFunction(Isolate& scriptIsolate, const std::string& functionName) : isolate(&scriptIsolate), name(functionName)
+	{
+		function = isolate->getGlobal(name);
+	}
+
+	// true if the global holds a script function taking the handle's number of parameters
+	inline bool isValid() const
+	{
+		return function.type == Value::Type::Function &&
+			static_cast<const Compiled::Closure*>(function.object)->prototype->parameterCount == sizeof...(Parameters);
+	}
+
+	Return operator()(Parameters... arguments) const
+	{
+		std::array<Value, sizeof...(Parameters)> values = { Binding::Convert<std::decay_t<Parameters>>::to(arguments)... };
+		Value result = isolate->call(function, values.data(), values.size());
+
+		if constexpr (std::is_void_v<Return>) {
+			return;
+		}
+		else if constexpr (std::is_same_v<std::decay_t<Return>, Value>) {
+			return result;
+		}
+		else {
+			using Convert = Binding::Convert<std::decay_t<Return>>;
+
+			if (result.type != Convert::type) {
+				if (isolate->getErrors().empty()) {
+					resultTypeMismatch(result.type);
+				}
+
+				return Return();
+			}
+
+			return Convert::from(result);
+		}
+	}
+
+private:
+	void resultTypeMismatch(Value::Type actual) const
+	{
+		std::ostringstream error;
+		error << "Expected " << Value::getTypeName(Binding::Convert<std::decay_t<Return>>::type) << " result from " << name << " but got " << Value::getTypeName(actual) << '.';
+		isolate->errors.push_back(error.str());
+	}
+
+private:
+	Isolate* isolate = nullptr;
+	std::string name;
+	Value function;
+};
+
+}
@@ -0,0 +1,344 @@
+#include "script.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Delve::Script;
+
+namespace {
+	int64_t gcd(int64_t a, int64_t b)
+	{
+		return b == 0 ? a : gcd(b, a % b);
+	}
+
+	bool isEven(int64_t n)
+	{
+		return n % 2 == 0;
+	}
+}
+
+class ScriptTest : public ::testing::TestWithParam<ExecutionMode> {};
+
+// helper function that runs each input and compares the string representation of the result to the expected output
+void compareResultsToExpectedOutput(ExecutionMode mode, const std::vector<std::string>& inputs, const std::vector<std::string>& expectedOutput);
+
+TEST_P(ScriptTest, IntegerArithmetic)
+{
+	std::vector<std::string> inputs = {
+		"5;",
+		"-5;",
+		"2 + 3 * 4;",
+		"(2 + 3) * 4;",
+		"10 / 3;",
+		"7 - 10;",
+		"--7;",
+		"9223372036854775807 + 1;"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"5", "-5", "14", "20", "3", "-3", "7", "-9223372036854775808"
+	};
+
+	compareResultsToExpectedOutput(GetParam(), inputs, expectedOutput);
+}
+
+TEST_P(ScriptTest, BooleanExpressions)
+{
+	std::vector<std::string> inputs = {
+		"true;",
+		"!true;",
+		"!!false;",
+		"!5;",
+		"1 < 2;",
+		"1 > 2;",
+		"1 == 1;",
+		"1 != 1;",
+		"true == false;",
+		"(1 < 2) == true;"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"true", "false", "false", "false", "true", "false", "true", "false", "false", "true"
+	};
+
+	compareResultsToExpectedOutput(GetParam(), inputs, expectedOutput);
+}
+
+TEST_P(ScriptTest, LetStatements)
+{
+	std::vector<std::string> inputs = {
+		"let x = 5; x;",
+		"let x = 5; let y = x * 2; y + x;",
+		"let x = 5; let x = x + 1; x;",
+		"let x = 1; { let x = 2; } x;",
+		"let x = 1; { let y = x + 1; y; }",
+		"let x = 5;"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"5", "15", "6", "1", "2", "null"
+	};
+
+	compareResultsToExpectedOutput(GetParam(), inputs, expectedOutput);
+}
+
+TEST_P(ScriptTest, IfStatements)
+{
+	std::vector<std::string> inputs = {
+		"if (true) { 10; }",
+		"if (false) { 10; }",
+		"if (1 < 2) { 10; } else { 20; }",
+		"if (1 > 2) { 10; } else { 20; }",
+		"let x = 3; if (x) { x; }"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"10", "null", "10", "20", "3"
+	};
+
+	compareResultsToExpectedOutput(GetParam(), inputs, expectedOutput);
+}
+
+TEST_P(ScriptTest, ReturnStatements)
+{
+	std::vector<std::string> inputs = {
+		"return 10; 9;",
+		"9; return 2 * 5; 9;",
+		"if (true) { if (true) { return 10; } return 1; }",
+		"let f = function(x) { if (x > 0) { return 1; } return 0; }; f(3) + f(0);"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"10", "10", "10", "1"
+	};
+
+	compareResultsToExpectedOutput(GetParam(), inputs, expectedOutput);
+}
+
+TEST_P(ScriptTest, Functions)
+{
+	std::vector<std::string> inputs = {
+		"let identity = function(x) { x; }; identity(5);",
+		"let add = function(x, y) { return x + y; }; add(5, add(1, 2));",
+		"function(x) { x * 2; }(4);",
+		"let nothing = function() {}; nothing();",
+		"let f = function() { 1; }; f == f;"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"5", "8", "8", "null", "true"
+	};
+
+	compareResultsToExpectedOutput(GetParam(), inputs, expectedOutput);
+}
+
+TEST_P(ScriptTest, Closures)
+{
+	std::vector<std::string> inputs = {
+		"let adder = function(x) { function(y) { x + y; }; }; let addTwo = adder(2); addTwo(3);",
+		"let a = function(x) { function(y) { function(z) { x + y + z; }; }; }; a(1)(2)(3);",
+		"let f = function() { let g = function(n) { if (n < 1) { return 0; } n + g(n - 1); }; g(4); }; f();",
+		"let f = function(x) { let g = function() { x; }; let x = x + 1; g(); }; f(1);",
+		"let f = function() { let g = function() { g; }; let h = g; let g = 1; h(); }; f();",
+		"let f = function(a) { let g = function(b) { function(c) { a + b + c; }; }; g(20)(300); }; f(1);",
+		"{ let x = 1; let g = function() { x; }; let x = 5; g(); }"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"5", "6", "10", "2", "1", "321", "5"
+	};
+
+	compareResultsToExpectedOutput(GetParam(), inputs, expectedOutput);
+}
+
+TEST_P(ScriptTest, Recursion)
+{
+	std::vector<std::string> inputs = {
+		"let fib = function(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2); }; fib(15);",
+		"let even = function(n) { if (n == 0) { return true; } odd(n - 1); }; let odd = function(n) { if (n == 0) { return false; } even(n - 1); }; even(10);"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"610", "true"
+	};
+
+	compareResultsToExpectedOutput(GetParam(), inputs, expectedOutput);
+}
+
+TEST_P(ScriptTest, RuntimeErrors)
+{
+	std::vector<std::string> inputs = {
+		"5 + true;",
+		"-true;",
+		"1 / 0;",
+		"let x = 5; x(1);",
+		"let f = function(a) { a; }; f(1, 2);",
+		"1 == true;",
+		"let f = function(n) { 1 + f(n + 1); }; f(0);"
+	};
+
+	std::vector<std::string> expectedErrors = {
+		"Type mismatch: int + bool.",
+		"Type mismatch: -bool.",
+		"Division by zero.",
+		"Attempted to call a value of type int.",
+		"Expected 1 arguments but got 2.",
+		"Type mismatch: int == bool.",
+		"Maximum call depth exceeded."
+	};
+
+	ASSERT_EQ(inputs.size(), expectedErrors.size());
+
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		Script script(inputs[i]);
+		Value result = script.run(GetParam());
+
+		EXPECT_EQ(result.type, Value::Type::Null);
+		ASSERT_EQ(script.getErrors().size(), 1) << inputs[i];
+		EXPECT_EQ(script.getErrors()[0], expectedErrors[i]);
+	}
+}
+
+TEST_P(ScriptTest, ParseErrors)
+{
+	Script script("let = 5;");
+	Value result = script.run(GetParam());
+
+	EXPECT_EQ(result.type, Value::Type::Null);
+	ASSERT_EQ(script.getErrors().size(), 1);
+}
+
+TEST_P(ScriptTest, RunTwice)
+{
+	Script script("let counter = function(n) { if (n < 1) { return 0; } 1 + counter(n - 1); }; counter(20);");
+
+	EXPECT_EQ(script.run(GetParam()).toString(), "20");
+	EXPECT_EQ(script.run(GetParam()).toString(), "20");
+}
+
+/*
+* Tests calling synchronous and asynchronous host functions.  Every engine waits for asynchronous functions, the bytecode
+* engine by suspending the script rather than blocking inside the call.
+*/
+TEST_P(ScriptTest, HostFunctions)
+{
+	Host host;
+	host.define("square", 1, [](const Value* arguments, size_t) { return Value::fromInteger(arguments[0].integer * arguments[0].integer); });
+	host.defineAsync("lookup", 1, [](std::vector<Value> arguments, HostCompletion completion) {
+		std::thread([key = arguments[0].integer, completion]() { completion.resolve(Value::fromInteger(key + 100)); }).detach();
+	});
+	host.defineAsync("fail", 0, [](std::vector<Value>, HostCompletion completion) { completion.reject("Lookup failed."); });
+
+	std::vector<std::string> inputs = {
+		"square(7);",
+		"let f = function(x) { square(x) + 1; }; f(3);",
+		"lookup(1) + lookup(2);",
+		"let sum = function(n, total) { if (n == 0) { return total; } sum(n - 1, total + lookup(n)); }; sum(10, 0);",
+		"let apply = function(f, x) { f(x); }; apply(square, 5);",
+		"let square = function(x) { x; }; square(4);",
+		"square == square;"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"49", "10", "203", "1055", "25", "4", "true"
+	};
+
+	ASSERT_EQ(inputs.size(), expectedOutput.size());
+
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		Script script(inputs[i]);
+		script.setHost(&host);
+		Value result = script.run(GetParam());
+
+		ASSERT_EQ(script.getErrors().size(), 0) << inputs[i] << ": " << script.getErrors()[0];
+		EXPECT_EQ(result.toString(), expectedOutput[i]) << inputs[i];
+	}
+
+	std::vector<std::string> failures = { "fail();", "square(1, 2);", "let f = function() { lookup(); }; f();" };
+	std::vector<std::string> expectedErrors = { "Lookup failed.", "Expected 1 arguments but got 2.", "Expected 1 arguments but got 0." };
+
+	for (size_t i = 0; i < failures.size(); ++i) {
+		Script script(failures[i]);
+		script.setHost(&host);
+		Value result = script.run(GetParam());
+
+		EXPECT_EQ(result.type, Value::Type::Null);
+		ASSERT_EQ(script.getErrors().size(), 1) << failures[i];
+		EXPECT_EQ(script.getErrors()[0], expectedErrors[i]);
+	}
+}
+
+/*
+* Tests that C++ functions and lambdas bound by signature are called with their arguments converted and checked.
+*/
+TEST_P(ScriptTest, BoundFunctions)
+{
+	int64_t calls = 0;
+
+	Host host;
+	host.bind("gcd", &gcd);
+	host.bind("isEven", isEven);
+	host.bind("choose", [](bool condition, int64_t a, int64_t b) { return condition ? a : b; });
+	host.bind("identity", [](const Value& value) { return value; });
+	host.bind("count", [&calls]() { calls += 1; });
+
+	std::vector<std::string> inputs = {
+		"gcd(84, 36);",
+		"isEven(gcd(10, 4));",
+		"choose(isEven(3), 1, 2);",
+		"let f = function(x) { x * 2; }; identity(f)(21);",
+		"count(); count();",
+		"let apply = function(f, a, b) { f(a, b); }; apply(gcd, 21, 14);"
+	};
+
+	std::vector<std::string> expectedOutput = {
+		"12", "true", "2", "42", "null", "7"
+	};
+
+	ASSERT_EQ(inputs.size(), expectedOutput.size());
+
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		Script script(inputs[i]);
+		script.setHost(&host);
+		Value result = script.run(GetParam());
+
+		ASSERT_EQ(script.getErrors().size(), 0) << inputs[i] << ": " << script.getErrors()[0];
+		EXPECT_EQ(result.toString(), expectedOutput[i]) << inputs[i];
+	}
+
+	EXPECT_EQ(calls, 2);
+
+	std::vector<std::string> failures = { "gcd(1, true);", "isEven(isEven);", "gcd(1);" };
+	std::vector<std::string> expectedErrors = {
+		"Expected int for argument 2 of gcd but got bool.",
+		"Expected int for argument 1 of isEven but got function.",
+		"Expected 2 arguments but got 1."
+	};
+
+	for (size_t i = 0; i < failures.size(); ++i) {
+		Script script(failures[i]);
+		script.setHost(&host);
+		script.run(GetParam());
+
+		ASSERT_EQ(script.getErrors().size(), 1) << failures[i];
+		EXPECT_EQ(script.getErrors()[0], expectedErrors[i]);
+	}
+}
+
+INSTANTIATE_TEST_SUITE_P(ExecutionModes, ScriptTest, ::testing::Values(ExecutionMode::TreeWalk, ExecutionMode::Closure, ExecutionMode::Bytecode));
+
+void compareResultsToExpectedOutput(ExecutionMode mode, const std::vector<std::string>& inputs, const std::vector<std::string>& expectedOutput)
+{
+	ASSERT_EQ(inputs.size(), expectedOutput.size());
+
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		Script script(inputs[i]);
+		Value result = script.run(mode);
+
+		ASSERT_EQ(script.getErrors().size(), 0) << inputs[i] << ": " << script.getErrors()[0];
+		EXPECT_EQ(result.toString(), expectedOutput[i]) << inputs[i];
+	}
+}
@@ -0,0 +1,803 @@
+#include "single_pass_compiler.h"
+#include "trace.h"
+
+#include <algorithm>
+
+namespace Delve::Script {
+
+	using Bytecode::OpCode;
+
+	namespace {
+		OpCode getInfixOpCode(Token::Type type)
+		{
+			switch (type) {
+			case Token::Type::Plus:
+				return OpCode::Add;
+			case Token::Type::Minus:
+				return OpCode::Subtract;
+			case Token::Type::Multiply:
+				return OpCode::Multiply;
+			case Token::Type::Divide:
+				return OpCode::Divide;
+			case Token::Type::LessThan:
+				return OpCode::LessThan;
+			case Token::Type::GreaterThan:
+				return OpCode::GreaterThan;
+			case Token::Type::Equal:
+				return OpCode::Equal;
+			default:
+				return OpCode::NotEqual;
+			}
+		}
+	}
+
+	SinglePassCompiler::SinglePassCompiler()
+	{
+	}
+
+	SinglePassCompiler::SinglePassCompiler(const Token::Vector& tokens, const Host* host)
+	{
+		compile(tokens, host);
+	}
+
+	void SinglePassCompiler::clear()
+	{
+		program.reset();
+		statistics = Statistics();
+		errors.clear();
+	}
+
+	/**
+	* Compiles a program from the lexer's tokens.  On success the result is available through getProgram().  If the
+	* program could not be compiled the program will be null and the reasons are available through getErrors(), which
+	* are those the Parser or the BytecodeCompiler would give.
+	* @param tokenVec the tokens of the program, which only need to live until this method returns
+	* @param host functions the program may call, which must outlive the compiled program
+	*/
+	void SinglePassCompiler::compile(const Token::Vector& tokenVec, const Host* host)
+	{
+		DELVE_SCRIPT_TRACE("compile single pass", "compile");
+
+		clear();
+		tokens = &tokenVec;
+
+		try {
+			compileTokens(host);
+		}
+		catch (const Unsupported&) {
+			program.reset();
+		}
+		catch (const std::out_of_range&) {
+			program.reset();
+		}
+
+		functions.clear();
+		variables.clear();
+		uses.clear();
+		globals.clear();
+		brackets.clear();
+		target = nullptr;
+		tokens = nullptr;
+
+		if (program) {
+			return;
+		}
+
+		statistics = Statistics();
+		statistics.parsed = true;
+
+		Parser parser(tokenVec);
+		errors = parser.getErrors();
+
+		if (errors.empty() && parser.getProgram()) {
+			BytecodeCompiler compiler(parser.getProgram(), host);
+			program = compiler.getProgram();
+			errors = compiler.getErrors();
+		}
+	}
+
+	/*
+	* Compiles the whole program, throwing Unsupported at the first thing which needs the tree to report.
+	*/
+	void SinglePassCompiler::compileTokens(const Host* host)
+	{
+		if (tokens->empty() || tokens->back()->type != Token::Type::Eof) {
+			throw Unsupported();
+		}
+
+		matchBrackets();
+
+		hostNames = host ? host->getNames() : std::vector<std::string>();
+
+		for (const auto& name : hostNames) {
+			globals.try_emplace(name, Global{ static_cast<uint32_t>(globals.size()), true });
+		}
+
+		auto compiled = std::make_shared<BytecodeProgram>();
+		compiled->host = host;
+		compiled->functions.push_back(std::make_unique<Bytecode::Function>());
+		target = compiled.get();
+
+		// the outermost block of the top level code holds globals rather than frame slots
+		functions.emplace_back();
+		functions.back().function = compiled->functions.back().get();
+		position = 0;
+		line = 0;
+
+		compileStatements(Token::Type::Eof, true, false);
+		emit(OpCode::Return);
+		finishFunction(functions.back());
+
+		for (const auto& global : globals) {
+			if (!global.second.defined) {
+				throw Unsupported();
+			}
+		}
+
+		compiled->globalCount = globals.size();
+		statistics.functions = static_cast<uint32_t>(compiled->functions.size());
+
+		for (const auto& function : compiled->functions) {
+			statistics.instructions += static_cast<uint32_t>(function->code.size());
+		}
+
+		program = compiled;
+	}
+
+	// Finds the closing bracket of every parenthesis and brace, so that the end of a block is known when it starts.
+	void SinglePassCompiler::matchBrackets()
+	{
+		std::vector<uint32_t> open;
+		brackets.assign(tokens->size(), 0);
+
+		for (uint32_t i = 0; i < tokens->size(); i++) {
+			Token::Type type = (*tokens)[i]->type;
+
+			if (type == Token::Type::LParen || type == Token::Type::LBrace) {
+				open.push_back(i);
+			}
+			else if (type == Token::Type::RParen || type == Token::Type::RBrace) {
+				Token::Type opening = type == Token::Type::RParen ? Token::Type::LParen : Token::Type::LBrace;
+
+				if (open.empty() || (*tokens)[open.back()]->type != opening) {
+					throw Unsupported();
+				}
+
+				brackets[open.back()] = i;
+				brackets[i] = open.back();
+				open.pop_back();
+			}
+		}
+
+		if (!open.empty()) {
+			throw Unsupported();
+		}
+	}
+
+	/*
+	* Compiles statements up to the token which ends their block.  Only the value of the last statement can be the
+	* result of the block, so the values of the others are discarded.
+	* @param end the token type which closes the block
+	* @param wantResult true if the value of the block should be left on the stack
+	* @param tail true if the value of the block is the result of the enclosing function
+	*/
+	void SinglePassCompiler::compileStatements(Token::Type end, bool wantResult, bool tail)
+	{
+		bool empty = true;
+
+		while (current()->type != end) {
+			if (current()->type == Token::Type::Eof) {
+				throw Unsupported();
+			}
+
+			// a lone semicolon is an empty statement, which the Parser leaves out of the tree
+			if (current()->type != Token::Type::Semicolon) {
+				compileStatement(end, wantResult, tail);
+				empty = false;
+			}
+
+			advance();
+		}
+
+		if (empty && wantResult) {
+			emit(OpCode::Null);
+		}
+	}
+
+	/*
+	* Compiles the statement starting at the current token, leaving the current token on its last token.  Whether the
+	* value is wanted and the statement is a tail only applies if it turns out to be the last statement of its block.
+	*/
+	void SinglePassCompiler::compileStatement(Token::Type end, bool wantResult, bool tail)
+	{
+		line = current()->lineNum;
+
+		switch (current()->type) {
+		case Token::Type::Let:
+			compileLetStatement(end, wantResult);
+			return;
+
+		case Token::Type::Return: {
+			advance();
+
+			if (compileExpression(Parser::Precedence::Lowest) && functions.size() > 1) {
+				makeTailCall();
+			}
+
+			emit(OpCode::Return);
+			advance();
+			expect(Token::Type::Semicolon);
+
+			// nothing after a return is reached, but the code which follows expects the statement to have left a value
+			functions.back().stackDepth += wantResult && isLast(position, end) ? 1 : 0;
+			return;
+		}
+
+		case Token::Type::LBrace: {
+			bool last = isLast(brackets[position], end);
+			compileBlock(wantResult && last, tail && last);
+			return;
+		}
+
+		case Token::Type::If:
+			compileIfStatement(end, wantResult, tail);
+			return;
+
+		default: {
+			bool call = compileExpression(Parser::Precedence::Lowest);
+			advance();
+			expect(Token::Type::Semicolon);
+
+			bool last = isLast(position, end);
+
+			if (tail && last && call) {
+				makeTailCall();
+				emit(OpCode::Return);
+				functions.back().stackDepth += wantResult ? 1 : 0;
+			}
+			else if (!(wantResult && last)) {
+				emit(OpCode::Pop);
+			}
+
+			return;
+		}
+		}
+	}
+
+	/*
+	* A let statement binds its name after the initializer is compiled, so the initializer sees any outer binding with
+	* the same name.  Function initializers are the exception: the name is bound first so that the function can call
+	* itself.  The whole initializer must be the function literal, which is only the case if a semicolon follows it.
+	*/
+	void SinglePassCompiler::compileLetStatement(Token::Type end, bool wantResult)
+	{
+		advance();
+		expect(Token::Type::Identifier);
+		const Token* name = current();
+
+		advance();
+		expect(Token::Type::Assign);
+		advance();
+
+		Variable* variable;
+		uint32_t global = 0;
+
+		if (current()->type == Token::Type::Function && at(findFunctionEnd(position) + 1)->type == Token::Type::Semicolon) {
+			variable = declare(name, global);
+			compileFunctionLiteral(variable);
+		}
+		else {
+			compileExpression(Parser::Precedence::Lowest);
+			variable = declare(name, global);
+		}
+
+		advance();
+		expect(Token::Type::Semicolon);
+
+		if (!variable) {
+			emit(OpCode::SetGlobal, global);
+		}
+		else {
+			emitVariable(variable->boxed ? OpCode::SetLocalBoxed : OpCode::SetLocal, variable, variable->slot);
+		}
+
+		if (wantResult && isLast(position, end)) {
+			emit(OpCode::Null);
+		}
+	}
+
+	void SinglePassCompiler::compileIfStatement(Token::Type end, bool wantResult, bool tail)
+	{
+		if (peek()->type != Token::Type::LParen) {
+			throw Unsupported();
+		}
+
+		advance();
+		compileExpression(Parser::Precedence::Lowest);
+
+		if (peek()->type != Token::Type::LBrace) {
+			throw Unsupported();
+		}
+
+		advance();
+
+		// the statement ends with the alternative if there is one
+		size_t statementEnd = brackets[position];
+		bool hasAlternative = at(statementEnd + 1)->type == Token::Type::Else;
+
+		if (hasAlternative) {
+			if (at(statementEnd + 2)->type != Token::Type::LBrace) {
+				throw Unsupported();
+			}
+
+			statementEnd = brackets[statementEnd + 2];
+		}
+
+		bool last = isLast(statementEnd, end);
+		wantResult = wantResult && last;
+		tail = tail && last;
+
+		size_t skipConsequence = emit(OpCode::JumpIfFalse);
+		uint32_t branchDepth = functions.back().stackDepth;
+
+		compileBlock(wantResult, tail);
+		size_t skipAlternative = emit(OpCode::Jump);
+
+		patchJump(skipConsequence);
+		functions.back().stackDepth = branchDepth;
+
+		if (hasAlternative) {
+			advance(2);
+			compileBlock(wantResult, tail);
+		}
+		else if (wantResult) {
+			emit(OpCode::Null);
+		}
+
+		patchJump(skipAlternative);
+	}
+
+	// Compiles a block starting at its opening brace, whose names go out of scope at its closing brace.
+	void SinglePassCompiler::compileBlock(bool wantResult, bool tail)
+	{
+		line = current()->lineNum;
+
+		auto& scope = functions.back();
+		scope.block += 1;
+
+		advance();
+		compileStatements(Token::Type::RBrace, wantResult, tail);
+
+		while (!scope.names.empty() && scope.names.back().block == scope.block) {
+			scope.names.pop_back();
+		}
+
+		scope.block -= 1;
+	}
+
+	/*
+	* Compiles the expression starting at the current token, in the same way as Parser::parseExpression parses it.
+	* @returns true if the expression is a call, so that it may be made a tail call
+	*/
+	bool SinglePassCompiler::compileExpression(Parser::Precedence precedence)
+	{
+		bool call = compilePrefix();
+
+		while (peek()->type != Token::Type::Semicolon && precedence < Parser::getTokenPrecedence(peek())) {
+			advance();
+
+			if (current()->type == Token::Type::LParen) {
+				compileArguments();
+				call = true;
+				continue;
+			}
+
+			Token::Type op = current()->type;
+			advance();
+			compileExpression(Parser::getTokenPrecedence(at(position - 1)));
+			emit(getInfixOpCode(op));
+			call = false;
+		}
+
+		return call;
+	}
+
+	bool SinglePassCompiler::compilePrefix()
+	{
+		const Token* token = current();
+		line = token->lineNum;
+
+		switch (token->type) {
+		case Token::Type::Identifier:
+			compileIdentifier();
+			return false;
+
+		case Token::Type::Integer:
+			emitConstant(Value::fromInteger(std::stoll(token->literal)));
+			return false;
+
+		case Token::Type::True:
+		case Token::Type::False:
+			emitConstant(Value::fromBoolean(token->type == Token::Type::True));
+			return false;
+
+		case Token::Type::Negate:
+		case Token::Type::Minus:
+			advance();
+			compileExpression(Parser::Precedence::Prefix);
+			emit(token->type == Token::Type::Negate ? OpCode::Negate : OpCode::Minus);
+			return false;
+
+		case Token::Type::LParen: {
+			advance();
+			bool call = compileExpression(Parser::Precedence::Lowest);
+
+			if (peek()->type != Token::Type::RParen) {
+				throw Unsupported();
+			}
+
+			advance();
+			return call;
+		}
+
+		case Token::Type::Function:
+			compileFunctionLiteral(nullptr);
+			return false;
+
+		default:
+			throw Unsupported();
+		}
+	}
+
+	/*
+	* Compiles the arguments of a call starting at its opening parenthesis, the callee has already been pushed.
+	*/
+	void SinglePassCompiler::compileArguments()
+	{
+		uint32_t count = 0;
+		advance();
+
+		while (current()->type != Token::Type::RParen) {
+			if (count > 0) {
+				expect(Token::Type::Comma);
+				advance();
+			}
+
+			compileExpression(Parser::Precedence::Lowest);
+			count += 1;
+			advance();
+		}
+
+		emit(OpCode::Call, count);
+	}
+
+	/*
+	* Compiles the body of a function literal into a new function of the program, followed by the instruction which
+	* creates its closure.
+	* @param self the local variable which a let statement is binding the function to, or null
+	*/
+	void SinglePassCompiler::compileFunctionLiteral(Variable* self)
+	{
+		line = current()->lineNum;
+		uint32_t outerLine = line;
+
+		uint32_t index = static_cast<uint32_t>(target->functions.size());
+		target->functions.push_back(std::make_unique<Bytecode::Function>());
+
+		functions.emplace_back();
+		functions.back().function = target->functions.back().get();
+		functions.back().self = self;
+
+		advance();
+		expect(Token::Type::LParen);
+		advance();
+
+		uint32_t parameterCount = 0;
+
+		while (current()->type != Token::Type::RParen) {
+			if (parameterCount > 0) {
+				expect(Token::Type::Comma);
+				advance();
+			}
+
+			uint32_t global;
+			expect(Token::Type::Identifier);
+			declare(current(), global);
+			parameterCount += 1;
+			advance();
+		}
+
+		advance();
+		expect(Token::Type::LBrace);
+		advance();
+
+		// parameters and the outermost names of the body share a scope
+		compileStatements(Token::Type::RBrace, true, true);
+		emit(OpCode::Return);
+
+		functions.back().function->parameterCount = parameterCount;
+		finishFunction(functions.back());
+		functions.pop_back();
+
+		line = outerLine;
+		emit(OpCode::Closure, index);
+	}
+
+	/*
+	* Finds the binding for the current identifier by searching scopes from the innermost outwards, as the Resolver does,
+	* and pushes its value.
+	*/
+	void SinglePassCompiler::compileIdentifier()
+	{
+		std::string_view name = current()->literal;
+
+		for (size_t f = functions.size(); f-- > 0;) {
+			auto& names = functions[f].names;
+
+			for (auto entry = names.rbegin(); entry != names.rend(); ++entry) {
+				if (entry->name != name) {
+					continue;
+				}
+
+				Variable* variable = entry->variable;
+
+				if (f == functions.size() - 1) {
+					emitVariable(variable->boxed ? OpCode::GetLocalBoxed : OpCode::GetLocal, variable, variable->slot);
+					return;
+				}
+
+				variable->captured = true;
+
+				auto& capturingFunction = functions[f + 1];
+				Ast::Capture capture = capturingFunction.self == variable
+					? Ast::Capture{ Ast::Capture::Source::Self, 0 }
+					: Ast::Capture{ Ast::Capture::Source::Local, variable->slot };
+
+				uint32_t index = addCapture(capturingFunction, variable, capture);
+
+				for (size_t g = f + 2; g < functions.size(); g++) {
+					index = addCapture(functions[g], variable, Ast::Capture{ Ast::Capture::Source::Capture, index });
+				}
+
+				if (variable->declarations > 1 && !variable->boxed) {
+					box(variable);
+				}
+
+				emitVariable(variable->boxed ? OpCode::GetCaptureBoxed : OpCode::GetCapture, variable, index);
+				return;
+			}
+		}
+
+		auto result = globals.try_emplace(name, Global{ static_cast<uint32_t>(globals.size()), false });
+		emit(OpCode::GetGlobal, result.first->second.index);
+	}
+
+	/*
+	* Binds a name in the innermost scope.  Redeclaring a name in the same scope reuses its slot.
+	* @param global set to the index of the global if the name is declared in the outermost scope
+	* @returns the variable the name is bound to, or null for globals
+	*/
+	SinglePassCompiler::Variable* SinglePassCompiler::declare(const Token* identifier, uint32_t& global)
+	{
+		std::string_view name = identifier->literal;
+		auto& scope = functions.back();
+
+		if (functions.size() == 1 && scope.block == 0) {
+			auto result = globals.try_emplace(name, Global{ static_cast<uint32_t>(globals.size()), true });
+			result.first->second.defined = true;
+			global = result.first->second.index;
+
+			return nullptr;
+		}
+
+		Variable* variable = nullptr;
+
+		for (auto entry = scope.names.rbegin(); entry != scope.names.rend() && entry->block == scope.block; ++entry) {
+			if (entry->name == name) {
+				variable = entry->variable;
+				break;
+			}
+		}
+
+		if (!variable) {
+			variable = &variables.emplace_back();
+			variable->slot = scope.slotCount++;
+			variable->function = static_cast<uint32_t>(functions.size() - 1);
+			scope.names.push_back(Name{ name, variable, scope.block });
+		}
+
+		variable->declarations += 1;
+
+		if (variable->captured && variable->declarations > 1 && !variable->boxed) {
+			box(variable);
+		}
+
+		return variable;
+	}
+
+	/*
+	* Adds a variable to the values captured by a function's closure.
+	* @returns the index of the variable in the function's captures
+	*/
+	uint32_t SinglePassCompiler::addCapture(FunctionScope& scope, Variable* variable, Ast::Capture capture)
+	{
+		for (size_t i = 0; i < scope.captures.size(); i++) {
+			if (scope.captures[i].first == variable) {
+				return static_cast<uint32_t>(i);
+			}
+		}
+
+		scope.captures.emplace_back(variable, capture);
+		return static_cast<uint32_t>(scope.captures.size() - 1);
+	}
+
+	/*
+	* Shares a variable through a box once it has been captured and declared again, rewriting the instructions which
+	* used it so far.  The function declaring the variable is still being compiled, since both the declarations and the
+	* functions capturing it are inside it.
+	*/
+	void SinglePassCompiler::box(Variable* variable)
+	{
+		variable->boxed = true;
+
+		auto& boxedSlots = functions[variable->function].boxedSlots;
+		boxedSlots.insert(std::upper_bound(boxedSlots.begin(), boxedSlots.end(), variable->slot), variable->slot);
+
+		for (const auto& use : uses) {
+			if (use.variable != variable) {
+				continue;
+			}
+
+			if (use.capture) {
+				use.function->storage.captures[use.index] = Ast::Capture{ Ast::Capture::Source::Local, variable->slot };
+				continue;
+			}
+
+			auto& instruction = use.function->storage.code[use.index];
+
+			switch (instruction.op) {
+			case OpCode::GetLocal:
+				instruction.op = OpCode::GetLocalBoxed;
+				break;
+			case OpCode::SetLocal:
+				instruction.op = OpCode::SetLocalBoxed;
+				break;
+			case OpCode::GetCapture:
+				instruction.op = OpCode::GetCaptureBoxed;
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	/*
+	* Completes a function's frame layout and captures.  A function which captures itself may still have to capture
+	* the box of the variable it is bound to instead, if the variable is declared again later in the enclosing function.
+	*/
+	void SinglePassCompiler::finishFunction(FunctionScope& scope)
+	{
+		auto* function = scope.function;
+		function->slotCount = scope.slotCount;
+		function->storage.boxedSlots = scope.boxedSlots;
+
+		for (size_t i = 0; i < scope.captures.size(); i++) {
+			Variable* variable = scope.captures[i].first;
+			Ast::Capture capture = scope.captures[i].second;
+
+			if (capture.source == Ast::Capture::Source::Self) {
+				if (variable->boxed) {
+					capture = Ast::Capture{ Ast::Capture::Source::Local, variable->slot };
+				}
+				else {
+					uses.push_back(Use{ variable, function, static_cast<uint32_t>(i), true });
+				}
+			}
+
+			function->storage.captures.push_back(capture);
+		}
+
+		function->seal();
+	}
+
+	size_t SinglePassCompiler::emit(OpCode op, uint32_t operand)
+	{
+		auto& scope = functions.back();
+		auto* function = scope.function;
+
+		scope.stackDepth += Bytecode::getStackEffect(op, operand);
+		function->maxStack = std::max(function->maxStack, scope.stackDepth);
+		auto& storage = function->storage;
+
+		if (storage.lines.empty() || storage.lines.back().line != line) {
+			storage.lines.push_back({ static_cast<uint32_t>(storage.code.size()), line });
+		}
+
+		storage.code.push_back({ op, operand });
+
+		return storage.code.size() - 1;
+	}
+
+	// Emits an instruction which uses a local or captured variable, recording it in case the variable is boxed later.
+	void SinglePassCompiler::emitVariable(OpCode op, Variable* variable, uint32_t operand)
+	{
+		size_t pc = emit(op, operand);
+
+		if (!variable->boxed) {
+			uses.push_back(Use{ variable, functions.back().function, static_cast<uint32_t>(pc), false });
+		}
+	}
+
+	void SinglePassCompiler::emitConstant(Value value)
+	{
+		auto& constants = functions.back().function->storage.constants;
+
+		for (size_t i = 0; i < constants.size(); ++i) {
+			if (constants[i].type == value.type && constants[i].integer == value.integer) {
+				emit(OpCode::Constant, static_cast<uint32_t>(i));
+				return;
+			}
+		}
+
+		constants.push_back(value);
+		emit(OpCode::Constant, static_cast<uint32_t>(constants.size() - 1));
+	}
+
+	// points a jump at the next instruction to be emitted
+	void SinglePassCompiler::patchJump(size_t jump)
+	{
+		auto& code = functions.back().function->storage.code;
+		code[jump].operand = static_cast<uint32_t>(code.size());
+	}
+
+	// Turns the call which was just emitted into a tail call.
+	void SinglePassCompiler::makeTailCall()
+	{
+		functions.back().function->storage.code.back().op = OpCode::TailCall;
+	}
+
+	void SinglePassCompiler::advance(size_t count)
+	{
+		position = std::min(position + count, tokens->size() - 1);
+	}
+
+	void SinglePassCompiler::expect(Token::Type type) const
+	{
+		if (current()->type != type) {
+			throw Unsupported();
+		}
+	}
+
+	/*
+	* Finds the closing brace of the function literal starting at a token.
+	* @returns the index of the closing brace, or start if the literal is not complete
+	*/
+	size_t SinglePassCompiler::findFunctionEnd(size_t start) const
+	{
+		size_t parameters = start + 1;
+
+		if (at(parameters)->type != Token::Type::LParen) {
+			return start;
+		}
+
+		size_t body = brackets[parameters] + 1;
+
+		if (at(body)->type != Token::Type::LBrace) {
+			return start;
+		}
+
+		return brackets[body];
+	}
+
+	// Whether the statement ending at a token is the last of the block closed by the given token type.
+	bool SinglePassCompiler::isLast(size_t end, Token::Type blockEnd) const
+	{
+		size_t next = end + 1;
+
+		while (at(next)->type == Token::Type::Semicolon) {
+			next += 1;
+		}
+
+		return at(next)->type == blockEnd;
+	}
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "bytecode.h"
+#include "host.h"
+#include "parser.h"
+#include "token.h"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* Compiles tokens straight to bytecode, parsing expressions with the Parser's precedences and resolving names as it
+* goes, so that scripts which are only run once never build an Ast::Program.  The bytecode is the same as the
+* BytecodeCompiler produces for the parsed program.
+*
+* A few things are only known further on in the source.  Whether a statement is the last of its block, which decides
+* whether its value is kept and whether a call in it is a tail call, is found from the position of the closing brace.
+* Whether a variable is boxed is only known once it has been both captured and declared again, so the instructions
+* which use it are recorded and rewritten when that happens.
+*
+* Programs with syntax errors or undefined names are compiled again through the Parser and BytecodeCompiler, so that
+* errors are reported exactly as they would be from the tree.
+*/
+class SinglePassCompiler
+{
+public:
+	using ErrorList = std::vector<std::string>;
+
+	struct Statistics
+	{
+		uint32_t functions = 0;
+		uint32_t instructions = 0;
+
+		// whether the program was parsed into a tree after all, to report its errors
+		bool parsed = false;
+	};
+
+public:
+	SinglePassCompiler();
+	SinglePassCompiler(const Token::Vector& tokens, const Host* host = nullptr);
+
+public:
+	void compile(const Token::Vector& tokens, const Host* host = nullptr);
+	void clear();
+
+	inline std::shared_ptr<const BytecodeProgram> getProgram() const { return program; }
+	inline const Statistics& getStatistics() const { return statistics; }
+	inline const ErrorList& getErrors() const { return errors; }
+
+private:
+	// thrown for anything the tree must be built to report
+	class Unsupported : public std::runtime_error {
+	public:
+		Unsupported() : std::runtime_error("unsupported") {}
+	};
+
+	struct Variable
+	{
+		uint32_t slot = 0;
+		uint32_t declarations = 0;
+
+		// position in the function stack of the function declaring the variable, which is open whenever it is used
+		uint32_t function = 0;
+
+		bool captured = false;
+		bool boxed = false;
+	};
+
+	struct Name
+	{
+		std::string_view name;
+		Variable* variable;
+		uint32_t block;
+	};
+
+	struct FunctionScope
+	{
+		Bytecode::Function* function = nullptr;
+
+		// the variable a let statement is binding this function to, if any
+		Variable* self = nullptr;
+
+		// names declared in the blocks which are open, innermost last
+		std::vector<Name> names;
+		uint32_t block = 0;
+
+		std::vector<std::pair<Variable*, Ast::Capture>> captures;
+		std::vector<uint32_t> boxedSlots;
+		uint32_t slotCount = 0;
+		uint32_t stackDepth = 0;
+	};
+
+	// an instruction or capture which refers to a variable and changes if the variable is boxed
+	struct Use
+	{
+		Variable* variable;
+		Bytecode::Function* function;
+		uint32_t index;
+		bool capture;
+	};
+
+	struct Global
+	{
+		uint32_t index;
+		bool defined;
+	};
+
+private:
+	void compileTokens(const Host* host);
+	void matchBrackets();
+
+	void compileStatements(Token::Type end, bool wantResult, bool tail);
+	void compileStatement(Token::Type end, bool wantResult, bool tail);
+	void compileLetStatement(Token::Type end, bool wantResult);
+	void compileIfStatement(Token::Type end, bool wantResult, bool tail);
+	void compileBlock(bool wantResult, bool tail);
+
+	bool compileExpression(Parser::Precedence precedence);
+	bool compilePrefix();
+	void compileArguments();
+	void compileFunctionLiteral(Variable* self);
+	void compileIdentifier();
+
+	Variable* declare(const Token* identifier, uint32_t& global);
+	uint32_t addCapture(FunctionScope& function, Variable* variable, Ast::Capture capture);
+	void box(Variable* variable);
+	void finishFunction(FunctionScope& scope);
+
+	size_t emit(Bytecode::OpCode op, uint32_t operand = 0);
+	void emitVariable(Bytecode::OpCode op, Variable* variable, uint32_t operand);
+	void emitConstant(Value value);
+	void patchJump(size_t jump);
+	void makeTailCall();
+
+	inline const Token* current() const { return (*tokens)[position].get(); }
+	inline const Token* peek() const { return (*tokens)[position + 1 < tokens->size() ? position + 1 : position].get(); }
+	inline const Token* at(size_t index) const { return (*tokens)[index < tokens->size() ? index : tokens->size() - 1].get(); }
+	void advance(size_t count = 1);
+	void expect(Token::Type type) const;
+	size_t findFunctionEnd(size_t start) const;
+	bool isLast(size_t end, Token::Type blockEnd) const;
+
+private:
+	const Token::Vector* tokens = nullptr;
+	size_t position = 0;
+
+	// the index of the matching bracket of each parenthesis and brace, or zero
+	std::vector<uint32_t> brackets;
+
+	std::vector<FunctionScope> functions;
+	std::deque<Variable> variables;
+	std::vector<Use> uses;
+	std::vector<std::string> hostNames;
+	std::unordered_map<std::string_view, Global> globals;
+
+	// the program being compiled, and the source line of the token being compiled which is recorded in the line table
+	BytecodeProgram* target = nullptr;
+	uint32_t line = 0;
+
+	std::shared_ptr<const BytecodeProgram> program;
+
+	Statistics statistics;
+	ErrorList errors;
+};
+
+}
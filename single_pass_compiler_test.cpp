@@ -0,0 +1,180 @@
+#include "single_pass_compiler.h"
+#include "task.h"
+#include "parser.h"
+#include "lexer.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace Delve::Script;
+
+namespace {
+	// lists everything about a program which affects how it runs, including the frame layouts the disassembly leaves out
+	std::string describe(const BytecodeProgram& program)
+	{
+		std::ostringstream out;
+		out << "globals " << program.getGlobalCount() << '\n' << program.disassemble();
+
+		for (size_t i = 0; i < program.functionCount(); ++i) {
+			const auto* function = program.getFunction(i);
+			out << "function " << i << " boxed";
+
+			for (uint32_t slot : function->boxedSlots) {
+				out << ' ' << slot;
+			}
+
+			out << " captures";
+
+			for (const auto& capture : function->captures) {
+				out << ' ' << static_cast<int>(capture.source) << ':' << capture.index;
+			}
+
+			out << '\n';
+		}
+
+		return out.str();
+	}
+
+	// compiles a script both from its tree and in a single pass, checking that the programs are the same
+	void expectSameProgram(const std::string& code, const Host* host = nullptr)
+	{
+		Lexer lexer(code);
+		Parser parser(lexer.tokens());
+		BytecodeCompiler treeCompiler(parser.getProgram(), host);
+		SinglePassCompiler compiler(lexer.tokens(), host);
+
+		ASSERT_NE(treeCompiler.getProgram(), nullptr) << code;
+		ASSERT_NE(compiler.getProgram(), nullptr) << code;
+		EXPECT_FALSE(compiler.getStatistics().parsed) << code;
+		EXPECT_EQ(describe(*compiler.getProgram()), describe(*treeCompiler.getProgram())) << code;
+
+		Task treeTask(treeCompiler.getProgram());
+		Task task(compiler.getProgram());
+		EXPECT_EQ(task.runToCompletion().toString(), treeTask.runToCompletion().toString()) << code;
+		EXPECT_EQ(task.getErrors(), treeTask.getErrors()) << code;
+	}
+}
+
+TEST(SinglePassCompiler, MatchesTreeCompiler)
+{
+	std::vector<std::string> scripts = {
+		"1;",
+		"",
+		"let x = 5; let y = 7; x * y;",
+		"let x = 1;",
+		"-5 + !true; (1 + 2) * 3 - 4 / 2 < 10 == true != false;",
+		"let fib = function(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2); };\nfib(15);",
+		"let sum = function(n, total) { if (n == 0) { return total; } return sum(n - 1, total + n); }; sum(100000, 0);",
+		"let count = function(n) { if (n == 0) { return 0; } 1 + count(n - 1); }; count(100);",
+		"let f = function(x) { if (x > 1) { 1; } else { 2; }; }; f(3) + f(0);",
+		"let f = function(x) { if (x > 1) { 1; } }; f(0);",
+		"if (true) { 5; } else { 6; }",
+		"{ let a = 1; { let a = 2; a; }; a; }",
+		"let f = function() { }; f();",
+		"let f = function(a, b) { a; b; }; f(1, 2);",
+		";; 1;; 2;;",
+
+		// closures, capturing through several functions and capturing themselves
+		"let adder = function(x) { function(y) { x + y; }; }; let add2 = adder(2); add2(3);",
+		"let f = function(a) { function(b) { function(c) { a + b + c; }; }; }; f(1)(2)(3);",
+		"let f = function(n) { let g = function(m) { if (m == 0) { return 0; } g(m - 1) + n; }; g(3); }; f(4);",
+		"let f = function() { let g = function() { g; }; let g = 3; g; }; f();",
+
+		// captured variables which are declared again are shared through a box
+		"let f = function() { let x = 1; let g = function() { x; }; let x = 2; g(); }; f();",
+		"let f = function() { let x = 1; let x = 2; let g = function() { x; }; g(); }; f();",
+		"let f = function() { let x = 1; let g = function() { function() { x; }; }; let x = 5; g()(); }; f();",
+		"{ let x = 1; let g = function() { x; }; let x = 2; g(); }",
+
+		// names resolved across the top level before they are declared, and shadowing
+		"let isEven = function(n) { if (n == 0) { return true; } isOdd(n - 1); }; let isOdd = function(n) { if (n == 0) { return false; } isEven(n - 1); }; isEven(10);",
+		"let x = 1; let f = function(x) { let x = x + 1; x; }; f(5) + x;",
+		"let x = 1; let x = x + 1; x;",
+		"let f = function(x) { x; }(3);\nf;",
+		"let f = (function(x) { x * 2; })(4); f;",
+		"let f = function() { return 1; 2; }; f();",
+
+		// errors at runtime are the same
+		"let f = 1; f(2);",
+		"1 / 0;"
+	};
+
+	for (const auto& script : scripts) {
+		expectSameProgram(script);
+	}
+}
+
+TEST(SinglePassCompiler, HostFunctions)
+{
+	Host host;
+	host.bind("double", [](int64_t x) { return x * 2; });
+	host.bind("answer", []() { return int64_t(42); });
+
+	expectSameProgram("double(answer());", &host);
+	expectSameProgram("let f = function(x) { double(x); }; f(4);", &host);
+	expectSameProgram("let answer = 1; answer + double(3);", &host);
+}
+
+/*
+* Tests that programs which do not compile are compiled again from their tree, giving the errors the Parser and
+* BytecodeCompiler give.
+*/
+TEST(SinglePassCompiler, ReportsTreeErrors)
+{
+	std::vector<std::string> scripts = {
+		"let x = 5;\nlet f = function(a) { a + b; };\nc;",
+		"let = 5;",
+		"let x 5;",
+		"let x = 5",
+		"return;",
+		"(1 + 2;",
+		"let f = function(a b) { a; };",
+		"if x { 1; }"
+	};
+
+	for (const auto& script : scripts) {
+		Lexer lexer(script);
+		Parser parser(lexer.tokens());
+		BytecodeCompiler treeCompiler(parser.getProgram());
+
+		SinglePassCompiler compiler(lexer.tokens());
+		EXPECT_TRUE(compiler.getStatistics().parsed) << script;
+
+		EXPECT_EQ(compiler.getProgram(), nullptr) << script;
+
+		if (parser.getErrors().empty()) {
+			EXPECT_EQ(compiler.getErrors(), treeCompiler.getErrors()) << script;
+		}
+		else {
+			EXPECT_EQ(compiler.getErrors(), parser.getErrors()) << script;
+		}
+	}
+
+	// the Parser accepts blocks which are still open at the end of the source, so these are compiled from the tree
+	Lexer unterminated("if (true) { 1; ");
+	SinglePassCompiler fallback(unterminated.tokens());
+	EXPECT_TRUE(fallback.getStatistics().parsed);
+	ASSERT_NE(fallback.getProgram(), nullptr);
+	EXPECT_EQ(Task(fallback.getProgram()).runToCompletion().toString(), "1");
+
+	SinglePassCompiler compiler(Lexer("let x = 5;\nlet f = function(a) { a + b; };\nc;").tokens());
+	EXPECT_EQ(compiler.getErrors(), std::vector<std::string>({ "Undefined identifier b at 2, 27.", "Undefined identifier c at 3, 1." }));
+}
+
+TEST(SinglePassCompiler, Statistics)
+{
+	Lexer lexer("let f = function(x) { x + 1; }; f(1);");
+	SinglePassCompiler compiler(lexer.tokens());
+
+	ASSERT_NE(compiler.getProgram(), nullptr);
+	EXPECT_EQ(compiler.getStatistics().functions, 2);
+	EXPECT_EQ(compiler.getStatistics().instructions, 10);
+	EXPECT_FALSE(compiler.getStatistics().parsed);
+
+	compiler.clear();
+	EXPECT_EQ(compiler.getProgram(), nullptr);
+	EXPECT_EQ(compiler.getStatistics().functions, 0);
+}
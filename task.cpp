@@ -0,0 +1,585 @@
+#include "task.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace Delve::Script {
+
+	using Bytecode::OpCode;
+
+	namespace {
+		inline Value& unbox(const Value& value)
+		{
+			return static_cast<Box*>(value.object)->value;
+		}
+
+		void argumentCountMismatch(size_t parameterCount, size_t argumentCount)
+		{
+			std::ostringstream error;
+			error << "Expected " << parameterCount << " arguments but got " << argumentCount << '.';
+			throw RuntimeError(error.str());
+		}
+
+		// values reserved for the first frame, the stack grows as calls need it
+		constexpr size_t initialStackSize = 256;
+	}
+
+	void Task::HostCall::complete(const Value& value, const std::string& message)
+	{
+		Waker wake;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (done) {
+				return;
+			}
+
+			done = true;
+			result = value;
+			error = message;
+
+			if (suspended) {
+				wake = waker;
+			}
+		}
+
+		condition.notify_all();
+
+		if (wake) {
+			wake();
+		}
+	}
+
+	Task::Task(std::shared_ptr<const BytecodeProgram> p) : program(std::move(p))
+	{
+	}
+
+	/**
+	* Runs the task until it completes, fails, calls an asynchronous host function or uses up its slice.  The first call
+	* starts the program with the limits set by setLimits.  Resuming a suspended task whose host call has not completed
+	* yet does nothing.
+	* @param sliceTicks the number of ticks to run for before yielding, zero to run until the task completes or suspends
+	* @returns the status of the task.  If the task was suspended it may have been resumed by another thread by the time
+	* this returns, so the caller must not use the task any further unless it is the one to be woken
+	*/
+	Task::Status Task::resume(uint64_t sliceTicks)
+	{
+		DELVE_SCRIPT_TRACE("run bytecode", "execute");
+
+		if (status == Status::Completed || status == Status::Failed) {
+			return status;
+		}
+
+		try {
+			if (!started) {
+				start();
+			}
+
+			if (status == Status::Suspended) {
+				std::lock_guard<std::mutex> lock(pendingCall->mutex);
+
+				if (!pendingCall->done) {
+					return Status::Suspended;
+				}
+
+				pendingCall->suspended = false;
+			}
+
+			budget.startSlice(sliceTicks);
+
+			if (pendingCall) {
+				finishHostCall();
+			}
+
+			status = Status::Ready;
+
+			// nothing may touch the task once it has suspended, since it may already have been resumed elsewhere
+			Status next = execute();
+
+			if (next != Status::Suspended) {
+				status = next;
+			}
+
+			return next;
+		}
+		catch (const RuntimeError& error) {
+			errors.push_back(error.what());
+			status = Status::Failed;
+			result = Value();
+		}
+
+		return status;
+	}
+
+	/**
+	* Runs the task until it completes or fails, blocking the calling thread while it waits for asynchronous host functions.
+	* The returned value remains valid until the task is reset.
+	* @returns the result of the program, or null if it failed, in which case the reasons are available through getErrors()
+	*/
+	Value Task::runToCompletion()
+	{
+		Status next = resume();
+
+		while (next == Status::Ready || next == Status::Suspended) {
+			if (next == Status::Suspended) {
+				wait();
+			}
+
+			next = resume();
+		}
+
+		return result;
+	}
+
+	/**
+	* Blocks the calling thread until the host call the task is suspended at completes.  Returns immediately if the task
+	* is not suspended.
+	*/
+	void Task::wait()
+	{
+		if (status != Status::Suspended || !pendingCall) {
+			return;
+		}
+
+		auto call = pendingCall;
+		std::unique_lock<std::mutex> lock(call->mutex);
+		call->condition.wait(lock, [&call]() { return call->done; });
+	}
+
+	/**
+	* Discards all state so that the next resume runs the program from the beginning.  If the task is suspended the host
+	* call it is waiting for is abandoned and will not wake it.  Any value referencing the task's heap is invalid after
+	* this call.
+	*/
+	void Task::reset()
+	{
+		if (pendingCall) {
+			std::lock_guard<std::mutex> lock(pendingCall->mutex);
+			pendingCall->suspended = false;
+			pendingCall->waker = nullptr;
+		}
+
+		pendingCall.reset();
+		heap.clear();
+		globals.clear();
+		frames.clear();
+		stackTop = 0;
+		errors.clear();
+		result = Value();
+		status = Status::Ready;
+		started = false;
+	}
+
+	void Task::start()
+	{
+		started = true;
+
+		heap.setRootMarker([this](Heap& heap) { markRoots(heap); });
+		globals.assign(program->getGlobalCount(), Value());
+
+		const Host* host = program->getHost();
+
+		for (size_t i = 0; host && i < host->functionCount(); ++i) {
+			globals[i] = Value::fromHostFunction(host->getFunction(i));
+		}
+
+		// the main frame has no callee, but keeps the same layout as every other frame
+		stack.resize(std::max(stack.size(), initialStackSize));
+		stack[0] = Value();
+		stackTop = 1;
+
+		budget.start(limits);
+
+		frames.push_back({ program->getMain(), nullptr, 0, 0 });
+		enterFunction(0, 0);
+	}
+
+	/*
+	* The interpreter loop.  The running frame's instruction pointer, slots and operand stack pointer are kept in locals
+	* and written back to the task whenever something else may need them: before allocating, calling and suspending.
+	*/
+	Task::Status Task::execute()
+	{
+		CallFrame* frame;
+		const Bytecode::Instruction* code;
+		const Bytecode::Instruction* ip;
+		const Value* constants;
+		Value* slots;
+		Value* sp;
+
+		auto load = [&]() {
+			frame = &frames.back();
+			code = frame->function->code.data();
+			ip = code + frame->pc;
+			constants = frame->function->constants.data();
+			slots = stack.data() + frame->base + 1;
+			sp = stack.data() + stackTop;
+		};
+
+		auto save = [&]() {
+			frame->pc = ip - code;
+			stackTop = sp - stack.data();
+		};
+
+		load();
+
+		for (;;) {
+			const auto& instruction = *ip++;
+
+			switch (instruction.op) {
+			case OpCode::Constant:
+				*sp++ = constants[instruction.operand];
+				break;
+
+			case OpCode::Null:
+				*sp++ = Value();
+				break;
+
+			case OpCode::GetGlobal:
+				*sp++ = globals[instruction.operand];
+				break;
+
+			case OpCode::SetGlobal:
+				globals[instruction.operand] = *--sp;
+				break;
+
+			case OpCode::GetLocal:
+				*sp++ = slots[instruction.operand];
+				break;
+
+			case OpCode::SetLocal:
+				slots[instruction.operand] = *--sp;
+				break;
+
+			case OpCode::GetLocalBoxed:
+				*sp++ = unbox(slots[instruction.operand]);
+				break;
+
+			case OpCode::SetLocalBoxed:
+				unbox(slots[instruction.operand]) = *--sp;
+				break;
+
+			case OpCode::GetCapture:
+				*sp++ = frame->closure->captures[instruction.operand];
+				break;
+
+			case OpCode::GetCaptureBoxed:
+				*sp++ = unbox(frame->closure->captures[instruction.operand]);
+				break;
+
+			case OpCode::Negate:
+				sp[-1] = Operators::negate(sp[-1]);
+				break;
+
+			case OpCode::Minus:
+				sp[-1] = Operators::minus(sp[-1]);
+				break;
+
+			case OpCode::Add:
+				sp[-2] = Operators::add(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::Subtract:
+				sp[-2] = Operators::subtract(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::Multiply:
+				sp[-2] = Operators::multiply(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::Divide:
+				sp[-2] = Operators::divide(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::LessThan:
+				sp[-2] = Operators::lessThan(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::GreaterThan:
+				sp[-2] = Operators::greaterThan(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::Equal:
+				sp[-2] = Operators::equal(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::NotEqual:
+				sp[-2] = Operators::notEqual(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::AddIntegers:
+				sp[-2] = Operators::addIntegers(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::SubtractIntegers:
+				sp[-2] = Operators::subtractIntegers(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::MultiplyIntegers:
+				sp[-2] = Operators::multiplyIntegers(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::DivideIntegers:
+				sp[-2] = Operators::divideIntegers(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::LessThanIntegers:
+				sp[-2] = Operators::lessThanIntegers(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::GreaterThanIntegers:
+				sp[-2] = Operators::greaterThanIntegers(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::EqualIntegers:
+				sp[-2] = Operators::equalIntegers(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::NotEqualIntegers:
+				sp[-2] = Operators::notEqualIntegers(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::EqualBooleans:
+				sp[-2] = Operators::equalBooleans(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::NotEqualBooleans:
+				sp[-2] = Operators::notEqualBooleans(sp[-2], sp[-1]);
+				--sp;
+				break;
+
+			case OpCode::Jump:
+				ip = code + instruction.operand;
+				break;
+
+			case OpCode::JumpIfFalse:
+				if (!(--sp)->isTruthy()) {
+					ip = code + instruction.operand;
+				}
+
+				if (budget.tick()) {
+					save();
+					return Status::Ready;
+				}
+
+				break;
+
+			case OpCode::Pop:
+				--sp;
+				break;
+
+			case OpCode::Closure: {
+				const auto* function = program->getFunction(instruction.operand);
+
+				save();
+				auto* closure = heap.allocate<Bytecode::Closure>(function);
+				closure->captures.reserve(function->captures.size());
+
+				for (const auto& capture : function->captures) {
+					switch (capture.source) {
+					case Ast::Capture::Source::Local:
+						closure->captures.push_back(slots[capture.index]);
+						break;
+					case Ast::Capture::Source::Capture:
+						closure->captures.push_back(frame->closure->captures[capture.index]);
+						break;
+					case Ast::Capture::Source::Self:
+						closure->captures.push_back(Value::fromFunction(closure));
+						break;
+					}
+				}
+
+				*sp++ = Value::fromFunction(closure);
+				break;
+			}
+
+			case OpCode::Call:
+			case OpCode::TailCall: {
+				size_t argumentCount = instruction.operand;
+				Value* callee = sp - argumentCount - 1;
+				size_t base = callee - stack.data();
+
+				if (callee->type == Value::Type::HostFunction) {
+					const auto* function = callee->host;
+					function->checkArgumentCount(argumentCount);
+
+					// host functions do not use the script's stack, so a tail call is made as a normal call and the return
+					// which follows it returns the result
+					if (!function->isAsync()) {
+						Value value = function->call(callee + 1);
+						sp = callee;
+						*sp++ = value;
+						break;
+					}
+
+					save();
+
+					if (!startHostCall(function, base, argumentCount)) {
+						return Status::Suspended;
+					}
+
+					load();
+					break;
+				}
+
+				if (callee->type != Value::Type::Function) {
+					throw RuntimeError("Attempted to call a value of type " + Value::getTypeName(callee->type) + '.');
+				}
+
+				const auto* closure = static_cast<const Bytecode::Closure*>(callee->object);
+
+				if (closure->function->parameterCount != argumentCount) {
+					argumentCountMismatch(closure->function->parameterCount, argumentCount);
+				}
+
+				save();
+
+				if (instruction.op == OpCode::TailCall) {
+					// the callee and arguments replace the current frame
+					std::copy(callee, sp, stack.data() + frame->base);
+					base = frame->base;
+					frames.pop_back();
+				}
+				else if (frames.size() > maxCallDepth) {
+					throw RuntimeError("Maximum call depth exceeded.");
+				}
+
+				frames.push_back({ closure->function, closure, 0, base });
+				enterFunction(base, argumentCount);
+				load();
+
+				if (budget.tick()) {
+					save();
+					return Status::Ready;
+				}
+
+				break;
+			}
+
+			case OpCode::Return: {
+				Value value = sp[-1];
+				size_t base = frame->base;
+				frames.pop_back();
+
+				if (frames.empty()) {
+					result = value;
+					stackTop = 0;
+					return Status::Completed;
+				}
+
+				stack[base] = value;
+				stackTop = base + 1;
+				load();
+				break;
+			}
+			}
+		}
+	}
+
+	/*
+	* Pushes the result of a completed asynchronous host call, or fails the task if the call was rejected.
+	*/
+	void Task::finishHostCall()
+	{
+		auto call = std::move(pendingCall);
+
+		if (!call->error.empty()) {
+			throw RuntimeError(call->error);
+		}
+
+		stack[stackTop++] = call->result;
+	}
+
+	// makes sure the stack has room for a frame of the given function starting at base
+	void Task::reserveStack(size_t base, const Bytecode::Function* function)
+	{
+		size_t needed = base + 1 + function->slotCount + function->maxStack;
+
+		if (stack.size() < needed) {
+			stack.resize(std::max(needed, stack.size() * 2));
+		}
+	}
+
+	/*
+	* Sets up the slots of the frame on top of the frame stack, whose callee and arguments are already in place.
+	*/
+	void Task::enterFunction(size_t base, size_t argumentCount)
+	{
+		const auto* function = frames.back().function;
+		reserveStack(base, function);
+
+		Value* slots = stack.data() + base + 1;
+		std::fill(slots + argumentCount, slots + function->slotCount, Value());
+		stackTop = base + 1 + function->slotCount;
+
+		// boxes the slots of captured variables which are declared more than once
+		for (uint32_t slot : function->boxedSlots) {
+			slots[slot] = Value::fromBox(heap.allocate<Box>(slots[slot]));
+		}
+	}
+
+	/*
+	* Starts a call to an asynchronous host function whose callee and arguments are on top of the stack at base.
+	* @returns true if the function completed immediately, in which case its result has been pushed.  Otherwise the task is
+	* now suspended and may be resumed by another thread at any time.
+	*/
+	bool Task::startHostCall(const HostFunction* function, size_t base, size_t argumentCount)
+	{
+		auto call = std::make_shared<HostCall>();
+		call->waker = waker;
+
+		std::vector<Value> arguments(stack.begin() + base + 1, stack.begin() + base + 1 + argumentCount);
+		stackTop = base;
+		pendingCall = call;
+		status = Status::Suspended;
+
+		function->asyncCallback(std::move(arguments), HostCompletion([call](const Value& value, const std::string& error) {
+			call->complete(value, error);
+		}));
+
+		{
+			std::lock_guard<std::mutex> lock(call->mutex);
+
+			if (!call->done) {
+				call->suspended = true;
+				return false;
+			}
+		}
+
+		status = Status::Ready;
+		finishHostCall();
+
+		return true;
+	}
+
+	// the globals and everything on the stack are the roots of the heap
+	void Task::markRoots(Heap& heap)
+	{
+		for (const auto& value : globals) {
+			heap.mark(value);
+		}
+
+		for (size_t i = 0; i < stackTop; ++i) {
+			heap.mark(stack[i]);
+		}
+	}
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "budget.h"
+#include "bytecode.h"
+#include "heap.h"
+#include "host.h"
+#include "value.h"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* One run of a BytecodeProgram.  A task owns everything which changes while the program runs: its heap, globals, value
+* stack and call frames.  Because none of that lives on the native stack a task can stop between any two instructions
+* and be resumed later from any thread, which it does when it calls an asynchronous host function or uses up the
+* slice of ticks it was resumed with.
+*
+* Only one thread may resume a task at a time.  Host completions may arrive on any thread; when a suspended task's
+* host call completes, its waker is called so that whoever is scheduling the task can resume it.
+*/
+class Task
+{
+public:
+	using ErrorList = std::vector<std::string>;
+	using Waker = std::function<void()>;
+
+	enum class Status
+	{
+		// the task can be resumed, either because it has not started yet or because it used up its slice
+		Ready,
+
+		// the task is waiting for an asynchronous host function to complete
+		Suspended,
+
+		Completed,
+		Failed
+	};
+
+public:
+	Task(std::shared_ptr<const BytecodeProgram> program);
+
+public:
+	Status resume(uint64_t sliceTicks = 0);
+	Value runToCompletion();
+	void wait();
+	void reset();
+
+	inline void setWaker(Waker taskWaker) { waker = std::move(taskWaker); }
+	inline void setLimits(const ExecutionLimits& executionLimits) { limits = executionLimits; }
+	inline const ExecutionLimits& getLimits() const { return limits; }
+
+	inline Status getStatus() const { return status; }
+	inline const Value& getResult() const { return result; }
+	inline uint64_t getFuelUsed() const { return budget.used(); }
+	inline const BytecodeProgram& getProgram() const { return *program; }
+
+	inline Heap& getHeap() { return heap; }
+	inline const ErrorList& getErrors() const { return errors; }
+
+	static constexpr uint32_t maxCallDepth = 4096;
+
+private:
+	struct CallFrame
+	{
+		const Bytecode::Function* function;
+		const Bytecode::Closure* closure;
+
+		// index of the next instruction, only up to date while the frame is not the one running
+		size_t pc;
+
+		// index of the callee in the value stack, the frame's slots follow it
+		size_t base;
+	};
+
+	// An asynchronous host function call which has not yet completed.  Shared with the completion handed to the host.
+	struct HostCall
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool done = false;
+		bool suspended = false;
+		Value result;
+		std::string error;
+		Waker waker;
+
+		void complete(const Value& value, const std::string& message);
+	};
+
+private:
+	void start();
+	Status execute();
+	void finishHostCall();
+
+	void reserveStack(size_t base, const Bytecode::Function* function);
+	void enterFunction(size_t base, size_t argumentCount);
+	bool startHostCall(const HostFunction* function, size_t base, size_t argumentCount);
+	void markRoots(Heap& heap);
+
+private:
+	std::shared_ptr<const BytecodeProgram> program;
+
+	Heap heap;
+	std::vector<Value> globals;
+	std::vector<Value> stack;
+	size_t stackTop = 0;
+	std::vector<CallFrame> frames;
+	std::shared_ptr<HostCall> pendingCall;
+
+	Status status = Status::Ready;
+	bool started = false;
+	Value result;
+
+	Waker waker;
+	ExecutionLimits limits;
+	Budget budget;
+	ErrorList errors;
+};
+
+}
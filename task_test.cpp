@@ -0,0 +1,223 @@
+#include "task.h"
+#include "parser.h"
+#include "lexer.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Delve::Script;
+
+namespace {
+	// compiles a script to bytecode, returning null if it did not compile
+	std::shared_ptr<const BytecodeProgram> compile(const std::string& code, const Host* host = nullptr)
+	{
+		Lexer lexer(code);
+		Parser parser(lexer.tokens());
+		BytecodeCompiler compiler(parser.getProgram(), host);
+
+		return compiler.getProgram();
+	}
+}
+
+TEST(Task, EmptyProgram)
+{
+	BytecodeCompiler compiler;
+	compiler.compile(nullptr);
+
+	ASSERT_EQ(compiler.getProgram(), nullptr);
+	ASSERT_EQ(compiler.getErrors().size(), 0);
+}
+
+TEST(Task, BasicProgram)
+{
+	auto program = compile("let x = 5; let y = 7; x * y;");
+	ASSERT_NE(program, nullptr);
+
+	Task task(program);
+	Value result = task.runToCompletion();
+
+	EXPECT_EQ(task.getStatus(), Task::Status::Completed);
+	ASSERT_EQ(result.type, Value::Type::Integer);
+	EXPECT_EQ(result.integer, 35);
+}
+
+/*
+* Tests that compile errors are reported the same way as by the closure compiler.
+*/
+TEST(Task, CompileErrors)
+{
+	std::string code = "let x = 5;\nlet f = function(a) { a + b; };\nc;";
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+	BytecodeCompiler compiler(parser.getProgram());
+
+	ASSERT_EQ(compiler.getProgram(), nullptr);
+
+	const auto& errors = compiler.getErrors();
+	ASSERT_EQ(errors.size(), 2);
+	EXPECT_EQ(errors[0], "Undefined identifier b at 2, 27.");
+	EXPECT_EQ(errors[1], "Undefined identifier c at 3, 1.");
+}
+
+/*
+* Tests that tail calls replace the caller's frame, so tail recursion is not limited by the call depth.
+*/
+TEST(Task, TailCalls)
+{
+	auto program = compile("let sum = function(n, total) { if (n == 0) { return total; } return sum(n - 1, total + n); }; sum(10000000, 0);");
+	ASSERT_NE(program, nullptr);
+
+	Task task(program);
+	EXPECT_EQ(task.runToCompletion().toString(), "50000005000000");
+
+	program = compile("let count = function(n) { if (n == 0) { return 0; } 1 + count(n - 1); }; count(10000);");
+	Task deepTask(program);
+	deepTask.runToCompletion();
+
+	EXPECT_EQ(deepTask.getStatus(), Task::Status::Failed);
+	ASSERT_EQ(deepTask.getErrors().size(), 1);
+	EXPECT_EQ(deepTask.getErrors()[0], "Maximum call depth exceeded.");
+}
+
+/*
+* Tests that a task given a slice of ticks yields once it has used them, and picks up where it left off.
+*/
+TEST(Task, Slices)
+{
+	auto program = compile("let count = function(n) { if (n == 0) { return 0; } 1 + count(n - 1); }; count(1000);");
+	ASSERT_NE(program, nullptr);
+
+	Task task(program);
+	size_t slices = 1;
+
+	while (task.resume(100) == Task::Status::Ready) {
+		slices += 1;
+	}
+
+	ASSERT_EQ(task.getStatus(), Task::Status::Completed);
+	EXPECT_EQ(task.getResult().integer, 1000);
+
+	// each call is a function entry and a branch
+	EXPECT_EQ(task.getFuelUsed(), 2002);
+	EXPECT_EQ(slices, 21);
+}
+
+/*
+* Tests that runs are metered the same way as the closure engine and stopped once they try to use more fuel than they
+* were given.
+*/
+TEST(Task, FuelLimit)
+{
+	auto program = compile("let count = function(n) { if (n == 0) { return 0; } count(n - 1); }; count(10);");
+	ASSERT_NE(program, nullptr);
+
+	Task task(program);
+	task.runToCompletion();
+	EXPECT_EQ(task.getFuelUsed(), 22);
+
+	ExecutionLimits limits;
+	limits.fuel = 21;
+	task.reset();
+	task.setLimits(limits);
+	Value result = task.runToCompletion();
+
+	EXPECT_EQ(result.type, Value::Type::Null);
+	ASSERT_EQ(task.getErrors().size(), 1);
+	EXPECT_EQ(task.getErrors()[0], "Fuel exhausted.");
+
+	// slices do not change how much fuel a run may use
+	limits.fuel = 22;
+	task.reset();
+	task.setLimits(limits);
+
+	while (task.resume(3) == Task::Status::Ready) {
+	}
+
+	EXPECT_EQ(task.getStatus(), Task::Status::Completed);
+	EXPECT_EQ(task.getFuelUsed(), 22);
+}
+
+/*
+* Tests that a task suspends at an asynchronous host call which has not completed, wakes when it completes, and
+* carries on with its result.
+*/
+TEST(Task, Suspension)
+{
+	std::vector<HostCompletion> pending;
+
+	Host host;
+	host.defineAsync("lookup", 1, [&pending](std::vector<Value> arguments, HostCompletion completion) {
+		pending.push_back(completion);
+	});
+	host.defineAsync("now", 0, [](std::vector<Value>, HostCompletion completion) {
+		completion.resolve(Value::fromInteger(42));
+	});
+
+	auto program = compile("let f = function(x) { let y = lookup(x); y * 2 + now(); }; f(1) + f(2);", &host);
+	ASSERT_NE(program, nullptr);
+
+	int wakes = 0;
+	Task task(program);
+	task.setWaker([&wakes]() { wakes += 1; });
+
+	ASSERT_EQ(task.resume(), Task::Status::Suspended);
+	ASSERT_EQ(pending.size(), 1);
+
+	// resuming before the call completes does nothing
+	EXPECT_EQ(task.resume(), Task::Status::Suspended);
+	EXPECT_EQ(wakes, 0);
+
+	std::thread([&pending]() { pending[0].resolve(Value::fromInteger(10)); }).join();
+	EXPECT_EQ(wakes, 1);
+
+	// calls which complete straight away do not suspend
+	ASSERT_EQ(task.resume(), Task::Status::Suspended);
+	ASSERT_EQ(pending.size(), 2);
+
+	pending[1].resolve(Value::fromInteger(20));
+	EXPECT_EQ(wakes, 2);
+
+	ASSERT_EQ(task.resume(), Task::Status::Completed);
+	EXPECT_EQ(task.getResult().integer, 20 + 42 + 40 + 42);
+
+	// a rejected call fails the task
+	task.reset();
+	ASSERT_EQ(task.resume(), Task::Status::Suspended);
+	pending[2].reject("Not found.");
+
+	EXPECT_EQ(task.resume(), Task::Status::Failed);
+	ASSERT_EQ(task.getErrors().size(), 1);
+	EXPECT_EQ(task.getErrors()[0], "Not found.");
+}
+
+/*
+* Tests that the collector can run while a task is suspended part way through a call.
+*/
+TEST(Task, Collection)
+{
+	Host host;
+	host.defineAsync("identity", 1, [](std::vector<Value> arguments, HostCompletion completion) {
+		std::thread([value = arguments[0], completion]() { completion.resolve(value); }).detach();
+	});
+
+	auto program = compile(
+		"let adder = function(x) { function(y) { x + y; }; };"
+		"let churn = function(n) { if (n < 2) { return adder(n)(1); } let f = adder(identity(n)); churn(n - 1) + churn(n - 2) + f(0) - n; };"
+		"churn(12);", &host);
+	ASSERT_NE(program, nullptr);
+
+	Heap::Settings settings;
+	settings.initialThreshold = 1024;
+
+	Task task(program);
+	task.getHeap().configure(settings);
+	Value result = task.runToCompletion();
+
+	ASSERT_EQ(task.getErrors().size(), 0);
+	EXPECT_EQ(result.integer, 377);
+	EXPECT_GT(task.getHeap().getStatistics().collections, 0);
+}
@@ -0,0 +1,180 @@
+#include "trace.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace Delve::Script {
+
+	namespace {
+		// writes nanoseconds as the fractional microseconds trace events are measured in
+		void writeMicroseconds(std::ostream& out, int64_t nanoseconds)
+		{
+			char buffer[32];
+			std::snprintf(buffer, sizeof(buffer), "%lld.%03lld", static_cast<long long>(nanoseconds / 1000), static_cast<long long>(nanoseconds % 1000));
+			out << buffer;
+		}
+
+		void writeString(std::ostream& out, const std::string& text)
+		{
+			out << '"';
+
+			for (char c : text) {
+				if (c == '"' || c == '\\') {
+					out << '\\' << c;
+				}
+				else if (static_cast<unsigned char>(c) < 0x20) {
+					char escaped[8];
+					std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					out << escaped;
+				}
+				else {
+					out << c;
+				}
+			}
+
+			out << '"';
+		}
+	}
+
+	std::atomic<TraceRecorder*> TraceRecorder::active{ nullptr };
+
+	TraceRecorder::Span::Span(const char* n, const char* c, uint32_t l, std::string d)
+		: recorder(TraceRecorder::getActive()), name(n), category(c), line(l)
+	{
+		if (recorder) {
+			detail = std::move(d);
+			start = std::chrono::steady_clock::now();
+		}
+	}
+
+	TraceRecorder::Span::~Span()
+	{
+		if (recorder) {
+			recorder->record(name, category, start, std::chrono::steady_clock::now(), line, std::move(detail));
+		}
+	}
+
+	TraceRecorder::TraceRecorder()
+		: origin(std::chrono::steady_clock::now())
+	{
+	}
+
+	TraceRecorder::~TraceRecorder()
+	{
+		TraceRecorder* self = this;
+		active.compare_exchange_strong(self, nullptr);
+	}
+
+	/**
+	* Makes a recorder the one spans are recorded to.  Spans which started before keep going to the recorder which was
+	* active when they started.
+	* @param recorder the recorder to activate, or null to stop recording
+	*/
+	void TraceRecorder::setActive(TraceRecorder* recorder)
+	{
+		active.store(recorder, std::memory_order_release);
+	}
+
+	/**
+	* Adds a span which finished on the calling thread.
+	* @param name what the span measured, which must outlive the recorder
+	* @param category the group of phases the span belongs to, which must outlive the recorder
+	* @param line the source line the span is for, or zero
+	* @param detail anything else which tells spans with the same name apart
+	*/
+	void TraceRecorder::record(const char* name, const char* category, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end, uint32_t line, std::string detail)
+	{
+		Event event;
+		event.name = name;
+		event.category = category;
+		event.start = std::chrono::duration_cast<std::chrono::nanoseconds>(start - origin).count();
+		event.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+		event.line = line;
+		event.detail = std::move(detail);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		auto thread = threads.try_emplace(std::this_thread::get_id(), static_cast<uint32_t>(threads.size() + 1));
+		event.thread = thread.first->second;
+		events.push_back(std::move(event));
+	}
+
+	// Forgets every span recorded so far.
+	void TraceRecorder::clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		events.clear();
+		threads.clear();
+	}
+
+	std::vector<TraceRecorder::Event> TraceRecorder::getEvents() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return events;
+	}
+
+	size_t TraceRecorder::getEventCount() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return events.size();
+	}
+
+	/**
+	* Formats the spans recorded so far in the Chrome trace event format, as complete events in the order they finished.
+	* @returns a JSON object with the events in its traceEvents array
+	*/
+	std::string TraceRecorder::toJson() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::ostringstream out;
+
+		out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+		for (size_t i = 0; i < events.size(); ++i) {
+			const Event& event = events[i];
+
+			out << (i > 0 ? ",\n" : "\n") << "{\"name\":";
+			writeString(out, event.name);
+			out << ",\"cat\":";
+			writeString(out, event.category);
+			out << ",\"ph\":\"X\",\"ts\":";
+			writeMicroseconds(out, event.start);
+			out << ",\"dur\":";
+			writeMicroseconds(out, event.duration);
+			out << ",\"pid\":1,\"tid\":" << event.thread;
+
+			if (event.line || !event.detail.empty()) {
+				out << ",\"args\":{";
+
+				if (event.line) {
+					out << "\"line\":" << event.line << (event.detail.empty() ? "" : ",");
+				}
+
+				if (!event.detail.empty()) {
+					out << "\"detail\":";
+					writeString(out, event.detail);
+				}
+
+				out << '}';
+			}
+
+			out << '}';
+		}
+
+		out << "\n]}\n";
+		return out.str();
+	}
+
+	/**
+	* Writes the spans recorded so far to a file which Perfetto or chrome://tracing can open.
+	* @param path the file to write
+	* @returns true if the file was written
+	*/
+	bool TraceRecorder::write(const std::string& path) const
+	{
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		out << toJson();
+
+		return static_cast<bool>(out);
+	}
+}
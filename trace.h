@@ -0,0 +1,111 @@
+#pragma once
+
+#include "instrumentation.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* Records spans of time spent in each phase of the pipeline, from tokenizing to running, as Chrome trace events which
+* Perfetto or chrome://tracing can show.  Spans are only recorded while a recorder is active, and each is tagged with
+* the thread it ran on so that work done concurrently shows on separate tracks.
+*
+* Only one recorder is active at a time.  It must stay alive until it has been deactivated and every span started
+* while it was active has finished.  Spans may finish on any number of threads at once.
+*/
+class TraceRecorder
+{
+public:
+	struct Event
+	{
+		// names and categories are string literals, so recording a span copies nothing
+		const char* name;
+		const char* category;
+
+		// nanoseconds since the recorder was created
+		int64_t start;
+		int64_t duration;
+
+		uint32_t thread;
+
+		// the source line the span is for, or zero
+		uint32_t line;
+
+		// anything else which tells spans with the same name apart, such as a script's path
+		std::string detail;
+	};
+
+	// Records the time from its construction to its destruction to the recorder which was active when it started.
+	class Span
+	{
+	public:
+		Span(const char* name, const char* category, uint32_t line = 0, std::string detail = std::string());
+		~Span();
+
+		Span(const Span&) = delete;
+		Span& operator=(const Span&) = delete;
+
+	private:
+		TraceRecorder* recorder;
+		const char* name;
+		const char* category;
+		uint32_t line;
+		std::string detail;
+		std::chrono::steady_clock::time_point start;
+	};
+
+public:
+	TraceRecorder();
+	~TraceRecorder();
+
+	TraceRecorder(const TraceRecorder&) = delete;
+	TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+public:
+	static void setActive(TraceRecorder* recorder);
+	static inline TraceRecorder* getActive() { return active.load(std::memory_order_acquire); }
+
+	void record(const char* name, const char* category, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end, uint32_t line = 0, std::string detail = std::string());
+	void clear();
+
+	std::vector<Event> getEvents() const;
+	size_t getEventCount() const;
+
+	std::string toJson() const;
+	bool write(const std::string& path) const;
+
+private:
+	static std::atomic<TraceRecorder*> active;
+
+	std::chrono::steady_clock::time_point origin;
+
+	mutable std::mutex mutex;
+	std::vector<Event> events;
+
+	// small numbers for the threads seen so far, in the order they first finished a span
+	std::unordered_map<std::thread::id, uint32_t> threads;
+};
+
+}
+
+#if DELVE_SCRIPT_INSTRUMENTATION
+
+// records the time until the end of the enclosing scope as a span, at most once per scope
+#define DELVE_SCRIPT_TRACE(name, category) ::Delve::Script::TraceRecorder::Span traceSpan(name, category)
+#define DELVE_SCRIPT_TRACE_LINE(name, category, line) ::Delve::Script::TraceRecorder::Span traceSpan(name, category, line)
+
+#else
+
+#define DELVE_SCRIPT_TRACE(name, category) do {} while (false)
+#define DELVE_SCRIPT_TRACE_LINE(name, category, line) do {} while (false)
+
+#endif
@@ -0,0 +1,134 @@
+#include "trace.h"
+#include "script.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstring>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Delve::Script;
+
+namespace {
+	size_t countEvents(const std::vector<TraceRecorder::Event>& events, const char* name)
+	{
+		size_t count = 0;
+
+		for (const auto& event : events) {
+			count += std::strcmp(event.name, name) == 0 ? 1 : 0;
+		}
+
+		return count;
+	}
+}
+
+/*
+* Tests that running a script records a span for each phase, and one for each top level statement with its line.
+*/
+TEST(TraceRecorder, RecordsPhases)
+{
+	// only the spans of whole scripts are recorded when instrumentation is compiled out
+	if (!Instrumentation::enabled) {
+		return;
+	}
+
+	TraceRecorder recorder;
+	TraceRecorder::setActive(&recorder);
+
+	Script script("let f = function(x) { x * 2; };\nlet y = f(4);\ny + 1;");
+	EXPECT_EQ(script.run(ExecutionMode::Bytecode).toString(), "9");
+
+	TraceRecorder::setActive(nullptr);
+	auto events = recorder.getEvents();
+
+	EXPECT_EQ(countEvents(events, "tokenize"), 1);
+	EXPECT_EQ(countEvents(events, "parse"), 1);
+	EXPECT_EQ(countEvents(events, "statement"), 3);
+	EXPECT_EQ(countEvents(events, "resolve"), 1);
+	EXPECT_EQ(countEvents(events, "compile bytecode"), 1);
+	EXPECT_GE(countEvents(events, "run bytecode"), 1);
+
+	std::vector<uint32_t> lines;
+	const TraceRecorder::Event* parse = nullptr;
+
+	for (const auto& event : events) {
+		if (std::strcmp(event.name, "statement") == 0) {
+			lines.push_back(event.line);
+		}
+		else if (std::strcmp(event.name, "parse") == 0) {
+			parse = &event;
+		}
+	}
+
+	EXPECT_EQ(lines, std::vector<uint32_t>({ 1, 2, 3 }));
+
+	// statements are inside the parse, which finishes after them
+	ASSERT_NE(parse, nullptr);
+
+	for (const auto& event : events) {
+		if (std::strcmp(event.name, "statement") == 0) {
+			EXPECT_GE(event.start, parse->start);
+			EXPECT_LE(event.start + event.duration, parse->start + parse->duration);
+		}
+	}
+
+	// nothing is recorded once the recorder is no longer active
+	size_t count = recorder.getEventCount();
+	Script("1;").run();
+	EXPECT_EQ(recorder.getEventCount(), count);
+}
+
+TEST(TraceRecorder, Threads)
+{
+	TraceRecorder recorder;
+	TraceRecorder::setActive(&recorder);
+
+	{
+		TraceRecorder::Span span("main", "test");
+	}
+
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < 3; ++i) {
+		threads.emplace_back([]() { TraceRecorder::Span span("worker", "test"); });
+	}
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	TraceRecorder::setActive(nullptr);
+	auto events = recorder.getEvents();
+	ASSERT_EQ(events.size(), 4);
+
+	std::set<uint32_t> ids;
+
+	for (const auto& event : events) {
+		ids.insert(event.thread);
+	}
+
+	EXPECT_EQ(ids.size(), 4);
+	EXPECT_EQ(events[0].thread, 1);
+}
+
+TEST(TraceRecorder, Json)
+{
+	TraceRecorder recorder;
+	auto start = std::chrono::steady_clock::now();
+	recorder.record("load script", "console", start, start + std::chrono::nanoseconds(2500), 0, "scripts/\"a\".ds");
+	recorder.record("statement", "frontend", start, start + std::chrono::microseconds(1), 7);
+
+	std::string json = recorder.toJson();
+
+	EXPECT_EQ(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["), 0);
+	EXPECT_NE(json.find("\"name\":\"load script\",\"cat\":\"console\",\"ph\":\"X\""), std::string::npos);
+	EXPECT_NE(json.find("\"dur\":2.500,\"pid\":1,\"tid\":1,\"args\":{\"detail\":\"scripts/\\\"a\\\".ds\"}"), std::string::npos);
+	EXPECT_NE(json.find("\"dur\":1.000,\"pid\":1,\"tid\":1,\"args\":{\"line\":7}"), std::string::npos);
+
+	recorder.clear();
+	EXPECT_EQ(recorder.getEventCount(), 0);
+	EXPECT_EQ(recorder.toJson(), "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n]}\n");
+}
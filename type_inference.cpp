@@ -0,0 +1,543 @@
+#include "type_inference.h"
+#include "resolver.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace Delve::Script {
+	namespace {
+		const size_t undeclared = std::numeric_limits<size_t>::max();
+	}
+
+	/**
+	* Adds the values of another type to this one.
+	* @returns true if the type grew
+	*/
+	bool TypeInference::Type::join(const Type& other)
+	{
+		bool grew = false;
+
+		if ((set | other.set) != set) {
+			set |= other.set;
+			grew = true;
+		}
+
+		for (auto* function : other.functions) {
+			auto position = std::lower_bound(functions.begin(), functions.end(), function);
+
+			if (position == functions.end() || *position != function) {
+				functions.insert(position, function);
+				grew = true;
+			}
+		}
+
+		return grew;
+	}
+
+	/*
+	* @returns the type of a value from the host, which may be anything including any script function it holds
+	*/
+	TypeInference::Type TypeInference::fromHost() const
+	{
+		Type type = escaped;
+		type.set = Ast::TypeSet::Any;
+
+		return type;
+	}
+
+	/**
+	* Infers the types in a program and annotates its infix expressions and function literals.  Annotations from an
+	* earlier run are cleared first, and a program which does not resolve is left unannotated for the compiler to
+	* report.  Statistics are reset each time this method is called.
+	* @param ast the program to annotate
+	* @param host the host functions the program will be compiled with, which are its first globals
+	*/
+	void TypeInference::infer(Ast::Program& ast, const Host* host)
+	{
+		DELVE_SCRIPT_TRACE("infer types", "optimize");
+
+		statistics = Statistics();
+
+		for (auto& statement : ast.statements) {
+			clear(statement.get());
+		}
+
+		std::vector<std::string> hostNames = host ? host->getNames() : std::vector<std::string>();
+		Resolver resolver;
+		resolver.resolve(ast, hostNames);
+
+		if (!resolver.getErrors().empty()) {
+			return;
+		}
+
+		program = &ast;
+		globals.assign(ast.globalCount, Global{ Type(), undeclared });
+		functions.clear();
+		escaped = Type();
+		main = Function();
+		main.slots.resize(ast.slotCount);
+
+		for (size_t i = 0; i < hostNames.size(); i++) {
+			globals[i].type.set = Ast::TypeSet::HostFunction;
+			globals[i].declaration = 0;
+		}
+
+		for (size_t i = 0; i < ast.statements.size(); i++) {
+			auto* statement = ast.statements[i].get();
+
+			if (statement && statement->kind == Ast::Node::Kind::LetStatement) {
+				const Ast::Binding& binding = static_cast<Ast::LetStatement*>(statement)->identifier->binding;
+
+				if (binding.kind != Ast::Binding::Kind::Global) {
+					continue;
+				}
+
+				globals[binding.index].declaration = std::min(globals[binding.index].declaration, i + 1);
+			}
+		}
+
+		bool widened;
+
+		do {
+			do {
+				visitProgram();
+				statistics.iterations += 1;
+			} while (changed);
+
+			// a function the host may call but the script never does can be given anything
+			widened = false;
+
+			for (auto& entry : functions) {
+				Function& function = entry.second;
+
+				for (size_t i = 0; function.escaped && i < function.literal->parameters.size(); i++) {
+					if (function.slots[i].set == 0) {
+						function.slots[i] = fromHost();
+						widened = true;
+					}
+				}
+			}
+		} while (widened);
+
+		annotating = true;
+		visitProgram();
+		annotating = false;
+
+		for (auto& entry : functions) {
+			Function& function = entry.second;
+			function.literal->parameterTypes.clear();
+
+			for (size_t i = 0; i < function.literal->parameters.size(); i++) {
+				uint8_t set = function.slots[i].set;
+				function.literal->parameterTypes.push_back(set ? set : Ast::TypeSet::Any);
+			}
+		}
+
+		program = nullptr;
+		scopes.clear();
+	}
+
+	/*
+	* Makes one pass over the whole program, growing the types of variables, parameters and results from what it finds.
+	* Everything the host can reach escapes: globals, the program's result, and the results of functions it may call.
+	*/
+	void TypeInference::visitProgram()
+	{
+		changed = false;
+		scopes.assign(1, &main);
+
+		Type result;
+		result.set = Ast::TypeSet::Null;
+
+		for (size_t i = 0; i < program->statements.size(); i++) {
+			auto* statement = program->statements[i].get();
+			statementIndex = i + 1;
+			definingGlobal = 0;
+
+			if (statement && statement->kind == Ast::Node::Kind::LetStatement) {
+				auto* letStatement = static_cast<Ast::LetStatement*>(statement);
+
+				if (letStatement->expression && letStatement->expression->kind == Ast::Node::Kind::FunctionLiteral) {
+					definingGlobal = letStatement->identifier->binding.index + 1;
+				}
+			}
+
+			result = inferStatement(statement);
+		}
+
+		update(main.result, result);
+		escape(main.result);
+
+		escaped = Type();
+		escaped.set = Ast::TypeSet::Function;
+
+		for (auto& entry : functions) {
+			if (entry.second.escaped) {
+				escape(entry.second.result);
+				escaped.functions.push_back(entry.first);
+			}
+		}
+
+		std::sort(escaped.functions.begin(), escaped.functions.end());
+
+		// the host may pass any script function it holds to a function it calls
+		for (auto& entry : functions) {
+			Function& function = entry.second;
+
+			for (size_t i = 0; function.escaped && i < function.literal->parameters.size(); i++) {
+				if (function.slots[i].set & Ast::TypeSet::Function) {
+					update(function.slots[i], escaped);
+				}
+			}
+		}
+	}
+
+	void TypeInference::update(Type& variable, const Type& type)
+	{
+		if (variable.join(type)) {
+			changed = true;
+		}
+	}
+
+	// Marks every function a value may hold as reachable by the host.
+	void TypeInference::escape(const Type& type)
+	{
+		for (auto* literal : type.functions) {
+			Function& function = functions.at(literal);
+
+			if (!function.escaped) {
+				function.escaped = true;
+				changed = true;
+			}
+		}
+	}
+
+	/*
+	* @returns the type of the value the statements evaluate to, which is that of the last statement or null if there
+	* are none
+	*/
+	TypeInference::Type TypeInference::inferStatements(std::vector<std::unique_ptr<Ast::Statement>>& statements)
+	{
+		Type value;
+		value.set = Ast::TypeSet::Null;
+
+		for (auto& statement : statements) {
+			value = inferStatement(statement.get());
+		}
+
+		return value;
+	}
+
+	/*
+	* Return statements add to the result of the enclosing function rather than producing a value.
+	*/
+	TypeInference::Type TypeInference::inferStatement(Ast::Statement* statement)
+	{
+		Type null;
+		null.set = Ast::TypeSet::Null;
+
+		if (!statement) {
+			return null;
+		}
+
+		switch (statement->kind) {
+		case Ast::Node::Kind::LetStatement: {
+			auto* letStatement = static_cast<Ast::LetStatement*>(statement);
+			Type value = inferExpression(letStatement->expression.get());
+			const Ast::Binding& binding = letStatement->identifier->binding;
+
+			if (binding.kind == Ast::Binding::Kind::Global) {
+				update(globals[binding.index].type, value);
+				escape(value);
+			}
+			else {
+				update(scopes.back()->slots[binding.index], value);
+			}
+
+			return null;
+		}
+
+		case Ast::Node::Kind::ReturnStatement:
+			update(scopes.back()->result, inferExpression(static_cast<Ast::ReturnStatement*>(statement)->expression.get()));
+			return Type();
+
+		case Ast::Node::Kind::ExpressionStatement:
+			return inferExpression(static_cast<Ast::ExpressionStatement*>(statement)->expression.get());
+
+		case Ast::Node::Kind::BlockStatement:
+			return inferStatements(static_cast<Ast::BlockStatement*>(statement)->statements);
+
+		case Ast::Node::Kind::IfStatement: {
+			auto* ifStatement = static_cast<Ast::IfStatement*>(statement);
+			inferExpression(ifStatement->condition.get());
+
+			Type value = inferStatement(ifStatement->consequence.get());
+			value.join(ifStatement->alternative ? inferStatement(ifStatement->alternative.get()) : null);
+
+			return value;
+		}
+
+		default:
+			return inferExpression(statement);
+		}
+	}
+
+	TypeInference::Type TypeInference::inferExpression(Ast::Expression* expression)
+	{
+		Type type;
+
+		if (!expression) {
+			type.set = Ast::TypeSet::Null;
+			return type;
+		}
+
+		switch (expression->kind) {
+		case Ast::Node::Kind::Identifier:
+			return inferIdentifier(static_cast<Ast::Identifier*>(expression));
+
+		case Ast::Node::Kind::IntegerLiteral:
+			type.set = Ast::TypeSet::Integer;
+			return type;
+
+		case Ast::Node::Kind::BooleanLiteral:
+			type.set = Ast::TypeSet::Boolean;
+			return type;
+
+		case Ast::Node::Kind::PrefixExpression:
+			inferExpression(static_cast<Ast::PrefixExpression*>(expression)->rightExpression.get());
+			type.set = expression->token->type == Token::Type::Negate ? Ast::TypeSet::Boolean : Ast::TypeSet::Integer;
+			return type;
+
+		case Ast::Node::Kind::InfixExpression:
+			return inferInfixExpression(static_cast<Ast::InfixExpression*>(expression));
+
+		case Ast::Node::Kind::CallExpression:
+			return inferCallExpression(static_cast<Ast::CallExpression*>(expression));
+
+		case Ast::Node::Kind::FunctionLiteral:
+			return inferFunctionLiteral(static_cast<Ast::FunctionLiteral*>(expression));
+
+		default:
+			return fromHost();
+		}
+	}
+
+	/*
+	* Globals hold null until their first declaration runs.  A global is only known to be declared if it is read by a
+	* later top level statement, or it is a function reading itself, since a function cannot run before it exists.
+	*/
+	TypeInference::Type TypeInference::inferIdentifier(const Ast::Identifier* identifier)
+	{
+		const Ast::Binding& binding = identifier->binding;
+
+		if (binding.kind == Ast::Binding::Kind::Global) {
+			const Global& global = globals[binding.index];
+			Type type = global.type;
+
+			if (global.declaration > statementIndex || (global.declaration == statementIndex && definingGlobal != binding.index + 1)) {
+				type.set |= Ast::TypeSet::Null;
+			}
+
+			return type;
+		}
+
+		if (binding.kind == Ast::Binding::Kind::Local) {
+			return scopes.back()->slots[binding.index];
+		}
+
+		Type self;
+		return *findCapture(scopes.size() - 1, binding.index, self);
+	}
+
+	/*
+	* Arithmetic operators only produce integers and comparisons only produce booleans; any other operands raise an
+	* error instead of producing a value.
+	*/
+	TypeInference::Type TypeInference::inferInfixExpression(Ast::InfixExpression* expression)
+	{
+		uint8_t operands = inferExpression(expression->left.get()).set | inferExpression(expression->right.get()).set;
+		Token::Type op = expression->token->type;
+		bool equality = op == Token::Type::Equal || op == Token::Type::NotEqual;
+
+		if (annotating) {
+			statistics.operations += 1;
+
+			if ((operands & ~Ast::TypeSet::Integer) == 0) {
+				expression->operandType = Ast::OperandType::Integer;
+				statistics.integerOperations += 1;
+			}
+			else if (equality && (operands & ~Ast::TypeSet::Boolean) == 0) {
+				expression->operandType = Ast::OperandType::Boolean;
+				statistics.booleanOperations += 1;
+			}
+		}
+
+		Type type;
+		type.set = equality || op == Token::Type::LessThan || op == Token::Type::GreaterThan ? Ast::TypeSet::Boolean : Ast::TypeSet::Integer;
+
+		return type;
+	}
+
+	/*
+	* The arguments of a call are added to the parameters of every function the callee may be, and the call produces any
+	* of their results.  Arguments passed to a host function escape, and it may return anything.  The host's own calls
+	* into the script are checked against the inferred types when they are made, so are not considered here.
+	*/
+	TypeInference::Type TypeInference::inferCallExpression(Ast::CallExpression* expression)
+	{
+		Type callee = inferExpression(expression->function.get());
+		std::vector<Type> arguments;
+
+		for (auto& argument : expression->arguments) {
+			arguments.push_back(inferExpression(argument.get()));
+		}
+
+		Type result;
+
+		auto call = [&](Function& function) {
+			// a call with the wrong number of arguments raises an error
+			if (function.literal->parameters.size() != arguments.size()) {
+				return;
+			}
+
+			for (size_t i = 0; i < arguments.size(); i++) {
+				update(function.slots[i], arguments[i]);
+			}
+
+			result.join(function.result);
+		};
+
+		for (auto* literal : callee.functions) {
+			call(functions.at(literal));
+		}
+
+		if (callee.set & Ast::TypeSet::HostFunction) {
+			for (auto& argument : arguments) {
+				escape(argument);
+			}
+
+			result.join(fromHost());
+		}
+
+		return result;
+	}
+
+	TypeInference::Type TypeInference::inferFunctionLiteral(Ast::FunctionLiteral* literal)
+	{
+		Function& function = functions[literal];
+
+		if (!function.literal) {
+			function.literal = literal;
+			function.slots.resize(literal->slotCount);
+		}
+
+		scopes.push_back(&function);
+
+		if (literal->body) {
+			update(function.result, inferStatements(literal->body->statements));
+		}
+
+		scopes.pop_back();
+
+		Type type;
+		type.set = Ast::TypeSet::Function;
+		type.functions.push_back(literal);
+
+		return type;
+	}
+
+	/*
+	* Follows a capture out through the enclosing functions to the variable it copies.
+	* @param depth the index in scopes of the function whose capture it is
+	* @param self receives the type of the function itself for a function which captures itself
+	* @returns the variable, or self
+	*/
+	TypeInference::Type* TypeInference::findCapture(size_t depth, uint32_t index, Type& self)
+	{
+		const Ast::Capture& capture = scopes[depth]->literal->captures[index];
+
+		switch (capture.source) {
+		case Ast::Capture::Source::Local:
+			return &scopes[depth - 1]->slots[capture.index];
+
+		case Ast::Capture::Source::Capture:
+			return findCapture(depth - 1, capture.index, self);
+
+		default:
+			self.set = Ast::TypeSet::Function;
+			self.functions.assign(1, scopes[depth]->literal);
+			return &self;
+		}
+	}
+
+	// Removes the annotations of an earlier run.
+	void TypeInference::clear(Ast::Node* node)
+	{
+		if (!node) {
+			return;
+		}
+
+		switch (node->kind) {
+		case Ast::Node::Kind::PrefixExpression:
+			clear(static_cast<Ast::PrefixExpression*>(node)->rightExpression.get());
+			break;
+
+		case Ast::Node::Kind::InfixExpression: {
+			auto* infixExpression = static_cast<Ast::InfixExpression*>(node);
+			infixExpression->operandType = Ast::OperandType::Unknown;
+			clear(infixExpression->left.get());
+			clear(infixExpression->right.get());
+			break;
+		}
+
+		case Ast::Node::Kind::CallExpression: {
+			auto* callExpression = static_cast<Ast::CallExpression*>(node);
+			clear(callExpression->function.get());
+
+			for (auto& argument : callExpression->arguments) {
+				clear(argument.get());
+			}
+
+			break;
+		}
+
+		case Ast::Node::Kind::FunctionLiteral: {
+			auto* literal = static_cast<Ast::FunctionLiteral*>(node);
+			literal->parameterTypes.clear();
+			clear(literal->body.get());
+			break;
+		}
+
+		case Ast::Node::Kind::LetStatement:
+			clear(static_cast<Ast::LetStatement*>(node)->expression.get());
+			break;
+
+		case Ast::Node::Kind::ReturnStatement:
+			clear(static_cast<Ast::ReturnStatement*>(node)->expression.get());
+			break;
+
+		case Ast::Node::Kind::ExpressionStatement:
+			clear(static_cast<Ast::ExpressionStatement*>(node)->expression.get());
+			break;
+
+		case Ast::Node::Kind::BlockStatement:
+			for (auto& statement : static_cast<Ast::BlockStatement*>(node)->statements) {
+				clear(statement.get());
+			}
+
+			break;
+
+		case Ast::Node::Kind::IfStatement: {
+			auto* ifStatement = static_cast<Ast::IfStatement*>(node);
+			clear(ifStatement->condition.get());
+			clear(ifStatement->consequence.get());
+			clear(ifStatement->alternative.get());
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+}
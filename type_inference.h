@@ -0,0 +1,111 @@
+#pragma once
+
+#include "ast.h"
+#include "host.h"
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace Delve::Script {
+
+/*
+* Analysis pass which finds the kinds of value every variable, parameter and function result may hold, and marks the
+* operators whose operands are always integers or always booleans so that the engines can skip their type checks.
+*
+* The analysis is flow-insensitive: a variable's type is the union of everything ever stored in it, a parameter's is the
+* union of the arguments of every call which may reach the function, and the pass repeats until nothing grows.  Values
+* from the host may be anything, and functions which escape to the host check the arguments of calls it makes against
+* the inferred types, since those calls are not seen by the analysis.
+*/
+class TypeInference
+{
+public:
+	struct Statistics
+	{
+		// infix operators in the program, and how many of them were specialized
+		uint32_t operations = 0;
+		uint32_t integerOperations = 0;
+		uint32_t booleanOperations = 0;
+
+		// passes over the program before the types stopped changing
+		uint32_t iterations = 0;
+	};
+
+public:
+	void infer(Ast::Program& program, const Host* host = nullptr);
+
+	inline const Statistics& getStatistics() const { return statistics; }
+
+private:
+	struct Type
+	{
+		// a HostFunction may be any function the host holds, including escaped script functions
+		uint8_t set = 0;
+
+		// the script functions a Function may be
+		std::vector<const Ast::FunctionLiteral*> functions;
+
+		bool join(const Type& other);
+	};
+
+	struct Function
+	{
+		Ast::FunctionLiteral* literal = nullptr;
+
+		// parameters occupy the first slots
+		std::vector<Type> slots;
+		Type result;
+
+		// whether the host may hold the function and so call it with arguments the script never passes
+		bool escaped = false;
+	};
+
+	struct Global
+	{
+		Type type;
+
+		// the top level statement which first declares the global, it holds null until then
+		size_t declaration = 0;
+	};
+
+private:
+	void visitProgram();
+	Type fromHost() const;
+	void update(Type& variable, const Type& type);
+	void escape(const Type& type);
+
+	Type inferStatements(std::vector<std::unique_ptr<Ast::Statement>>& statements);
+	Type inferStatement(Ast::Statement* statement);
+	Type inferExpression(Ast::Expression* expression);
+	Type inferIdentifier(const Ast::Identifier* identifier);
+	Type inferInfixExpression(Ast::InfixExpression* expression);
+	Type inferCallExpression(Ast::CallExpression* expression);
+	Type inferFunctionLiteral(Ast::FunctionLiteral* literal);
+	Type* findCapture(size_t depth, uint32_t index, Type& self);
+
+	void clear(Ast::Node* node);
+
+private:
+	Ast::Program* program = nullptr;
+
+	std::vector<Global> globals;
+	std::unordered_map<const Ast::FunctionLiteral*, Function> functions;
+	Function main;
+
+	// every function the host may hold, as of the last pass
+	Type escaped;
+
+	// the functions enclosing the node being visited, outermost first, starting with the top level code
+	std::vector<Function*> scopes;
+	size_t statementIndex = 0;
+	uint32_t definingGlobal = 0;
+
+	bool changed = false;
+	bool annotating = false;
+
+	Statistics statistics;
+};
+
+}
@@ -0,0 +1,176 @@
+#include "type_inference.h"
+#include "compiler.h"
+#include "script_function.h"
+#include "script.h"
+#include "parser.h"
+#include "lexer.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace Delve::Script;
+
+namespace {
+	struct Case
+	{
+		std::string code;
+		uint32_t operations;
+		uint32_t integerOperations;
+		uint32_t booleanOperations;
+	};
+
+	// infers the types of each program and checks how many of its operators were specialized
+	void compareSpecializedOperations(const std::vector<Case>& cases)
+	{
+		for (const auto& test : cases) {
+			Lexer lexer(test.code);
+			Parser parser(lexer.tokens());
+			ASSERT_EQ(parser.getErrors().size(), 0) << test.code;
+
+			TypeInference inference;
+			inference.infer(*parser.getProgram());
+
+			const auto& statistics = inference.getStatistics();
+			EXPECT_EQ(statistics.operations, test.operations) << test.code;
+			EXPECT_EQ(statistics.integerOperations, test.integerOperations) << test.code;
+			EXPECT_EQ(statistics.booleanOperations, test.booleanOperations) << test.code;
+		}
+	}
+}
+
+TEST(TypeInference, SpecializesOperations)
+{
+	compareSpecializedOperations({
+		{ "1 + 2 * 3;", 2, 2, 0 },
+		{ "let x = 1; let y = true; x + 1 == 2; y == false;", 3, 2, 1 },
+		{ "let fib = function(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2); }; fib(20);", 4, 4, 0 },
+		{ "let adder = function(x) { function(y) { x + y; }; }; adder(1)(2);", 1, 1, 0 },
+		{ "let apply = function(f, x) { f(x); }; apply(function(x) { x * 2; }, 3) + apply(function(x) { -x; }, 4);", 2, 2, 0 },
+		{ "let f = function(g) { g(1); }; f(function(x) { x + 1; }) + 1;", 2, 2, 0 },
+		{ "let f = function(x) { let y = x; if (y) { return 1; } 2; }; f(true) - f(false);", 1, 1, 0 },
+		{ "let isEven = function(n) { if (n == 0) { return true; } isOdd(n - 1); }; let isOdd = function(n) { if (n == 0) { return false; } isEven(n - 1); }; isEven(10) == true;", 5, 4, 1 }
+	});
+}
+
+/*
+* Tests that operators are left checked whenever an operand could have some other type, including null from a global
+* read before it is declared or an argument the host passed in.
+*/
+TEST(TypeInference, LeavesUncertainOperationsChecked)
+{
+	compareSpecializedOperations({
+		{ "let f = function(x) { x + 1; }; f(1); f(true);", 1, 0, 0 },
+		{ "let f = function() { x + 1; }; f(); let x = 1;", 1, 0, 0 },
+		{ "x + 1; let x = 1;", 1, 0, 0 },
+		{ "let f = function(x) { if (x) { return 1; } }; f(true) + 1;", 1, 0, 0 },
+		{ "let onEvent = function(x) { x * 2; };", 1, 0, 0 },
+		{ "let f = function(g, x) { g(x); }; let h = function(x) { x + 1; }; f(h, 1); f(f, h);", 1, 0, 0 },
+		{ "1 == true;", 1, 0, 0 }
+	});
+}
+
+/*
+* Tests that values which reach the host may come back into the script with any type, and that functions the host
+* could call accept anything when the script never calls them itself.
+*/
+TEST(TypeInference, HostValues)
+{
+	Host host;
+	host.bind("identity", [](Value value) { return value; });
+
+	std::vector<Case> cases = {
+		{ "identity(1) + 1;", 1, 0, 0 },
+		{ "let f = function(x) { x + 1; }; f(1); identity(f)(true);", 1, 0, 0 },
+		{ "let f = function(x) { x + 1; }; f(1); identity(f)(2);", 1, 1, 0 },
+	};
+
+	for (const auto& test : cases) {
+		Lexer lexer(test.code);
+		Parser parser(lexer.tokens());
+
+		TypeInference inference;
+		inference.infer(*parser.getProgram(), &host);
+
+		EXPECT_EQ(inference.getStatistics().operations, test.operations) << test.code;
+		EXPECT_EQ(inference.getStatistics().integerOperations, test.integerOperations) << test.code;
+	}
+}
+
+/*
+* Tests that specialized programs give the same results and report the same errors as unspecialized ones.
+*/
+TEST(TypeInference, PreservesResults)
+{
+	std::vector<std::string> inputs = {
+		"let fib = function(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2); }; fib(15);",
+		"let x = 1; let y = true; (x + 1 == 2) != (y == false);",
+		"let f = function() { x + 1; }; f(); let x = 1;",
+		"let f = function(x) { x / 0; }; f(1);",
+		"let big = 9223372036854775807; big + 1;",
+		"let min = -9223372036854775807 - 1; min / -1;",
+		"let f = function(x) { x + 1; }; f(1) + f(true);",
+		"let adder = function(x) { function(y) { x + y; }; }; let add = adder(2); add(3) * add(4);"
+	};
+
+	for (auto& input : inputs) {
+		for (auto mode : { ExecutionMode::Closure, ExecutionMode::Bytecode }) {
+			Script original(input);
+			Script optimized(input);
+			optimized.optimize();
+
+			EXPECT_EQ(original.run(mode).toString(), optimized.run(mode).toString()) << input;
+			EXPECT_EQ(original.getErrors(), optimized.getErrors()) << input;
+		}
+	}
+}
+
+/*
+* Tests that calls from the host are checked against the parameter types the script was specialized for.
+*/
+TEST(TypeInference, CallsFromHostAreChecked)
+{
+	std::string code =
+		"let add = function(a, b) { a + b; };"
+		"let onEvent = function(x) { x * 2; };"
+		"add(1, 2);";
+
+	Lexer lexer(code);
+	Parser parser(lexer.tokens());
+
+	TypeInference inference;
+	inference.infer(*parser.getProgram());
+	EXPECT_EQ(inference.getStatistics().integerOperations, 1);
+
+	Compiler compiler(parser.getProgram());
+	Isolate isolate(compiler.getProgram());
+	EXPECT_EQ(isolate.run().toString(), "3");
+
+	ScriptFunction<int64_t(int64_t, int64_t)> add(isolate, "add");
+	EXPECT_EQ(add(20, 22), 42);
+
+	ScriptFunction<int64_t(int64_t, bool)> badAdd(isolate, "add");
+	EXPECT_EQ(badAdd(1, true), 0);
+	ASSERT_EQ(isolate.getErrors().size(), 1);
+	EXPECT_EQ(isolate.getErrors()[0], "Expected int for argument 2 but got bool.");
+
+	// never called by the script, so the operator is still checked
+	ScriptFunction<int64_t(bool)> onEvent(isolate, "onEvent");
+	EXPECT_EQ(onEvent(true), 0);
+	ASSERT_EQ(isolate.getErrors().size(), 1);
+	EXPECT_EQ(isolate.getErrors()[0], "Type mismatch: bool * int.");
+}
+
+TEST(TypeInference, Statistics)
+{
+	Script script("let sum = function(n, total) { if (n == 0) { return total; } sum(n - 1, total + n); }; sum(100, 0);");
+	script.optimize();
+	EXPECT_EQ(script.run().toString(), "5050");
+
+	const auto& statistics = script.getInferenceStatistics();
+	EXPECT_EQ(statistics.operations, 3);
+	EXPECT_EQ(statistics.integerOperations, 3);
+	EXPECT_EQ(statistics.booleanOperations, 0);
+	EXPECT_GE(statistics.iterations, 2);
+}
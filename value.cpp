@@ -0,0 +1,73 @@
+#include "value.h"
+
+#include <sstream>
+
+namespace Delve::Script {
+
+/**
+* Returns a String representation of a Value.
+* @returns string representation of this value.
+*/
+std::string Value::toString() const
+{
+	switch (type)
+	{
+	case Type::Integer:
+		return std::to_string(integer);
+	case Type::Boolean:
+		return boolean ? "true" : "false";
+	case Type::Function:
+	case Type::HostFunction:
+		return "function";
+	default:
+		return "null";
+	}
+}
+
+/**
+* Returns a String representation of a Value::Type enumeration.
+* @param type the type to retrieve string representation for.
+* @returns string representation for supplied value type.
+*/
+std::string Value::getTypeName(Type type)
+{
+	switch (type)
+	{
+	case Type::Integer:
+		return "int";
+	case Type::Boolean:
+		return "bool";
+	case Type::Function:
+	case Type::HostFunction:
+		return "function";
+	case Type::Box:
+		return "box";
+	default:
+		return "null";
+	}
+}
+
+namespace Operators {
+	void typeMismatch(Token::Type op, const Value& left, const Value& right)
+	{
+		std::ostringstream error;
+		error << "Type mismatch: " << Value::getTypeName(left.type) << ' ' << Token::getTokenName(op) << ' ' << Value::getTypeName(right.type) << '.';
+
+		throw RuntimeError(error.str());
+	}
+
+	void typeMismatch(Token::Type op, const Value& right)
+	{
+		std::ostringstream error;
+		error << "Type mismatch: " << Token::getTokenName(op) << Value::getTypeName(right.type) << '.';
+
+		throw RuntimeError(error.str());
+	}
+
+	void divisionByZero()
+	{
+		throw RuntimeError("Division by zero.");
+	}
+}
+
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "token.h"
+
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+
+namespace Delve::Script {
+
+struct Object;
+struct HostFunction;
+
+struct Value
+{
+	enum class Type : uint8_t
+	{
+		Null,
+		Integer,
+		Boolean,
+		Function,
+
+		// A function implemented by the application, scripts see it as a function.
+		HostFunction,
+
+		// Shared storage for a captured variable.  Only ever held in frame slots and closures, never seen by scripts.
+		Box
+	};
+
+	Type type;
+
+	union {
+		int64_t integer;
+		bool boolean;
+		Object* object;
+		const Delve::Script::HostFunction* host;
+	};
+
+	Value() : type(Type::Null), integer(0) {}
+
+	static Value fromInteger(int64_t i) { Value v; v.type = Type::Integer; v.integer = i; return v; }
+	static Value fromBoolean(bool b) { Value v; v.type = Type::Boolean; v.boolean = b; return v; }
+	static Value fromFunction(Object* o) { Value v; v.type = Type::Function; v.object = o; return v; }
+	static Value fromHostFunction(const Delve::Script::HostFunction* h) { Value v; v.type = Type::HostFunction; v.host = h; return v; }
+	static Value fromBox(Object* o) { Value v; v.type = Type::Box; v.object = o; return v; }
+
+	inline bool isCallable() const { return type == Type::Function || type == Type::HostFunction; }
+
+	// Everything other than false and null is considered true by conditionals and the negate operator.
+	inline bool isTruthy() const { return !(type == Type::Null || (type == Type::Boolean && !boolean)); }
+
+	std::string toString() const;
+	static std::string getTypeName(Type type);
+};
+
+class RuntimeError : public std::runtime_error {
+public:
+	RuntimeError(const std::string& desc) : std::runtime_error(desc) {}
+};
+
+/*
+* Implementations of the language operators.  Both execution engines share these so that they are guaranteed
+* to agree on semantics; each checks the operand types and raises a RuntimeError on a mismatch.
+*/
+namespace Operators {
+	[[noreturn]] void typeMismatch(Token::Type op, const Value& left, const Value& right);
+	[[noreturn]] void typeMismatch(Token::Type op, const Value& right);
+	[[noreturn]] void divisionByZero();
+
+	/*
+	* Integer operators for operands which TypeInference has proven are integers, so need no type check.  Division
+	* still checks for zero.
+	*/
+	inline Value addIntegers(const Value& left, const Value& right)
+	{
+		// integer arithmetic wraps on overflow
+		return Value::fromInteger(static_cast<int64_t>(static_cast<uint64_t>(left.integer) + static_cast<uint64_t>(right.integer)));
+	}
+
+	inline Value subtractIntegers(const Value& left, const Value& right)
+	{
+		return Value::fromInteger(static_cast<int64_t>(static_cast<uint64_t>(left.integer) - static_cast<uint64_t>(right.integer)));
+	}
+
+	inline Value multiplyIntegers(const Value& left, const Value& right)
+	{
+		return Value::fromInteger(static_cast<int64_t>(static_cast<uint64_t>(left.integer) * static_cast<uint64_t>(right.integer)));
+	}
+
+	inline Value divideIntegers(const Value& left, const Value& right)
+	{
+		if (right.integer == 0) {
+			divisionByZero();
+		}
+
+		// INT64_MIN / -1 overflows, wrap it like the other operators
+		if (right.integer == -1) {
+			return Value::fromInteger(static_cast<int64_t>(0 - static_cast<uint64_t>(left.integer)));
+		}
+
+		return Value::fromInteger(left.integer / right.integer);
+	}
+
+	inline Value lessThanIntegers(const Value& left, const Value& right)
+	{
+		return Value::fromBoolean(left.integer < right.integer);
+	}
+
+	inline Value greaterThanIntegers(const Value& left, const Value& right)
+	{
+		return Value::fromBoolean(left.integer > right.integer);
+	}
+
+	inline Value equalIntegers(const Value& left, const Value& right)
+	{
+		return Value::fromBoolean(left.integer == right.integer);
+	}
+
+	inline Value notEqualIntegers(const Value& left, const Value& right)
+	{
+		return Value::fromBoolean(left.integer != right.integer);
+	}
+
+	inline Value equalBooleans(const Value& left, const Value& right)
+	{
+		return Value::fromBoolean(left.boolean == right.boolean);
+	}
+
+	inline Value notEqualBooleans(const Value& left, const Value& right)
+	{
+		return Value::fromBoolean(left.boolean != right.boolean);
+	}
+
+	inline Value add(const Value& left, const Value& right)
+	{
+		if (left.type != Value::Type::Integer || right.type != Value::Type::Integer) {
+			typeMismatch(Token::Type::Plus, left, right);
+		}
+
+		return addIntegers(left, right);
+	}
+
+	inline Value subtract(const Value& left, const Value& right)
+	{
+		if (left.type != Value::Type::Integer || right.type != Value::Type::Integer) {
+			typeMismatch(Token::Type::Minus, left, right);
+		}
+
+		return subtractIntegers(left, right);
+	}
+
+	inline Value multiply(const Value& left, const Value& right)
+	{
+		if (left.type != Value::Type::Integer || right.type != Value::Type::Integer) {
+			typeMismatch(Token::Type::Multiply, left, right);
+		}
+
+		return multiplyIntegers(left, right);
+	}
+
+	inline Value divide(const Value& left, const Value& right)
+	{
+		if (left.type != Value::Type::Integer || right.type != Value::Type::Integer) {
+			typeMismatch(Token::Type::Divide, left, right);
+		}
+
+		return divideIntegers(left, right);
+	}
+
+	inline Value lessThan(const Value& left, const Value& right)
+	{
+		if (left.type != Value::Type::Integer || right.type != Value::Type::Integer) {
+			typeMismatch(Token::Type::LessThan, left, right);
+		}
+
+		return lessThanIntegers(left, right);
+	}
+
+	inline Value greaterThan(const Value& left, const Value& right)
+	{
+		if (left.type != Value::Type::Integer || right.type != Value::Type::Integer) {
+			typeMismatch(Token::Type::GreaterThan, left, right);
+		}
+
+		return greaterThanIntegers(left, right);
+	}
+
+	inline bool equals(Token::Type op, const Value& left, const Value& right)
+	{
+		if (left.type != right.type) {
+			// script functions and host functions are both functions to scripts, but never the same function
+			if (left.isCallable() && right.isCallable()) {
+				return false;
+			}
+
+			typeMismatch(op, left, right);
+		}
+
+		switch (left.type) {
+		case Value::Type::Integer:
+			return left.integer == right.integer;
+		case Value::Type::Boolean:
+			return left.boolean == right.boolean;
+		case Value::Type::Function:
+			return left.object == right.object;
+		case Value::Type::HostFunction:
+			return left.host == right.host;
+		default:
+			return true;
+		}
+	}
+
+	inline Value equal(const Value& left, const Value& right)
+	{
+		return Value::fromBoolean(equals(Token::Type::Equal, left, right));
+	}
+
+	inline Value notEqual(const Value& left, const Value& right)
+	{
+		return Value::fromBoolean(!equals(Token::Type::NotEqual, left, right));
+	}
+
+	inline Value negate(const Value& right)
+	{
+		return Value::fromBoolean(!right.isTruthy());
+	}
+
+	inline Value minus(const Value& right)
+	{
+		if (right.type != Value::Type::Integer) {
+			typeMismatch(Token::Type::Minus, right);
+		}
+
+		return Value::fromInteger(static_cast<int64_t>(0 - static_cast<uint64_t>(right.integer)));
+	}
+}
+
+}